@@ -0,0 +1,290 @@
+#ifndef DIAGONAL_RESCORER_H
+#define DIAGONAL_RESCORER_H
+
+#include "DBReader.h"
+#include "Debug.h"
+#include "DistanceCalculator.h"
+#include "EvalueComputation.h"
+#include "FastSort.h"
+#include "Matcher.h"
+#include "NucleotideMatrix.h"
+#include "Parameters.h"
+#include "QueryMatcher.h"
+#include "StripedSmithWaterman.h"
+#include "SubstitutionMatrix.h"
+#include "Util.h"
+#include "itoa.h"
+
+#include <limits>
+#include <string>
+#include <vector>
+
+// Removes alignment results of a query before they are sorted and written,
+// select is called by all threads at the same time
+class AlignmentHitSelection {
+public:
+    virtual ~AlignmentHitSelection() {}
+
+    virtual void select(std::vector<Matcher::result_t> &results, unsigned int queryKey,
+                        EvalueComputation &evaluer, unsigned int thread_idx) = 0;
+};
+
+// Rescores the prefilter hits of one query on their diagonals, this is the part of
+// rescorediagonal that runs for every query. Writer is a DBWriter or any class with
+// the same writeData, so the assembly modules can keep the result in memory.
+class DiagonalRescorer {
+public:
+    // buffers of one thread
+    struct Buffers {
+        char buffer[1024 + 32768*4];
+        std::string resultBuffer;
+        std::string queryBuffer;
+        std::vector<hit_t> prefResults;
+        std::vector<Matcher::result_t> alnResults;
+        std::vector<hit_t> shortResults;
+        std::vector<char> queryRevSeq;
+
+        explicit Buffers(int maxSeqLen) : queryRevSeq(maxSeqLen + 1) {
+            resultBuffer.reserve(1000000);
+            queryBuffer.reserve(32768);
+            prefResults.reserve(300);
+            alnResults.reserve(300);
+            shortResults.reserve(300);
+        }
+    };
+
+    // hitSelection can be NULL to keep all hits
+    DiagonalRescorer(Parameters &par, DBReader<unsigned int> *qdbr, DBReader<unsigned int> *tdbr, BaseMatrix *subMat,
+                     bool sameQTDB, bool reversePrefilterResult, float scorePerColThr, AlignmentHitSelection *hitSelection)
+            : par(par), qdbr(qdbr), tdbr(tdbr), subMat(subMat), sameQTDB(sameQTDB),
+              reversePrefilterResult(reversePrefilterResult), scorePerColThr(scorePerColThr), hitSelection(hitSelection),
+              fastMatrix(SubstitutionMatrix::createAsciiSubMat(*subMat)), evaluer(tdbr->getAminoAcidDBSize(), subMat) {}
+
+    ~DiagonalRescorer() {
+        delete[] fastMatrix.matrix;
+        delete[] fastMatrix.matrixData;
+    }
+
+    DiagonalRescorer(const DiagonalRescorer &) = delete;
+    DiagonalRescorer &operator=(const DiagonalRescorer &) = delete;
+
+    template <typename Writer>
+    void rescoreQuery(Buffers &buffers, char *data, unsigned int queryKey, Writer &resultWriter, unsigned int thread_idx) {
+        char *buffer = buffers.buffer;
+        std::vector<Matcher::result_t> &alnResults = buffers.alnResults;
+        std::vector<hit_t> &shortResults = buffers.shortResults;
+
+        char *querySeq = NULL;
+        std::string queryToWrap; // needed only for wrapped end-start scoring
+        unsigned int queryId = UINT_MAX;
+        int queryLen = -1, origQueryLen = -1;
+        if(*data !=  '\0'){
+            queryId = qdbr->getId(queryKey);
+            querySeq = qdbr->getData(queryId, thread_idx);
+            queryLen = static_cast<int>(qdbr->getSeqLen(queryId));
+            origQueryLen = queryLen;
+
+            if (par.wrappedScoring){
+                queryToWrap = std::string(querySeq,queryLen);
+                queryToWrap = queryToWrap + queryToWrap;
+                querySeq = (char*)(queryToWrap).c_str();
+                queryLen = origQueryLen*2;
+            }
+
+            if(reversePrefilterResult == true && static_cast<size_t>(queryLen) + 1 > buffers.queryRevSeq.size()){
+                buffers.queryRevSeq.resize(queryLen+1);
+            }
+            if (reversePrefilterResult == true) {
+                ((NucleotideMatrix *) subMat)->reverseComplement(querySeq, queryLen, buffers.queryRevSeq.data());
+            }
+            if (sameQTDB && qdbr->isCompressed()) {
+                buffers.queryBuffer.clear();
+                buffers.queryBuffer.append(querySeq, queryLen);
+                querySeq = (char *) buffers.queryBuffer.c_str();
+            }
+        }
+
+        std::vector<hit_t> &results = buffers.prefResults;
+        results.clear();
+        QueryMatcher::parsePrefilterHits(data, results);
+        for (size_t entryIdx = 0; entryIdx < results.size(); entryIdx++) {
+            char *querySeqToAlign = querySeq;
+            bool isReverse = false;
+            if (reversePrefilterResult) {
+                if (results[entryIdx].prefScore < 0) {
+                    querySeqToAlign = buffers.queryRevSeq.data();
+                    isReverse=true;
+                }
+            }
+
+            unsigned int targetId = tdbr->getId(results[entryIdx].seqId);
+            const bool isIdentity = (queryId == targetId && (par.includeIdentity || sameQTDB)) ? true : false;
+            char *targetSeq = tdbr->getData(targetId, thread_idx);
+            int dbLen = static_cast<int>(tdbr->getSeqLen(targetId));
+
+            float queryLength = static_cast<float>(origQueryLen);
+            float targetLength = static_cast<float>(dbLen);
+            if (Util::canBeCovered(par.covThr, par.covMode, queryLength, targetLength) == false) {
+                continue;
+            }
+            DistanceCalculator::LocalAlignment alignment;
+            if (par.wrappedScoring) {
+                if (dbLen > origQueryLen) {
+                    Debug(Debug::WARNING) << "WARNING: target sequence " << targetId
+                                          << " is skipped, no valid wrapped scoring possible\n";
+                    continue;
+                }
+
+                alignment = DistanceCalculator::computeUngappedWrappedAlignment(
+                        querySeqToAlign, queryLen, targetSeq, targetLength,
+                        results[entryIdx].diagonal, fastMatrix.matrix, par.rescoreMode);
+            }
+            else {
+                alignment = DistanceCalculator::computeUngappedAlignment(
+                        querySeqToAlign, queryLen, targetSeq, targetLength,
+                        results[entryIdx].diagonal, fastMatrix.matrix, par.rescoreMode);
+            }
+            unsigned int distanceToDiagonal = alignment.distToDiagonal;
+            int diagonalLen = alignment.diagonalLen;
+            int distance = alignment.score;
+            int diagonal = alignment.diagonal;
+            double seqId = 0;
+            double evalue = 0.0;
+            int bitScore = 0;
+            int alnLen = 0;
+            float targetCov = static_cast<float>(diagonalLen) / static_cast<float>(dbLen);
+            float queryCov = static_cast<float>(diagonalLen) / static_cast<float>(origQueryLen);
+
+            Matcher::result_t result;
+            if (par.rescoreMode == Parameters::RESCORE_MODE_HAMMING) {
+                int idCnt = (static_cast<float>(distance));
+                seqId = Util::computeSeqId(par.seqIdMode, idCnt, origQueryLen, dbLen, diagonalLen);
+                alnLen = diagonalLen;
+            } else if (par.rescoreMode == Parameters::RESCORE_MODE_SUBSTITUTION ||
+                       par.rescoreMode == Parameters::RESCORE_MODE_ALIGNMENT ||
+                       par.rescoreMode == Parameters::RESCORE_MODE_END_TO_END_ALIGNMENT ||
+                       par.rescoreMode == Parameters::RESCORE_MODE_WINDOW_QUALITY_ALIGNMENT) {
+                evalue = evaluer.computeEvalue(distance, origQueryLen);
+                bitScore = static_cast<int>(evaluer.computeBitScore(distance) + 0.5);
+
+                if (par.rescoreMode == Parameters::RESCORE_MODE_ALIGNMENT ||
+                    par.rescoreMode == Parameters::RESCORE_MODE_END_TO_END_ALIGNMENT ||
+                    par.rescoreMode == Parameters::RESCORE_MODE_WINDOW_QUALITY_ALIGNMENT) {
+                    alnLen = (alignment.endPos - alignment.startPos) + 1;
+                    int qStartPos, qEndPos, dbStartPos, dbEndPos;
+                    // -1 since diagonal is computed from sequence Len which starts by 1
+                    if (diagonal >= 0) {
+                        qStartPos = alignment.startPos + distanceToDiagonal;
+                        qEndPos = alignment.endPos + distanceToDiagonal;
+                        dbStartPos = alignment.startPos;
+                        dbEndPos = alignment.endPos;
+                    } else {
+                        qStartPos = alignment.startPos;
+                        qEndPos = alignment.endPos;
+                        dbStartPos = alignment.startPos + distanceToDiagonal;
+                        dbEndPos = alignment.endPos + distanceToDiagonal;
+                    }
+
+                    // compute seq.id if hit fulfills e-value but not by seqId criteria
+                    if (evalue <= par.evalThr || isIdentity) {
+                        int idCnt = 0;
+                        for (int i = qStartPos; i <= qEndPos; i++) {
+                            char qLetter = querySeqToAlign[i] & static_cast<unsigned char>(~0x20);
+                            char tLetter = targetSeq[dbStartPos + (i - qStartPos)] & static_cast<unsigned char>(~0x20);
+                            idCnt += (qLetter == tLetter) ? 1 : 0;
+                        }
+                        seqId = Util::computeSeqId(par.seqIdMode, idCnt, origQueryLen, dbLen, alnLen);
+                    }
+                    char *end = Itoa::i32toa_sse2(alnLen, buffer);
+                    size_t len = end - buffer;
+                    std::string backtrace = "";
+                    if (par.addBacktrace) {
+                        backtrace=std::string(buffer, len - 1);
+                        backtrace.push_back('M');
+                    }
+                    queryCov = SmithWaterman::computeCov(qStartPos, qEndPos, origQueryLen);
+                    targetCov = SmithWaterman::computeCov(dbStartPos, dbEndPos, dbLen);
+                    if (isReverse) {
+                        qStartPos = queryLen - qStartPos - 1;
+                        qEndPos = queryLen - qEndPos - 1;
+                    }
+                    result = Matcher::result_t(results[entryIdx].seqId, bitScore, queryCov, targetCov, seqId, evalue, alnLen,
+                                               qStartPos, qEndPos, origQueryLen, dbStartPos, dbEndPos, dbLen, backtrace);
+                }
+            }
+
+            //float maxSeqLen = std::max(static_cast<float>(targetLen), static_cast<float>(queryLen));
+            float currScorePerCol = static_cast<float>(distance) / static_cast<float>(diagonalLen);
+            // query/target cov mode
+            bool hasCov = Util::hasCoverage(par.covThr, par.covMode, queryCov, targetCov);
+            // --min-seq-id
+            bool hasSeqId = seqId >= (par.seqIdThr - std::numeric_limits<float>::epsilon());
+            bool hasEvalue = (evalue <= par.evalThr);
+            bool hasAlnLen = (alnLen >= par.alnLenThr);
+
+            // --filter-hits
+            bool hasToFilter = (par.filterHits == true && currScorePerCol >= scorePerColThr);
+            if (isIdentity || hasToFilter || (hasAlnLen && hasCov && hasSeqId && hasEvalue)) {
+                if (par.rescoreMode == Parameters::RESCORE_MODE_ALIGNMENT ||
+                    par.rescoreMode == Parameters::RESCORE_MODE_END_TO_END_ALIGNMENT ||
+                    par.rescoreMode == Parameters::RESCORE_MODE_WINDOW_QUALITY_ALIGNMENT) {
+                    alnResults.emplace_back(result);
+                } else if (par.rescoreMode == Parameters::RESCORE_MODE_SUBSTITUTION) {
+                    hit_t hit;
+                    hit.seqId = results[entryIdx].seqId;
+                    hit.prefScore = (isReverse) ? -bitScore : bitScore;
+                    hit.diagonal = diagonal;
+                    shortResults.emplace_back(hit);
+                } else {
+                    hit_t hit;
+                    hit.seqId = results[entryIdx].seqId;
+                    hit.prefScore = 100 * seqId;
+                    hit.prefScore = (isReverse) ? -hit.prefScore : hit.prefScore;
+                    hit.diagonal = diagonal;
+                    shortResults.emplace_back(hit);
+                }
+            }
+        }
+
+        if (hitSelection != NULL && alnResults.empty() == false) {
+            hitSelection->select(alnResults, queryKey, evaluer, thread_idx);
+        }
+        if (par.sortResults > 0 && alnResults.size() > 1) {
+            SORT_SERIAL(alnResults.begin(), alnResults.end(), Matcher::compareHits);
+        }
+        for (size_t i = 0; i < alnResults.size(); ++i) {
+            size_t len = Matcher::resultToBuffer(buffer, alnResults[i], par.addBacktrace, false);
+            buffers.resultBuffer.append(buffer, len);
+        }
+
+        if (par.sortResults > 0 && shortResults.size() > 1) {
+            SORT_SERIAL(shortResults.begin(), shortResults.end(), hit_t::compareHitsByScoreAndId);
+        }
+        for (size_t i = 0; i < shortResults.size(); ++i) {
+            size_t len = QueryMatcher::prefilterHitToBuffer(buffer, shortResults[i]);
+            buffers.resultBuffer.append(buffer, len);
+        }
+
+        resultWriter.writeData(buffers.resultBuffer.c_str(), buffers.resultBuffer.length(), queryKey, thread_idx);
+        buffers.resultBuffer.clear();
+        shortResults.clear();
+        alnResults.clear();
+    }
+
+private:
+    Parameters &par;
+    DBReader<unsigned int> *qdbr;
+    DBReader<unsigned int> *tdbr;
+    BaseMatrix *subMat;
+    const bool sameQTDB;
+    const bool reversePrefilterResult;
+    const float scorePerColThr;
+    AlignmentHitSelection *hitSelection;
+    SubstitutionMatrix::FastMatrix fastMatrix;
+    EvalueComputation evaluer;
+};
+
+// rescorediagonal on the databases of the already parsed par, hitSelection can be NULL
+int rescorediagonal(Parameters &par, AlignmentHitSelection *hitSelection);
+
+#endif
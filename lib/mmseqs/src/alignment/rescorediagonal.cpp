@@ -1,3 +1,4 @@
+#include "DiagonalRescorer.h"
 #include "DistanceCalculator.h"
 #include "Util.h"
 #include "Parameters.h"
@@ -45,7 +46,7 @@ float parsePrecisionLib(const std::string &scoreFile, double targetSeqid, double
 int doRescorediagonal(Parameters &par,
                       DBWriter &resultWriter,
                       DBReader<unsigned int> &resultReader,
-              const size_t dbFrom, const size_t dbSize) {
+              const size_t dbFrom, const size_t dbSize, AlignmentHitSelection *hitSelection) {
 
 
     IndexReader * qDbrIdx = NULL;
@@ -88,9 +89,6 @@ int doRescorediagonal(Parameters &par,
         subMat = new SubstitutionMatrix(par.scoringMatrixFile.aminoacids, 2.0, 0.0);
     }
 
-    SubstitutionMatrix::FastMatrix fastMatrix = SubstitutionMatrix::createAsciiSubMat(*subMat);
-
-
     float scorePerColThr = 0.0;
     if (par.filterHits) {
         if (par.rescoreMode == Parameters::RESCORE_MODE_HAMMING) {
@@ -104,7 +102,7 @@ int doRescorediagonal(Parameters &par,
         scorePerColThr = parsePrecisionLib(libraryString, par.seqIdThr, par.covThr, 0.99);
     }
     bool reversePrefilterResult = (Parameters::isEqualDbtype(resultReader.getDbtype(), Parameters::DBTYPE_PREFILTER_REV_RES));
-    EvalueComputation evaluer(tdbr->getAminoAcidDBSize(), subMat);
+    DiagonalRescorer rescorer(par, qdbr, tdbr, subMat, sameQTDB, reversePrefilterResult, scorePerColThr, hitSelection);
 
     size_t totalMemory = Util::getTotalSystemMemory();
     size_t flushSize = 100000000;
@@ -128,234 +126,11 @@ int doRescorediagonal(Parameters &par,
 #ifdef OPENMP
             thread_idx = (unsigned int) omp_get_thread_num();
 #endif
-            char buffer[1024 + 32768*4];
-            std::string resultBuffer;
-            resultBuffer.reserve(1000000);
-            std::string queryBuffer;
-            queryBuffer.reserve(32768);
-            std::vector<Matcher::result_t> alnResults;
-            alnResults.reserve(300);
-            std::vector<hit_t> shortResults;
-            shortResults.reserve(300);
-            char *queryRevSeq = NULL;
-            int queryRevSeqLen = par.maxSeqLen + 1;
-            if (reversePrefilterResult == true) {
-                queryRevSeq = static_cast<char*>(malloc(queryRevSeqLen));
-            }
+            DiagonalRescorer::Buffers buffers(par.maxSeqLen);
 #pragma omp for schedule(dynamic, 1)
             for (size_t id = start; id < (start + bucketSize); id++) {
                 progress.updateProgress();
-
-                char *data = resultReader.getData(id, thread_idx);
-                size_t queryKey = resultReader.getDbKey(id);
-
-                char *querySeq = NULL;
-                std::string queryToWrap; // needed only for wrapped end-start scoring
-                unsigned int queryId = UINT_MAX;
-                int queryLen = -1, origQueryLen = -1;
-                if(*data !=  '\0'){
-                    queryId = qdbr->getId(queryKey);
-                    querySeq = qdbr->getData(queryId, thread_idx);
-                    queryLen = static_cast<int>(qdbr->getSeqLen(queryId));
-                    origQueryLen = queryLen;
-
-                    if (par.wrappedScoring){
-                        queryToWrap = std::string(querySeq,queryLen);
-                        queryToWrap = queryToWrap + queryToWrap;
-                        querySeq = (char*)(queryToWrap).c_str();
-                        queryLen = origQueryLen*2;
-                    }
-
-                    if(reversePrefilterResult == true && queryLen > queryRevSeqLen){
-                        queryRevSeq = static_cast<char*>(realloc(queryRevSeq, queryLen+1));
-                        queryRevSeqLen = queryLen+1;
-                    }
-                    if (reversePrefilterResult == true) {
-                        NucleotideMatrix *nuclMatrix = (NucleotideMatrix *) subMat;
-                        for (int pos = queryLen - 1; pos > -1; pos--) {
-                            unsigned char res = subMat->aa2num[static_cast<int>(querySeq[pos])];
-                            queryRevSeq[(queryLen - 1) - pos] = subMat->num2aa[nuclMatrix->reverseResidue(res)];
-                        }
-                    }
-                    if (sameQTDB && qdbr->isCompressed()) {
-                        queryBuffer.clear();
-                        queryBuffer.append(querySeq, queryLen);
-                        querySeq = (char *) queryBuffer.c_str();
-                    }
-                }
-//                if(par.rescoreMode != Parameters::RESCORE_MODE_HAMMING){
-//                    query.mapSequence(id, queryId, querySeq);
-//                    queryLen = query.L;
-//                }else{
-                // -2 because of \n\0 in sequenceDB
-//                }
-
-                std::vector<hit_t> results = QueryMatcher::parsePrefilterHits(data);
-                for (size_t entryIdx = 0; entryIdx < results.size(); entryIdx++) {
-                    char *querySeqToAlign = querySeq;
-                    bool isReverse = false;
-                    if (reversePrefilterResult) {
-                        if (results[entryIdx].prefScore < 0) {
-                            querySeqToAlign = queryRevSeq;
-                            isReverse=true;
-                        }
-                    }
-
-                    unsigned int targetId = tdbr->getId(results[entryIdx].seqId);
-                    const bool isIdentity = (queryId == targetId && (par.includeIdentity || sameQTDB)) ? true : false;
-                    char *targetSeq = tdbr->getData(targetId, thread_idx);
-                    int dbLen = static_cast<int>(tdbr->getSeqLen(targetId));
-
-                    float queryLength = static_cast<float>(origQueryLen);
-                    float targetLength = static_cast<float>(dbLen);
-                    if (Util::canBeCovered(par.covThr, par.covMode, queryLength, targetLength) == false) {
-                        continue;
-                    }
-                    DistanceCalculator::LocalAlignment alignment;
-                    if (par.wrappedScoring) {
-                        if (dbLen > origQueryLen) {
-                            Debug(Debug::WARNING) << "WARNING: target sequence " << targetId
-                                                  << " is skipped, no valid wrapped scoring possible\n";
-                            continue;
-                        }
-
-                        alignment = DistanceCalculator::computeUngappedWrappedAlignment(
-                                querySeqToAlign, queryLen, targetSeq, targetLength,
-                                results[entryIdx].diagonal, fastMatrix.matrix, par.rescoreMode);
-                    }
-                    else {
-                        alignment = DistanceCalculator::computeUngappedAlignment(
-                                querySeqToAlign, queryLen, targetSeq, targetLength,
-                                results[entryIdx].diagonal, fastMatrix.matrix, par.rescoreMode);
-                    }
-                    unsigned int distanceToDiagonal = alignment.distToDiagonal;
-                    int diagonalLen = alignment.diagonalLen;
-                    int distance = alignment.score;
-                    int diagonal = alignment.diagonal;
-                    double seqId = 0;
-                    double evalue = 0.0;
-                    int bitScore = 0;
-                    int alnLen = 0;
-                    float targetCov = static_cast<float>(diagonalLen) / static_cast<float>(dbLen);
-                    float queryCov = static_cast<float>(diagonalLen) / static_cast<float>(origQueryLen);
-
-                    Matcher::result_t result;
-                    if (par.rescoreMode == Parameters::RESCORE_MODE_HAMMING) {
-                        int idCnt = (static_cast<float>(distance));
-                        seqId = Util::computeSeqId(par.seqIdMode, idCnt, origQueryLen, dbLen, diagonalLen);
-                        alnLen = diagonalLen;
-                    } else if (par.rescoreMode == Parameters::RESCORE_MODE_SUBSTITUTION ||
-                               par.rescoreMode == Parameters::RESCORE_MODE_ALIGNMENT ||
-                               par.rescoreMode == Parameters::RESCORE_MODE_END_TO_END_ALIGNMENT ||
-                               par.rescoreMode == Parameters::RESCORE_MODE_WINDOW_QUALITY_ALIGNMENT) {
-                        evalue = evaluer.computeEvalue(distance, origQueryLen);
-                        bitScore = static_cast<int>(evaluer.computeBitScore(distance) + 0.5);
-
-                        if (par.rescoreMode == Parameters::RESCORE_MODE_ALIGNMENT ||
-                            par.rescoreMode == Parameters::RESCORE_MODE_END_TO_END_ALIGNMENT ||
-                            par.rescoreMode == Parameters::RESCORE_MODE_WINDOW_QUALITY_ALIGNMENT) {
-                            alnLen = (alignment.endPos - alignment.startPos) + 1;
-                            int qStartPos, qEndPos, dbStartPos, dbEndPos;
-                            // -1 since diagonal is computed from sequence Len which starts by 1
-                            if (diagonal >= 0) {
-                                qStartPos = alignment.startPos + distanceToDiagonal;
-                                qEndPos = alignment.endPos + distanceToDiagonal;
-                                dbStartPos = alignment.startPos;
-                                dbEndPos = alignment.endPos;
-                            } else {
-                                qStartPos = alignment.startPos;
-                                qEndPos = alignment.endPos;
-                                dbStartPos = alignment.startPos + distanceToDiagonal;
-                                dbEndPos = alignment.endPos + distanceToDiagonal;
-                            }
-//                                int qAlnLen = std::max(qEndPos - qStartPos, static_cast<int>(1));
-//                                int dbAlnLen = std::max(dbEndPos - dbStartPos, static_cast<int>(1));
-//                                seqId = (alignment.score1 / static_cast<float>(std::max(qAlnLength, dbAlnLength)))  * 0.1656 + 0.1141;
-
-                            // compute seq.id if hit fulfills e-value but not by seqId criteria
-                            if (evalue <= par.evalThr || isIdentity) {
-                                int idCnt = 0;
-                                for (int i = qStartPos; i <= qEndPos; i++) {
-                                    char qLetter = querySeqToAlign[i] & static_cast<unsigned char>(~0x20);
-                                    char tLetter = targetSeq[dbStartPos + (i - qStartPos)] & static_cast<unsigned char>(~0x20);
-                                    idCnt += (qLetter == tLetter) ? 1 : 0;
-                                }
-                                seqId = Util::computeSeqId(par.seqIdMode, idCnt, origQueryLen, dbLen, alnLen);
-                            }
-                            char *end = Itoa::i32toa_sse2(alnLen, buffer);
-                            size_t len = end - buffer;
-                            std::string backtrace = "";
-                            if (par.addBacktrace) {
-                                backtrace=std::string(buffer, len - 1);
-                                backtrace.push_back('M');
-                            }
-                            queryCov = SmithWaterman::computeCov(qStartPos, qEndPos, origQueryLen);
-                            targetCov = SmithWaterman::computeCov(dbStartPos, dbEndPos, dbLen);
-                            if (isReverse) {
-                                qStartPos = queryLen - qStartPos - 1;
-                                qEndPos = queryLen - qEndPos - 1;
-                            }
-                            result = Matcher::result_t(results[entryIdx].seqId, bitScore, queryCov, targetCov, seqId, evalue, alnLen,
-                                                       qStartPos, qEndPos, origQueryLen, dbStartPos, dbEndPos, dbLen, backtrace);
-                        }
-                    }
-
-                    //float maxSeqLen = std::max(static_cast<float>(targetLen), static_cast<float>(queryLen));
-                    float currScorePerCol = static_cast<float>(distance) / static_cast<float>(diagonalLen);
-                    // query/target cov mode
-                    bool hasCov = Util::hasCoverage(par.covThr, par.covMode, queryCov, targetCov);
-                    // --min-seq-id
-                    bool hasSeqId = seqId >= (par.seqIdThr - std::numeric_limits<float>::epsilon());
-                    bool hasEvalue = (evalue <= par.evalThr);
-                    bool hasAlnLen = (alnLen >= par.alnLenThr);
-
-                    // --filter-hits
-                    bool hasToFilter = (par.filterHits == true && currScorePerCol >= scorePerColThr);
-                    if (isIdentity || hasToFilter || (hasAlnLen && hasCov && hasSeqId && hasEvalue)) {
-                        if (par.rescoreMode == Parameters::RESCORE_MODE_ALIGNMENT ||
-                            par.rescoreMode == Parameters::RESCORE_MODE_END_TO_END_ALIGNMENT ||
-                            par.rescoreMode == Parameters::RESCORE_MODE_WINDOW_QUALITY_ALIGNMENT) {
-                            alnResults.emplace_back(result);
-                        } else if (par.rescoreMode == Parameters::RESCORE_MODE_SUBSTITUTION) {
-                            hit_t hit;
-                            hit.seqId = results[entryIdx].seqId;
-                            hit.prefScore = (isReverse) ? -bitScore : bitScore;
-                            hit.diagonal = diagonal;
-                            shortResults.emplace_back(hit);
-                        } else {
-                            hit_t hit;
-                            hit.seqId = results[entryIdx].seqId;
-                            hit.prefScore = 100 * seqId;
-                            hit.prefScore = (isReverse) ? -hit.prefScore : hit.prefScore;
-                            hit.diagonal = diagonal;
-                            shortResults.emplace_back(hit);
-                        }
-                    }
-                }
-
-                if (par.sortResults > 0 && alnResults.size() > 1) {
-                    SORT_SERIAL(alnResults.begin(), alnResults.end(), Matcher::compareHits);
-                }
-                for (size_t i = 0; i < alnResults.size(); ++i) {
-                    size_t len = Matcher::resultToBuffer(buffer, alnResults[i], par.addBacktrace, false);
-                    resultBuffer.append(buffer, len);
-                }
-
-                if (par.sortResults > 0 && shortResults.size() > 1) {
-                    SORT_SERIAL(shortResults.begin(), shortResults.end(), hit_t::compareHitsByScoreAndId);
-                }
-                for (size_t i = 0; i < shortResults.size(); ++i) {
-                    size_t len = QueryMatcher::prefilterHitToBuffer(buffer, shortResults[i]);
-                    resultBuffer.append(buffer, len);
-                }
-
-                resultWriter.writeData(resultBuffer.c_str(), resultBuffer.length(), queryKey, thread_idx);
-                resultBuffer.clear();
-                shortResults.clear();
-                alnResults.clear();
-            }
-            if (reversePrefilterResult == true) {
-                free(queryRevSeq);
+                rescorer.rescoreQuery(buffers, resultReader.getData(id, thread_idx), resultReader.getDbKey(id), resultWriter, thread_idx);
             }
         }
         resultReader.remapData();
@@ -372,8 +147,6 @@ int doRescorediagonal(Parameters &par,
         }
     }
 
-    delete[] fastMatrix.matrix;
-    delete[] fastMatrix.matrixData;
     delete subMat;
     return 0;
 }
@@ -383,6 +156,10 @@ int rescorediagonal(int argc, const char **argv, const Command &command) {
     Parameters &par = Parameters::getInstance();
     par.parseParameters(argc, argv, command, true, 0, 0);
 
+    return rescorediagonal(par, NULL);
+}
+
+int rescorediagonal(Parameters &par, AlignmentHitSelection *hitSelection) {
     if (par.wrappedScoring && par.rescoreMode != Parameters::RESCORE_MODE_HAMMING) {
         Debug(Debug::ERROR) << "ERROR: wrapped scoring is only allowed with RESCORE_MODE_HAMMING\n";
         return EXIT_FAILURE;
@@ -407,7 +184,7 @@ int rescorediagonal(int argc, const char **argv, const Command &command) {
 
     DBWriter resultWriter(tmpOutput.first.c_str(), tmpOutput.second.c_str(), par.threads, par.compressed, dbtype);
     resultWriter.open();
-    int status = doRescorediagonal(par, resultWriter, resultReader, dbFrom, dbSize);
+    int status = doRescorediagonal(par, resultWriter, resultReader, dbFrom, dbSize, hitSelection);
     resultWriter.close(true);
 
     MPI_Barrier(MPI_COMM_WORLD);
@@ -422,7 +199,7 @@ int rescorediagonal(int argc, const char **argv, const Command &command) {
 #else
     DBWriter resultWriter(par.db4.c_str(), par.db4Index.c_str(), par.threads, par.compressed, dbtype);
     resultWriter.open();
-    int status = doRescorediagonal(par, resultWriter, resultReader, 0, resultReader.getSize());
+    int status = doRescorediagonal(par, resultWriter, resultReader, 0, resultReader.getSize(), hitSelection);
     resultWriter.close();
 
 #endif
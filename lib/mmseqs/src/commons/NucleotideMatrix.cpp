@@ -1,4 +1,5 @@
 #include "NucleotideMatrix.h"
+#include "simd.h"
 #include <climits>
 
 NucleotideMatrix::NucleotideMatrix(const char* scoringMatrixFileName, float bitFactor, float scoreBias)
@@ -11,6 +12,68 @@ NucleotideMatrix::NucleotideMatrix(const char* scoringMatrixFileName, float bitF
     reverseLookup[aa2num[static_cast<int>('C')]] = aa2num[static_cast<int>('G')];
     reverseLookup[aa2num[static_cast<int>('T')]] = aa2num[static_cast<int>('A')];
     reverseLookup[aa2num[static_cast<int>('X')]] = aa2num[static_cast<int>('X')];
+
+    // aa2num has no entry for UCHAR_MAX
+    for (int letter = 0; letter < UCHAR_MAX; letter++) {
+        unsigned char res = aa2num[letter];
+        complementLookup[letter] = (res < alphabetSize) ? num2aa[reverseResidue(res)] : 'X';
+    }
+    complementLookup[UCHAR_MAX] = 'X';
+}
+
+// A, C, T and G differ in the lower four bits, so a block that only contains these
+// letters (in any case) is complemented by a single shuffle. reverseComplementForward
+// maps the lower bits back to the letter to verify the block. Its unused entries
+// can never match a character with these lower bits.
+static const __m128i reverseComplementForward = _mm_setr_epi8(static_cast<char>(0xFF), 'A', 0, 'C', 'T', 0, 0, 'G', 0, 0, 0, 0, 0, 0, 0, 0);
+static const __m128i reverseComplementLookup = _mm_setr_epi8(0, 'T', 0, 'G', 'A', 0, 0, 'C', 0, 0, 0, 0, 0, 0, 0, 0);
+static const __m128i reverseComplementOrder = _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+
+void NucleotideMatrix::reverseComplement(const char *seq, size_t len, char *out, char unknownResidue) const {
+    const __m128i lowerBits = _mm_set1_epi8(0x0F);
+    const __m128i upperCase = _mm_set1_epi8(static_cast<char>(~0x20));
+    size_t pos = 0;
+#ifdef AVX2
+    const __m256i forward256 = _mm256_broadcastsi128_si256(reverseComplementForward);
+    const __m256i complement256 = _mm256_broadcastsi128_si256(reverseComplementLookup);
+    const __m256i order256 = _mm256_broadcastsi128_si256(reverseComplementOrder);
+    const __m256i lowerBits256 = _mm256_broadcastsi128_si256(lowerBits);
+    const __m256i upperCase256 = _mm256_broadcastsi128_si256(upperCase);
+#endif
+    while (pos + 16 <= len) {
+#ifdef AVX2
+        if (pos + 32 <= len) {
+            __m256i block = _mm256_loadu_si256((const __m256i *) (seq + len - pos - 32));
+            __m256i index = _mm256_and_si256(block, lowerBits256);
+            __m256i valid = _mm256_cmpeq_epi8(_mm256_shuffle_epi8(forward256, index),
+                                              _mm256_and_si256(block, upperCase256));
+            if (_mm256_movemask_epi8(valid) == -1) {
+                // shuffle only reverses within the 128-bit lanes, swap them afterwards
+                __m256i result = _mm256_shuffle_epi8(_mm256_shuffle_epi8(complement256, index), order256);
+                _mm256_storeu_si256((__m256i *) (out + pos), _mm256_permute2x128_si256(result, result, 0x01));
+                pos += 32;
+                continue;
+            }
+        }
+#endif
+        __m128i block = _mm_loadu_si128((const __m128i *) (seq + len - pos - 16));
+        __m128i index = _mm_and_si128(block, lowerBits);
+        __m128i valid = _mm_cmpeq_epi8(_mm_shuffle_epi8(reverseComplementForward, index), _mm_and_si128(block, upperCase));
+        if (_mm_movemask_epi8(valid) == 0xFFFF) {
+            _mm_storeu_si128((__m128i *) (out + pos),
+                             _mm_shuffle_epi8(_mm_shuffle_epi8(reverseComplementLookup, index), reverseComplementOrder));
+        } else {
+            for (size_t i = pos; i < pos + 16; i++) {
+                char res = complementLookup[static_cast<unsigned char>(seq[len - 1 - i])];
+                out[i] = (res == 'X') ? unknownResidue : res;
+            }
+        }
+        pos += 16;
+    }
+    for (; pos < len; pos++) {
+        char res = complementLookup[static_cast<unsigned char>(seq[len - 1 - pos])];
+        out[pos] = (res == 'X') ? unknownResidue : res;
+    }
 }
 
 
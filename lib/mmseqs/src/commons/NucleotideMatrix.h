@@ -3,6 +3,9 @@
 
 #include "SubstitutionMatrix.h"
 
+#include <climits>
+#include <cstddef>
+
 class NucleotideMatrix : public SubstitutionMatrix {
 public:
     NucleotideMatrix(const char *scoringMatrixFileName, float bitFactor, float scoreBias);
@@ -17,8 +20,15 @@ public:
         return reverseLookup[res];
     }
 
+    // Writes the reverse complement of seq to out (without null byte). Residues are
+    // normalized like num2aa[reverseResidue(aa2num[c])], residues without complement
+    // are written as unknownResidue. seq and out must not overlap.
+    void reverseComplement(const char *seq, size_t len, char *out, char unknownResidue = 'X') const;
+
 private:
     int *reverseLookup;
+    // reverse complement in ASCII for every input character
+    char complementLookup[UCHAR_MAX + 1];
 };
 
 #endif
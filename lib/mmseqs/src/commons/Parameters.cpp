@@ -144,6 +144,9 @@ Parameters::Parameters():
         PARAM_HASH_SHIFT(PARAM_HASH_SHIFT_ID, "--hash-shift", "Shift hash", "Shift k-mer hash initialization", typeid(int), (void *) &hashShift, "^[1-9]{1}[0-9]*$", MMseqsParameter::COMMAND_CLUSTLINEAR | MMseqsParameter::COMMAND_EXPERT),
         PARAM_PICK_N_SIMILAR(PARAM_PICK_N_SIMILAR_ID, "--pick-n-sim-kmer", "Add N similar to search", "Add N similar k-mers to search", typeid(int), (void *) &pickNbest, "^[1-9]{1}[0-9]*$", MMseqsParameter::COMMAND_CLUSTLINEAR | MMseqsParameter::COMMAND_EXPERT),
         PARAM_ADJUST_KMER_LEN(PARAM_ADJUST_KMER_LEN_ID, "--adjust-kmer-len", "Adjust k-mer length", "Adjust k-mer length based on specificity (only for nucleotides)", typeid(bool), (void *) &adjustKmerLength, "", MMseqsParameter::COMMAND_CLUSTLINEAR | MMseqsParameter::COMMAND_EXPERT),
+        PARAM_KMER_END_WINDOW(PARAM_KMER_END_WINDOW_ID, "--kmer-end-window", "K-mer end window", "Select k-mers only from the first and last N residues of each sequence (0: whole sequence)", typeid(int), (void *) &kmerEndWindow, "^[0-9]{1}[0-9]*$", MMseqsParameter::COMMAND_CLUSTLINEAR | MMseqsParameter::COMMAND_EXPERT),
+        PARAM_MINIMIZER_WINDOW(PARAM_MINIMIZER_WINDOW_ID, "--minimizer-window", "Minimizer window", "Select the minimizers of N consecutive k-mers of nucleotide sequences instead of the k-mers with the lowest hashes, --kmer-per-seq is ignored (0: off)", typeid(int), (void *) &minimizerWindow, "^[0-9]{1}[0-9]*$", MMseqsParameter::COMMAND_CLUSTLINEAR | MMseqsParameter::COMMAND_EXPERT),
+        PARAM_RADIX_SORT_THREADS(PARAM_RADIX_SORT_THREADS_ID, "--radix-sort-threads", "Radix sort threads", "Sort k-mer arrays with the in-place radix sort up to N threads and with ips4o above, if it is available (0: always ips4o)", typeid(int), (void *) &radixSortThreads, "^[0-9]{1}[0-9]*$", MMseqsParameter::COMMAND_CLUSTLINEAR | MMseqsParameter::COMMAND_EXPERT),
         PARAM_RESULT_DIRECTION(PARAM_RESULT_DIRECTION_ID, "--result-direction", "Result direction", "result is 0: query, 1: target centric", typeid(int), (void *) &resultDirection, "^[0-1]{1}$", MMseqsParameter::COMMAND_CLUSTLINEAR | MMseqsParameter::COMMAND_EXPERT),
 
         // workflow
@@ -877,6 +880,9 @@ Parameters::Parameters():
     kmermatcher.push_back(&PARAM_SPACED_KMER_PATTERN);
     kmermatcher.push_back(&PARAM_KMER_PER_SEQ_SCALE);
     kmermatcher.push_back(&PARAM_ADJUST_KMER_LEN);
+    kmermatcher.push_back(&PARAM_KMER_END_WINDOW);
+    kmermatcher.push_back(&PARAM_MINIMIZER_WINDOW);
+    kmermatcher.push_back(&PARAM_RADIX_SORT_THREADS);
     kmermatcher.push_back(&PARAM_MASK_RESIDUES);
     kmermatcher.push_back(&PARAM_MASK_LOWER_CASE);
     kmermatcher.push_back(&PARAM_COV_MODE);
@@ -2336,6 +2342,9 @@ void Parameters::setDefaults() {
     hashShift = 67;
     pickNbest = 1;
     adjustKmerLength = false;
+    kmerEndWindow = 0;
+    minimizerWindow = 0;
+    radixSortThreads = 4;
     resultDirection = Parameters::PARAM_RESULT_DIRECTION_TARGET;
     // result2stats
     stat = "";
@@ -508,6 +508,9 @@ public:
     int hashShift;
     int pickNbest;
     int adjustKmerLength;
+    int kmerEndWindow;
+    int minimizerWindow;
+    int radixSortThreads;
     int resultDirection;
 
     // indexdb
@@ -803,6 +806,9 @@ public:
     PARAMETER(PARAM_HASH_SHIFT)
     PARAMETER(PARAM_PICK_N_SIMILAR)
     PARAMETER(PARAM_ADJUST_KMER_LEN)
+    PARAMETER(PARAM_KMER_END_WINDOW)
+    PARAMETER(PARAM_MINIMIZER_WINDOW)
+    PARAMETER(PARAM_RADIX_SORT_THREADS)
     PARAMETER(PARAM_RESULT_DIRECTION)
     // workflow
     PARAMETER(PARAM_RUNNER)
@@ -0,0 +1,143 @@
+#ifndef MMSEQS_KMERRADIXSORT_H
+#define MMSEQS_KMERRADIXSORT_H
+
+#include "kmermatcher.h"
+#include "FastSort.h"
+#include "Util.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstddef>
+
+#ifdef OPENMP
+#include <omp.h>
+#endif
+
+// In-place MSD radix sort (American flag sort) of KmerPosition or CompactKmerPosition
+// arrays by the kmer field, one byte per pass. Bytes that are the same in all keys of a
+// range are skipped, so only the bits the hashes or rep. sequence ids actually use are
+// distributed. Ranges of equal kmer and small ranges are finished with the comparator,
+// which breaks the ties by seqLen, id and pos. MaskStrand sets bit 63 of every key like the *Reverse comparators.
+// The first pass is serial, the 256 ranges it produces are sorted in parallel.
+template <typename KmerType, bool MaskStrand, bool (*Compare)(const KmerType &, const KmerType &)>
+class KmerRadixSort {
+public:
+    static void sort(KmerType *kmers, size_t size) {
+        if (size <= COMPARISON_SORT_SIZE) {
+            std::sort(kmers, kmers + size, Compare);
+            return;
+        }
+        size_t anyBits = 0;
+        size_t allBits = SIZE_MAX;
+#pragma omp parallel for schedule(static) reduction(|:anyBits) reduction(&:allBits)
+        for (size_t i = 0; i < size; i++) {
+            size_t k = key(kmers[i]);
+            anyBits |= k;
+            allBits &= k;
+        }
+        size_t varyingBits = anyBits & ~allBits;
+        if (varyingBits == 0) {
+            // a single kmer, only the tie-breakers are left
+            std::sort(kmers, kmers + size, Compare);
+            return;
+        }
+        int shift = ((63 - __builtin_clzll(varyingBits)) / 8) * 8;
+
+        size_t counts[BUCKETS];
+        countBytes(kmers, size, shift, counts);
+        size_t starts[BUCKETS];
+        distribute(kmers, counts, shift, starts);
+#pragma omp parallel for schedule(dynamic, 1)
+        for (size_t bucket = 0; bucket < BUCKETS; bucket++) {
+            sortRange(kmers + starts[bucket], counts[bucket], shift - 8);
+        }
+    }
+
+private:
+    static const size_t BUCKETS = 256;
+    static const size_t COMPARISON_SORT_SIZE = 64;
+
+    static size_t key(const KmerType &kmer) {
+        return MaskStrand ? BIT_SET(getKmer(kmer), 63) : getKmer(kmer);
+    }
+
+    static size_t byteAt(const KmerType &kmer, int shift) {
+        return (key(kmer) >> shift) & 0xFF;
+    }
+
+    static void countBytes(const KmerType *kmers, size_t size, int shift, size_t *counts) {
+        std::fill(counts, counts + BUCKETS, 0);
+        for (size_t i = 0; i < size; i++) {
+            counts[byteAt(kmers[i], shift)]++;
+        }
+    }
+
+    // moves every element into the range of its byte by following the permutation cycles
+    static void distribute(KmerType *kmers, const size_t *counts, int shift, size_t *starts) {
+        size_t next[BUCKETS];
+        size_t ends[BUCKETS];
+        size_t offset = 0;
+        for (size_t bucket = 0; bucket < BUCKETS; bucket++) {
+            starts[bucket] = offset;
+            next[bucket] = offset;
+            offset += counts[bucket];
+            ends[bucket] = offset;
+        }
+        for (size_t bucket = 0; bucket < BUCKETS; bucket++) {
+            while (next[bucket] < ends[bucket]) {
+                KmerType element = kmers[next[bucket]];
+                size_t target = byteAt(element, shift);
+                while (target != bucket) {
+                    std::swap(element, kmers[next[target]++]);
+                    target = byteAt(element, shift);
+                }
+                kmers[next[bucket]++] = element;
+            }
+        }
+    }
+
+    static void sortRange(KmerType *kmers, size_t size, int shift) {
+        size_t counts[BUCKETS];
+        while (true) {
+            if (size <= COMPARISON_SORT_SIZE || shift < 0) {
+                std::sort(kmers, kmers + size, Compare);
+                return;
+            }
+            countBytes(kmers, size, shift, counts);
+            if (counts[byteAt(kmers[0], shift)] != size) {
+                break;
+            }
+            shift -= 8;
+        }
+        size_t starts[BUCKETS];
+        distribute(kmers, counts, shift, starts);
+        for (size_t bucket = 0; bucket < BUCKETS; bucket++) {
+            if (counts[bucket] > 1) {
+                sortRange(kmers + starts[bucket], counts[bucket], shift - 8);
+            }
+        }
+    }
+};
+
+// sorts like SORT_PARALLEL with Compare, MaskStrand has to match the comparator. The serial
+// first pass of KmerRadixSort limits how well it scales: single threaded it sorts about three
+// times faster than ips4o, with more threads ips4o catches up. Above radixSortThreads
+// (--radix-sort-threads) threads ips4o sorts instead.
+template <typename KmerType, bool MaskStrand, bool (*Compare)(const KmerType &, const KmerType &)>
+void sortKmerPositions(KmerType *kmers, size_t size, int radixSortThreads) {
+#ifdef ENABLE_IPS4O
+    int threads = 1;
+#ifdef OPENMP
+    threads = omp_get_max_threads();
+#endif
+    if (threads > radixSortThreads) {
+        SORT_PARALLEL(kmers, kmers + size, Compare);
+        return;
+    }
+#else
+    (void) radixSortThreads;
+#endif
+    KmerRadixSort<KmerType, MaskStrand, Compare>::sort(kmers, size);
+}
+
+#endif
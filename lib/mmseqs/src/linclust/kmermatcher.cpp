@@ -15,6 +15,7 @@
 #include "MarkovKmerScore.h"
 #include "FileUtil.h"
 #include "FastSort.h"
+#include "KmerRadixSort.h"
 
 #include <sys/stat.h>
 #include <sys/mman.h>
@@ -74,11 +75,158 @@ void maskSequence(int maskMode, int maskLowerCase, Sequence &seq, int maskLetter
     }
 }
 
-template <int TYPE, typename T>
-std::pair<size_t, size_t> fillKmerPositionArray(KmerPosition<T> * kmerArray, size_t kmerArraySize, DBReader<unsigned int> &seqDbr,
+template <typename T>
+static void storeKmerPositions(KmerPosition<T> *kmerArray, const KmerPosition<T> *kmers, size_t count) {
+    memcpy(kmerArray, kmers, sizeof(KmerPosition<T>) * count);
+}
+
+static void storeKmerPositions(CompactKmerPosition *kmerArray, const KmerPosition<short> *kmers, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        kmerArray[i] = CompactKmerPosition(kmers[i]);
+    }
+}
+
+// Rolling k-mer indices for fillKmerPositionArray. If a k-mer directly follows the last
+// one, its index is updated with the residue that entered it, otherwise it is computed
+// again. Spaced k-mers are always computed again.
+class RollingNucleotideKmer {
+public:
+    RollingNucleotideKmer(size_t kmerSize, bool contiguous)
+            : forward(0), reverse(0), kmerSize(kmerSize), contiguous(contiguous), lastPos(-2),
+              mask((kmerSize >= 32) ? UINT64_MAX : ((1ULL << (2 * kmerSize)) - 1)) {}
+
+    void reset() {
+        lastPos = -2;
+    }
+
+    // forward like Indexer::computeKmerIdx and reverse like Util::revComplement
+    void next(const unsigned char *kmer, int pos) {
+        if (contiguous && pos == lastPos + 1) {
+            // A, C, T and G are 0 to 3, so the complement flips the second bit
+            uint64_t residue = kmer[kmerSize - 1];
+            forward = ((forward << 2) | residue) & mask;
+            reverse = (reverse >> 2) | ((residue ^ 2) << (2 * (kmerSize - 1)));
+        } else {
+            forward = Indexer::computeKmerIdx(kmer, kmerSize);
+            reverse = Util::revComplement(forward, kmerSize);
+        }
+        lastPos = pos;
+    }
+
+    uint64_t forward;
+    uint64_t reverse;
+
+private:
+    const size_t kmerSize;
+    const bool contiguous;
+    int lastPos;
+    const uint64_t mask;
+};
+
+// Indexer::int2index weights residue i with alphabetSize^i, so the index of the next
+// k-mer is (index - first residue) / alphabetSize + new residue * alphabetSize^(k - 1).
+// The division is exact and done as a shift by the trailing zeros of alphabetSize and a
+// multiplication with the inverse of its odd part modulo 2^64. Only indices that do not
+// overflow are rolled.
+class RollingKmerIndex {
+public:
+    RollingKmerIndex(size_t alphabetSize, size_t kmerSize, bool contiguous)
+            : kmerSize(kmerSize), shift(__builtin_ctzll(alphabetSize)), inverse(alphabetSize >> shift),
+              highestPower(1), rolling(contiguous), lastPos(-2), index(0), first(0) {
+        for (size_t i = 1; i < kmerSize; i++) {
+            if (highestPower > UINT64_MAX / alphabetSize) {
+                rolling = false;
+            }
+            highestPower *= alphabetSize;
+        }
+        if (highestPower > UINT64_MAX / alphabetSize) {
+            rolling = false;
+        }
+        // Newton iteration, every step doubles the correct low bits
+        const uint64_t odd = inverse;
+        for (int i = 0; i < 6; i++) {
+            inverse *= 2 - odd * inverse;
+        }
+    }
+
+    void reset() {
+        lastPos = -2;
+    }
+
+    size_t next(const unsigned char *kmer, int pos, Indexer &idxer) {
+        if (rolling && pos == lastPos + 1) {
+            index = ((index - first) >> shift) * inverse + kmer[kmerSize - 1] * highestPower;
+        } else {
+            index = idxer.int2index(kmer, 0, kmerSize);
+        }
+        first = kmer[0];
+        lastPos = pos;
+        return index;
+    }
+
+private:
+    const size_t kmerSize;
+    const int shift;
+    uint64_t inverse;
+    uint64_t highestPower;
+    bool rolling;
+    int lastPos;
+    uint64_t index;
+    uint64_t first;
+};
+
+// smaller hash first, equal hashes are ordered by the canonical k-mer
+static bool isSmallerMinimizer(const SequencePosition &first, const SequencePosition &second) {
+    if (first.score != second.score) {
+        return first.score < second.score;
+    }
+    return BIT_SET(first.kmer, 63) < BIT_SET(second.kmer, 63);
+}
+
+// Keeps the minimizer of every window of window consecutive k-mers, a k-mer that is the
+// minimizer of several windows only once. The order of the canonical k-mers does not
+// depend on the strand, so two sequences that share window + k - 1 residues on either
+// strand keep at least one common k-mer. Returns the number of kept k-mers, which are
+// moved to the front of kmers.
+static size_t selectMinimizers(SequencePosition *kmers, size_t count, size_t window,
+                               std::vector<size_t> &minimizers) {
+    minimizers.clear();
+    window = std::min(window, count);
+    size_t minIdx = SIZE_T_MAX;
+    for (size_t start = 0; start + window <= count && window > 0; start++) {
+        const size_t end = start + window - 1;
+        if (minIdx != SIZE_T_MAX && minIdx >= start) {
+            // only the k-mer that entered the window can be smaller
+            if (isSmallerMinimizer(kmers[end], kmers[minIdx])) {
+                minIdx = end;
+            }
+        } else {
+            minIdx = start;
+            for (size_t i = start + 1; i <= end; i++) {
+                if (isSmallerMinimizer(kmers[i], kmers[minIdx])) {
+                    minIdx = i;
+                }
+            }
+        }
+        if (minimizers.empty() || minimizers.back() != minIdx) {
+            minimizers.push_back(minIdx);
+        }
+    }
+    // the minimizer positions increase, so no k-mer is overwritten before it was moved
+    for (size_t i = 0; i < minimizers.size(); i++) {
+        kmers[i] = kmers[minimizers[i]];
+    }
+    return minimizers.size();
+}
+
+template <int TYPE, typename T, typename KmerType>
+std::pair<size_t, size_t> fillKmerPositionArray(KmerType * kmerArray, size_t kmerArraySize, DBReader<unsigned int> &seqDbr,
                                                 Parameters & par, BaseMatrix * subMat, bool hashWholeSequence,
                                                 size_t hashStartRange, size_t hashEndRange, size_t * hashDistribution){
     size_t offset = 0;
+    // computeKmerCount only estimates the number of minimizers, if they do not fit into the
+    // array they are still counted and the caller sets up a larger array or more splits
+    const bool countOverflow = (TYPE == Parameters::DBTYPE_NUCLEOTIDES && par.minimizerWindow > 0);
     int querySeqType  =  seqDbr.getDbtype();
     size_t longestKmer = par.kmerSize;
     ProbabilityMatrix *probMatrix = NULL;
@@ -111,11 +259,15 @@ std::pair<size_t, size_t> fillKmerPositionArray(KmerPosition<T> * kmerArray, siz
             generator->setDivideStrategy(&three, &two);
         }
         Indexer idxer(subMat->alphabetSize - 1,  par.kmerSize);
+        const bool contiguousKmers = seq.getEffectiveKmerSize() == seq.getKmerSize();
+        RollingNucleotideKmer nuclKmer(par.kmerSize, contiguousKmers);
+        RollingKmerIndex aaKmer(subMat->alphabetSize - 1, par.kmerSize, contiguousKmers);
         const unsigned int BUFFER_SIZE = 1048576;
         size_t bufferPos = 0;
         KmerPosition<T> * threadKmerBuffer = new KmerPosition<T>[BUFFER_SIZE];
         SequencePosition * kmers = (SequencePosition *) malloc((par.pickNbest * (par.maxSeqLen + 1) + 1) * sizeof(SequencePosition));
         size_t kmersArraySize = par.maxSeqLen;
+        std::vector<size_t> minimizers;
         const size_t flushSize = 100000000;
         size_t iterations = static_cast<size_t>(ceil(static_cast<double>(seqDbr.getSize()) / static_cast<double>(flushSize)));
         for (size_t i = 0; i < iterations; i++) {
@@ -141,16 +293,26 @@ std::pair<size_t, size_t> fillKmerPositionArray(KmerPosition<T> * kmerArray, siz
 
                 size_t seqKmerCount = 0;
                 unsigned int seqId = seq.getDbKey();
+                nuclKmer.reset();
+                aaKmer.reset();
                 while (seq.hasNextKmer()) {
                     unsigned char *kmer = (unsigned char*) seq.nextKmer();
                     if(seq.kmerContainsX()){
                         continue;
                     }
+                    // only k-mers that lie within the first or the last kmerEndWindow residues
+                    if(par.kmerEndWindow > 0){
+                        int pos = seq.getCurrentPosition();
+                        if(pos + adjustedKmerSize > par.kmerEndWindow && pos < seq.L - par.kmerEndWindow){
+                            continue;
+                        }
+                    }
                     if(TYPE == Parameters::DBTYPE_NUCLEOTIDES){
                         NucleotideMatrix * nuclMatrix = (NucleotideMatrix*)subMat;
                         size_t kmerLen =  par.kmerSize;
-                        size_t kmerIdx = Indexer::computeKmerIdx(kmer, kmerLen);
-                        size_t revkmerIdx = Util::revComplement(kmerIdx, kmerLen);
+                        nuclKmer.next(kmer, seq.getCurrentPosition());
+                        size_t kmerIdx = nuclKmer.forward;
+                        size_t revkmerIdx = nuclKmer.reverse;
                         // skip forward and rev. identical k-mers.
                         // We can not know how to align these afterwards
                         if(revkmerIdx == kmerIdx){
@@ -199,7 +361,7 @@ std::pair<size_t, size_t> fillKmerPositionArray(KmerPosition<T> * kmerArray, siz
                             seqKmerCount++;
                         }
                     } else {
-                        size_t kmerIdx = idxer.int2index(kmer, 0, par.kmerSize);
+                        size_t kmerIdx = aaKmer.next(kmer, seq.getCurrentPosition(), idxer);
                         (kmers + seqKmerCount)->kmer = kmerIdx;
                         (kmers + seqKmerCount)->pos = seq.getCurrentPosition();
                         const unsigned short hash = hashUInt64(kmerIdx, par.hashShift);
@@ -220,7 +382,19 @@ std::pair<size_t, size_t> fillKmerPositionArray(KmerPosition<T> * kmerArray, siz
                 }
                 float kmersPerSequenceScale = (TYPE == Parameters::DBTYPE_NUCLEOTIDES) ? par.kmersPerSequenceScale.nucleotides
                                                                                        : par.kmersPerSequenceScale.aminoacids;
-                size_t kmerConsidered = std::min(static_cast<size_t >(par.kmersPerSequence  - 1 + (kmersPerSequenceScale * seq.L)), seqKmerCount);
+                // the k-mers of a sequence scale with the residues they are selected from
+                int selectableLen = (par.kmerEndWindow > 0) ? std::min(seq.L, 2 * par.kmerEndWindow) : seq.L;
+                size_t kmerConsidered = std::min(static_cast<size_t >(par.kmersPerSequence  - 1 + (kmersPerSequenceScale * selectableLen)), seqKmerCount);
+                if(TYPE == Parameters::DBTYPE_NUCLEOTIDES && par.minimizerWindow > 0){
+                    seqKmerCount = selectMinimizers(kmers, seqKmerCount, par.minimizerWindow, minimizers);
+                    kmerConsidered = seqKmerCount;
+                    memset(scoreDist, 0, sizeof(unsigned short) * 65536);
+                    memset(hierarchicalScoreDist, 0, sizeof(unsigned int) * 128);
+                    for(size_t i = 0; i < seqKmerCount; i++){
+                        scoreDist[kmers[i].score]++;
+                        hierarchicalScoreDist[kmers[i].score >> 9]++;
+                    }
+                }
 
                 unsigned int threshold = 0;
                 size_t kmerInBins = 0;
@@ -249,11 +423,11 @@ std::pair<size_t, size_t> fillKmerPositionArray(KmerPosition<T> * kmerArray, siz
                     bufferPos++;
                     if (bufferPos >= BUFFER_SIZE) {
                         size_t writeOffset = __sync_fetch_and_add(&offset, bufferPos);
-                        if(writeOffset + bufferPos < kmerArraySize){
+                        if(writeOffset + bufferPos <= kmerArraySize){
                             if(kmerArray!=NULL){
-                                memcpy(kmerArray + writeOffset, threadKmerBuffer, sizeof(KmerPosition<T>) * bufferPos);
+                                storeKmerPositions(kmerArray + writeOffset, threadKmerBuffer, bufferPos);
                             }
-                        } else{
+                        } else if(countOverflow == false){
                             Debug(Debug::ERROR) << "Kmer array overflow. currKmerArrayOffset="<< writeOffset
                                                 << ", kmerBufferPos=" << bufferPos
                                                 << ", kmerArraySize=" << kmerArraySize <<".\n";
@@ -264,10 +438,16 @@ std::pair<size_t, size_t> fillKmerPositionArray(KmerPosition<T> * kmerArray, siz
                 }
 
                 if(par.ignoreMultiKmer){
+                    // only k-mers below the threshold can be selected, the others stay unsorted
+                    // behind them. Repeated k-mers have the same hash and stay together.
+                    SequencePosition *candidatesEnd = std::partition(kmers, kmers + seqKmerCount,
+                                                                     [threshold](const SequencePosition &kmer) {
+                                                                         return kmer.score < threshold;
+                                                                     });
                     if(TYPE == Parameters::DBTYPE_NUCLEOTIDES) {
-                        SORT_SERIAL(kmers, kmers + seqKmerCount, SequencePosition::compareByScoreReverse);
+                        SORT_SERIAL(kmers, candidatesEnd, SequencePosition::compareByScoreReverse);
                     }else{
-                        SORT_SERIAL(kmers, kmers + seqKmerCount, SequencePosition::compareByScore);
+                        SORT_SERIAL(kmers, candidatesEnd, SequencePosition::compareByScore);
                     }
                 }
                 size_t selectedKmer = 0;
@@ -327,12 +507,11 @@ std::pair<size_t, size_t> fillKmerPositionArray(KmerPosition<T> * kmerArray, siz
 
                             if (bufferPos >= BUFFER_SIZE) {
                                 size_t writeOffset = __sync_fetch_and_add(&offset, bufferPos);
-                                if(writeOffset + bufferPos < kmerArraySize){
+                                if(writeOffset + bufferPos <= kmerArraySize){
                                     if(kmerArray!=NULL) {
-                                        memcpy(kmerArray + writeOffset, threadKmerBuffer,
-                                               sizeof(KmerPosition<T>) * bufferPos);
+                                        storeKmerPositions(kmerArray + writeOffset, threadKmerBuffer, bufferPos);
                                     }
-                                } else{
+                                } else if(countOverflow == false){
                                     Debug(Debug::ERROR) << "Kmer array overflow. currKmerArrayOffset="<< writeOffset
                                                         << ", kmerBufferPos=" << bufferPos
                                                         << ", kmerArraySize=" << kmerArraySize <<".\n";
@@ -360,8 +539,13 @@ std::pair<size_t, size_t> fillKmerPositionArray(KmerPosition<T> * kmerArray, siz
 
         if(bufferPos > 0){
             size_t writeOffset = __sync_fetch_and_add(&offset, bufferPos);
-            if(kmerArray != NULL){
-                memcpy(kmerArray+writeOffset, threadKmerBuffer, sizeof(KmerPosition<T>) * bufferPos);
+            if(kmerArray != NULL && writeOffset + bufferPos <= kmerArraySize){
+                storeKmerPositions(kmerArray + writeOffset, threadKmerBuffer, bufferPos);
+            } else if(kmerArray != NULL && countOverflow == false){
+                Debug(Debug::ERROR) << "Kmer array overflow. currKmerArrayOffset="<< writeOffset
+                                    << ", kmerBufferPos=" << bufferPos
+                                    << ", kmerArraySize=" << kmerArraySize <<".\n";
+                EXIT(EXIT_FAILURE);
             }
         }
         free(kmers);
@@ -384,20 +568,28 @@ std::pair<size_t, size_t> fillKmerPositionArray(KmerPosition<T> * kmerArray, siz
     return std::make_pair(offset, longestKmer);
 }
 
+// Returns NULL if more minimizers than totalKmers are selected, selectedKmers is their
+// number then. computeKmerCount only estimates it, the caller sets up the splits again.
 template <typename T>
 KmerPosition<T> * doComputation(size_t totalKmers, size_t hashStartRange, size_t hashEndRange, std::string splitFile,
-                                DBReader<unsigned int> & seqDbr, Parameters & par, BaseMatrix  * subMat) {
+                                DBReader<unsigned int> & seqDbr, Parameters & par, BaseMatrix  * subMat, size_t &selectedKmers) {
 
     KmerPosition<T> * hashSeqPair = initKmerPositionMemory<T>(totalKmers);
     size_t elementsToSort;
     if(Parameters::isEqualDbtype(seqDbr.getDbtype(), Parameters::DBTYPE_NUCLEOTIDES)){
         std::pair<size_t, size_t > ret = fillKmerPositionArray<Parameters::DBTYPE_NUCLEOTIDES, T>(hashSeqPair, totalKmers, seqDbr, par, subMat, true, hashStartRange, hashEndRange, NULL);
+        selectedKmers = ret.first;
+        if(ret.first > totalKmers){
+            delete [] hashSeqPair;
+            return NULL;
+        }
         elementsToSort = ret.first;
         par.kmerSize = ret.second;
         Debug(Debug::INFO) << "\nAdjusted k-mer length " << par.kmerSize << "\n";
     }else{
         std::pair<size_t, size_t > ret = fillKmerPositionArray<Parameters::DBTYPE_AMINO_ACIDS, T>(hashSeqPair, totalKmers, seqDbr, par, subMat, true, hashStartRange, hashEndRange, NULL);
         elementsToSort = ret.first;
+        selectedKmers = ret.first;
     }
     if(hashEndRange == SIZE_T_MAX){
         seqDbr.unmapData();
@@ -406,9 +598,9 @@ KmerPosition<T> * doComputation(size_t totalKmers, size_t hashStartRange, size_t
     Debug(Debug::INFO) << "Sort kmer ";
     Timer timer;
     if(Parameters::isEqualDbtype(seqDbr.getDbtype(), Parameters::DBTYPE_NUCLEOTIDES)) {
-        SORT_PARALLEL(hashSeqPair, hashSeqPair + elementsToSort, KmerPosition<T>::compareRepSequenceAndIdAndPosReverse);
+        sortKmerPositions<KmerPosition<T>, true, KmerPosition<T>::compareRepSequenceAndIdAndPosReverse>(hashSeqPair, elementsToSort, par.radixSortThreads);
     }else{
-        SORT_PARALLEL(hashSeqPair, hashSeqPair + elementsToSort, KmerPosition<T>::compareRepSequenceAndIdAndPos);
+        sortKmerPositions<KmerPosition<T>, false, KmerPosition<T>::compareRepSequenceAndIdAndPos>(hashSeqPair, elementsToSort, par.radixSortThreads);
     }
     Debug(Debug::INFO) << timer.lap() << "\n";
 
@@ -425,11 +617,10 @@ KmerPosition<T> * doComputation(size_t totalKmers, size_t hashStartRange, size_t
     Debug(Debug::INFO) << "Sort by rep. sequence ";
     timer.reset();
     if(Parameters::isEqualDbtype(seqDbr.getDbtype(), Parameters::DBTYPE_NUCLEOTIDES)){
-        SORT_PARALLEL(hashSeqPair, hashSeqPair + writePos, KmerPosition<T>::compareRepSequenceAndIdAndDiagReverse);
+        sortKmerPositions<KmerPosition<T>, true, KmerPosition<T>::compareRepSequenceAndIdAndDiagReverse>(hashSeqPair, writePos, par.radixSortThreads);
     }else{
-        SORT_PARALLEL(hashSeqPair, hashSeqPair + writePos, KmerPosition<T>::compareRepSequenceAndIdAndDiag);
+        sortKmerPositions<KmerPosition<T>, false, KmerPosition<T>::compareRepSequenceAndIdAndDiag>(hashSeqPair, writePos, par.radixSortThreads);
     }
-    //kx::radix_sort(hashSeqPair, hashSeqPair + elementsToSort, SequenceComparision());
 //    for(size_t i = 0; i < writePos; i++){
 //        std::cout << BIT_CLEAR(hashSeqPair[i].kmer, 63) << "\t" << hashSeqPair[i].id << "\t" << hashSeqPair[i].pos << std::endl;
 //    }
@@ -573,17 +764,30 @@ void setLinearFilterDefault(Parameters *p) {
 }
 
 
-size_t computeKmerCount(DBReader<unsigned int> &reader, size_t KMER_SIZE, size_t chooseTopKmer, float chooseTopKmerScale) {
+size_t computeKmerCount(DBReader<unsigned int> &reader, size_t KMER_SIZE, size_t chooseTopKmer, float chooseTopKmerScale, size_t endWindow, int minimizerWindow) {
     size_t totalKmers = 0;
     for(size_t id = 0; id < reader.getSize(); id++ ){
         int seqLen = static_cast<int>(reader.getSeqLen(id));
+        // with an end window k-mers are only selected from both ends
+        if(endWindow > 0){
+            seqLen = std::min(seqLen, static_cast<int>(2 * endWindow));
+        }
         // we need one for the sequence hash
         int kmerAdjustedSeqLen = std::max(1, seqLen  - static_cast<int>(KMER_SIZE ) + 2) ;
+        // a window of w k-mers keeps about 2/(w+1) of them as minimizers. Some sequences keep
+        // more, fillKmerPositionArray reports if the estimate is exceeded.
+        if(minimizerWindow > 0){
+            int expectedMinimizers = static_cast<int>(1.5f * 2.0f * (kmerAdjustedSeqLen - 1) / (minimizerWindow + 1)) + 8;
+            totalKmers += std::min(kmerAdjustedSeqLen, expectedMinimizers + 1);
+            continue;
+        }
         totalKmers += std::min(kmerAdjustedSeqLen, static_cast<int>( chooseTopKmer + (chooseTopKmerScale * seqLen)));
     }
     return totalKmers;
 }
 
+// kmermatcherInner always stores KmerPosition<T>, CompactKmerPosition is only used by the
+// in-memory k-mer step of the nucleotide assembly
 template <typename T>
 size_t computeMemoryNeededLinearfilter(size_t totalKmer) {
     return sizeof(KmerPosition<T>) * totalKmer;
@@ -614,7 +818,8 @@ int kmermatcherInner(Parameters& par, DBReader<unsigned int>& seqDbr) {
     Debug(Debug::INFO) << "\n";
     float kmersPerSequenceScale = (Parameters::isEqualDbtype(querySeqType, Parameters::DBTYPE_NUCLEOTIDES)) ?
                                         par.kmersPerSequenceScale.nucleotides : par.kmersPerSequenceScale.aminoacids;
-    size_t totalKmers = computeKmerCount(seqDbr, par.kmerSize, par.kmersPerSequence, kmersPerSequenceScale);
+    int minimizerWindow = Parameters::isEqualDbtype(querySeqType, Parameters::DBTYPE_NUCLEOTIDES) ? par.minimizerWindow : 0;
+    size_t totalKmers = computeKmerCount(seqDbr, par.kmerSize, par.kmersPerSequence, kmersPerSequenceScale, par.kmerEndWindow, minimizerWindow);
     size_t totalSizeNeeded = computeMemoryNeededLinearfilter<T>(totalKmers);
     // compute splits
     size_t splits = static_cast<size_t>(std::ceil(static_cast<float>(totalSizeNeeded) / memoryLimit));
@@ -649,7 +854,12 @@ int kmermatcherInner(Parameters& par, DBReader<unsigned int>& seqDbr) {
 
     for(size_t split = fromSplit; split < fromSplit+splitCount; split++) {
         std::string splitFileName = par.db2 + "_split_" +SSTR(split);
-        hashSeqPair = doComputation<T>(totalKmers, hashRanges[split].first, hashRanges[split].second, splitFileName, seqDbr, par, subMat);
+        size_t selectedKmers;
+        hashSeqPair = doComputation<T>(totalKmers, hashRanges[split].first, hashRanges[split].second, splitFileName, seqDbr, par, subMat, selectedKmers);
+        if(hashSeqPair == NULL && hashRanges[split].second == SIZE_T_MAX){
+            Debug(Debug::ERROR) << "Selected " << selectedKmers << " minimizers, more than the " << totalKmers << " expected\n";
+            EXIT(EXIT_FAILURE);
+        }
     }
     MPI_Barrier(MPI_COMM_WORLD);
     if(mpiRank == 0){
@@ -665,7 +875,24 @@ int kmermatcherInner(Parameters& par, DBReader<unsigned int>& seqDbr) {
 
         std::string splitFileNameDone = splitFileName + ".done";
         if(FileUtil::fileExists(splitFileNameDone.c_str()) == false){
-            hashSeqPair = doComputation<T>(totalKmersPerSplit, hashRanges[split].first, hashRanges[split].second, splitFileName, seqDbr, par, subMat);
+            size_t selectedKmers;
+            hashSeqPair = doComputation<T>(totalKmersPerSplit, hashRanges[split].first, hashRanges[split].second, splitFileName, seqDbr, par, subMat, selectedKmers);
+            // computeKmerCount underestimated the minimizers. The splits of setupKmerSplits
+            // are sized by the exact k-mer distribution, so this only happens without splits.
+            if(hashSeqPair == NULL && hashRanges[split].second == SIZE_T_MAX){
+                Debug(Debug::INFO) << "Selected " << selectedKmers << " minimizers, more than the " << totalKmersPerSplit << " expected\n";
+                totalSizeNeeded = computeMemoryNeededLinearfilter<T>(selectedKmers);
+                splits = static_cast<size_t>(std::ceil(static_cast<float>(totalSizeNeeded) / memoryLimit));
+                totalKmersPerSplit = std::max(static_cast<size_t>(1024+1),
+                                              static_cast<size_t>(std::min(totalSizeNeeded, memoryLimit)/sizeof(KmerPosition<T>))+1);
+                hashRanges = setupKmerSplits<T>(par, subMat, seqDbr, totalKmersPerSplit, splits);
+                if(splits > 1){
+                    Debug(Debug::INFO) << "Process file into " << hashRanges.size() << " parts\n";
+                }
+                // start again with the first of the new splits
+                split = SIZE_T_MAX;
+                continue;
+            }
         }
 
         splitFiles.push_back(splitFileName);
@@ -674,8 +901,9 @@ int kmermatcherInner(Parameters& par, DBReader<unsigned int>& seqDbr) {
     if(mpiRank == 0){
         std::vector<char> repSequence(seqDbr.getLastKey()+1);
         std::fill(repSequence.begin(), repSequence.end(), false);
-        // write result
-        DBWriter dbw(par.db2.c_str(), par.db2Index.c_str(), 1, par.compressed,
+        // write result, the split merge writes its key ranges in order to the thread files
+        const unsigned int writerThreads = (splits > 1) ? static_cast<unsigned int>(par.threads) : 1;
+        DBWriter dbw(par.db2.c_str(), par.db2Index.c_str(), writerThreads, par.compressed,
                      (Parameters::isEqualDbtype(seqDbr.getDbtype(), Parameters::DBTYPE_NUCLEOTIDES)) ? Parameters::DBTYPE_PREFILTER_REV_RES : Parameters::DBTYPE_PREFILTER_RES );
         dbw.open();
 
@@ -683,9 +911,9 @@ int kmermatcherInner(Parameters& par, DBReader<unsigned int>& seqDbr) {
         if(splits > 1) {
             seqDbr.unmapData();
             if(Parameters::isEqualDbtype(seqDbr.getDbtype(), Parameters::DBTYPE_NUCLEOTIDES)) {
-                mergeKmerFilesAndOutput<Parameters::DBTYPE_NUCLEOTIDES, KmerEntryRev>(dbw, splitFiles, repSequence);
+                mergeKmerFilesAndOutput<Parameters::DBTYPE_NUCLEOTIDES, KmerEntryRev>(dbw, splitFiles, repSequence, writerThreads);
             }else{
-                mergeKmerFilesAndOutput<Parameters::DBTYPE_AMINO_ACIDS, KmerEntry>(dbw, splitFiles, repSequence);
+                mergeKmerFilesAndOutput<Parameters::DBTYPE_AMINO_ACIDS, KmerEntry>(dbw, splitFiles, repSequence, writerThreads);
             }
             for(size_t i = 0; i < splitFiles.size(); i++){
                 FileUtil::remove(splitFiles[i].c_str());
@@ -700,14 +928,10 @@ int kmermatcherInner(Parameters& par, DBReader<unsigned int>& seqDbr) {
             }
         }
         Debug(Debug::INFO) << "Time for fill: " << timer.lap() << "\n";
-        // add missing entries to the result (needed for clustering)
-
+        // add missing entries to the result (needed for clustering), behind the merged ones
 #pragma omp parallel num_threads(1)
         {
-            unsigned int thread_idx = 0;
-#ifdef OPENMP
-            thread_idx = static_cast<unsigned int>(omp_get_thread_num());
-#endif
+            unsigned int thread_idx = writerThreads - 1;
 #pragma omp for
             for (size_t id = 0; id < seqDbr.getSize(); id++) {
                 char buffer[100];
@@ -742,9 +966,9 @@ std::vector<std::pair<size_t, size_t>> setupKmerSplits(Parameters &par, BaseMatr
         size_t * hashDist = new size_t[USHRT_MAX+1];
         memset(hashDist, 0 , sizeof(size_t) * (USHRT_MAX+1));
         if(Parameters::isEqualDbtype(seqDbr.getDbtype(), Parameters::DBTYPE_NUCLEOTIDES)){
-            fillKmerPositionArray<Parameters::DBTYPE_NUCLEOTIDES, T>(NULL, SIZE_T_MAX, seqDbr, par, subMat, true, 0, SIZE_T_MAX, hashDist);
+            fillKmerPositionArray<Parameters::DBTYPE_NUCLEOTIDES, T>(static_cast<KmerPosition<T> *>(NULL), SIZE_T_MAX, seqDbr, par, subMat, true, 0, SIZE_T_MAX, hashDist);
         }else{
-            fillKmerPositionArray<Parameters::DBTYPE_AMINO_ACIDS, T>(NULL, SIZE_T_MAX, seqDbr, par, subMat, true, 0, SIZE_T_MAX, hashDist);
+            fillKmerPositionArray<Parameters::DBTYPE_AMINO_ACIDS, T>(static_cast<KmerPosition<T> *>(NULL), SIZE_T_MAX, seqDbr, par, subMat, true, 0, SIZE_T_MAX, hashDist);
         }
         seqDbr.remapData();
         // figure out if machine has enough memory to run this job
@@ -943,45 +1167,43 @@ size_t queueNextEntry(KmerPositionQueue &queue, int file, size_t offsetPos, T *e
     return offsetPos+pos;
 }
 
-template <int TYPE, typename T>
-void mergeKmerFilesAndOutput(DBWriter & dbw,
-                             std::vector<std::string> tmpFiles,
-                             std::vector<char> &repSequence) {
-    Debug(Debug::INFO) << "Merge splits ... ";
+// start of the block that contains entry pos, the blocks of a split file start with the
+// rep. sequence key and end with an UINT_MAX entry
+template <typename T>
+static size_t findKmerBlockStart(T *entries, size_t pos) {
+    while(pos > 0 && entries[pos - 1].seqId != UINT_MAX){
+        pos--;
+    }
+    return pos;
+}
 
-    const int fileCnt = tmpFiles.size();
-    FILE ** files       = new FILE*[fileCnt];
-    T **entries = new T*[fileCnt];
-    size_t * entrySizes = new size_t[fileCnt];
-    size_t * offsetPos  = new size_t[fileCnt];
-    size_t * dataSizes  = new size_t[fileCnt];
-    // init structures
-    for(size_t file = 0; file < tmpFiles.size(); file++){
-        files[file] = FileUtil::openFileOrDie(tmpFiles[file].c_str(),"r",true);
-        size_t dataSize;
-        struct stat sb;
-        fstat(fileno(files[file]) , &sb);
-        if(sb.st_size > 0){
-            entries[file]    = (T*)FileUtil::mmapFile(files[file], &dataSize);
-#if HAVE_POSIX_MADVISE
-            if (posix_madvise (entries[file], dataSize, POSIX_MADV_SEQUENTIAL) != 0){
-                Debug(Debug::ERROR) << "posix_madvise returned an error for file " << tmpFiles[file] << "\n";
-            }
-#endif
+// first block with a rep. sequence key of at least repSeqId, the blocks are sorted by key
+template <typename T>
+static size_t findFirstKmerBlock(T *entries, size_t entrySize, unsigned int repSeqId) {
+    size_t low = 0;
+    size_t high = entrySize;
+    while(low < high){
+        size_t mid = low + (high - low) / 2;
+        if(entries[findKmerBlockStart(entries, mid)].seqId < repSeqId){
+            low = mid + 1;
         }else{
-            dataSize = 0;
+            high = mid;
         }
-
-        dataSizes[file]  = dataSize;
-        entrySizes[file] = dataSize/sizeof(T);
     }
+    return low;
+}
+
+// k-way merge of the blocks between starts[file] and ends[file] of each split file
+template <int TYPE, typename T>
+static void mergeKmerFileRange(DBWriter & dbw, unsigned int thread_idx, int fileCnt, T **entries,
+                               const size_t *starts, const size_t *ends, std::vector<char> &repSequence) {
+    size_t * offsetPos  = new size_t[fileCnt];
     KmerPositionQueue queue;
     // read one entry for each file
     for(int file = 0; file < fileCnt; file++ ){
-        offsetPos[file] = queueNextEntry<TYPE,T>(queue, file, 0, entries[file], entrySizes[file]);
+        offsetPos[file] = queueNextEntry<TYPE,T>(queue, file, starts[file], entries[file], ends[file]);
     }
     std::string prefResultsOutString;
-    prefResultsOutString.reserve(100000000);
     char buffer[100];
     FileKmerPosition res;
     bool hasRepSeq =  repSequence.size()>0;
@@ -999,20 +1221,13 @@ void mergeKmerFilesAndOutput(DBWriter & dbw,
         }
     }
 
-//    while(queue.empty() == false) {
-//        res = queue.top();
-//        std::cout << (int)res.repSeq << "\t" << (int)res.id << "\t" <<(int) res.pos << "\t" << (int) res.reverse << std::endl;
-//        queue.pop();
-//        offsetPos[res.file] = queueNextEntry<TYPE,T>(queue, res.file, offsetPos[res.file],
-//                                                     entries[res.file], entrySizes[res.file]);
-//    }
     while(queue.empty() == false) {
         res = queue.top();
         queue.pop();
         if(res.id == UINT_MAX) {
             offsetPos[res.file] = queueNextEntry<TYPE,T>(queue, res.file, offsetPos[res.file],
-                                                         entries[res.file], entrySizes[res.file]);
-            dbw.writeData(prefResultsOutString.c_str(), prefResultsOutString.length(), res.repSeq, 0);
+                                                         entries[res.file], ends[res.file]);
+            dbw.writeData(prefResultsOutString.c_str(), prefResultsOutString.length(), res.repSeq, thread_idx);
             if(hasRepSeq){
                 repSequence[res.repSeq]=true;
             }
@@ -1022,7 +1237,7 @@ void mergeKmerFilesAndOutput(DBWriter & dbw,
                 res = queue.top();
                 queue.pop();
                 offsetPos[res.file] = queueNextEntry<TYPE,T>(queue, res.file, offsetPos[res.file],
-                                                             entries[res.file], entrySizes[res.file]);
+                                                             entries[res.file], ends[res.file]);
             }
             if(queue.empty() == false) {
                 res = queue.top();
@@ -1084,6 +1299,80 @@ void mergeKmerFilesAndOutput(DBWriter & dbw,
         int len = QueryMatcher::prefilterHitToBuffer(buffer, h);
         prefResultsOutString.append(buffer, len);
     }
+    delete [] offsetPos;
+}
+
+// The merge is split into key ranges of the rep. sequences, the range boundaries are found by
+// binary search in each split file. Each range is merged independently and written to the
+// thread files of dbw in key order, so dbw needs at least threads threads.
+template <int TYPE, typename T>
+void mergeKmerFilesAndOutput(DBWriter & dbw,
+                             std::vector<std::string> tmpFiles,
+                             std::vector<char> &repSequence,
+                             unsigned int threads) {
+    Debug(Debug::INFO) << "Merge splits ... ";
+
+    const int fileCnt = tmpFiles.size();
+    FILE ** files       = new FILE*[fileCnt];
+    T **entries = new T*[fileCnt];
+    size_t * entrySizes = new size_t[fileCnt];
+    size_t * dataSizes  = new size_t[fileCnt];
+    // init structures
+    for(size_t file = 0; file < tmpFiles.size(); file++){
+        files[file] = FileUtil::openFileOrDie(tmpFiles[file].c_str(),"r",true);
+        size_t dataSize;
+        struct stat sb;
+        fstat(fileno(files[file]) , &sb);
+        if(sb.st_size > 0){
+            entries[file]    = (T*)FileUtil::mmapFile(files[file], &dataSize);
+#if HAVE_POSIX_MADVISE
+            if (posix_madvise (entries[file], dataSize, POSIX_MADV_SEQUENTIAL) != 0){
+                Debug(Debug::ERROR) << "posix_madvise returned an error for file " << tmpFiles[file] << "\n";
+            }
+#endif
+        }else{
+            entries[file] = NULL;
+            dataSize = 0;
+        }
+
+        dataSizes[file]  = dataSize;
+        entrySizes[file] = dataSize/sizeof(T);
+    }
+
+    // the rep. sequences are spread over all split files alike, the boundary keys are
+    // sampled from the largest one
+    int largestFile = 0;
+    for(int file = 1; file < fileCnt; file++){
+        if(entrySizes[file] > entrySizes[largestFile]){
+            largestFile = file;
+        }
+    }
+    std::vector<unsigned int> boundaries;
+    for(size_t range = 1; range < threads && entrySizes[largestFile] > 0; range++){
+        size_t pos = findKmerBlockStart(entries[largestFile], (entrySizes[largestFile] * range) / threads);
+        unsigned int repSeqId = entries[largestFile][pos].seqId;
+        if(repSeqId > entries[largestFile][0].seqId && (boundaries.empty() || repSeqId > boundaries.back())){
+            boundaries.push_back(repSeqId);
+        }
+    }
+    const size_t rangeCnt = boundaries.size() + 1;
+    // rangeStarts[range * fileCnt + file], the last range ends at the end of the file
+    std::vector<size_t> rangeStarts((rangeCnt + 1) * fileCnt);
+    for(int file = 0; file < fileCnt; file++){
+        rangeStarts[file] = 0;
+        for(size_t range = 1; range < rangeCnt; range++){
+            rangeStarts[range * fileCnt + file] = findFirstKmerBlock(entries[file], entrySizes[file], boundaries[range - 1]);
+        }
+        rangeStarts[rangeCnt * fileCnt + file] = entrySizes[file];
+    }
+
+#pragma omp parallel for schedule(dynamic, 1)
+    for(size_t range = 0; range < rangeCnt; range++){
+        // writes of different ranges go to different keys of repSequence
+        mergeKmerFileRange<TYPE, T>(dbw, static_cast<unsigned int>(range), fileCnt, entries,
+                                    &rangeStarts[range * fileCnt], &rangeStarts[(range + 1) * fileCnt], repSequence);
+    }
+
     for(size_t file = 0; file < tmpFiles.size(); file++) {
         if (fclose(files[file]) != 0) {
             Debug(Debug::ERROR) << "Cannot close file " << tmpFiles[file] << "\n";
@@ -1097,7 +1386,6 @@ void mergeKmerFilesAndOutput(DBWriter & dbw,
 
 
     delete [] dataSizes;
-    delete [] offsetPos;
     delete [] entries;
     delete [] entrySizes;
     delete [] files;
@@ -1181,8 +1469,11 @@ void writeKmersToDisk(std::string tmpFile, KmerPosition<seqLenType> *hashSeqPair
         lastTargetId = targetId;
         writeSets++;
     }
-    if (writeSets > 0 && elemenetCnt > 0 && bufferPos > 0) {
-        fwrite(writeBuffer, sizeof(T), bufferPos, filePtr);
+    // the last block also needs its UINT_MAX entry if the buffer was just flushed
+    if (writeSets > 0 && elemenetCnt > 0) {
+        if(bufferPos > 0){
+            fwrite(writeBuffer, sizeof(T), bufferPos, filePtr);
+        }
         fwrite(&nullEntry,  sizeof(T), 1, filePtr);
     }
     if (fclose(filePtr) != 0) {
@@ -1240,9 +1531,15 @@ template std::pair<size_t, size_t>  fillKmerPositionArray<1, int>(KmerPosition <
 template std::pair<size_t, size_t>  fillKmerPositionArray<2, int>(KmerPosition< int> * kmerArray, size_t kmerArraySize, DBReader<unsigned int> &seqDbr,
                                                                   Parameters & par, BaseMatrix * subMat, bool hashWholeSequence, size_t hashStartRange, size_t hashEndRange, size_t * hashDistribution);
 
+template std::pair<size_t, size_t>  fillKmerPositionArray<1, short>(CompactKmerPosition * kmerArray, size_t kmerArraySize, DBReader<unsigned int> &seqDbr,
+                                                                    Parameters & par, BaseMatrix * subMat, bool hashWholeSequence, size_t hashStartRange, size_t hashEndRange, size_t * hashDistribution);
+
 template KmerPosition<short> *initKmerPositionMemory(size_t size);
 template KmerPosition<int> *initKmerPositionMemory(size_t size);
 
+template int kmermatcherInner<short>(Parameters& par, DBReader<unsigned int>& seqDbr);
+template int kmermatcherInner<int>(Parameters& par, DBReader<unsigned int>& seqDbr);
+
 template size_t computeMemoryNeededLinearfilter<short>(size_t totalKmer);
 template size_t computeMemoryNeededLinearfilter<int>(size_t totalKmer);
 
@@ -5,6 +5,7 @@
 #include "Parameters.h"
 #include "BaseMatrix.h"
 
+#include <cstdint>
 #include <queue>
 
 struct SequencePosition{
@@ -130,7 +131,68 @@ struct __attribute__((__packed__))KmerPosition {
     }
 };
 
+// 12 byte variant of KmerPosition<short> for nucleotide k-mers of up to MAX_KMER_SIZE
+// residues. The kmer keeps its lower 46 bits, the strand bit 63 is stored as bit 47 and
+// SIZE_MAX as all 48 bits set, so getKmer() returns what a KmerPosition would hold.
+// Only the hash of the whole sequence loses its upper bits. seqLen is not stored, the
+// caller has to look it up by id.
+struct __attribute__((__packed__)) CompactKmerPosition {
+    unsigned int kmerLow;
+    unsigned short kmerHigh;
+    unsigned int id;
+    short pos;
+
+    static const int MAX_KMER_SIZE = 23;
+
+    CompactKmerPosition() = default;
+    explicit CompactKmerPosition(const KmerPosition<short> &kmer) : id(kmer.id), pos(kmer.pos) {
+        setKmer(kmer.kmer);
+    }
+
+    size_t getKmer() const {
+        size_t value = (static_cast<size_t>(kmerHigh) << 32) | kmerLow;
+        if (value == ALL_BITS) {
+            return SIZE_MAX;
+        }
+        size_t kmer = value & KMER_BITS;
+        return BIT_CHECK(value, 47) ? BIT_SET(kmer, 63) : kmer;
+    }
+
+    void setKmer(size_t kmer) {
+        size_t value = ALL_BITS;
+        if (kmer != SIZE_MAX) {
+            value = BIT_CHECK(kmer, 63) ? BIT_SET(kmer & KMER_BITS, 47) : (kmer & KMER_BITS);
+        }
+        kmerLow = static_cast<unsigned int>(value);
+        kmerHigh = static_cast<unsigned short>(value >> 32);
+    }
 
+    // same order as KmerPosition<T>::compareRepSequenceAndIdAndDiagReverse
+    static bool compareKmerAndIdAndPosReverse(const CompactKmerPosition &first, const CompactKmerPosition &second) {
+        size_t firstKmer  = BIT_SET(first.getKmer(), 63);
+        size_t secondKmer = BIT_SET(second.getKmer(), 63);
+        if (firstKmer != secondKmer) {
+            return firstKmer < secondKmer;
+        }
+        if (first.id != second.id) {
+            return first.id < second.id;
+        }
+        return first.pos < second.pos;
+    }
+
+private:
+    static const size_t KMER_BITS = (1ULL << 46) - 1;
+    static const size_t ALL_BITS = (1ULL << 48) - 1;
+};
+
+template <typename T>
+inline size_t getKmer(const KmerPosition<T> &kmer) {
+    return kmer.kmer;
+}
+
+inline size_t getKmer(const CompactKmerPosition &kmer) {
+    return kmer.getKmer();
+}
 
 struct __attribute__((__packed__)) KmerEntry {
     unsigned int seqId;
@@ -196,7 +258,7 @@ template  <int TYPE, typename T>
 size_t assignGroup(KmerPosition<T> *kmers, size_t splitKmerCount, bool includeOnlyExtendable, int covMode, float covThr);
 
 template <int TYPE, typename T>
-void mergeKmerFilesAndOutput(DBWriter & dbw, std::vector<std::string> tmpFiles, std::vector<char> &repSequence);
+void mergeKmerFilesAndOutput(DBWriter & dbw, std::vector<std::string> tmpFiles, std::vector<char> &repSequence, unsigned int threads);
 
 typedef std::priority_queue<FileKmerPosition, std::vector<FileKmerPosition>, CompareResultBySeqId> KmerPositionQueue;
 
@@ -220,8 +282,13 @@ KmerPosition<T> * doComputation(size_t totalKmers, size_t split, size_t splits,
 template <typename T>
 KmerPosition<T> *initKmerPositionMemory(size_t size);
 
-template <int TYPE, typename T>
-std::pair<size_t, size_t>  fillKmerPositionArray(KmerPosition<T> * kmerArray, size_t kmerArraySize, DBReader<unsigned int> &seqDbr,
+template <typename T>
+int kmermatcherInner(Parameters& par, DBReader<unsigned int>& seqDbr);
+
+// returns the number of selected k-mers and the longest adjusted k-mer length. With
+// --minimizer-window the number can exceed kmerArraySize - 1, the array is incomplete then.
+template <int TYPE, typename T, typename KmerType = KmerPosition<T> >
+std::pair<size_t, size_t>  fillKmerPositionArray(KmerType * kmerArray, size_t kmerArraySize, DBReader<unsigned int> &seqDbr,
                                                  Parameters & par, BaseMatrix * subMat, bool hashWholeSequence,
                                                  size_t hashStartRange, size_t hashEndRange, size_t * hashDistribution);
 
@@ -236,7 +303,7 @@ template <typename T>
 std::vector<std::pair<size_t, size_t>> setupKmerSplits(Parameters &par, BaseMatrix * subMat, DBReader<unsigned int> &seqDbr, size_t totalKmers, size_t splits);
 
 size_t computeKmerCount(DBReader<unsigned int> &reader, size_t KMER_SIZE, size_t chooseTopKmer,
-                        float chooseTopKmerScale = 0.0);
+                        float chooseTopKmerScale = 0.0, size_t endWindow = 0, int minimizerWindow = 0);
 
 void setLinearFilterDefault(Parameters *p);
 
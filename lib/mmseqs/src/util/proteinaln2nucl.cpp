@@ -10,10 +10,8 @@
 #include <omp.h>
 #endif
 
-int proteinaln2nucl(int argc, const char **argv, const Command &command) {
-    Parameters &par = Parameters::getInstance();
-    par.parseParameters(argc, argv, command, true, 0, 0);
-
+// proteinaln2nucl on the databases of the already parsed par
+int proteinaln2nucl(Parameters &par) {
     DBReader<unsigned int> qdbr_nuc(par.db1.c_str(), par.db1Index.c_str(), par.threads, DBReader<unsigned int>::USE_INDEX | DBReader<unsigned int>::USE_DATA);
     qdbr_nuc.open(DBReader<unsigned int>::NOSORT);
     qdbr_nuc.readMmapedDataInMemory();
@@ -203,3 +201,10 @@ int proteinaln2nucl(int argc, const char **argv, const Command &command) {
     return EXIT_SUCCESS;
 }
 
+int proteinaln2nucl(int argc, const char **argv, const Command &command) {
+    Parameters &par = Parameters::getInstance();
+    par.parseParameters(argc, argv, command, true, 0, 0);
+
+    return proteinaln2nucl(par);
+}
+
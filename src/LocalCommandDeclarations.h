@@ -10,9 +10,15 @@ extern int guidedNuclAssemble(int argc, const char** argv, const Command &comman
 extern int assembleresult(int argc, const char** argv, const Command &command);
 extern int guidedassembleresults(int argc, const char** argv, const Command &command);
 extern int nuclassembleresult(int argc, const char** argv, const Command &command);
+extern int assembleiterate(int argc, const char** argv, const Command &command);
+extern int extensionrescorediagonal(int argc, const char** argv, const Command &command);
 extern int filternoncoding(int argc, const char** argv, const Command &command);
 extern int mergereads(int argc, const char** argv, const Command &command);
 extern int findassemblystart(int argc, const char** argv, const Command &command);
 extern int cyclecheck(int argc, const char** argv, const Command &command);
 extern int createhdb(int argc, const char** argv, const Command &command);
+extern int extractstartlongorfs(int argc, const char** argv, const Command &command);
+extern int selectassembled(int argc, const char** argv, const Command &command);
+extern int collapseduplicates(int argc, const char** argv, const Command &command);
+extern int normalizereads(int argc, const char** argv, const Command &command);
 #endif
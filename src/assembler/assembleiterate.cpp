@@ -0,0 +1,887 @@
+/*
+ * Runs all iterations of the nucleotide assembly (kmermatcher, rescorediagonal,
+ * nuclassembleresults and cyclecheck) in one process. Contigs, prefilter and
+ * alignment results of an iteration are kept in memory and only the final
+ * contigs are written. The k-mer matching is done on disk instead if the
+ * k-mer array and the contigs together do not fit into --split-memory-limit.
+ *
+ * For k-mers of up to 23 residues the in-memory k-mer array uses the 12 byte
+ * CompactKmerPosition, so a third more k-mers fit before the disk fallback. The
+ * disk fallback itself (kmermatcherInner) still stores and sizes its splits by
+ * the 16 or 20 byte KmerPosition.
+ *
+ * Most contigs are not extended in an iteration. Their k-mers are kept from the
+ * previous iteration and only the k-mers of changed contigs are extracted again.
+ *
+ * The iterations stop early once an iteration extends less than
+ * --min-extension-yield of the sequences or after --max-assembly-time seconds.
+ * With --kmer-window-scale only the k-mers near both contig ends are selected.
+ * With --drop-contained, sequences that are covered by a longer one are not
+ * passed on to the next iteration and are collected in <contigDB>_contained.
+ * With --max-extension-hits the alignment result of a query keeps only the hits
+ * nuclassembleresults would extend with first on each side of the query.
+ */
+
+#include "LocalParameters.h"
+#include "AssemblySteps.h"
+#include "InMemoryDB.h"
+#include "DBReader.h"
+#include "DBWriter.h"
+#include "Debug.h"
+#include "DiagonalRescorer.h"
+#include "ExtensionHitSelection.h"
+#include "EvalueComputation.h"
+#include "FastSort.h"
+#include "FileUtil.h"
+#include "Matcher.h"
+#include "NucleotideMatrix.h"
+#include "QueryMatcher.h"
+#include "ResourceProfile.h"
+#include "StripedSmithWaterman.h"
+#include "Timer.h"
+#include "Util.h"
+#include "kmermatcher.h"
+#include "KmerRadixSort.h"
+
+#include <algorithm>
+#include <cmath>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <vector>
+
+#ifdef OPENMP
+#include <omp.h>
+#endif
+
+// same grouping as writeKmerMatcherResult in kmermatcher for a single split
+template <typename T, typename Kmer>
+void writeKmerMatches(InMemoryDB &prefDb, Kmer *hashSeqPair, size_t totalKmers,
+                      DBReader<unsigned int> *seqDbr) {
+    std::vector<char> repSequence(seqDbr->getLastKey() + 1, false);
+    std::string prefResultsOutString;
+    char buffer[100];
+    size_t lastTargetId = SIZE_MAX;
+    unsigned int writeSets = 0;
+    size_t repSeqId = SIZE_MAX;
+    for (size_t kmerPos = 0; kmerPos < totalKmers && getKmer(hashSeqPair[kmerPos]) != SIZE_MAX; kmerPos++) {
+        size_t currKmer = getKmer(hashSeqPair[kmerPos]);
+        int reverMask = BIT_CHECK(currKmer, 63) == false;
+        currKmer = BIT_CLEAR(currKmer, 63);
+        if (repSeqId != currKmer) {
+            if (writeSets > 0) {
+                repSequence[repSeqId] = true;
+                prefDb.writeData(prefResultsOutString.c_str(), prefResultsOutString.length(), repSeqId, 0);
+            } else if (repSeqId != SIZE_MAX) {
+                repSequence[repSeqId] = false;
+            }
+            lastTargetId = SIZE_MAX;
+            prefResultsOutString.clear();
+            repSeqId = currKmer;
+            hit_t h;
+            h.seqId = repSeqId;
+            h.prefScore = 0;
+            h.diagonal = 0;
+            int len = QueryMatcher::prefilterHitToBuffer(buffer, h);
+            prefResultsOutString.append(buffer, len);
+        }
+        unsigned int targetId = hashSeqPair[kmerPos].id;
+        T diagonal = hashSeqPair[kmerPos].pos;
+        size_t kmerOffset = 0;
+        T prevDiagonal = diagonal;
+        size_t maxDiagonal = 0;
+        size_t diagonalCnt = 0;
+        size_t topScore = 0;
+        int bestReverMask = reverMask;
+        // compute best diagonal and score for every group of target sequences
+        while (lastTargetId != targetId
+               && kmerPos + kmerOffset < totalKmers
+               && hashSeqPair[kmerPos + kmerOffset].id == targetId) {
+            if (prevDiagonal == hashSeqPair[kmerPos + kmerOffset].pos) {
+                diagonalCnt++;
+            } else {
+                diagonalCnt = 1;
+            }
+            if (diagonalCnt >= maxDiagonal) {
+                diagonal = hashSeqPair[kmerPos + kmerOffset].pos;
+                maxDiagonal = diagonalCnt;
+                bestReverMask = BIT_CHECK(getKmer(hashSeqPair[kmerPos + kmerOffset]), 63) == false;
+            }
+            prevDiagonal = hashSeqPair[kmerPos + kmerOffset].pos;
+            kmerOffset++;
+            topScore++;
+        }
+        // remove similar double sequence hit
+        if (targetId == repSeqId || lastTargetId == targetId) {
+            lastTargetId = targetId;
+            continue;
+        }
+        hit_t h;
+        h.seqId = targetId;
+        h.prefScore = (bestReverMask) ? -topScore : topScore;
+        h.diagonal = diagonal;
+        int len = QueryMatcher::prefilterHitToBuffer(buffer, h);
+        prefResultsOutString.append(buffer, len);
+        lastTargetId = targetId;
+        writeSets++;
+    }
+    if (writeSets > 0) {
+        repSequence[repSeqId] = true;
+        prefDb.writeData(prefResultsOutString.c_str(), prefResultsOutString.length(), repSeqId, 0);
+    } else if (repSeqId != SIZE_MAX) {
+        repSequence[repSeqId] = false;
+    }
+
+    // kmermatcher reports every sequence without matches with a self hit
+    for (size_t id = 0; id < seqDbr->getSize(); id++) {
+        unsigned int dbKey = seqDbr->getDbKey(id);
+        if (repSequence[dbKey] == false) {
+            hit_t h;
+            h.prefScore = 0;
+            h.diagonal = 0;
+            h.seqId = dbKey;
+            int len = QueryMatcher::prefilterHitToBuffer(buffer, h);
+            prefDb.writeData(buffer, len, dbKey, 0);
+        }
+    }
+}
+
+// How matchKmersInMemory stores the k-mers of an iteration. KmerPositions keeps them as
+// KmerPosition<T> with the key of the sequence as id.
+template <typename T>
+struct KmerPositions {
+    typedef T PosType;
+    typedef KmerPosition<T> Kmer;
+
+    explicit KmerPositions(DBReader<unsigned int> *) {}
+
+    static size_t memoryNeeded(DBReader<unsigned int> *, size_t totalKmers) {
+        return computeMemoryNeededLinearfilter<T>(totalKmers);
+    }
+
+    static Kmer *allocate(size_t size) {
+        return initKmerPositionMemory<T>(size);
+    }
+
+    static bool compare(const Kmer &first, const Kmer &second) {
+        return Kmer::compareRepSequenceAndIdAndPosReverse(first, second);
+    }
+
+    size_t fill(LocalParameters &par, DBReader<unsigned int> &seqDbr, BaseMatrix *subMat, Kmer *kmers, size_t size) const {
+        std::pair<size_t, size_t> ret = fillKmerPositionArray<Parameters::DBTYPE_NUCLEOTIDES, T>(
+                kmers, size, seqDbr, par, subMat, true, 0, SIZE_MAX, NULL);
+        return ret.first;
+    }
+
+    void sort(LocalParameters &par, Kmer *kmers, size_t count) const {
+        sortKmerPositions<Kmer, true, Kmer::compareRepSequenceAndIdAndPosReverse>(kmers, count, par.radixSortThreads);
+    }
+
+    void idsToKeys(Kmer *, size_t) const {}
+
+    void idsToRanks(Kmer *, size_t) const {}
+
+    // kmers has to end with an entry of SIZE_MAX
+    size_t assignGroups(LocalParameters &par, Kmer *kmers, size_t count) const {
+        return assignGroup<Parameters::DBTYPE_NUCLEOTIDES, T>(kmers, count, par.includeOnlyExtendable, par.covMode, par.covThr);
+    }
+
+    void sortGroups(LocalParameters &par, Kmer *kmers, size_t count) const {
+        sortKmerPositions<Kmer, true, Kmer::compareRepSequenceAndIdAndDiagReverse>(kmers, count, par.radixSortThreads);
+    }
+};
+
+// CompactKmerPositions keeps them in 12 instead of 16 bytes, for sequences shorter than
+// SHRT_MAX and k-mers of up to CompactKmerPosition::MAX_KMER_SIZE. While the k-mers are
+// sorted and grouped, the id is the rank of the sequence ordered by decreasing length and
+// then by key, which is how compareRepSequenceAndIdAndPosReverse breaks ties. So the
+// order does not need the sequence length and assignGroup looks it up by rank.
+struct CompactKmerPositions {
+    typedef short PosType;
+    typedef CompactKmerPosition Kmer;
+
+    explicit CompactKmerPositions(DBReader<unsigned int> *seqDbr) {
+        std::vector<unsigned int> ids(seqDbr->getSize());
+        for (size_t id = 0; id < ids.size(); id++) {
+            ids[id] = static_cast<unsigned int>(id);
+        }
+        std::sort(ids.begin(), ids.end(), [&](unsigned int first, unsigned int second) {
+            size_t firstLen = seqDbr->getSeqLen(first);
+            size_t secondLen = seqDbr->getSeqLen(second);
+            if (firstLen != secondLen) {
+                return firstLen > secondLen;
+            }
+            return seqDbr->getDbKey(first) < seqDbr->getDbKey(second);
+        });
+        rankOfKey.resize(seqDbr->getLastKey() + 1, UINT_MAX);
+        keyOfRank.resize(ids.size());
+        lengthOfRank.resize(ids.size());
+        for (size_t rank = 0; rank < ids.size(); rank++) {
+            unsigned int key = seqDbr->getDbKey(ids[rank]);
+            rankOfKey[key] = static_cast<unsigned int>(rank);
+            keyOfRank[rank] = key;
+            lengthOfRank[rank] = static_cast<short>(seqDbr->getSeqLen(ids[rank]));
+        }
+    }
+
+    static size_t memoryNeeded(DBReader<unsigned int> *seqDbr, size_t totalKmers) {
+        return sizeof(Kmer) * totalKmers + sizeof(unsigned int) * (seqDbr->getLastKey() + 1)
+               + (sizeof(unsigned int) + sizeof(short)) * seqDbr->getSize();
+    }
+
+    static Kmer *allocate(size_t size) {
+        Kmer *kmers = new(std::nothrow) Kmer[size + 1];
+        Util::checkAllocation(kmers, "Can not allocate memory");
+        memset(kmers, 0xFF, sizeof(Kmer) * (size + 1));
+        return kmers;
+    }
+
+    static bool compare(const Kmer &first, const Kmer &second) {
+        return Kmer::compareKmerAndIdAndPosReverse(first, second);
+    }
+
+    size_t fill(LocalParameters &par, DBReader<unsigned int> &seqDbr, BaseMatrix *subMat, Kmer *kmers, size_t size) const {
+        std::pair<size_t, size_t> ret = fillKmerPositionArray<Parameters::DBTYPE_NUCLEOTIDES, short>(
+                kmers, size, seqDbr, par, subMat, true, 0, SIZE_MAX, NULL);
+        // an incomplete array is extracted again
+        if (ret.first <= size) {
+            idsToRanks(kmers, ret.first);
+        }
+        return ret.first;
+    }
+
+    void sort(LocalParameters &par, Kmer *kmers, size_t count) const {
+        sortKmerPositions<Kmer, true, Kmer::compareKmerAndIdAndPosReverse>(kmers, count, par.radixSortThreads);
+    }
+
+    void idsToKeys(Kmer *kmers, size_t count) const {
+#pragma omp parallel for schedule(static)
+        for (size_t i = 0; i < count; i++) {
+            kmers[i].id = keyOfRank[kmers[i].id];
+        }
+    }
+
+    void idsToRanks(Kmer *kmers, size_t count) const {
+#pragma omp parallel for schedule(static)
+        for (size_t i = 0; i < count; i++) {
+            kmers[i].id = rankOfKey[kmers[i].id];
+        }
+    }
+
+    // expands chunks of whole groups of equal k-mers to KmerPosition<short> for
+    // assignGroup and compacts its result, which is never longer than the chunk, in place.
+    // assignGroup takes the strand of the first rep. sequence in an array as forward, so
+    // every chunk but the first starts with a single k-mer, which assignGroup drops, to
+    // group exactly like one call over the whole array.
+    size_t assignGroups(LocalParameters &par, Kmer *kmers, size_t count) const {
+        const size_t chunkSize = 65536;
+        std::vector<KmerPosition<short>> chunk;
+        size_t writePos = 0;
+        size_t start = 0;
+        while (start < count) {
+            chunk.clear();
+            if (start > 0) {
+                KmerPosition<short> single;
+                single.kmer = (BIT_SET(kmers[start].getKmer(), 63) == BIT_SET(0, 63)) ? 1 : 0;
+                single.id = 0;
+                single.seqLen = 0;
+                single.pos = 0;
+                chunk.push_back(single);
+            }
+            size_t end = start;
+            while (end < count && (end == start || chunk.size() < chunkSize)) {
+                const size_t kmer = BIT_SET(kmers[end].getKmer(), 63);
+                do {
+                    KmerPosition<short> entry;
+                    entry.kmer = kmers[end].getKmer();
+                    entry.id = kmers[end].id;
+                    entry.seqLen = lengthOfRank[kmers[end].id];
+                    entry.pos = kmers[end].pos;
+                    chunk.push_back(entry);
+                    end++;
+                } while (end < count && BIT_SET(kmers[end].getKmer(), 63) == kmer);
+            }
+            KmerPosition<short> last;
+            last.kmer = SIZE_MAX;
+            chunk.push_back(last);
+            size_t chunkCount = assignGroup<Parameters::DBTYPE_NUCLEOTIDES, short>(
+                    chunk.data(), chunk.size() - 1, par.includeOnlyExtendable, par.covMode, par.covThr);
+            for (size_t i = 0; i < chunkCount; i++) {
+                kmers[writePos++] = CompactKmerPosition(chunk[i]);
+            }
+            start = end;
+        }
+        return writePos;
+    }
+
+    // the rep. sequences and ids are keys again afterwards
+    void sortGroups(LocalParameters &par, Kmer *kmers, size_t count) const {
+#pragma omp parallel for schedule(static)
+        for (size_t i = 0; i < count; i++) {
+            size_t repSeq = kmers[i].getKmer();
+            size_t repKey = keyOfRank[BIT_CLEAR(repSeq, 63)];
+            kmers[i].setKmer(BIT_CHECK(repSeq, 63) ? BIT_SET(repKey, 63) : repKey);
+            kmers[i].id = keyOfRank[kmers[i].id];
+        }
+        sortKmerPositions<Kmer, true, Kmer::compareKmerAndIdAndPosReverse>(kmers, count, par.radixSortThreads);
+    }
+
+    std::vector<unsigned int> rankOfKey;
+    std::vector<unsigned int> keyOfRank;
+    std::vector<short> lengthOfRank;
+};
+
+// Sorted k-mer array of the previous iteration before assignGroup, with keys as ids. The
+// k-mers of a sequence only depend on the sequence itself, so the entries of unchanged
+// sequences can be merged with the k-mers of the changed ones.
+template <typename Kmer>
+struct KmerCache {
+    Kmer *kmers;
+    size_t count;
+    int kmerSize;
+
+    KmerCache() : kmers(NULL), count(0), kmerSize(0) {}
+    ~KmerCache() {
+        clear();
+    }
+
+    KmerCache(const KmerCache &) = delete;
+    KmerCache &operator=(const KmerCache &) = delete;
+
+    void clear() {
+        delete[] kmers;
+        kmers = NULL;
+        count = 0;
+    }
+
+    bool isValid(int currKmerSize) const {
+        return kmers != NULL && kmerSize == currKmerSize;
+    }
+};
+
+// extracts the k-mers of seqDbr into a new array of the layout. With --minimizer-window
+// computeKmerCount only estimates their number, if more are selected they are extracted
+// again into an array of their exact number. Returns NULL if that exceeds maxKmers.
+template <typename Layout>
+typename Layout::Kmer *extractKmers(LocalParameters &par, DBReader<unsigned int> &seqDbr, BaseMatrix *subMat,
+                                    const Layout &layout, size_t expectedKmers, size_t maxKmers, size_t &count) {
+    size_t arraySize = std::max(static_cast<size_t>(1024 + 1), expectedKmers + 1);
+    typename Layout::Kmer *kmers = Layout::allocate(arraySize);
+    count = layout.fill(par, seqDbr, subMat, kmers, arraySize);
+    if (count > arraySize) {
+        Debug(Debug::INFO) << "Selected " << count << " minimizers, more than the " << expectedKmers << " expected\n";
+        delete[] kmers;
+        if (count > maxKmers) {
+            return NULL;
+        }
+        arraySize = count;
+        kmers = Layout::allocate(arraySize);
+        count = layout.fill(par, seqDbr, subMat, kmers, arraySize);
+    }
+    return kmers;
+}
+
+// extracts the k-mers of the sequences in seqDbr that are not marked as unchanged and
+// merges them with the cached k-mers of the unchanged ones into a new sorted array.
+// Returns NULL if the merged array would exceed maxKmers.
+template <typename Layout>
+typename Layout::Kmer *mergeKmersWithCache(LocalParameters &par, DBReader<unsigned int> *seqDbr, BaseMatrix *subMat,
+                                           const Layout &layout, KmerCache<typename Layout::Kmer> &cache,
+                                           const std::vector<char> &unchanged, size_t maxKmers, size_t &count) {
+    typedef typename Layout::Kmer Kmer;
+    const unsigned int lastKey = seqDbr->getLastKey();
+    Kmer *cacheEnd = std::remove_if(cache.kmers, cache.kmers + cache.count,
+                                    [&](const Kmer &kmer) {
+                                        return kmer.id > lastKey || unchanged[kmer.id] == false;
+                                    });
+    cache.count = cacheEnd - cache.kmers;
+    // the order of the unchanged sequences among themselves stays the same
+    layout.idsToRanks(cache.kmers, cache.count);
+
+    InMemoryDB changedDb(par.threads, seqDbr->getDbtype());
+#pragma omp parallel
+    {
+        unsigned int thread_idx = 0;
+#ifdef OPENMP
+        thread_idx = (unsigned int) omp_get_thread_num();
+#endif
+#pragma omp for schedule(static)
+        for (size_t id = 0; id < seqDbr->getSize(); id++) {
+            unsigned int key = seqDbr->getDbKey(id);
+            if (unchanged[key] == false) {
+                changedDb.writeData(seqDbr->getData(id, thread_idx), seqDbr->getEntryLen(id) - 1, key, thread_idx);
+            }
+        }
+    }
+    changedDb.close();
+    DBReader<unsigned int> *changedDbr = changedDb.getReader();
+    Debug(Debug::INFO) << "Extract k-mers of " << changedDbr->getSize() << " changed sequences\n";
+
+    size_t changedKmers = computeKmerCount(*changedDbr, par.kmerSize, par.kmersPerSequence,
+                                           par.kmersPerSequenceScale.nucleotides, par.kmerEndWindow, par.minimizerWindow);
+    size_t changedCount;
+    Kmer *changedSeqPair = extractKmers(par, *changedDbr, subMat, layout, changedKmers,
+                                        maxKmers - std::min(cache.count, maxKmers), changedCount);
+    if (changedSeqPair == NULL) {
+        return NULL;
+    }
+    layout.sort(par, changedSeqPair, changedCount);
+
+    count = cache.count + changedCount;
+    Kmer *hashSeqPair = Layout::allocate(std::max(static_cast<size_t>(1024 + 1), count + 1));
+    std::merge(cache.kmers, cache.kmers + cache.count, changedSeqPair, changedSeqPair + changedCount,
+               hashSeqPair, Layout::compare);
+    delete[] changedSeqPair;
+    return hashSeqPair;
+}
+
+// returns NULL if the k-mer array and the sequences do not fit into the memory limit.
+// unchanged marks the keys of seqDbr that did not change since cache was filled.
+template <typename Layout>
+InMemoryDB *matchKmersInMemory(LocalParameters &par, DBReader<unsigned int> *seqDbr, BaseMatrix *subMat,
+                               size_t sequenceMemory, KmerCache<typename Layout::Kmer> &cache,
+                               const std::vector<char> &unchanged) {
+    typedef typename Layout::Kmer Kmer;
+    size_t memoryLimit = Util::computeMemory(par.splitMemoryLimit);
+    size_t totalKmers = computeKmerCount(*seqDbr, par.kmerSize, par.kmersPerSequence,
+                                         par.kmersPerSequenceScale.nucleotides, par.kmerEndWindow, par.minimizerWindow);
+    size_t totalSizeNeeded = Layout::memoryNeeded(seqDbr, totalKmers);
+    if (totalSizeNeeded + sequenceMemory > memoryLimit) {
+        cache.clear();
+        return NULL;
+    }
+
+    // the largest k-mer array that fits next to the sequences
+    size_t maxKmers = (memoryLimit - sequenceMemory - Layout::memoryNeeded(seqDbr, 0)) / sizeof(Kmer);
+
+    Layout layout(seqDbr);
+    Kmer *hashSeqPair;
+    size_t elementsToSort;
+    if (cache.isValid(par.kmerSize) && unchanged.empty() == false) {
+        hashSeqPair = mergeKmersWithCache<Layout>(par, seqDbr, subMat, layout, cache, unchanged, maxKmers, elementsToSort);
+    } else {
+        hashSeqPair = extractKmers(par, *seqDbr, subMat, layout, totalKmers, maxKmers, elementsToSort);
+        if (hashSeqPair != NULL) {
+            layout.sort(par, hashSeqPair, elementsToSort);
+        }
+    }
+    if (hashSeqPair == NULL) {
+        cache.clear();
+        return NULL;
+    }
+    totalSizeNeeded = std::max(totalSizeNeeded, Layout::memoryNeeded(seqDbr, elementsToSort));
+
+    // assignGroup overwrites the array, keep a copy if both fit into memory
+    cache.clear();
+    if (2 * totalSizeNeeded + sequenceMemory <= memoryLimit) {
+        cache.kmers = new(std::nothrow) Kmer[std::max(elementsToSort, static_cast<size_t>(1))];
+        Util::checkAllocation(cache.kmers, "Cannot allocate k-mer cache");
+        memcpy(cache.kmers, hashSeqPair, elementsToSort * sizeof(Kmer));
+        layout.idsToKeys(cache.kmers, elementsToSort);
+        cache.count = elementsToSort;
+        cache.kmerSize = par.kmerSize;
+    }
+
+    size_t writePos = layout.assignGroups(par, hashSeqPair, elementsToSort);
+    layout.sortGroups(par, hashSeqPair, writePos);
+
+    InMemoryDB *prefDb = new InMemoryDB(par.threads, Parameters::DBTYPE_PREFILTER_REV_RES);
+    writeKmerMatches<typename Layout::PosType>(*prefDb, hashSeqPair, writePos, seqDbr);
+    delete[] hashSeqPair;
+    prefDb->close();
+    return prefDb;
+}
+
+template <typename T>
+void matchKmersOnDisk(LocalParameters &par, DBReader<unsigned int> *seqDbr, const std::string &prefDbName) {
+    std::string outDb = par.db2;
+    std::string outDbIndex = par.db2Index;
+    par.db2 = prefDbName;
+    par.db2Index = prefDbName + ".index";
+    kmermatcherInner<T>(par, *seqDbr);
+    par.db2 = outDb;
+    par.db2Index = outDbIndex;
+    // kmermatcher releases the sequence data after extracting the k-mers
+    seqDbr->remapData();
+}
+
+// rescorediagonal with the query and target database being the same
+void rescoreDiagonals(LocalParameters &par, DBReader<unsigned int> *seqDbr, DBReader<unsigned int> *prefReader,
+                      BaseMatrix *subMat, const SequenceCounts *counts, InMemoryDB &alnDb) {
+    ExtensionHitSelection extensionHits(par.maxExtensionHits, par.threads, true, counts);
+    DiagonalRescorer rescorer(par, seqDbr, seqDbr, subMat, true, true, 0.0f,
+                              (par.maxExtensionHits > 0) ? &extensionHits : NULL);
+
+    Debug::Progress progress(prefReader->getSize());
+#pragma omp parallel
+    {
+        unsigned int thread_idx = 0;
+#ifdef OPENMP
+        thread_idx = (unsigned int) omp_get_thread_num();
+#endif
+        DiagonalRescorer::Buffers buffers(par.maxSeqLen);
+#pragma omp for schedule(dynamic, 1)
+        for (size_t id = 0; id < prefReader->getSize(); id++) {
+            progress.updateProgress();
+            rescorer.rescoreQuery(buffers, prefReader->getData(id, thread_idx), prefReader->getDbKey(id), alnDb, thread_idx);
+        }
+    }
+}
+
+// marks the keys of next that have the same sequence in prev
+std::vector<char> findUnchanged(DBReader<unsigned int> *prev, DBReader<unsigned int> *next) {
+    std::vector<char> unchanged(next->getLastKey() + 1, false);
+#pragma omp parallel
+    {
+        unsigned int thread_idx = 0;
+#ifdef OPENMP
+        thread_idx = (unsigned int) omp_get_thread_num();
+#endif
+#pragma omp for schedule(static)
+        for (size_t id = 0; id < next->getSize(); id++) {
+            unsigned int key = next->getDbKey(id);
+            size_t prevId = prev->getId(key);
+            if (prevId == UINT_MAX || prev->getEntryLen(prevId) != next->getEntryLen(id)) {
+                continue;
+            }
+            unchanged[key] = memcmp(prev->getData(prevId, thread_idx), next->getData(id, thread_idx),
+                                    next->getEntryLen(id)) == 0;
+        }
+    }
+    return unchanged;
+}
+
+// appends all entries of the database on disk to out
+static void appendEntries(LocalParameters &par, const std::string &db, InMemoryDB &out) {
+    DBReader<unsigned int> in(db.c_str(), (db + ".index").c_str(), par.threads, DBReader<unsigned int>::USE_DATA|DBReader<unsigned int>::USE_INDEX);
+    in.open(DBReader<unsigned int>::NOSORT);
+    const bool isCompressed = in.isCompressed();
+    for (size_t id = 0; id < in.getSize(); id++) {
+        char *data = in.getData(id, 0);
+        out.writeData(data, isCompressed ? strlen(data) : in.getEntryLen(id) - 1, in.getDbKey(id), 0);
+    }
+    in.close();
+}
+
+static void touchFile(const std::string &file) {
+    FILE *handle = FileUtil::openFileOrDie(file.c_str(), "w", false);
+    if (fclose(handle) != 0) {
+        Debug(Debug::ERROR) << "Cannot close file " << file << "\n";
+        EXIT(EXIT_FAILURE);
+    }
+}
+
+// Writes the state after an iteration: the contigs, the cycles and contained sequences found
+// since the previous checkpoint and <checkpoint>_<step>.done. stop marks the last iteration.
+// Only the contigs of the latest checkpoint are kept.
+static void writeCheckpoint(const std::string &checkpoint, int step, int previousStep, bool stop, InMemoryDB &contigs,
+                            InMemoryDB &newCycles, InMemoryDB &newContained, int compressed) {
+    const std::string stepName = checkpoint + "_" + SSTR(step);
+    contigs.writeToDisk(stepName, stepName + ".index", compressed);
+    newCycles.writeToDisk(checkpoint + "_cycle_" + SSTR(step), checkpoint + "_cycle_" + SSTR(step) + ".index", compressed);
+    newContained.writeToDisk(checkpoint + "_contained_" + SSTR(step), checkpoint + "_contained_" + SSTR(step) + ".index", compressed);
+    if (stop) {
+        touchFile(checkpoint + ".stop");
+    }
+    touchFile(stepName + ".done");
+    if (previousStep >= 0) {
+        DBReader<unsigned int>::removeDb(checkpoint + "_" + SSTR(previousStep));
+    }
+}
+
+void removeAssemblyCheckpoints(const std::string &checkpoint, int iterations) {
+    for (int step = 0; step < iterations; step++) {
+        const std::string stepName = checkpoint + "_" + SSTR(step);
+        if (FileUtil::fileExists((stepName + ".done").c_str()) == false) {
+            continue;
+        }
+        if (FileUtil::fileExists((stepName + ".dbtype").c_str())) {
+            DBReader<unsigned int>::removeDb(stepName);
+        }
+        DBReader<unsigned int>::removeDb(checkpoint + "_cycle_" + SSTR(step));
+        DBReader<unsigned int>::removeDb(checkpoint + "_contained_" + SSTR(step));
+        FileUtil::remove((stepName + ".done").c_str());
+    }
+    if (FileUtil::fileExists((checkpoint + ".stop").c_str())) {
+        FileUtil::remove((checkpoint + ".stop").c_str());
+    }
+}
+
+// copies all entries of in, except for the ones listed in exclude
+InMemoryDB *removeEntries(LocalParameters &par, DBReader<unsigned int> *in, DBReader<unsigned int> *exclude) {
+    InMemoryDB *out = new InMemoryDB(par.threads, in->getDbtype());
+#pragma omp parallel
+    {
+        unsigned int thread_idx = 0;
+#ifdef OPENMP
+        thread_idx = (unsigned int) omp_get_thread_num();
+#endif
+#pragma omp for schedule(static)
+        for (size_t id = 0; id < in->getSize(); id++) {
+            unsigned int key = in->getDbKey(id);
+            if (exclude->getId(key) == UINT_MAX) {
+                out->writeData(in->getData(id, thread_idx), in->getEntryLen(id) - 1, key, thread_idx);
+            }
+        }
+    }
+    out->close();
+    return out;
+}
+
+InMemoryDB *assembleIterations(LocalParameters &par, DBReader<unsigned int> *inputDbr, const SequenceCounts *counts,
+                               const std::string &prefDbName, const std::string &checkpoint,
+                               InMemoryDB &cycles, InMemoryDB &contained, ResourceProfile &profile) {
+    if (par.rescoreMode != Parameters::RESCORE_MODE_ALIGNMENT &&
+        par.rescoreMode != Parameters::RESCORE_MODE_END_TO_END_ALIGNMENT &&
+        par.rescoreMode != Parameters::RESCORE_MODE_WINDOW_QUALITY_ALIGNMENT) {
+        Debug(Debug::ERROR) << "Module assembleiterate needs an alignment rescore mode (--rescore-mode 2, 3 or 4)\n";
+        EXIT(EXIT_FAILURE);
+    }
+    if (par.numIterations < 1) {
+        Debug(Debug::ERROR) << "Module assembleiterate needs at least one iteration\n";
+        EXIT(EXIT_FAILURE);
+    }
+    if (Parameters::isEqualDbtype(inputDbr->getDbtype(), Parameters::DBTYPE_NUCLEOTIDES) == false) {
+        Debug(Debug::ERROR) << "Module assembleiterate only supports nucleotide input database\n";
+        EXIT(EXIT_FAILURE);
+    }
+    // never allow deletions
+    par.allowDeletion = false;
+    // contained sequences are only found through the k-mer matches that cannot extend
+    if (par.dropContained) {
+        par.includeOnlyExtendable = false;
+    }
+
+    // overlaps with an input sequence lie within its length of a contig end,
+    // so the contigs only need the k-mers of both ends
+    if (par.kmerWindowScale > 0.0f) {
+        par.kmerEndWindow = kmerEndWindow(par.kmerWindowScale, inputDbr);
+        Debug(Debug::INFO) << "Select k-mers from the first and last " << par.kmerEndWindow << " residues\n";
+    }
+
+    NucleotideMatrix subMat(par.scoringMatrixFile.nucleotides, 1.0, 0.0);
+
+    // kmermatcher adjusts these for each database
+    const int kmerSize = par.kmerSize;
+    const int kmersPerSequence = par.kmersPerSequence;
+
+    DBReader<unsigned int> *seqDbr = inputDbr;
+    InMemoryDB *contigs = NULL;
+    KmerCache<CompactKmerPosition> compactKmerCache;
+    KmerCache<KmerPosition<short>> shortKmerCache;
+    KmerCache<KmerPosition<int>> intKmerCache;
+    std::vector<char> unchanged;
+
+    // continue after the last iteration with a checkpoint
+    int firstStep = 0;
+    int lastCheckpoint = -1;
+    if (checkpoint.empty() == false) {
+        int lastStep = par.numIterations - 1;
+        while (lastStep >= 0 && FileUtil::fileExists((checkpoint + "_" + SSTR(lastStep) + ".done").c_str()) == false) {
+            lastStep--;
+        }
+        if (lastStep >= 0) {
+            Debug(Debug::INFO) << "Continue after iteration " << lastStep << " from " << checkpoint << "\n";
+            for (int step = 0; step <= lastStep; step++) {
+                if (FileUtil::fileExists((checkpoint + "_" + SSTR(step) + ".done").c_str()) == false) {
+                    continue;
+                }
+                appendEntries(par, checkpoint + "_cycle_" + SSTR(step), cycles);
+                appendEntries(par, checkpoint + "_contained_" + SSTR(step), contained);
+            }
+            lastCheckpoint = lastStep;
+            contigs = new InMemoryDB(par.threads, inputDbr->getDbtype());
+            appendEntries(par, checkpoint + "_" + SSTR(lastStep), *contigs);
+            contigs->close();
+            seqDbr = contigs->getReader();
+            firstStep = FileUtil::fileExists((checkpoint + ".stop").c_str()) ? par.numIterations : lastStep + 1;
+        }
+    }
+
+    // with --checkpoint-interval every N-th iteration leaves a checkpoint, the cycles and
+    // contained sequences found since the previous one are collected for it
+    const bool writeCheckpoints = checkpoint.empty() == false && par.checkpointInterval > 0;
+    InMemoryDB *newCycles = NULL;
+    InMemoryDB *newContained = NULL;
+
+    Timer timer;
+    for (int step = firstStep; step < par.numIterations; step++) {
+        if (writeCheckpoints && newCycles == NULL) {
+            newCycles = new InMemoryDB(par.threads, Parameters::DBTYPE_NUCLEOTIDES);
+            newContained = new InMemoryDB(par.threads, Parameters::DBTYPE_GENERIC_DB);
+        }
+        Debug(Debug::INFO) << "STEP: " << step << "\n";
+        profile.startStep("iteration_" + SSTR(step));
+        par.kmerSize = kmerSize;
+        par.kmersPerSequence = kmersPerSequence;
+        setKmerLengthAndAlphabet(par, seqDbr->getAminoAcidDBSize(), seqDbr->getDbtype());
+
+        // 1. Finding exact k-mer matches
+        Debug(Debug::INFO) << "Find k-mer matches\n";
+        profile.startStep("kmermatcher_" + SSTR(step));
+        size_t sequenceMemory = (contigs != NULL) ? contigs->getMemorySize() : 0;
+        InMemoryDB *prefDb;
+        if (seqDbr->getMaxSeqLen() < SHRT_MAX && par.kmerSize <= CompactKmerPosition::MAX_KMER_SIZE) {
+            shortKmerCache.clear();
+            intKmerCache.clear();
+            prefDb = matchKmersInMemory<CompactKmerPositions>(par, seqDbr, &subMat, sequenceMemory, compactKmerCache, unchanged);
+        } else if (seqDbr->getMaxSeqLen() < SHRT_MAX) {
+            compactKmerCache.clear();
+            intKmerCache.clear();
+            prefDb = matchKmersInMemory<KmerPositions<short>>(par, seqDbr, &subMat, sequenceMemory, shortKmerCache, unchanged);
+        } else {
+            compactKmerCache.clear();
+            shortKmerCache.clear();
+            prefDb = matchKmersInMemory<KmerPositions<int>>(par, seqDbr, &subMat, sequenceMemory, intKmerCache, unchanged);
+        }
+        DBReader<unsigned int> *prefReader;
+        if (prefDb != NULL) {
+            prefReader = prefDb->getReader();
+        } else {
+            Debug(Debug::INFO) << "K-mers do not fit into memory, write prefilter result to " << prefDbName << "\n";
+            if (seqDbr->getMaxSeqLen() < SHRT_MAX) {
+                matchKmersOnDisk<short>(par, seqDbr, prefDbName);
+            } else {
+                matchKmersOnDisk<int>(par, seqDbr, prefDbName);
+            }
+            prefReader = new DBReader<unsigned int>(prefDbName.c_str(), (prefDbName + ".index").c_str(), par.threads, DBReader<unsigned int>::USE_DATA|DBReader<unsigned int>::USE_INDEX);
+            prefReader->open(DBReader<unsigned int>::LINEAR_ACCCESS);
+        }
+        profile.setEntries(seqDbr->getSize(), prefReader->getSize());
+        profile.endStep();
+
+        // 2. Ungapped alignment
+        Debug(Debug::INFO) << "Rescore diagonals\n";
+        profile.startStep("rescorediagonal_" + SSTR(step));
+        InMemoryDB alnDb(par.threads, Parameters::DBTYPE_ALIGNMENT_RES);
+        rescoreDiagonals(par, seqDbr, prefReader, &subMat, counts, alnDb);
+        alnDb.close();
+        profile.setEntries(prefReader->getSize(), alnDb.getReader()->getSize());
+        profile.endStep();
+        if (prefDb != NULL) {
+            delete prefDb;
+        } else {
+            prefReader->close();
+            delete prefReader;
+            DBReader<unsigned int>::removeDb(prefDbName);
+        }
+
+        // 3. Assemble
+        Debug(Debug::INFO) << "Compute assembly\n";
+        profile.startStep("assembleresults_" + SSTR(step));
+        InMemoryDB *assembly = new InMemoryDB(par.threads, seqDbr->getDbtype());
+        InMemoryDB stepContained(par.threads, Parameters::DBTYPE_GENERIC_DB);
+        ExtensionYield yield = nuclAssemble(par, seqDbr, alnDb.getReader(), *assembly, &stepContained, counts);
+        assembly->close();
+        stepContained.close();
+        DBReader<unsigned int> *stepContainedDbr = stepContained.getReader();
+        for (size_t id = 0; id < stepContainedDbr->getSize(); id++) {
+            contained.writeData(stepContainedDbr->getData(id, 0), stepContainedDbr->getEntryLen(id) - 1, stepContainedDbr->getDbKey(id), 0);
+            if (newContained != NULL) {
+                newContained->writeData(stepContainedDbr->getData(id, 0), stepContainedDbr->getEntryLen(id) - 1, stepContainedDbr->getDbKey(id), 0);
+            }
+        }
+        yield.print();
+        profile.setEntries(seqDbr->getSize(), assembly->getReader()->getSize());
+        profile.endStep();
+
+        // 4. Remove cyclic contigs from further extension
+        InMemoryDB stepCycles(par.threads, Parameters::DBTYPE_NUCLEOTIDES);
+        if (par.cycleCheck) {
+            Debug(Debug::INFO) << "Check for cycles\n";
+            profile.startStep("cyclecheck_" + SSTR(step));
+            const size_t assembled = assembly->getReader()->getSize();
+            findCycles(par, CYCLE_CHECK_KMER_SIZE, assembly->getReader(), stepCycles);
+            stepCycles.close();
+            DBReader<unsigned int> *cycleDbr = stepCycles.getReader();
+            if (cycleDbr->getSize() > 0) {
+                for (size_t id = 0; id < cycleDbr->getSize(); id++) {
+                    cycles.writeData(cycleDbr->getData(id, 0), cycleDbr->getEntryLen(id) - 1, cycleDbr->getDbKey(id), 0);
+                    if (newCycles != NULL) {
+                        newCycles->writeData(cycleDbr->getData(id, 0), cycleDbr->getEntryLen(id) - 1, cycleDbr->getDbKey(id), 0);
+                    }
+                }
+                InMemoryDB *noneCycle = removeEntries(par, assembly->getReader(), cycleDbr);
+                delete assembly;
+                assembly = noneCycle;
+            }
+            profile.setEntries(assembled, assembly->getReader()->getSize());
+            profile.endStep();
+        }
+
+        if (compactKmerCache.kmers != NULL || shortKmerCache.kmers != NULL || intKmerCache.kmers != NULL) {
+            unchanged = findUnchanged(seqDbr, assembly->getReader());
+        } else {
+            unchanged.clear();
+        }
+        profile.setEntries(seqDbr->getSize(), assembly->getReader()->getSize());
+        if (contigs != NULL) {
+            delete contigs;
+        }
+        contigs = assembly;
+        seqDbr = contigs->getReader();
+
+        bool stop = false;
+        if (step + 1 < par.numIterations && par.minExtensionYield > 0.0f && yield.isBelow(par.minExtensionYield)) {
+            Debug(Debug::INFO) << "Stop after " << (step + 1) << " iterations, less than " << par.minExtensionYield
+                               << " of the sequences were extended\n";
+            stop = true;
+        } else if (step + 1 < par.numIterations && par.maxAssemblyTime > 0 && timer.getTimediff() >= par.maxAssemblyTime) {
+            Debug(Debug::INFO) << "Stop after " << (step + 1) << " iterations, the time limit of "
+                               << par.maxAssemblyTime << "s was reached\n";
+            stop = true;
+        }
+        // the contigs of the last iteration are written by the caller
+        if (writeCheckpoints && step + 1 < par.numIterations && (stop || (step + 1) % par.checkpointInterval == 0)) {
+            newCycles->close();
+            newContained->close();
+            writeCheckpoint(checkpoint, step, lastCheckpoint, stop, *contigs, *newCycles, *newContained, par.compressed);
+            lastCheckpoint = step;
+            delete newCycles;
+            newCycles = NULL;
+            delete newContained;
+            newContained = NULL;
+        }
+        profile.endStep();
+        if (stop) {
+            break;
+        }
+    }
+    delete newCycles;
+    delete newContained;
+    par.kmerSize = kmerSize;
+    par.kmersPerSequence = kmersPerSequence;
+    cycles.close();
+    contained.close();
+    return contigs;
+}
+
+int assembleiterate(int argc, const char **argv, const Command &command) {
+    MMseqsMPI::init(argc, argv);
+
+    LocalParameters &par = LocalParameters::getLocalInstance();
+    par.parseParameters(argc, argv, command, true, 0, 0);
+
+    DBReader<unsigned int> *inputDbr = new DBReader<unsigned int>(par.db1.c_str(), par.db1Index.c_str(), par.threads, DBReader<unsigned int>::USE_DATA|DBReader<unsigned int>::USE_INDEX);
+    inputDbr->open(DBReader<unsigned int>::NOSORT);
+
+    InMemoryDB cycles(par.threads, Parameters::DBTYPE_NUCLEOTIDES);
+    InMemoryDB contained(par.threads, Parameters::DBTYPE_GENERIC_DB);
+    // only the workflows record a resource profile
+    ResourceProfile profile;
+    InMemoryDB *contigs = assembleIterations(par, inputDbr, NULL, par.db2 + "_pref", "", cycles, contained, profile);
+    inputDbr->close();
+    delete inputDbr;
+    contigs->writeToDisk(par.db2, par.db2Index, par.compressed);
+    delete contigs;
+    cycles.writeToDisk(par.db3, par.db3Index, par.compressed);
+    if (par.dropContained) {
+        std::string containedDb = par.db2 + "_contained";
+        contained.writeToDisk(containedDb, containedDb + ".index", par.compressed);
+    }
+
+    return EXIT_SUCCESS;
+}
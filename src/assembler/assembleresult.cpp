@@ -1,4 +1,10 @@
 #include "LocalParameters.h"
+#include "AssemblySteps.h"
+#include "AssemblyHit.h"
+#include "TargetStrands.h"
+#include "IncrementalUngappedAligner.h"
+#include "ContigBuffer.h"
+#include "ExtensionYield.h"
 #include "DistanceCalculator.h"
 #include "Matcher.h"
 #include "DBReader.h"
@@ -7,68 +13,41 @@
 #include "Util.h"
 #include "MathUtil.h"
 
+#include <algorithm>
+#include <cstring>
 #include <limits>
 #include <cstdint>
-#include <queue>
+#include <unordered_map>
 #include <vector>
 
 #ifdef OPENMP
 #include <omp.h>
 #endif
 
-class CompareResultByScore {
-public:
-    bool operator() (const Matcher::result_t & r1,const Matcher::result_t & r2) {
-        if(r1.score < r2.score )
-            return true;
-        if(r2.score < r1.score )
-            return false;
-        if(r1.alnLength < r2.alnLength )
-            return true;
-        if(r2.alnLength < r1.alnLength )
-            return false;
-        if(r1.dbKey > r2.dbKey )
-            return true;
-        if(r2.dbKey > r1.dbKey )
-            return false;
-        return false;
-    }
-};
-
-
-typedef std::priority_queue<Matcher::result_t, std::vector<Matcher::result_t> , CompareResultByScore> QueueByScore;
-Matcher::result_t selectFragmentToExtend(QueueByScore &alignments,
-                                             unsigned int queryKey) {
+typedef HitQueue<CompareResultByScore> QueueByScore;
+// returns the index of the hit in hits or UINT_MAX
+unsigned int selectFragmentToExtend(QueueByScore &alignments, const std::vector<AssemblyHit> &hits,
+                                    unsigned int queryKey, unsigned int queryLen) {
     // results are ordered by score
     while (alignments.empty() == false){
-        Matcher::result_t res = alignments.top();
+        unsigned int hitIdx = alignments.top();
         alignments.pop();
+        const AssemblyHit &res = hits[hitIdx];
         size_t dbKey = res.dbKey;
         const bool notRightStartAndLeftStart = !(res.dbStartPos == 0 &&  res.qStartPos == 0 );
         const bool rightStart = res.dbStartPos == 0 && (res.dbEndPos != static_cast<int>(res.dbLen)-1);
-        const bool leftStart = res.qStartPos == 0   && (res.qEndPos != static_cast<int>(res.qLen)-1);
+        const bool leftStart = res.qStartPos == 0   && (res.qEndPos != static_cast<int>(queryLen)-1);
         const bool isNotIdentity = (dbKey != queryKey);
 
         if ((rightStart || leftStart) && notRightStartAndLeftStart && isNotIdentity){
-            return res;
+            return hitIdx;
         }
     }
-    return Matcher::result_t(UINT_MAX,0,0,0,0,0,0,0,0,0,0,0,0,"");
-}
-
-inline char* getRevFragment(const char* fragment, size_t fragLen, NucleotideMatrix *nuclMatrix)
-{
-    char *fragmentRev = new char[fragLen];
-    for (int pos = fragLen - 1; pos > -1; pos--) {
-        int res = nuclMatrix->aa2num[static_cast<int>(fragment[pos])];
-        char revRes = nuclMatrix->num2aa[nuclMatrix->reverseResidue(res)];
-        fragmentRev[(fragLen - 1) - pos] = (revRes == 'X')? 'N' : revRes;
-    }
-    return fragmentRev;
+    return UINT_MAX;
 }
 
-inline void updateAlignment(Matcher::result_t &tmpAlignment, DistanceCalculator::LocalAlignment &alignment,
-                            const char *querySeq, size_t querySeqLen, const char *tSeq, size_t tSeqLen) {
+inline void updateAlignment(AssemblyHit &tmpAlignment, DistanceCalculator::LocalAlignment &alignment,
+                            unsigned int idCnt, size_t tSeqLen) {
 
     int qStartPos, qEndPos, dbStartPos, dbEndPos;
     int diag = alignment.diagonal;
@@ -86,18 +65,12 @@ inline void updateAlignment(Matcher::result_t &tmpAlignment, DistanceCalculator:
         dbEndPos = alignment.endPos + dist;
     }
 
-    int idCnt = 0;
-    for(int i = qStartPos; i < qEndPos; i++){
-        idCnt += (querySeq[i] == tSeq[dbStartPos+(i-qStartPos)]) ? 1 : 0;
-    }
     float seqId =  static_cast<float>(idCnt) / (static_cast<float>(qEndPos) - static_cast<float>(qStartPos));
 
     tmpAlignment.seqId = seqId;
-    tmpAlignment.qLen = querySeqLen;
     tmpAlignment.dbLen = tSeqLen;
 
-    tmpAlignment.alnLength = alignment.diagonalLen;
-    float scorePerCol = static_cast<float>(alignment.score ) / static_cast<float>(tmpAlignment.alnLength + 0.5);
+    float scorePerCol = static_cast<float>(alignment.score ) / static_cast<float>(alignment.diagonalLen + 0.5);
     tmpAlignment.score = static_cast<int>(scorePerCol*100);
 
     tmpAlignment.qStartPos = qStartPos;
@@ -107,14 +80,17 @@ inline void updateAlignment(Matcher::result_t &tmpAlignment, DistanceCalculator:
 
 }
 
-int doassembly(LocalParameters &par) {
-    DBReader<unsigned int> *sequenceDbr = new DBReader<unsigned int>(par.db1.c_str(), par.db1Index.c_str(), par.threads, DBReader<unsigned int>::USE_DATA|DBReader<unsigned int>::USE_INDEX);
+ExtensionYield assembleResults(LocalParameters &par, const std::string &seqDb, const std::string &alnDb, const std::string &outDb) {
+    // never allow deletions
+    par.allowDeletion = false;
+
+    DBReader<unsigned int> *sequenceDbr = new DBReader<unsigned int>(seqDb.c_str(), (seqDb + ".index").c_str(), par.threads, DBReader<unsigned int>::USE_DATA|DBReader<unsigned int>::USE_INDEX);
     sequenceDbr->open(DBReader<unsigned int>::NOSORT);
 
-    DBReader<unsigned int> * alnReader = new DBReader<unsigned int>(par.db2.c_str(), par.db2Index.c_str(), par.threads, DBReader<unsigned int>::USE_DATA|DBReader<unsigned int>::USE_INDEX);
+    DBReader<unsigned int> * alnReader = new DBReader<unsigned int>(alnDb.c_str(), (alnDb + ".index").c_str(), par.threads, DBReader<unsigned int>::USE_DATA|DBReader<unsigned int>::USE_INDEX);
     alnReader->open(DBReader<unsigned int>::NOSORT);
 
-    DBWriter resultWriter(par.db3.c_str(), par.db3Index.c_str(), par.threads, par.compressed, sequenceDbr->getDbtype());
+    DBWriter resultWriter(outDb.c_str(), (outDb + ".index").c_str(), par.threads, par.compressed, sequenceDbr->getDbtype());
     resultWriter.open();
 
     int seqType = sequenceDbr->getDbtype();
@@ -126,22 +102,39 @@ int doassembly(LocalParameters &par) {
     }
 
     SubstitutionMatrix::FastMatrix fastMatrix = SubstitutionMatrix::createAsciiSubMat(*subMat);
+    IncrementalUngappedAligner ungappedAligner(fastMatrix.matrix, par.rescoreMode);
     EvalueComputation evaluer(sequenceDbr->getAminoAcidDBSize(), subMat);
+    // counts of collapseduplicates next to the sequences break ties between extensions
+    SequenceCounts *counts = SequenceCounts::openIfExists(seqDb);
 
     unsigned char * wasExtended = new unsigned char[sequenceDbr->getSize()];
     std::fill(wasExtended, wasExtended+sequenceDbr->getSize(), 0);
+    size_t extended = 0;
+    size_t addedResidues = 0;
     Debug::Progress progress(sequenceDbr->getSize());
-#pragma omp parallel
+#pragma omp parallel reduction(+:extended, addedResidues)
     {
         unsigned int thread_idx = 0;
 #ifdef OPENMP
         thread_idx = (unsigned int) omp_get_thread_num();
 #endif
 
-        std::vector<Matcher::result_t> alignments;
+        // hits of the current query, the queue and tmpAlignments refer to them by index
+        std::vector<AssemblyHit> alignments;
         alignments.reserve(300);
-        bool *useReverse = new bool[sequenceDbr->getSize()];
-        std::fill(useReverse, useReverse+sequenceDbr->getSize(), false);
+        QueueByScore alnQueue(alignments, CompareResultByScore(counts));
+        std::vector<unsigned int> tmpAlignments;
+        // strand of each hit of the current query
+        std::vector<std::pair<unsigned int, bool>> strands;
+        strands.reserve(300);
+        ContigBuffer query;
+        // reverse complement of target fragments and the copies of the targets that are
+        // realigned after an extension, grows to the longest seen
+        std::vector<char> revFragment;
+        std::vector<IncrementalUngappedAligner::Target> rescoreTargets;
+        std::vector<IncrementalUngappedAligner::Result> rescoreResults;
+        // overlap sums of the pending hits of the current query by target key
+        std::unordered_map<unsigned int, IncrementalUngappedAligner::OverlapSum> overlapSums;
 #pragma omp for schedule(dynamic, 100)
         for (size_t id = 0; id < sequenceDbr->getSize(); id++) {
             progress.updateProgress();
@@ -149,28 +142,29 @@ int doassembly(LocalParameters &par) {
             unsigned int queryKey = sequenceDbr->getDbKey(id);
             char *querySeq = sequenceDbr->getData(id, thread_idx);
             unsigned int querySeqLen = sequenceDbr->getSeqLen(id);
-            std::string query(querySeq, querySeqLen); // no /n/0
+            query.assign(querySeq, querySeqLen); // no /n/0
 
             char *alnData = alnReader->getDataByDBKey(queryKey, thread_idx);
             alignments.clear();
-            Matcher::readAlignmentResults(alignments, alnData);
+            strands.clear();
+            AssemblyHit::readAlignmentResults(alignments, alnData);
 
             bool queryCouldBeExtended = false;
-            QueueByScore alnQueue;
+            alnQueue.clear();
 
             for (size_t alnIdx = 0; alnIdx < alignments.size(); alnIdx++) {
 
                 int rawScore = static_cast<int>(evaluer.computeRawScoreFromBitScore(alignments[alnIdx].score) + 0.5);
-                float scorePerCol = static_cast<float>(rawScore) / static_cast<float>(alignments[alnIdx].alnLength + 0.5);
+                float scorePerCol = static_cast<float>(rawScore) / static_cast<float>(alignments[alnIdx].alnLength() + 0.5);
 
-                float alnLen = static_cast<float>(alignments[alnIdx].alnLength);
+                float alnLen = static_cast<float>(alignments[alnIdx].alnLength());
                 float ids = static_cast<float>(alignments[alnIdx].seqId) * alnLen;
                 alignments[alnIdx].seqId = ids / (alnLen + 0.5);
                 alignments[alnIdx].score = static_cast<int>(scorePerCol*100);
 
                 if (seqType == Parameters::DBTYPE_NUCLEOTIDES) {
                     if (alignments[alnIdx].qStartPos > alignments[alnIdx].qEndPos) {
-                        useReverse[sequenceDbr->getId(alignments[alnIdx].dbKey)] = true;
+                        strands.emplace_back(alignments[alnIdx].dbKey, true);
 
                         std::swap(alignments[alnIdx].qStartPos, alignments[alnIdx].qEndPos);
                         unsigned int dbStartPos = alignments[alnIdx].dbStartPos;
@@ -178,25 +172,29 @@ int doassembly(LocalParameters &par) {
                         alignments[alnIdx].dbEndPos= alignments[alnIdx].dbLen - dbStartPos - 1;
 
                     } else {
-                        useReverse[sequenceDbr->getId(alignments[alnIdx].dbKey)] = false;
+                        strands.emplace_back(alignments[alnIdx].dbKey, false);
                     }
                 }
 
-                alnQueue.push(alignments[alnIdx]);
+                alnQueue.push(alnIdx);
                 if (alignments.size() > 1)
                     __sync_or_and_fetch(&wasExtended[sequenceDbr->getId(alignments[alnIdx].dbKey)],
                                         static_cast<unsigned char>(0x40));
             }
 
-            std::vector<Matcher::result_t> tmpAlignments;
-            tmpAlignments.reserve(alignments.size());
+            std::stable_sort(strands.begin(), strands.end(), compareStrandByKey);
+
+            // residues prepended to the query since the alignments were read
+            unsigned int queryOffset = 0;
+            overlapSums.clear();
             while (!alnQueue.empty()) {
 
                 unsigned int leftQueryOffset = 0;
                 unsigned int rightQueryOffset = 0;
                 tmpAlignments.clear();
-                Matcher::result_t besttHitToExtend;
-                while ((besttHitToExtend = selectFragmentToExtend(alnQueue, queryKey)).dbKey != UINT_MAX) {
+                unsigned int hitIdx;
+                while ((hitIdx = selectFragmentToExtend(alnQueue, alignments, queryKey, querySeqLen)) != UINT_MAX) {
+                    const AssemblyHit &besttHitToExtend = alignments[hitIdx];
 
                     unsigned int targetId = sequenceDbr->getId(besttHitToExtend.dbKey);
                     if (targetId == UINT_MAX) {
@@ -227,21 +225,21 @@ int doassembly(LocalParameters &par) {
                         //right extension
 
                         if(rightQueryOffset > 0) {
-                            tmpAlignments.push_back(besttHitToExtend);
+                            tmpAlignments.push_back(hitIdx);
                             continue;
                         }
 
                         unsigned int fragLen = targetSeqLen - (dbEndPos + 1);
-                        std::string fragment;
-                        if (useReverse[targetId]) {
-                            char *cfragment = getRevFragment(targetSeq, fragLen, (NucleotideMatrix *) subMat);
-                            fragment = std::string(cfragment, fragLen);
-                            delete[] cfragment;
+                        if (isReverseTarget(strands, besttHitToExtend.dbKey)) {
+                            if (revFragment.size() < fragLen) {
+                                revFragment.resize(fragLen);
+                            }
+                            ((NucleotideMatrix *) subMat)->reverseComplement(targetSeq, fragLen, revFragment.data(), 'N');
+                            query.append(revFragment.data(), fragLen);
                         }
                         else
-                           fragment = std::string(targetSeq + dbEndPos + 1, fragLen);
+                            query.append(targetSeq + dbEndPos + 1, fragLen);
 
-                        query += fragment;
                         rightQueryOffset += fragLen;
                         //update that dbKey was used in assembly
                         __sync_or_and_fetch(&wasExtended[targetId], static_cast<unsigned char>(0x80));
@@ -251,7 +249,7 @@ int doassembly(LocalParameters &par) {
                         //left extension
 
                         if(leftQueryOffset > 0) {
-                            tmpAlignments.push_back(besttHitToExtend);
+                            tmpAlignments.push_back(hitIdx);
                             continue;
                         }
 
@@ -262,16 +260,16 @@ int doassembly(LocalParameters &par) {
                             break;
                         }
 
-                        std::string fragment;
-                        if (useReverse[targetId]) {
-                            char *cfragment = getRevFragment(targetSeq + (targetSeqLen - dbStartPos), fragLen, (NucleotideMatrix *) subMat);
-                            fragment = std::string(cfragment, fragLen);
-                            delete[] cfragment;
+                        if (isReverseTarget(strands, besttHitToExtend.dbKey)) {
+                            if (revFragment.size() < fragLen) {
+                                revFragment.resize(fragLen);
+                            }
+                            ((NucleotideMatrix *) subMat)->reverseComplement(targetSeq + (targetSeqLen - dbStartPos), fragLen, revFragment.data(), 'N');
+                            query.prepend(revFragment.data(), fragLen);
                         }
                         else
-                            fragment = std::string(targetSeq, fragLen);
+                            query.prepend(targetSeq, fragLen);
 
-                        query = fragment + query;
                         leftQueryOffset += fragLen;
                         //update that dbKey was used in assembly
                         __sync_or_and_fetch(&wasExtended[targetId], static_cast<unsigned char>(0x80));
@@ -286,44 +284,72 @@ int doassembly(LocalParameters &par) {
                     break;
 
                 querySeqLen = query.length();
-                querySeq = (char *) query.c_str();
+                querySeq = (char *) query.data();
 
                 // update alignments
-                for(size_t alnIdx = 0; alnIdx < tmpAlignments.size(); alnIdx++) {
-
-                    unsigned int tId = sequenceDbr->getId(tmpAlignments[alnIdx].dbKey);
+                queryOffset += leftQueryOffset;
+                // getData of a compressed database reuses one buffer per thread, so all
+                // targets are copied like the reverse ones before they are aligned together
+                const bool copyTargets = sequenceDbr->isCompressed();
+                size_t copiedTargetLen = 0;
+                for (size_t alnIdx = 0; alnIdx < tmpAlignments.size(); alnIdx++) {
+                    unsigned int dbKey = alignments[tmpAlignments[alnIdx]].dbKey;
+                    if (copyTargets || isReverseTarget(strands, dbKey)) {
+                        copiedTargetLen += sequenceDbr->getSeqLen(sequenceDbr->getId(dbKey));
+                    }
+                }
+                if (revFragment.size() < copiedTargetLen) {
+                    revFragment.resize(copiedTargetLen);
+                }
+                char *copiedTarget = revFragment.data();
+                rescoreTargets.clear();
+                for (size_t alnIdx = 0; alnIdx < tmpAlignments.size(); alnIdx++) {
+                    const AssemblyHit &tmpAlignment = alignments[tmpAlignments[alnIdx]];
+                    unsigned int tId = sequenceDbr->getId(tmpAlignment.dbKey);
                     unsigned int tSeqLen = sequenceDbr->getSeqLen(tId);
                     char *tSeq = sequenceDbr->getData(tId, thread_idx);
-                    if (useReverse[tId])
-                        tSeq = getRevFragment(tSeq, tSeqLen, (NucleotideMatrix *) subMat);
+                    if (isReverseTarget(strands, tmpAlignment.dbKey)) {
+                        ((NucleotideMatrix *) subMat)->reverseComplement(tSeq, tSeqLen, copiedTarget, 'N');
+                        tSeq = copiedTarget;
+                        copiedTarget += tSeqLen;
+                    } else if (copyTargets) {
+                        memcpy(copiedTarget, tSeq, tSeqLen);
+                        tSeq = copiedTarget;
+                        copiedTarget += tSeqLen;
+                    }
 
-                    int qStartPos = tmpAlignments[alnIdx].qStartPos;
-                    int dbStartPos = tmpAlignments[alnIdx].dbStartPos;
+                    int qStartPos = tmpAlignment.qStartPos;
+                    int dbStartPos = tmpAlignment.dbStartPos;
                     int diag = (qStartPos + leftQueryOffset) - dbStartPos;
+                    rescoreTargets.emplace_back(tSeq, tSeqLen, diag, &overlapSums[tmpAlignment.dbKey]);
+                }
+                ungappedAligner.align(querySeq, querySeqLen, queryOffset, rescoreTargets, rescoreResults);
 
-                    DistanceCalculator::LocalAlignment alignment = DistanceCalculator::ungappedAlignmentByDiagonal(
-                                                                   querySeq, querySeqLen, tSeq, tSeqLen,
-                                                                   diag, fastMatrix.matrix, par.rescoreMode);
-
-                    updateAlignment(tmpAlignments[alnIdx], alignment, querySeq, querySeqLen, tSeq, tSeqLen);
+                for (size_t alnIdx = 0; alnIdx < tmpAlignments.size(); alnIdx++) {
+                    AssemblyHit &tmpAlignment = alignments[tmpAlignments[alnIdx]];
+                    updateAlignment(tmpAlignment, rescoreResults[alnIdx].alignment, rescoreResults[alnIdx].identities,
+                                    rescoreTargets[alnIdx].seqLen);
 
                     // refill queue
-                    if(tmpAlignments[alnIdx].seqId >= par.seqIdThr)
+                    if(tmpAlignment.seqId >= par.seqIdThr)
                         alnQueue.push(tmpAlignments[alnIdx]);
                 }
             }
 
             if (queryCouldBeExtended)  {
+                extended++;
+                addedResidues += query.length() - sequenceDbr->getSeqLen(id);
                 query.push_back('\n');
                 __sync_or_and_fetch(&wasExtended[id], static_cast<unsigned char>(0x20));
-                resultWriter.writeData(query.c_str(), query.size(), queryKey, thread_idx);
+                resultWriter.writeData(query.data(), query.length(), queryKey, thread_idx);
             }
 
         }
     } // end parallel
 
 // add sequences that are not yet assembled
-#pragma omp parallel for schedule(dynamic, 10000)
+    size_t merged = 0;
+#pragma omp parallel for schedule(dynamic, 10000) reduction(+:merged)
     for (size_t id = 0; id < sequenceDbr->getSize(); id++) {
         unsigned int thread_idx = 0;
 #ifdef OPENMP
@@ -333,6 +359,7 @@ int doassembly(LocalParameters &par) {
         bool isNotContig =  !(wasExtended[id] & 0x20);
         //bool wasNotUsed =  !(wasExtended[id] & 0x40);
         bool wasNotExtended =  !(wasExtended[id] & 0x80);
+        merged += (wasNotExtended == false);
         //bool wasUsed    =  (wasExtended[id] & 0x40);
         //if(isNotContig && wasNotExtended ){
         if (isNotContig && (par.keepTarget || wasNotExtended)){
@@ -341,9 +368,18 @@ int doassembly(LocalParameters &par) {
         }
     }
 
+    ExtensionYield yield;
+    yield.queries = sequenceDbr->getSize();
+    yield.extended = extended;
+    yield.addedResidues = addedResidues;
+    yield.merged = merged;
+    yield.print();
+    yield.writeFile(outDb);
+
     // cleanup
     resultWriter.close(true);
     alnReader->close();
+    delete counts;
     delete [] wasExtended;
     delete alnReader;
     delete [] fastMatrix.matrix;
@@ -352,7 +388,7 @@ int doassembly(LocalParameters &par) {
     delete sequenceDbr;
     Debug(Debug::INFO) << "\nDone.\n";
 
-    return EXIT_SUCCESS;
+    return yield;
 }
 
 int assembleresult(int argc, const char **argv, const Command& command) {
@@ -361,9 +397,9 @@ int assembleresult(int argc, const char **argv, const Command& command) {
 
     MMseqsMPI::init(argc, argv);
 
-    // never allow deletions
-    par.allowDeletion = false;
     Debug(Debug::INFO) << "Compute assembly.\n";
-    return doassembly(par);
+    assembleResults(par, par.db1, par.db2, par.db3);
+
+    return EXIT_SUCCESS;
 }
 
@@ -5,8 +5,10 @@
  * constraint: fragments contain redundant parts at most 3 times
  */
 
+#include "AssemblySteps.h"
 #include "DBReader.h"
 #include "DBWriter.h"
+#include "InMemoryDB.h"
 #include "Indexer.h"
 #include "LocalParameters.h"
 #include "NucleotideMatrix.h"
@@ -23,23 +25,12 @@
 // verified for kmerSize = 22
 
 void setCycleCheckDefaults(LocalParameters *p) {
-    p->kmerSize = 22;
+    p->kmerSize = CYCLE_CHECK_KMER_SIZE;
     p->chopCycle = false;
 }
 
-int cyclecheck(int argc, const char **argv, const Command& command) {
-
-    LocalParameters &par = LocalParameters::getLocalInstance();
-    setCycleCheckDefaults(&par);
-    par.parseParameters(argc, argv, command, true, 0, 0);
-
-    DBReader<unsigned int> *seqDbr = new DBReader<unsigned int>(par.db1.c_str(), par.db1Index.c_str(),  par.threads, DBReader<unsigned int>::USE_DATA|DBReader<unsigned int>::USE_INDEX);
-    seqDbr->open(DBReader<unsigned int>::NOSORT);
-
-    DBWriter cycleResultWriter(par.db2.c_str(), par.db2Index.c_str(), par.threads, par.compressed, Parameters::DBTYPE_NUCLEOTIDES);
-    cycleResultWriter.open();
-
-    const size_t kmerSize = par.kmerSize;
+template <typename Writer>
+void findCycles(LocalParameters &par, size_t kmerSize, DBReader<unsigned int> *seqDbr, Writer &cycleResultWriter) {
     int seqType  =  seqDbr->getDbtype();
     BaseMatrix *subMat;
 
@@ -280,6 +271,27 @@ int cyclecheck(int argc, const char **argv, const Command& command) {
         delete[] middleKmers;
         delete[] backKmers;
     }
+    delete subMat;
+}
+
+template void findCycles<DBWriter>(LocalParameters &par, size_t kmerSize, DBReader<unsigned int> *seqDbr,
+                                   DBWriter &cycleResultWriter);
+template void findCycles<InMemoryDB>(LocalParameters &par, size_t kmerSize, DBReader<unsigned int> *seqDbr,
+                                     InMemoryDB &cycleResultWriter);
+
+int cyclecheck(int argc, const char **argv, const Command& command) {
+
+    LocalParameters &par = LocalParameters::getLocalInstance();
+    setCycleCheckDefaults(&par);
+    par.parseParameters(argc, argv, command, true, 0, 0);
+
+    DBReader<unsigned int> *seqDbr = new DBReader<unsigned int>(par.db1.c_str(), par.db1Index.c_str(),  par.threads, DBReader<unsigned int>::USE_DATA|DBReader<unsigned int>::USE_INDEX);
+    seqDbr->open(DBReader<unsigned int>::NOSORT);
+
+    DBWriter cycleResultWriter(par.db2.c_str(), par.db2Index.c_str(), par.threads, par.compressed, Parameters::DBTYPE_NUCLEOTIDES);
+    cycleResultWriter.open();
+
+    findCycles(par, par.kmerSize, seqDbr, cycleResultWriter);
 
     cycleResultWriter.close(true);
 
@@ -0,0 +1,36 @@
+#include "LocalParameters.h"
+#include "AssemblySteps.h"
+#include "DiagonalRescorer.h"
+#include "ExtensionHitSelection.h"
+#include "FileUtil.h"
+#include "MMseqsMPI.h"
+
+// rescorediagonal of the assembly workflows, with --max-extension-hits the alignment
+// result of a query keeps only the hits the assembly would extend with first. Counts
+// of collapseduplicates next to the query database break ties between hits.
+int extensionRescoreDiagonal(LocalParameters &par, const std::string &queryDb, const std::string &targetDb,
+                             const std::string &prefDb, const std::string &alnDb) {
+    par.db1 = queryDb;
+    par.db1Index = queryDb + ".index";
+    par.db2 = targetDb;
+    par.db2Index = targetDb + ".index";
+    par.db3 = prefDb;
+    par.db3Index = prefDb + ".index";
+    par.db4 = alnDb;
+    par.db4Index = alnDb + ".index";
+
+    const bool isNucl = Parameters::isEqualDbtype(FileUtil::parseDbType(queryDb.c_str()), Parameters::DBTYPE_NUCLEOTIDES);
+    SequenceCounts *counts = SequenceCounts::openIfExists(queryDb);
+    ExtensionHitSelection extensionHits(par.maxExtensionHits, par.threads, isNucl, counts);
+    int status = rescorediagonal(par, (par.maxExtensionHits > 0) ? &extensionHits : NULL);
+    delete counts;
+    return status;
+}
+
+int extensionrescorediagonal(int argc, const char **argv, const Command &command) {
+    MMseqsMPI::init(argc, argv);
+    LocalParameters &par = LocalParameters::getLocalInstance();
+    par.parseParameters(argc, argv, command, true, 0, 0);
+
+    return extensionRescoreDiagonal(par, par.db1, par.db2, par.db3, par.db4);
+}
@@ -9,6 +9,7 @@
 #include "DBWriter.h"
 
 #include "LocalParameters.h"
+#include "AssemblySteps.h"
 
 #include "kerasify/keras_model.h"
 //#include "predict_coding_acc9540_57x32x64.model.h"
@@ -23,16 +24,13 @@
 #include <omp.h>
 #endif
 
-int filternoncoding(int argc, const char **argv, const Command& command)  {
-    LocalParameters& par = LocalParameters::getLocalInstance();
-    par.parseParameters(argc, argv, command, true, 0, 0);
-
-    Debug(Debug::INFO) << "Sequence database: " << par.db1 << "\n";
-    DBReader<unsigned int> seqDb (par.db1.c_str(), par.db1Index.c_str(), par.threads, DBReader<unsigned int>::USE_DATA|DBReader<unsigned int>::USE_INDEX);
+void filterNoncoding(LocalParameters &par, const std::string &seqDbName, const std::string &outDb) {
+    Debug(Debug::INFO) << "Sequence database: " << seqDbName << "\n";
+    DBReader<unsigned int> seqDb (seqDbName.c_str(), (seqDbName + ".index").c_str(), par.threads, DBReader<unsigned int>::USE_DATA|DBReader<unsigned int>::USE_INDEX);
     seqDb.open(DBReader<unsigned int>::NOSORT);
 
-    Debug(Debug::INFO) << "Output file: " << par.db2 << "\n";
-    DBWriter dbw(par.db2.c_str(), par.db2Index.c_str(), static_cast<unsigned int>(par.threads), par.compressed, seqDb.getDbtype());
+    Debug(Debug::INFO) << "Output file: " << outDb << "\n";
+    DBWriter dbw(outDb.c_str(), (outDb + ".index").c_str(), static_cast<unsigned int>(par.threads), par.compressed, seqDb.getDbtype());
     dbw.open();
 
     // Initialize model.
@@ -176,7 +174,13 @@ int filternoncoding(int argc, const char **argv, const Command& command)  {
 //    std::cout << "Filtered: " << static_cast<float>(cnt)/ static_cast<float>(seqDb.getSize()) << std::endl;
     dbw.close(true);
     seqDb.close();
+}
+
+int filternoncoding(int argc, const char **argv, const Command& command)  {
+    LocalParameters& par = LocalParameters::getLocalInstance();
+    par.parseParameters(argc, argv, command, true, 0, 0);
+
+    filterNoncoding(par, par.db1, par.db2);
 
     return EXIT_SUCCESS;
 }
-
@@ -4,6 +4,7 @@
 #include "Util.h"
 #include "Matcher.h"
 #include "LocalParameters.h"
+#include "AssemblySteps.h"
 
 #ifdef OPENMP
 #include <omp.h>
@@ -32,19 +33,16 @@ struct PositionOfM {
             : id(id), mPos(mPos), hasM(hasM), hasStopM(hasStopM) {}
 };
 
-int findassemblystart(int argn, const char **argv, const Command &command) {
-    LocalParameters &par = LocalParameters::getLocalInstance();
-    par.parseParameters(argn, argv, command, true, 0, 0);
-
-    DBReader<unsigned int> qDbr(par.db1.c_str(), par.db1Index.c_str(), par.threads, DBReader<unsigned int>::USE_DATA | DBReader<unsigned int>::USE_INDEX);
+void findAssemblyStart(LocalParameters &par, const std::string &seqDb, const std::string &alnDb, const std::string &outDb) {
+    DBReader<unsigned int> qDbr(seqDb.c_str(), (seqDb + ".index").c_str(), par.threads, DBReader<unsigned int>::USE_DATA | DBReader<unsigned int>::USE_INDEX);
     qDbr.open(DBReader<unsigned int>::NOSORT);
 
     DBReader<unsigned int> *tDbr = &qDbr;
 
-    DBReader<unsigned int> resultReader(par.db2.c_str(), par.db2Index.c_str(), par.threads, DBReader<unsigned int>::USE_DATA | DBReader<unsigned int>::USE_INDEX);
+    DBReader<unsigned int> resultReader(alnDb.c_str(), (alnDb + ".index").c_str(), par.threads, DBReader<unsigned int>::USE_DATA | DBReader<unsigned int>::USE_INDEX);
     resultReader.open(DBReader<unsigned int>::LINEAR_ACCCESS);
 
-    DBWriter resultWriter(par.db3.c_str(), par.db3Index.c_str(), par.threads, par.compressed, Parameters::DBTYPE_AMINO_ACIDS);
+    DBWriter resultWriter(outDb.c_str(), (outDb + ".index").c_str(), par.threads, par.compressed, Parameters::DBTYPE_AMINO_ACIDS);
     resultWriter.open();
 
     int *addStopAtPosition = new int[qDbr.getSize()];
@@ -171,9 +169,13 @@ int findassemblystart(int argn, const char **argv, const Command &command) {
     resultReader.close();
     qDbr.close();
     delete[] addStopAtPosition;
-
-    return EXIT_SUCCESS;
 }
 
+int findassemblystart(int argn, const char **argv, const Command &command) {
+    LocalParameters &par = LocalParameters::getLocalInstance();
+    par.parseParameters(argn, argv, command, true, 0, 0);
 
+    findAssemblyStart(par, par.db1, par.db2, par.db3);
 
+    return EXIT_SUCCESS;
+}
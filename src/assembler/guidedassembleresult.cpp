@@ -1,6 +1,12 @@
 
 #include "NucleotideMatrix.h"
 #include "LocalParameters.h"
+#include "AssemblySteps.h"
+#include "AssemblyHit.h"
+#include "BetaBinomial.h"
+#include "IncrementalUngappedAligner.h"
+#include "ContigBuffer.h"
+#include "ExtensionYield.h"
 #include "DistanceCalculator.h"
 #include "Matcher.h"
 #include "DBReader.h"
@@ -11,7 +17,8 @@
 
 #include <limits>
 #include <cstdint>
-#include <queue>
+#include <cstring>
+#include <unordered_map>
 #include <string>
 #include <vector>
 #include <sstream>
@@ -38,63 +45,34 @@ public:
 
         return false;
     }*/
-    bool operator() (const Matcher::result_t & r1,const Matcher::result_t & r2) {
-        unsigned int mm_count1 = (1 - r1.seqId) * r1.alnLength + 0.5;
-        unsigned int mm_count2 = (1 - r2.seqId) * r2.alnLength + 0.5;
-
-        unsigned int alpha1 = mm_count1 + 1;
-        unsigned int alpha2 = mm_count2 + 1;
-        unsigned int beta1 = r1.alnLength - mm_count1 + 1;
-        unsigned int beta2 = r2.alnLength - mm_count2 + 1;
-
-        //double c=(std::tgamma(beta1+beta2)*std::tgamma(alpha1+beta2))/(std::tgamma(alpha1+beta1+beta2)*std::tgamma(beta1));
-        double log_c = (std::lgamma(beta1+beta2)+std::lgamma(alpha1+beta1))-(std::lgamma(alpha1+beta1+beta2)+std::lgamma(beta1));
-
-        //double r = 1.0; // r_0 =1
-        double log_r = 0.0;
-        double p = 0.0;
-        for (size_t idx = 0; idx < alpha2; idx++) {
-
-            p += exp(log_r + log_c);
-            //r *= ((alpha1+idx)*(beta2+idx))/((idx+1)*(idx+alpha1+beta1+beta2));
-            log_r = log(alpha1+idx)+log(beta2+idx)-(log(idx+1) + log(idx+alpha1+beta1+beta2)) + log_r;
-        }
-        //p *= c;
-
-        if (p < 0.45)
-            return true;
-        if (p  > 0.55)
-            return false;
-        if (r1.dbLen - r1.alnLength < r2.dbLen - r2.alnLength)
-            return true;
-        if (r1.dbLen - r1.alnLength > r2.dbLen - r2.alnLength)
-            return false;
-
-        return true;
+    bool operator() (const AssemblyHit & r1,const AssemblyHit & r2) {
+        return BetaBinomial::compare(r1, r2);
     }
 };
 
-typedef std::priority_queue<Matcher::result_t, std::vector<Matcher::result_t> , CompareResultBySeqId> QueueBySeqId;
-Matcher::result_t selectBestFragmentToExtend(QueueBySeqId &alignments,
-                                             unsigned int queryKey) {
+typedef HitQueue<CompareResultBySeqId> QueueBySeqId;
+// returns the index of the hit in hits or UINT_MAX
+unsigned int selectBestFragmentToExtend(QueueBySeqId &alignments, const std::vector<AssemblyHit> &hits,
+                                        unsigned int queryKey, unsigned int queryLen) {
     // results are ordered by seqid
     while (alignments.empty() == false){
-        Matcher::result_t res = alignments.top();
+        unsigned int hitIdx = alignments.top();
         alignments.pop();
+        const AssemblyHit &res = hits[hitIdx];
         size_t dbKey = res.dbKey;
         const bool notRightStartAndLeftStart = !(res.dbStartPos == 0 && res.qStartPos == 0);
         const bool rightStart = res.dbStartPos == 0 && (res.dbEndPos != static_cast<int>(res.dbLen)-1);
-        const bool leftStart = res.qStartPos == 0   && (res.qEndPos != static_cast<int>(res.qLen)-1);
+        const bool leftStart = res.qStartPos == 0   && (res.qEndPos != static_cast<int>(queryLen)-1);
         const bool isNotIdentity = (dbKey != queryKey);
         if ((rightStart || leftStart) && notRightStartAndLeftStart && isNotIdentity){
-            return res;
+            return hitIdx;
         }
     }
-    return Matcher::result_t(UINT_MAX,0,0,0,0,0,0,0,0,0,0,0,0,"");
+    return UINT_MAX;
 }
 
-inline void updateNuclAlignment(Matcher::result_t &tmpAlignment, DistanceCalculator::LocalAlignment &alignment,
-                                const char *querySeq, size_t querySeqLen, const char *tSeq, size_t tSeqLen) {
+inline void updateNuclAlignment(AssemblyHit &tmpAlignment, DistanceCalculator::LocalAlignment &alignment,
+                                unsigned int idCnt, size_t tSeqLen) {
 
     int qStartPos, qEndPos, dbStartPos, dbEndPos;
     int diag = alignment.diagonal;
@@ -112,18 +90,12 @@ inline void updateNuclAlignment(Matcher::result_t &tmpAlignment, DistanceCalcula
         dbEndPos = alignment.endPos + dist;
     }
 
-    int idCnt = 0;
-    for(int i = qStartPos; i < qEndPos; i++){
-        idCnt += (querySeq[i] == tSeq[dbStartPos+(i-qStartPos)]) ? 1 : 0;
-    }
     float seqId =  static_cast<float>(idCnt) / (static_cast<float>(qEndPos) - static_cast<float>(qStartPos));
 
     tmpAlignment.seqId = seqId;
-    tmpAlignment.qLen = querySeqLen;
     tmpAlignment.dbLen = tSeqLen;
 
-    tmpAlignment.alnLength = alignment.diagonalLen;
-    float scorePerCol = static_cast<float>(alignment.score ) / static_cast<float>(tmpAlignment.alnLength + 0.5);
+    float scorePerCol = static_cast<float>(alignment.score ) / static_cast<float>(alignment.diagonalLen + 0.5);
     tmpAlignment.score = static_cast<int>(scorePerCol*100);
 
     tmpAlignment.qStartPos = qStartPos;
@@ -133,36 +105,54 @@ inline void updateNuclAlignment(Matcher::result_t &tmpAlignment, DistanceCalcula
 
 }
 
-int doguidedassembleresult(LocalParameters &par) {
-    DBReader<unsigned int> *nuclSequenceDbr = new DBReader<unsigned int>(par.db1.c_str(), par.db1Index.c_str(),  par.threads, DBReader<unsigned int>::USE_DATA|DBReader<unsigned int>::USE_INDEX);
+ExtensionYield guidedAssembleResults(LocalParameters &par, const std::string &nuclSeqDb, const std::string &aaSeqDb,
+                                     const std::string &nuclAlnDb, const std::string &nuclOutDb, const std::string &aaOutDb) {
+    // never allow deletions
+    par.allowDeletion = false;
+
+    DBReader<unsigned int> *nuclSequenceDbr = new DBReader<unsigned int>(nuclSeqDb.c_str(), (nuclSeqDb + ".index").c_str(),  par.threads, DBReader<unsigned int>::USE_DATA|DBReader<unsigned int>::USE_INDEX);
     nuclSequenceDbr->open(DBReader<unsigned int>::NOSORT);
 
-    DBReader<unsigned int> *aaSequenceDbr = new DBReader<unsigned int>(par.db2.c_str(), par.db2Index.c_str(),  par.threads, DBReader<unsigned int>::USE_DATA|DBReader<unsigned int>::USE_INDEX);
+    DBReader<unsigned int> *aaSequenceDbr = new DBReader<unsigned int>(aaSeqDb.c_str(), (aaSeqDb + ".index").c_str(),  par.threads, DBReader<unsigned int>::USE_DATA|DBReader<unsigned int>::USE_INDEX);
     aaSequenceDbr->open(DBReader<unsigned int>::NOSORT);
 
-    DBReader<unsigned int> * nuclAlnReader = new DBReader<unsigned int>(par.db3.c_str(), par.db3Index.c_str(),  par.threads, DBReader<unsigned int>::USE_DATA|DBReader<unsigned int>::USE_INDEX);
+    DBReader<unsigned int> * nuclAlnReader = new DBReader<unsigned int>(nuclAlnDb.c_str(), (nuclAlnDb + ".index").c_str(),  par.threads, DBReader<unsigned int>::USE_DATA|DBReader<unsigned int>::USE_INDEX);
     nuclAlnReader->open(DBReader<unsigned int>::NOSORT);
 
-    DBWriter nuclResultWriter(par.db4.c_str(), par.db4Index.c_str(), par.threads, par.compressed, Parameters::DBTYPE_NUCLEOTIDES);
+    DBWriter nuclResultWriter(nuclOutDb.c_str(), (nuclOutDb + ".index").c_str(), par.threads, par.compressed, Parameters::DBTYPE_NUCLEOTIDES);
     nuclResultWriter.open();
 
-    DBWriter aaResultWriter(par.db5.c_str(), par.db5Index.c_str(), par.threads, par.compressed, Parameters::DBTYPE_AMINO_ACIDS);
+    DBWriter aaResultWriter(aaOutDb.c_str(), (aaOutDb + ".index").c_str(), par.threads, par.compressed, Parameters::DBTYPE_AMINO_ACIDS);
     aaResultWriter.open();
 
     NucleotideMatrix subMat(par.scoringMatrixFile.nucleotides, 1.0f, 0.0f);
     SubstitutionMatrix::FastMatrix fastMatrix = SubstitutionMatrix::createAsciiSubMat(subMat);
+    IncrementalUngappedAligner ungappedAligner(fastMatrix.matrix, par.rescoreMode);
 
     unsigned char * wasExtended = new unsigned char[nuclSequenceDbr->getSize()];
     std::fill(wasExtended, wasExtended+nuclSequenceDbr->getSize(), 0);
+    size_t extended = 0;
+    size_t addedResidues = 0;
     Debug::Progress progress(nuclSequenceDbr->getSize());
-#pragma omp parallel
+#pragma omp parallel reduction(+:extended, addedResidues)
     {
         unsigned int thread_idx = 0;
 #ifdef OPENMP
         thread_idx = (unsigned int) omp_get_thread_num();
 #endif
-        std::vector<Matcher::result_t> nuclAlignments;
+        // hits of the current query, the queue and tmpNuclAlignments refer to them by index
+        std::vector<AssemblyHit> nuclAlignments;
         nuclAlignments.reserve(300);
+        QueueBySeqId alnQueue(nuclAlignments);
+        std::vector<unsigned int> tmpNuclAlignments;
+        ContigBuffer nuclQuery;
+        ContigBuffer aaQuery;
+        // targets of compressed databases, grows to the longest seen
+        std::vector<char> targetCopies;
+        std::vector<IncrementalUngappedAligner::Target> rescoreTargets;
+        std::vector<IncrementalUngappedAligner::Result> rescoreResults;
+        // overlap sums of the pending hits of the current query by target key
+        std::unordered_map<unsigned int, IncrementalUngappedAligner::OverlapSum> overlapSums;
 
         #pragma omp for schedule(dynamic, 100)
         for (size_t id = 0; id < nuclSequenceDbr->getSize(); id++) {
@@ -177,18 +167,18 @@ int doguidedassembleresult(LocalParameters &par) {
             unsigned int aaQuerySeqLen = aaSequenceDbr->getSeqLen(aaQueryId);
 
 
-            std::string nuclQuery(nuclQuerySeq, nuclQuerySeqLen); // no /n/0
-            std::string aaQuery(aaQuerySeq, aaQuerySeqLen); // no /n/0
+            nuclQuery.assign(nuclQuerySeq, nuclQuerySeqLen); // no /n/0
+            aaQuery.assign(aaQuerySeq, aaQuerySeqLen); // no /n/0
 
             bool excludeLeftExtension = (aaQuery[0] == '*');
             bool excludeRightExtension = (aaQuery[aaQuerySeqLen-1] == '*');
 
             char *nuclAlnData = nuclAlnReader->getDataByDBKey(queryKey, thread_idx);
             nuclAlignments.clear();
-            Matcher::readAlignmentResults(nuclAlignments, nuclAlnData, true);
+            AssemblyHit::readAlignmentResults(nuclAlignments, nuclAlnData);
 
             bool queryCouldBeExtended = false;
-            QueueBySeqId alnQueue;
+            alnQueue.clear();
 
             // fill queue
             for (size_t alnIdx = 0; alnIdx < nuclAlignments.size(); alnIdx++) {
@@ -196,23 +186,25 @@ int doguidedassembleresult(LocalParameters &par) {
                 // re-evaluate sequence identity threshold on nucleotide level
                 if(nuclAlignments[alnIdx].seqId < par.seqIdThr)
                     continue;
-                alnQueue.push(nuclAlignments[alnIdx]);
+                alnQueue.push(alnIdx);
                 if (nuclAlignments.size() > 1) {
                     size_t id = nuclSequenceDbr->getId(nuclAlignments[alnIdx].dbKey);
                     __sync_or_and_fetch(&wasExtended[id],
                                         static_cast<unsigned char>(0x40));
                 }
             }
-            std::vector<Matcher::result_t> tmpNuclAlignments;
-            tmpNuclAlignments.reserve(nuclAlignments.size());
+            // residues prepended to the query since the alignments were read
+            unsigned int queryOffset = 0;
+            overlapSums.clear();
             while(!alnQueue.empty()){
 
                 unsigned int nuclLeftQueryOffset = 0;
                 unsigned int nuclRightQueryOffset = 0;
                 tmpNuclAlignments.clear();
-                Matcher::result_t nuclBesttHitToExtend;
+                unsigned int hitIdx;
 
-                while ((nuclBesttHitToExtend = selectBestFragmentToExtend(alnQueue, queryKey)).dbKey != UINT_MAX) {
+                while ((hitIdx = selectBestFragmentToExtend(alnQueue, nuclAlignments, queryKey, nuclQuerySeqLen)) != UINT_MAX) {
+                    const AssemblyHit &nuclBesttHitToExtend = nuclAlignments[hitIdx];
 
 //                nuclQuerySeq.mapSequence(id, queryKey, nuclQuery.c_str());
                     unsigned int nuclTargetId = nuclSequenceDbr->getId(nuclBesttHitToExtend.dbKey);
@@ -252,7 +244,7 @@ int doguidedassembleresult(LocalParameters &par) {
                         //right extension
 
                         if(nuclRightQueryOffset > 0) {
-                            tmpNuclAlignments.push_back(nuclBesttHitToExtend);
+                            tmpNuclAlignments.push_back(hitIdx);
                             continue;
                         }
                         unsigned int nuclDbFragLen = (nuclTargetSeqLen - nuclDbEndPos) - 1; // -1 get not aligned element
@@ -264,11 +256,8 @@ int doguidedassembleresult(LocalParameters &par) {
                             break;
                         }
 
-                        std::string fragment = std::string(nuclTargetSeq + nuclDbEndPos + 1, nuclDbFragLen);
-                        std::string aaFragment = std::string(aaTargetSeq + nuclDbEndPos/3 + 1, aaDbFragLen);
-
-                        nuclQuery += fragment;
-                        aaQuery += aaFragment;
+                        nuclQuery.append(nuclTargetSeq + nuclDbEndPos + 1, nuclDbFragLen);
+                        aaQuery.append(aaTargetSeq + nuclDbEndPos/3 + 1, aaDbFragLen);
                         nuclRightQueryOffset += nuclDbFragLen;
                         //update that dbKey was used in assembly
                         __sync_or_and_fetch(&wasExtended[nuclTargetId], static_cast<unsigned char>(0x80));
@@ -277,7 +266,7 @@ int doguidedassembleresult(LocalParameters &par) {
                         //left extension
 
                         if (nuclLeftQueryOffset > 0) {
-                            tmpNuclAlignments.push_back(nuclBesttHitToExtend);
+                            tmpNuclAlignments.push_back(hitIdx);
                             continue;
                         }
 
@@ -289,11 +278,8 @@ int doguidedassembleresult(LocalParameters &par) {
                         }
 
                         int hasStart = (aaTargetSeq[0] == '*')? 1:0;
-                        std::string fragment = std::string(nuclTargetSeq, nuclDbFragLen); // get not aligned element
-                        std::string aaFragment = std::string(aaTargetSeq, nuclDbFragLen/3 + hasStart); // get not aligned element
-
-                        nuclQuery = fragment + nuclQuery;
-                        aaQuery = aaFragment + aaQuery;
+                        nuclQuery.prepend(nuclTargetSeq, nuclDbFragLen); // get not aligned element
+                        aaQuery.prepend(aaTargetSeq, nuclDbFragLen/3 + hasStart); // get not aligned element
                         nuclLeftQueryOffset += nuclDbFragLen;
 
                         // update that dbKey was used in assembly
@@ -309,42 +295,68 @@ int doguidedassembleresult(LocalParameters &par) {
                     break;
 
                 nuclQuerySeqLen = nuclQuery.length();
-                nuclQuerySeq = (char *) nuclQuery.c_str();
+                nuclQuerySeq = (char *) nuclQuery.data();
 
                 // update alignments
+                queryOffset += nuclLeftQueryOffset;
+                // getData of a compressed database reuses one buffer per thread, so the
+                // targets are copied before they are aligned together
+                const bool copyTargets = nuclSequenceDbr->isCompressed();
+                if (copyTargets) {
+                    size_t copiedTargetLen = 0;
+                    for (size_t alnIdx = 0; alnIdx < tmpNuclAlignments.size(); alnIdx++) {
+                        copiedTargetLen += nuclSequenceDbr->getSeqLen(nuclSequenceDbr->getId(nuclAlignments[tmpNuclAlignments[alnIdx]].dbKey));
+                    }
+                    if (targetCopies.size() < copiedTargetLen) {
+                        targetCopies.resize(copiedTargetLen);
+                    }
+                }
+                char *copiedTarget = targetCopies.data();
+                rescoreTargets.clear();
                 for(size_t alnIdx = 0; alnIdx < tmpNuclAlignments.size(); alnIdx++){
 
-                    unsigned int tId = nuclSequenceDbr->getId(tmpNuclAlignments[alnIdx].dbKey);
+                    const AssemblyHit &tmpAlignment = nuclAlignments[tmpNuclAlignments[alnIdx]];
+                    unsigned int tId = nuclSequenceDbr->getId(tmpAlignment.dbKey);
                     unsigned int tSeqLen = nuclSequenceDbr->getSeqLen(tId);
                     char *tSeq = nuclSequenceDbr->getData(tId, thread_idx);
+                    if (copyTargets) {
+                        memcpy(copiedTarget, tSeq, tSeqLen);
+                        tSeq = copiedTarget;
+                        copiedTarget += tSeqLen;
+                    }
 
-                    int qStartPos = tmpNuclAlignments[alnIdx].qStartPos;
-                    int dbStartPos = tmpNuclAlignments[alnIdx].dbStartPos;
+                    int qStartPos = tmpAlignment.qStartPos;
+                    int dbStartPos = tmpAlignment.dbStartPos;
                     int diag = (qStartPos + nuclLeftQueryOffset) - dbStartPos;
+                    rescoreTargets.emplace_back(tSeq, tSeqLen, diag, &overlapSums[tmpAlignment.dbKey]);
+                }
+                ungappedAligner.align(nuclQuerySeq, nuclQuerySeqLen, queryOffset, rescoreTargets, rescoreResults);
 
-                    DistanceCalculator::LocalAlignment alignment = DistanceCalculator::ungappedAlignmentByDiagonal(
-                            nuclQuerySeq, nuclQuerySeqLen, tSeq, tSeqLen,
-                            diag, fastMatrix.matrix, par.rescoreMode);
-
-                    updateNuclAlignment(tmpNuclAlignments[alnIdx], alignment, nuclQuerySeq, nuclQuerySeqLen, tSeq, tSeqLen);
+                for(size_t alnIdx = 0; alnIdx < tmpNuclAlignments.size(); alnIdx++){
+                    AssemblyHit &tmpAlignment = nuclAlignments[tmpNuclAlignments[alnIdx]];
+                    updateNuclAlignment(tmpAlignment, rescoreResults[alnIdx].alignment, rescoreResults[alnIdx].identities,
+                                        rescoreTargets[alnIdx].seqLen);
 
                     // refill queue
-                    if(tmpNuclAlignments[alnIdx].seqId >= par.seqIdThr)
+                    if(tmpAlignment.seqId >= par.seqIdThr)
                         alnQueue.push(tmpNuclAlignments[alnIdx]);
                 }
             }
             if (queryCouldBeExtended) {
+                extended++;
+                addedResidues += nuclQuery.length() - nuclSequenceDbr->getSeqLen(id);
                 nuclQuery.push_back('\n');
                 aaQuery.push_back('\n');
                 __sync_or_and_fetch(&wasExtended[id], static_cast<unsigned char>(0x20));
-                nuclResultWriter.writeData(nuclQuery.c_str(), nuclQuery.size(), queryKey, thread_idx);
-                aaResultWriter.writeData(aaQuery.c_str(), aaQuery.size(), queryKey, thread_idx);
+                nuclResultWriter.writeData(nuclQuery.data(), nuclQuery.length(), queryKey, thread_idx);
+                aaResultWriter.writeData(aaQuery.data(), aaQuery.length(), queryKey, thread_idx);
             }
         }
     } // end parallel
 
 // add sequences that are not yet assembled
-#pragma omp parallel for schedule(dynamic, 10000)
+    size_t merged = 0;
+#pragma omp parallel for schedule(dynamic, 10000) reduction(+:merged)
     for (size_t id = 0; id < nuclSequenceDbr->getSize(); id++) {
         unsigned int thread_idx = 0;
 #ifdef OPENMP
@@ -354,6 +366,7 @@ int doguidedassembleresult(LocalParameters &par) {
         bool isNotContig =  !(wasExtended[id] & 0x20);
 //        bool wasNotUsed =  !(wasExtended[id] & 0x40);
         bool wasNotExtended =  !(wasExtended[id] & 0x80);
+        merged += (wasNotExtended == false);
         //    bool wasUsed    =  (wasExtended[id] & 0x40);
         //if(isNotContig && wasNotExtended ){
         if (isNotContig && (par.keepTarget || wasNotExtended)){
@@ -366,6 +379,15 @@ int doguidedassembleresult(LocalParameters &par) {
         }
     }
 
+    // the yield is reported in nucleotides
+    ExtensionYield yield;
+    yield.queries = nuclSequenceDbr->getSize();
+    yield.extended = extended;
+    yield.addedResidues = addedResidues;
+    yield.merged = merged;
+    yield.print();
+    yield.writeFile(nuclOutDb);
+
     // cleanup
     aaResultWriter.close(aaSequenceDbr->getDbtype());
     nuclResultWriter.close(nuclSequenceDbr->getDbtype());
@@ -381,7 +403,7 @@ int doguidedassembleresult(LocalParameters &par) {
     delete nuclSequenceDbr;
     Debug(Debug::INFO) << "\nDone.\n";
 
-    return EXIT_SUCCESS;
+    return yield;
 }
 
 int guidedassembleresults(int argc, const char **argv, const Command& command) {
@@ -390,9 +412,8 @@ int guidedassembleresults(int argc, const char **argv, const Command& command) {
 
     MMseqsMPI::init(argc, argv);
 
-    // never allow deletions
-    par.allowDeletion = false;
     Debug(Debug::INFO) << "Compute assembly.\n";
-    return doguidedassembleresult(par);
-}
+    guidedAssembleResults(par, par.db1, par.db2, par.db3, par.db4, par.db5);
 
+    return EXIT_SUCCESS;
+}
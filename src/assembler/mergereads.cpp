@@ -7,15 +7,13 @@
 #include "Debug.h"
 #include "Util.h"
 #include "LocalParameters.h"
+#include "AssemblySteps.h"
 
 #ifdef OPENMP
 #include <omp.h>
 #endif
 
-int mergereads(int argn, const char **argv, const Command& command) {
-    LocalParameters& par = LocalParameters::getLocalInstance();
-    par.parseParameters(argn, argv, command, true, Parameters::PARSE_VARIADIC, 0);
-
+void mergeReads(LocalParameters &par, const std::vector<std::string> &filenames, const std::string &outFile) {
     combine_params alg_params;
     alg_params.max_overlap = 65;
     alg_params.min_overlap = 15;
@@ -23,8 +21,6 @@ int mergereads(int argn, const char **argv, const Command& command) {
     alg_params.cap_mismatch_quals = false;
     alg_params.allow_outies = false;
 
-    std::vector<std::string> filenames(par.filenames);
-    std::string outFile = par.filenames.back();
     std::string outIndexFile = outFile + ".index";
     DBWriter resultWriter(outFile.c_str(), outIndexFile.c_str(), 1, par.compressed, Parameters::DBTYPE_NUCLEOTIDES);
     resultWriter.open();
@@ -121,11 +117,16 @@ int mergereads(int argn, const char **argv, const Command& command) {
     }
     resultWriter.close(true);
     headerResultWriter.close(true);
+}
+
+int mergereads(int argn, const char **argv, const Command& command) {
+    LocalParameters& par = LocalParameters::getLocalInstance();
+    par.parseParameters(argn, argv, command, true, Parameters::PARSE_VARIADIC, 0);
+
+    std::vector<std::string> filenames(par.filenames.begin(), par.filenames.end() - 1);
+    mergeReads(par, filenames, par.filenames.back());
 
     Debug(Debug::INFO) << "\nDone.\n";
 
     return EXIT_SUCCESS;
 }
-
-
-
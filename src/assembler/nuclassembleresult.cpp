@@ -1,4 +1,11 @@
 #include "LocalParameters.h"
+#include "AssemblySteps.h"
+#include "IncrementalUngappedAligner.h"
+#include "ContigBuffer.h"
+#include "InMemoryDB.h"
+#include "AssemblyHit.h"
+#include "TargetStrands.h"
+#include "BetaBinomial.h"
 #include "DistanceCalculator.h"
 #include "Matcher.h"
 #include "DBReader.h"
@@ -7,9 +14,12 @@
 #include "Util.h"
 #include "MathUtil.h"
 
+#include <algorithm>
 #include <limits>
 #include <cstdint>
-#include <queue>
+#include <cstring>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #ifdef OPENMP
@@ -33,76 +43,43 @@ public:
             return false;
         return false;
     }*/
-    bool operator() (const Matcher::result_t & r1,const Matcher::result_t & r2) {
-        unsigned int mm_count1 = (1 - r1.seqId) * r1.alnLength + 0.5;
-        unsigned int mm_count2 = (1 - r2.seqId) * r2.alnLength + 0.5;
-
-        unsigned int alpha1 = mm_count1 + 1;
-        unsigned int alpha2 = mm_count2 + 1;
-        unsigned int beta1 = r1.alnLength - mm_count1 + 1;
-        unsigned int beta2 = r2.alnLength - mm_count2 + 1;
-
-        //double c=(std::tgamma(beta1+beta2)*std::tgamma(alpha1+beta2))/(std::tgamma(alpha1+beta1+beta2)*std::tgamma(beta1));
-        double log_c = (std::lgamma(beta1+beta2)+std::lgamma(alpha1+beta1))-(std::lgamma(alpha1+beta1+beta2)+std::lgamma(beta1));
-
-        //double r = 1.0; // r_0 =1
-        double log_r = 0.0;
-        double p = 0.0;
-        for (size_t idx = 0; idx < alpha2; idx++) {
-
-            p += exp(log_r + log_c);
-            //r *= ((alpha1+idx)*(beta2+idx))/((idx+1)*(idx+alpha1+beta1+beta2));
-            log_r = log(alpha1+idx)+log(beta2+idx)-(log(idx+1) + log(idx+alpha1+beta1+beta2)) + log_r;
-        }
-        //p *= c;
-
-        if (p < 0.45)
-            return true;
-        if (p  > 0.55)
-            return false;
-        if (r1.dbLen - r1.alnLength < r2.dbLen - r2.alnLength)
-            return true;
-        if (r1.dbLen - r1.alnLength > r2.dbLen - r2.alnLength)
-            return false;
-
-        return true;
+    explicit CompareNuclResultByScore(const SequenceCounts *counts = NULL) : counts(counts) {}
 
+    bool operator() (const AssemblyHit & r1,const AssemblyHit & r2) {
+        if (counts == NULL) {
+            return BetaBinomial::compare(r1, r2);
+        }
+        return BetaBinomial::compare(r1, r2, counts->get(r1.dbKey), counts->get(r2.dbKey));
     }
+
+private:
+    const SequenceCounts *counts;
 };
 
-typedef std::priority_queue<Matcher::result_t, std::vector<Matcher::result_t> , CompareNuclResultByScore> QueueByScoreNucl;
-Matcher::result_t selectNuclFragmentToExtend(QueueByScoreNucl &alignments,
-                                             unsigned int queryKey) {
+typedef HitQueue<CompareNuclResultByScore> QueueByScoreNucl;
+// returns the index of the hit in hits or UINT_MAX
+unsigned int selectNuclFragmentToExtend(QueueByScoreNucl &alignments, const std::vector<AssemblyHit> &hits,
+                                        unsigned int queryKey, unsigned int queryLen) {
     // results are ordered by score
     while (alignments.empty() == false){
-        Matcher::result_t res = alignments.top();
+        unsigned int hitIdx = alignments.top();
         alignments.pop();
+        const AssemblyHit &res = hits[hitIdx];
         size_t dbKey = res.dbKey;
         const bool notRightStartAndLeftStart = !(res.dbStartPos == 0 &&  res.qStartPos == 0 );
         const bool rightStart = res.dbStartPos == 0 && (res.dbEndPos != static_cast<int>(res.dbLen)-1);
-        const bool leftStart = res.qStartPos == 0   && (res.qEndPos != static_cast<int>(res.qLen)-1);
+        const bool leftStart = res.qStartPos == 0   && (res.qEndPos != static_cast<int>(queryLen)-1);
         const bool isNotIdentity = (dbKey != queryKey);
 
         if ((rightStart || leftStart) && notRightStartAndLeftStart && isNotIdentity){
-            return res;
+            return hitIdx;
         }
     }
-    return Matcher::result_t(UINT_MAX,0,0,0,0,0,0,0,0,0,0,0,0,"");
-}
-
-inline char* getNuclRevFragment(const char* fragment, size_t fragLen, NucleotideMatrix *nuclMatrix)
-{
-    char *fragmentRev = new char[fragLen];
-    for (int pos = fragLen - 1; pos > -1; pos--) {
-        int res = nuclMatrix->aa2num[static_cast<int>(fragment[pos])];
-        char revRes = nuclMatrix->num2aa[nuclMatrix->reverseResidue(res)];
-        fragmentRev[(fragLen - 1) - pos] = (revRes == 'X')? 'N' : revRes;
-    }
-    return fragmentRev;
+    return UINT_MAX;
 }
 
-inline void updateNuclAlignment(Matcher::result_t &tmpAlignment, DistanceCalculator::LocalAlignment &alignment,
-                                const char *querySeq, size_t querySeqLen, const char *tSeq, size_t tSeqLen) {
+inline void updateNuclAlignment(AssemblyHit &tmpAlignment, DistanceCalculator::LocalAlignment &alignment,
+                                unsigned int idCnt, size_t tSeqLen) {
 
     int qStartPos, qEndPos, dbStartPos, dbEndPos;
     int diag = alignment.diagonal;
@@ -120,18 +97,12 @@ inline void updateNuclAlignment(Matcher::result_t &tmpAlignment, DistanceCalcula
         dbEndPos = alignment.endPos + dist;
     }
 
-    int idCnt = 0;
-    for(int i = qStartPos; i < qEndPos; i++){
-        idCnt += (querySeq[i] == tSeq[dbStartPos+(i-qStartPos)]) ? 1 : 0;
-    }
     float seqId =  static_cast<float>(idCnt) / (static_cast<float>(qEndPos) - static_cast<float>(qStartPos));
 
     tmpAlignment.seqId = seqId;
-    tmpAlignment.qLen = querySeqLen;
     tmpAlignment.dbLen = tSeqLen;
 
-    tmpAlignment.alnLength = alignment.diagonalLen;
-    float scorePerCol = static_cast<float>(alignment.score ) / static_cast<float>(tmpAlignment.alnLength + 0.5);
+    float scorePerCol = static_cast<float>(alignment.score ) / static_cast<float>(alignment.diagonalLen + 0.5);
     tmpAlignment.score = static_cast<int>(scorePerCol*100);
 
     tmpAlignment.qStartPos = qStartPos;
@@ -141,16 +112,276 @@ inline void updateNuclAlignment(Matcher::result_t &tmpAlignment, DistanceCalcula
 
 }
 
-int doNuclAssembly(LocalParameters &par) {
-    DBReader<unsigned int> *sequenceDbr = new DBReader<unsigned int>(par.db1.c_str(), par.db1Index.c_str(), par.threads, DBReader<unsigned int>::USE_DATA|DBReader<unsigned int>::USE_INDEX);
-    sequenceDbr->open(DBReader<unsigned int>::NOSORT);
+// read whose end is the current end of the query, reverse if it is the reverse complement in the query
+struct NuclContigEnd {
+    unsigned int dbKey;
+    bool reverse;
 
-    DBReader<unsigned int> * alnReader = new DBReader<unsigned int>(par.db2.c_str(), par.db2Index.c_str(), par.threads, DBReader<unsigned int>::USE_DATA|DBReader<unsigned int>::USE_INDEX);
-    alnReader->open(DBReader<unsigned int>::NOSORT);
+    NuclContigEnd() : dbKey(UINT_MAX), reverse(false) {}
+};
 
-    DBWriter resultWriter(par.db3.c_str(), par.db3Index.c_str(), par.threads, par.compressed, sequenceDbr->getDbtype());
-    resultWriter.open();
+// For every read the keys of the reads with a hit to it. kmermatcher links the reads
+// of a k-mer group only to one center read, so the alignment list of a read misses
+// most of its overlaps.
+class NuclReverseHits {
+public:
+    void build(DBReader<unsigned int> *sequenceDbr, DBReader<unsigned int> *alnReader) {
+        offsets.assign(sequenceDbr->getSize() + 1, 0);
+#pragma omp parallel
+        {
+            unsigned int thread_idx = 0;
+#ifdef OPENMP
+            thread_idx = (unsigned int) omp_get_thread_num();
+#endif
+#pragma omp for schedule(dynamic, 1000)
+            for (size_t id = 0; id < alnReader->getSize(); id++) {
+                char *data = alnReader->getData(id, thread_idx);
+                while (*data != '\0') {
+                    unsigned int targetId = sequenceDbr->getId(Util::fast_atoi<unsigned int>(data));
+                    if (targetId != UINT_MAX) {
+                        __sync_fetch_and_add(&offsets[targetId + 1], 1);
+                    }
+                    data = Util::skipLine(data);
+                }
+            }
+        }
+        for (size_t i = 1; i < offsets.size(); i++) {
+            offsets[i] += offsets[i - 1];
+        }
+        queryKeys.resize(offsets.back());
+        std::vector<size_t> fill(offsets.begin(), offsets.end() - 1);
+#pragma omp parallel
+        {
+            unsigned int thread_idx = 0;
+#ifdef OPENMP
+            thread_idx = (unsigned int) omp_get_thread_num();
+#endif
+#pragma omp for schedule(dynamic, 1000)
+            for (size_t id = 0; id < alnReader->getSize(); id++) {
+                unsigned int queryKey = alnReader->getDbKey(id);
+                char *data = alnReader->getData(id, thread_idx);
+                while (*data != '\0') {
+                    unsigned int targetId = sequenceDbr->getId(Util::fast_atoi<unsigned int>(data));
+                    if (targetId != UINT_MAX) {
+                        queryKeys[__sync_fetch_and_add(&fill[targetId], 1)] = queryKey;
+                    }
+                    data = Util::skipLine(data);
+                }
+            }
+            // the fill order depends on the threads
+#pragma omp for schedule(dynamic, 1000)
+            for (size_t id = 0; id < sequenceDbr->getSize(); id++) {
+                std::sort(queryKeys.begin() + offsets[id], queryKeys.begin() + offsets[id + 1]);
+            }
+        }
+    }
+
+    const unsigned int *begin(unsigned int id) const {
+        return queryKeys.data() + offsets[id];
+    }
+
+    const unsigned int *end(unsigned int id) const {
+        return queryKeys.data() + offsets[id + 1];
+    }
+
+private:
+    std::vector<size_t> offsets;
+    std::vector<unsigned int> queryKeys;
+};
+
+// per-thread buffers of extendNuclTransitively
+struct NuclTransitiveWalk {
+    struct Candidate {
+        unsigned int dbKey;
+        unsigned int targetId;
+        bool reverse;
+        size_t fragOffset;
+        unsigned int fragLen;
+    };
+
+    // hits of the read at the end from both alignment directions, with the read as
+    // forward query and each target in the orientation of the alignment
+    std::vector<AssemblyHit> hits;
+    std::vector<bool> hitReverse;
+    std::vector<AssemblyHit> sourceHits;
+    std::vector<Candidate> candidates;
+    // fragments of all candidates in query orientation
+    std::vector<char> fragments;
+    // reads already in the contig, a walk never visits a read twice
+    std::unordered_set<unsigned int> usedKeys;
+};
+
+// Keeps extending one end of the query with the overlaps of the read at that end.
+// Candidates are the overlaps that reach beyond the query end, the longest one is
+// added as long as all others agree with it. Returns true if the query was extended.
+bool extendNuclTransitively(LocalParameters &par, DBReader<unsigned int> *sequenceDbr,
+                            DBReader<unsigned int> *alnReader, const NuclReverseHits &reverseHits,
+                            NucleotideMatrix *nuclMat, unsigned int thread_idx, unsigned int queryKey,
+                            NuclContigEnd end, bool rightEnd, ContigBuffer &query,
+                            unsigned char *wasExtended, NuclTransitiveWalk &walk) {
+    const bool isNucl = Parameters::isEqualDbtype(sequenceDbr->getDbtype(), Parameters::DBTYPE_NUCLEOTIDES);
+    bool extended = false;
+    while (end.dbKey != UINT_MAX) {
+        walk.hits.clear();
+        walk.hitReverse.clear();
+        walk.candidates.clear();
+        walk.fragments.clear();
+
+        unsigned int endId = sequenceDbr->getId(end.dbKey);
+        const int endLen = static_cast<int>(sequenceDbr->getSeqLen(endId));
+        AssemblyHit::readAlignmentResults(walk.hits, alnReader->getDataByDBKey(end.dbKey, thread_idx));
+        for (size_t hitIdx = 0; hitIdx < walk.hits.size(); hitIdx++) {
+            AssemblyHit &hit = walk.hits[hitIdx];
+            bool hitReverse = isNucl && hit.qStartPos > hit.qEndPos;
+            if (hitReverse) {
+                std::swap(hit.qStartPos, hit.qEndPos);
+                int dbStartPos = hit.dbStartPos;
+                hit.dbStartPos = hit.dbLen - hit.dbEndPos - 1;
+                hit.dbEndPos = hit.dbLen - dbStartPos - 1;
+            }
+            walk.hitReverse.push_back(hitReverse);
+        }
+        // hits of other reads to the read at the end, seen from the read
+        for (const unsigned int *it = reverseHits.begin(endId); it != reverseHits.end(endId); ++it) {
+            if (walk.usedKeys.find(*it) != walk.usedKeys.end()) {
+                continue;
+            }
+            walk.sourceHits.clear();
+            AssemblyHit::readAlignmentResults(walk.sourceHits, alnReader->getDataByDBKey(*it, thread_idx));
+            for (size_t hitIdx = 0; hitIdx < walk.sourceHits.size(); hitIdx++) {
+                const AssemblyHit &sourceHit = walk.sourceHits[hitIdx];
+                if (sourceHit.dbKey != end.dbKey) {
+                    continue;
+                }
+                const int sourceLen = static_cast<int>(sequenceDbr->getSeqLen(sequenceDbr->getId(*it)));
+                AssemblyHit hit = sourceHit;
+                hit.dbKey = *it;
+                hit.dbLen = sourceLen;
+                hit.qStartPos = sourceHit.dbStartPos;
+                hit.qEndPos = sourceHit.dbEndPos;
+                bool hitReverse = isNucl && sourceHit.qStartPos > sourceHit.qEndPos;
+                if (hitReverse) {
+                    hit.dbStartPos = sourceLen - sourceHit.qStartPos - 1;
+                    hit.dbEndPos = sourceLen - sourceHit.qEndPos - 1;
+                } else {
+                    hit.dbStartPos = sourceHit.qStartPos;
+                    hit.dbEndPos = sourceHit.qEndPos;
+                }
+                walk.hits.push_back(hit);
+                walk.hitReverse.push_back(hitReverse);
+            }
+        }
+
+        // the end of the query is the right end of the read unless the read is reversed
+        const bool readRightEnd = (rightEnd != end.reverse);
+        size_t longest = SIZE_MAX;
+        for (size_t hitIdx = 0; hitIdx < walk.hits.size(); hitIdx++) {
+            const AssemblyHit &hit = walk.hits[hitIdx];
+            if (hit.dbKey == end.dbKey || hit.dbKey == queryKey || hit.seqId < par.seqIdThr
+                || walk.usedKeys.find(hit.dbKey) != walk.usedKeys.end()) {
+                continue;
+            }
+            unsigned int fragLen;
+            if (readRightEnd) {
+                if (hit.dbStartPos != 0 || hit.qEndPos != endLen - 1
+                    || hit.qStartPos == 0 || hit.dbEndPos >= static_cast<int>(hit.dbLen) - 1) {
+                    continue;
+                }
+                fragLen = hit.dbLen - (hit.dbEndPos + 1);
+            } else {
+                if (hit.qStartPos != 0 || hit.dbEndPos != static_cast<int>(hit.dbLen) - 1
+                    || hit.dbStartPos == 0 || hit.qEndPos >= endLen - 1) {
+                    continue;
+                }
+                fragLen = hit.dbStartPos;
+            }
+            unsigned int targetId = sequenceDbr->getId(hit.dbKey);
+            if (targetId == UINT_MAX) {
+                Debug(Debug::ERROR) << "Could not find targetId  " << hit.dbKey
+                                    << " in database " << sequenceDbr->getDataFileName() << "\n";
+                EXIT(EXIT_FAILURE);
+            }
+
+            // fragment beyond the query end in query orientation
+            NuclTransitiveWalk::Candidate candidate;
+            candidate.dbKey = hit.dbKey;
+            candidate.targetId = targetId;
+            candidate.reverse = (end.reverse != walk.hitReverse[hitIdx]);
+            candidate.fragOffset = walk.fragments.size();
+            candidate.fragLen = fragLen;
+            const char *targetSeq = sequenceDbr->getData(targetId, thread_idx);
+            unsigned int targetSeqLen = sequenceDbr->getSeqLen(targetId);
+            walk.fragments.resize(candidate.fragOffset + fragLen);
+            char *frag = walk.fragments.data() + candidate.fragOffset;
+            if (candidate.reverse) {
+                const char *src = rightEnd ? targetSeq : targetSeq + (targetSeqLen - fragLen);
+                nuclMat->reverseComplement(src, fragLen, frag, 'N');
+            } else {
+                const char *src = rightEnd ? targetSeq + (targetSeqLen - fragLen) : targetSeq;
+                memcpy(frag, src, fragLen);
+            }
+            if (longest == SIZE_MAX || fragLen > walk.candidates[longest].fragLen) {
+                longest = walk.candidates.size();
+            }
+            walk.candidates.push_back(candidate);
+        }
+        if (longest == SIZE_MAX) {
+            break;
+        }
+
+        // all candidates have to continue the query like the longest one
+        const NuclTransitiveWalk::Candidate &best = walk.candidates[longest];
+        const char *bestFrag = walk.fragments.data() + best.fragOffset;
+        bool ambiguous = false;
+        for (size_t i = 0; i < walk.candidates.size() && ambiguous == false; i++) {
+            const NuclTransitiveWalk::Candidate &candidate = walk.candidates[i];
+            const char *frag = walk.fragments.data() + candidate.fragOffset;
+            const char *bestPart = rightEnd ? bestFrag : bestFrag + (best.fragLen - candidate.fragLen);
+            ambiguous = memcmp(frag, bestPart, candidate.fragLen) != 0;
+        }
+        if (ambiguous) {
+            break;
+        }
+        if (query.size() + best.fragLen >= par.maxSeqLen) {
+            break;
+        }
+
+        if (rightEnd) {
+            query.append(bestFrag, best.fragLen);
+        } else {
+            query.prepend(bestFrag, best.fragLen);
+        }
+        __sync_or_and_fetch(&wasExtended[best.targetId], static_cast<unsigned char>(0x90));
+        walk.usedKeys.insert(best.dbKey);
+        end.dbKey = best.dbKey;
+        end.reverse = best.reverse;
+        extended = true;
+    }
+    return extended;
+}
+
+// a sequence can only be contained in a longer one or, for equal lengths, in the one with
+// the smaller key. So the longest sequence of a group that contain each other is kept.
+static bool isContainedBy(unsigned int len, unsigned int key, unsigned int otherLen, unsigned int otherKey) {
+    return len < otherLen || (len == otherLen && key > otherKey);
+}
+
+// keeps the smallest key of all sequences that contain a sequence, so the result does
+// not depend on the order of the threads
+static void setContainer(unsigned int *container, unsigned int key) {
+    unsigned int current = *container;
+    while (key < current) {
+        unsigned int previous = __sync_val_compare_and_swap(container, current, key);
+        if (previous == current) {
+            break;
+        }
+        current = previous;
+    }
+}
 
+template <typename Writer>
+ExtensionYield nuclAssemble(LocalParameters &par, DBReader<unsigned int> *sequenceDbr, DBReader<unsigned int> *alnReader,
+                            Writer &resultWriter, Writer *containedWriter, const SequenceCounts *counts) {
     int seqType = sequenceDbr->getDbtype();
     BaseMatrix *subMat;
     if (Parameters::isEqualDbtype(seqType, Parameters::DBTYPE_NUCLEOTIDES)) {
@@ -160,22 +391,49 @@ int doNuclAssembly(LocalParameters &par) {
     }
 
     SubstitutionMatrix::FastMatrix fastMatrix = SubstitutionMatrix::createAsciiSubMat(*subMat);
+    IncrementalUngappedAligner ungappedAligner(fastMatrix.matrix, par.rescoreMode);
     EvalueComputation evaluer(sequenceDbr->getAminoAcidDBSize(), subMat);
 
     unsigned char * wasExtended = new unsigned char[sequenceDbr->getSize()];
     std::fill(wasExtended, wasExtended+sequenceDbr->getSize(), 0);
+    // key of a sequence that completely covers the sequence or UINT_MAX
+    unsigned int *containedIn = NULL;
+    if (par.dropContained) {
+        containedIn = new unsigned int[sequenceDbr->getSize()];
+        std::fill(containedIn, containedIn + sequenceDbr->getSize(), UINT_MAX);
+    }
+    NuclReverseHits reverseHits;
+    if (par.transitiveExtension) {
+        reverseHits.build(sequenceDbr, alnReader);
+    }
+
+    size_t extended = 0;
+    size_t addedResidues = 0;
     Debug::Progress progress(sequenceDbr->getSize());
-#pragma omp parallel
+#pragma omp parallel reduction(+:extended, addedResidues)
     {
         unsigned int thread_idx = 0;
 #ifdef OPENMP
         thread_idx = (unsigned int) omp_get_thread_num();
 #endif
 
-        std::vector<Matcher::result_t> alignments;
+        // hits of the current query, the queue and tmpAlignments refer to them by index
+        std::vector<AssemblyHit> alignments;
         alignments.reserve(300);
-        bool *useReverse = new bool[sequenceDbr->getSize()];
-        std::fill(useReverse, useReverse+sequenceDbr->getSize(), false);
+        QueueByScoreNucl alnQueue(alignments, CompareNuclResultByScore(counts));
+        std::vector<unsigned int> tmpAlignments;
+        // strand of each hit of the current query
+        std::vector<std::pair<unsigned int, bool>> strands;
+        strands.reserve(300);
+        ContigBuffer query;
+        // reverse complement of target fragments and the copies of the targets that are
+        // realigned after an extension, grows to the longest seen
+        std::vector<char> revFragment;
+        std::vector<IncrementalUngappedAligner::Target> rescoreTargets;
+        std::vector<IncrementalUngappedAligner::Result> rescoreResults;
+        // overlap sums of the pending hits of the current query by target key
+        std::unordered_map<unsigned int, IncrementalUngappedAligner::OverlapSum> overlapSums;
+        NuclTransitiveWalk walk;
 #pragma omp for schedule(dynamic, 100)
         for (size_t id = 0; id < sequenceDbr->getSize(); id++) {
             progress.updateProgress();
@@ -183,20 +441,21 @@ int doNuclAssembly(LocalParameters &par) {
             unsigned int queryKey = sequenceDbr->getDbKey(id);
             char *querySeq = sequenceDbr->getData(id, thread_idx);
             unsigned int querySeqLen = sequenceDbr->getSeqLen(id);
-            std::string query(querySeq, querySeqLen); // no /n/0
+            query.assign(querySeq, querySeqLen); // no /n/0
 
             char *alnData = alnReader->getDataByDBKey(queryKey, thread_idx);
             alignments.clear();
-            Matcher::readAlignmentResults(alignments, alnData);
+            strands.clear();
+            AssemblyHit::readAlignmentResults(alignments, alnData);
 
             bool queryCouldBeExtended = false;
-            QueueByScoreNucl alnQueue;
+            alnQueue.clear();
 
             // fill queue
             for (size_t alnIdx = 0; alnIdx < alignments.size(); alnIdx++) {
 
                 int rawScore = static_cast<int>(evaluer.computeRawScoreFromBitScore(alignments[alnIdx].score) + 0.5);
-                float scorePerCol = static_cast<float>(rawScore) / static_cast<float>(alignments[alnIdx].alnLength + 0.5);
+                float scorePerCol = static_cast<float>(rawScore) / static_cast<float>(alignments[alnIdx].alnLength() + 0.5);
 
                 //float alnLen = static_cast<float>(alignments[alnIdx].alnLength);
                 //float ids = static_cast<float>(alignments[alnIdx].seqId) * alnLen;
@@ -205,7 +464,7 @@ int doNuclAssembly(LocalParameters &par) {
 
                 if (seqType == Parameters::DBTYPE_NUCLEOTIDES) {
                     if (alignments[alnIdx].qStartPos > alignments[alnIdx].qEndPos) {
-                        useReverse[sequenceDbr->getId(alignments[alnIdx].dbKey)] = true;
+                        strands.emplace_back(alignments[alnIdx].dbKey, true);
 
                         std::swap(alignments[alnIdx].qStartPos, alignments[alnIdx].qEndPos);
                         unsigned int dbStartPos = alignments[alnIdx].dbStartPos;
@@ -213,25 +472,44 @@ int doNuclAssembly(LocalParameters &par) {
                         alignments[alnIdx].dbEndPos= alignments[alnIdx].dbLen - dbStartPos - 1;
 
                     } else {
-                        useReverse[sequenceDbr->getId(alignments[alnIdx].dbKey)] = false;
+                        strands.emplace_back(alignments[alnIdx].dbKey, false);
                     }
                 }
 
-                alnQueue.push(alignments[alnIdx]);
+                alnQueue.push(alnIdx);
                 if (alignments.size() > 1)
                     __sync_or_and_fetch(&wasExtended[sequenceDbr->getId(alignments[alnIdx].dbKey)],
                                         static_cast<unsigned char>(0x40));
+
+                const AssemblyHit &hit = alignments[alnIdx];
+                if (containedIn != NULL && hit.dbKey != queryKey && hit.seqId >= par.seqIdThr
+                    && hit.dbStartPos == 0 && hit.dbEndPos == static_cast<int>(hit.dbLen) - 1
+                    && isContainedBy(hit.dbLen, hit.dbKey, querySeqLen, queryKey)) {
+                    setContainer(&containedIn[sequenceDbr->getId(hit.dbKey)], queryKey);
+                }
+            }
+
+            std::stable_sort(strands.begin(), strands.end(), compareStrandByKey);
+
+            // reads that extended the query last at each end, start of the transitive walks
+            NuclContigEnd leftEnd;
+            NuclContigEnd rightEnd;
+            if (par.transitiveExtension) {
+                walk.usedKeys.clear();
+                walk.usedKeys.insert(queryKey);
             }
 
-            std::vector<Matcher::result_t> tmpAlignments;
-            tmpAlignments.reserve(alignments.size());
+            // residues prepended to the query since the alignments were read
+            unsigned int queryOffset = 0;
+            overlapSums.clear();
             while (!alnQueue.empty()) {
 
                 unsigned int leftQueryOffset = 0;
                 unsigned int rightQueryOffset = 0;
                 tmpAlignments.clear();
-                Matcher::result_t besttHitToExtend;
-                while ((besttHitToExtend = selectNuclFragmentToExtend(alnQueue, queryKey)).dbKey != UINT_MAX) {
+                unsigned int hitIdx;
+                while ((hitIdx = selectNuclFragmentToExtend(alnQueue, alignments, queryKey, querySeqLen)) != UINT_MAX) {
+                    const AssemblyHit &besttHitToExtend = alignments[hitIdx];
 
                     unsigned int targetId = sequenceDbr->getId(besttHitToExtend.dbKey);
                     if (targetId == UINT_MAX) {
@@ -262,7 +540,7 @@ int doNuclAssembly(LocalParameters &par) {
                         //right extension
 
                         if(rightQueryOffset > 0) {
-                            tmpAlignments.push_back(besttHitToExtend);
+                            tmpAlignments.push_back(hitIdx);
                             continue;
                         }
 
@@ -274,26 +552,32 @@ int doNuclAssembly(LocalParameters &par) {
                             break;
                         }
 
-                        std::string fragment;
-                        if (useReverse[targetId]) {
-                            char *cfragment = getNuclRevFragment(targetSeq, fragLen, (NucleotideMatrix *) subMat);
-                            fragment = std::string(cfragment, fragLen);
-                            delete[] cfragment;
+                        bool isReverse = isReverseTarget(strands, besttHitToExtend.dbKey);
+                        if (isReverse) {
+                            if (revFragment.size() < fragLen) {
+                                revFragment.resize(fragLen);
+                            }
+                            ((NucleotideMatrix *) subMat)->reverseComplement(targetSeq, fragLen, revFragment.data(), 'N');
+                            query.append(revFragment.data(), fragLen);
                         }
                         else
-                           fragment = std::string(targetSeq + dbEndPos + 1, fragLen);
+                            query.append(targetSeq + dbEndPos + 1, fragLen);
 
-                        query += fragment;
                         rightQueryOffset += fragLen;
+                        rightEnd.dbKey = besttHitToExtend.dbKey;
+                        rightEnd.reverse = isReverse;
                         //update that dbKey was used in assembly
                         __sync_or_and_fetch(&wasExtended[targetId], static_cast<unsigned char>(0x80));
+                        if (par.transitiveExtension) {
+                            walk.usedKeys.insert(besttHitToExtend.dbKey);
+                        }
 
                     }
                     else if (qStartPos == 0 && dbEndPos == (targetSeqLen - 1)) {
                         //left extension
 
                         if(leftQueryOffset > 0) {
-                            tmpAlignments.push_back(besttHitToExtend);
+                            tmpAlignments.push_back(hitIdx);
                             continue;
                         }
 
@@ -304,19 +588,25 @@ int doNuclAssembly(LocalParameters &par) {
                             break;
                         }
 
-                        std::string fragment;
-                        if (useReverse[targetId]) {
-                            char *cfragment = getNuclRevFragment(targetSeq + (targetSeqLen - dbStartPos), fragLen, (NucleotideMatrix *) subMat);
-                            fragment = std::string(cfragment, fragLen);
-                            delete[] cfragment;
+                        bool isReverse = isReverseTarget(strands, besttHitToExtend.dbKey);
+                        if (isReverse) {
+                            if (revFragment.size() < fragLen) {
+                                revFragment.resize(fragLen);
+                            }
+                            ((NucleotideMatrix *) subMat)->reverseComplement(targetSeq + (targetSeqLen - dbStartPos), fragLen, revFragment.data(), 'N');
+                            query.prepend(revFragment.data(), fragLen);
                         }
                         else
-                            fragment = std::string(targetSeq, fragLen);
+                            query.prepend(targetSeq, fragLen);
 
-                        query = fragment + query;
                         leftQueryOffset += fragLen;
+                        leftEnd.dbKey = besttHitToExtend.dbKey;
+                        leftEnd.reverse = isReverse;
                         //update that dbKey was used in assembly
                         __sync_or_and_fetch(&wasExtended[targetId], static_cast<unsigned char>(0x80));
+                        if (par.transitiveExtension) {
+                            walk.usedKeys.insert(besttHitToExtend.dbKey);
+                        }
                     }
 
                 }
@@ -328,44 +618,85 @@ int doNuclAssembly(LocalParameters &par) {
                     break;
 
                 querySeqLen = query.length();
-                querySeq = (char *) query.c_str();
+                querySeq = (char *) query.data();
 
                 // update alignments
-                for(size_t alnIdx = 0; alnIdx < tmpAlignments.size(); alnIdx++) {
-
-                    unsigned int tId = sequenceDbr->getId(tmpAlignments[alnIdx].dbKey);
+                queryOffset += leftQueryOffset;
+                // getData of a compressed database reuses one buffer per thread, so all
+                // targets are copied like the reverse ones before they are aligned together
+                const bool copyTargets = sequenceDbr->isCompressed();
+                size_t copiedTargetLen = 0;
+                for (size_t alnIdx = 0; alnIdx < tmpAlignments.size(); alnIdx++) {
+                    unsigned int dbKey = alignments[tmpAlignments[alnIdx]].dbKey;
+                    if (copyTargets || isReverseTarget(strands, dbKey)) {
+                        copiedTargetLen += sequenceDbr->getSeqLen(sequenceDbr->getId(dbKey));
+                    }
+                }
+                if (revFragment.size() < copiedTargetLen) {
+                    revFragment.resize(copiedTargetLen);
+                }
+                char *copiedTarget = revFragment.data();
+                rescoreTargets.clear();
+                for (size_t alnIdx = 0; alnIdx < tmpAlignments.size(); alnIdx++) {
+                    const AssemblyHit &tmpAlignment = alignments[tmpAlignments[alnIdx]];
+                    unsigned int tId = sequenceDbr->getId(tmpAlignment.dbKey);
                     unsigned int tSeqLen = sequenceDbr->getSeqLen(tId);
                     char *tSeq = sequenceDbr->getData(tId, thread_idx);
-                    if (useReverse[tId])
-                        tSeq = getNuclRevFragment(tSeq, tSeqLen, (NucleotideMatrix *) subMat);
+                    if (isReverseTarget(strands, tmpAlignment.dbKey)) {
+                        ((NucleotideMatrix *) subMat)->reverseComplement(tSeq, tSeqLen, copiedTarget, 'N');
+                        tSeq = copiedTarget;
+                        copiedTarget += tSeqLen;
+                    } else if (copyTargets) {
+                        memcpy(copiedTarget, tSeq, tSeqLen);
+                        tSeq = copiedTarget;
+                        copiedTarget += tSeqLen;
+                    }
 
-                    int qStartPos = tmpAlignments[alnIdx].qStartPos;
-                    int dbStartPos = tmpAlignments[alnIdx].dbStartPos;
+                    int qStartPos = tmpAlignment.qStartPos;
+                    int dbStartPos = tmpAlignment.dbStartPos;
                     int diag = (qStartPos + leftQueryOffset) - dbStartPos;
+                    rescoreTargets.emplace_back(tSeq, tSeqLen, diag, &overlapSums[tmpAlignment.dbKey]);
+                }
+                ungappedAligner.align(querySeq, querySeqLen, queryOffset, rescoreTargets, rescoreResults);
 
-                    DistanceCalculator::LocalAlignment alignment = DistanceCalculator::ungappedAlignmentByDiagonal(
-                                                                   querySeq, querySeqLen, tSeq, tSeqLen,
-                                                                   diag, fastMatrix.matrix, par.rescoreMode);
-
-                    updateNuclAlignment(tmpAlignments[alnIdx], alignment, querySeq, querySeqLen, tSeq, tSeqLen);
+                for (size_t alnIdx = 0; alnIdx < tmpAlignments.size(); alnIdx++) {
+                    AssemblyHit &tmpAlignment = alignments[tmpAlignments[alnIdx]];
+                    updateNuclAlignment(tmpAlignment, rescoreResults[alnIdx].alignment, rescoreResults[alnIdx].identities,
+                                        rescoreTargets[alnIdx].seqLen);
 
                     // refill queue
-                    if(tmpAlignments[alnIdx].seqId >= par.seqIdThr)
+                    if(tmpAlignment.seqId >= par.seqIdThr)
                         alnQueue.push(tmpAlignments[alnIdx]);
                 }
             }
 
+            if (par.transitiveExtension) {
+                NucleotideMatrix *nuclMat = (NucleotideMatrix *) subMat;
+                if (extendNuclTransitively(par, sequenceDbr, alnReader, reverseHits, nuclMat, thread_idx, queryKey,
+                                           rightEnd, true, query, wasExtended, walk)) {
+                    queryCouldBeExtended = true;
+                }
+                if (extendNuclTransitively(par, sequenceDbr, alnReader, reverseHits, nuclMat, thread_idx, queryKey,
+                                           leftEnd, false, query, wasExtended, walk)) {
+                    queryCouldBeExtended = true;
+                }
+            }
+
             if (queryCouldBeExtended)  {
+                extended++;
+                addedResidues += query.length() - sequenceDbr->getSeqLen(id);
                 query.push_back('\n');
                 __sync_or_and_fetch(&wasExtended[id], static_cast<unsigned char>(0x20));
-                resultWriter.writeData(query.c_str(), query.size(), queryKey, thread_idx);
+                resultWriter.writeData(query.data(), query.length(), queryKey, thread_idx);
             }
 
         }
     } // end parallel
 
 // add sequences that are not yet assembled
-#pragma omp parallel for schedule(dynamic, 10000)
+    size_t merged = 0;
+    size_t contained = 0;
+#pragma omp parallel for schedule(dynamic, 10000) reduction(+:merged, contained)
     for (size_t id = 0; id < sequenceDbr->getSize(); id++) {
         unsigned int thread_idx = 0;
 #ifdef OPENMP
@@ -375,21 +706,79 @@ int doNuclAssembly(LocalParameters &par) {
         bool isNotContig =  !(wasExtended[id] & 0x20);
         //bool wasNotUsed =  !(wasExtended[id] & 0x40);
         bool wasNotExtended =  !(wasExtended[id] & 0x80);
+        merged += (wasNotExtended == false);
         //bool wasUsed    =  (wasExtended[id] & 0x40);
         //if(isNotContig && wasNotExtended ){
         if (isNotContig && (par.keepTarget || wasNotExtended)){
+            // the containing sequence or the contig that was extended from it is kept
+            if (containedIn != NULL && containedIn[id] != UINT_MAX) {
+                if (containedWriter != NULL) {
+                    std::string container = SSTR(containedIn[id]) + "\n";
+                    containedWriter->writeData(container.c_str(), container.length(), sequenceDbr->getDbKey(id), thread_idx);
+                }
+                contained++;
+                continue;
+            }
             char *querySeqData = sequenceDbr->getData(id, thread_idx);
             resultWriter.writeData(querySeqData, sequenceDbr->getEntryLen(id)-1, sequenceDbr->getDbKey(id), thread_idx);
         }
     }
 
     // cleanup
-    resultWriter.close(true);
-    alnReader->close();
     delete [] wasExtended;
-    delete alnReader;
+    delete [] containedIn;
     delete [] fastMatrix.matrix;
     delete [] fastMatrix.matrixData;
+    delete subMat;
+
+    ExtensionYield yield;
+    yield.queries = sequenceDbr->getSize();
+    yield.extended = extended;
+    yield.addedResidues = addedResidues;
+    yield.merged = merged;
+    yield.contained = contained;
+    return yield;
+}
+
+template ExtensionYield nuclAssemble<DBWriter>(LocalParameters &par, DBReader<unsigned int> *sequenceDbr,
+                                               DBReader<unsigned int> *alnReader, DBWriter &resultWriter,
+                                               DBWriter *containedWriter, const SequenceCounts *counts);
+template ExtensionYield nuclAssemble<InMemoryDB>(LocalParameters &par, DBReader<unsigned int> *sequenceDbr,
+                                                 DBReader<unsigned int> *alnReader, InMemoryDB &resultWriter,
+                                                 InMemoryDB *containedWriter, const SequenceCounts *counts);
+
+int doNuclAssembly(LocalParameters &par) {
+    DBReader<unsigned int> *sequenceDbr = new DBReader<unsigned int>(par.db1.c_str(), par.db1Index.c_str(), par.threads, DBReader<unsigned int>::USE_DATA|DBReader<unsigned int>::USE_INDEX);
+    sequenceDbr->open(DBReader<unsigned int>::NOSORT);
+
+    DBReader<unsigned int> * alnReader = new DBReader<unsigned int>(par.db2.c_str(), par.db2Index.c_str(), par.threads, DBReader<unsigned int>::USE_DATA|DBReader<unsigned int>::USE_INDEX);
+    alnReader->open(DBReader<unsigned int>::NOSORT);
+
+    DBWriter resultWriter(par.db3.c_str(), par.db3Index.c_str(), par.threads, par.compressed, sequenceDbr->getDbtype());
+    resultWriter.open();
+
+    DBWriter *containedWriter = NULL;
+    if (par.dropContained) {
+        std::string containedDb = par.db3 + "_contained";
+        containedWriter = new DBWriter(containedDb.c_str(), (containedDb + ".index").c_str(), par.threads, par.compressed, Parameters::DBTYPE_GENERIC_DB);
+        containedWriter->open();
+    }
+
+    // counts of collapseduplicates next to the sequences break ties between extensions
+    SequenceCounts *counts = SequenceCounts::openIfExists(par.db1);
+    ExtensionYield yield = nuclAssemble(par, sequenceDbr, alnReader, resultWriter, containedWriter, counts);
+    delete counts;
+
+    // cleanup
+    resultWriter.close(true);
+    if (containedWriter != NULL) {
+        containedWriter->close(true);
+        delete containedWriter;
+    }
+    yield.print();
+    yield.writeFile(par.db3);
+    alnReader->close();
+    delete alnReader;
     sequenceDbr->close();
     delete sequenceDbr;
     Debug(Debug::INFO) << "\nDone.\n";
@@ -0,0 +1,142 @@
+#ifndef ASSEMBLYHIT_H
+#define ASSEMBLYHIT_H
+
+#include "Debug.h"
+#include "Matcher.h"
+#include "SequenceCounts.h"
+#include "Util.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <vector>
+
+// Alignment hit with only the fields the assemblers need to extend a query.
+// Unlike Matcher::result_t it has no backtrace string, so hits are copied and
+// moved as plain memory. All hits of a query share its length, the assemblers
+// keep it once per query instead of in every hit.
+struct AssemblyHit {
+    unsigned int dbKey;
+    int score;
+    float seqId;
+    int qStartPos;
+    int qEndPos;
+    int dbStartPos;
+    int dbEndPos;
+    unsigned int dbLen;
+
+    // Matcher::computeAlnLength inlined for the queue comparisons, a start of -1 counts as 0
+    unsigned int alnLength() const {
+        return std::max(std::abs(qEndPos - std::max(qStartPos, 0)), std::abs(dbEndPos - std::max(dbStartPos, 0))) + 1;
+    }
+
+    // appends all records of an alignment result entry, the values are the same as
+    // the ones of Matcher::readAlignmentResults
+    static void readAlignmentResults(std::vector<AssemblyHit> &hits, char *data) {
+        if (data == NULL) {
+            return;
+        }
+        const char *entry[255];
+        while (*data != '\0') {
+            size_t columns = Util::getWordsOfLine(data, entry, 255);
+            if (columns < Matcher::ALN_RES_WITHOUT_BT_COL_CNT) {
+                Debug(Debug::ERROR) << "Invalid alignment result record.\n";
+                EXIT(EXIT_FAILURE);
+            }
+            AssemblyHit hit;
+            hit.dbKey = Util::fast_atoi<unsigned int>(entry[0]);
+            hit.score = Util::fast_atoi<int>(entry[1]);
+            hit.seqId = strtod(entry[2], NULL);
+            hit.qStartPos = Util::fast_atoi<int>(entry[4]);
+            hit.qEndPos = Util::fast_atoi<int>(entry[5]);
+            hit.dbStartPos = Util::fast_atoi<int>(entry[7]);
+            hit.dbEndPos = Util::fast_atoi<int>(entry[8]);
+            hit.dbLen = Util::fast_atoi<int>(entry[9]);
+            hits.push_back(hit);
+            data = Util::skipLine(data);
+        }
+    }
+};
+
+static_assert(sizeof(AssemblyHit) == 32, "AssemblyHit should fill half a cache line");
+
+// Queue order of the protein assembly, score is the score per column times 100
+// with counts, of two equally good hits the one to the more frequent sequence comes first
+class CompareResultByScore {
+public:
+    explicit CompareResultByScore(const SequenceCounts *counts = NULL) : counts(counts) {}
+
+    bool operator() (const AssemblyHit & r1,const AssemblyHit & r2) {
+        if(r1.score < r2.score )
+            return true;
+        if(r2.score < r1.score )
+            return false;
+        if(r1.alnLength() < r2.alnLength() )
+            return true;
+        if(r2.alnLength() < r1.alnLength() )
+            return false;
+        if (counts != NULL) {
+            unsigned int count1 = counts->get(r1.dbKey);
+            unsigned int count2 = counts->get(r2.dbKey);
+            if (count1 != count2) {
+                return count1 < count2;
+            }
+        }
+        if(r1.dbKey > r2.dbKey )
+            return true;
+        if(r2.dbKey > r1.dbKey )
+            return false;
+        return false;
+    }
+
+private:
+    const SequenceCounts *counts;
+};
+
+// Priority queue over indices into a hit arena. Pushing a hit again after it was
+// rescored reuses its index, so hits are never copied. Uses std::push_heap and
+// std::pop_heap like std::priority_queue, hits come out in the same order.
+template <typename Compare>
+class HitQueue {
+public:
+    explicit HitQueue(const std::vector<AssemblyHit> &hits, const Compare &compare = Compare()) : compare(hits, compare) {}
+
+    bool empty() const {
+        return heap.empty();
+    }
+
+    unsigned int top() const {
+        return heap.front();
+    }
+
+    void push(unsigned int hitIdx) {
+        heap.push_back(hitIdx);
+        std::push_heap(heap.begin(), heap.end(), compare);
+    }
+
+    void pop() {
+        std::pop_heap(heap.begin(), heap.end(), compare);
+        heap.pop_back();
+    }
+
+    void clear() {
+        heap.clear();
+    }
+
+private:
+    struct CompareIndex {
+        const std::vector<AssemblyHit> &hits;
+        Compare compare;
+
+        CompareIndex(const std::vector<AssemblyHit> &hits, const Compare &compare) : hits(hits), compare(compare) {}
+
+        bool operator()(unsigned int first, unsigned int second) {
+            return compare(hits[first], hits[second]);
+        }
+    };
+
+    CompareIndex compare;
+    std::vector<unsigned int> heap;
+};
+
+#endif
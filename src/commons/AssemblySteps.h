@@ -0,0 +1,87 @@
+#ifndef ASSEMBLYSTEPS_H
+#define ASSEMBLYSTEPS_H
+
+#include "DBReader.h"
+#include "ExtensionYield.h"
+#include "InMemoryDB.h"
+#include "LocalParameters.h"
+#include "ResourceProfile.h"
+#include "SequenceCounts.h"
+
+#include <string>
+#include <vector>
+
+// cyclecheck was verified for this k-mer length, see cyclecheck.cpp
+const size_t CYCLE_CHECK_KMER_SIZE = 22;
+
+// Building blocks of the nucleotide assembly modules that work on already opened
+// readers. Writer is either a DBWriter or an InMemoryDB, so the same code runs
+// as a standalone module and inside assembleiterate.
+
+// With --drop-contained, sequences that a longer one completely covers are not written to
+// resultWriter. If containedWriter is not NULL, it gets the key of the covering sequence for each.
+// If counts is not NULL, they break ties between equally good extensions.
+template <typename Writer>
+ExtensionYield nuclAssemble(LocalParameters &par, DBReader<unsigned int> *sequenceDbr, DBReader<unsigned int> *alnReader,
+                            Writer &resultWriter, Writer *containedWriter, const SequenceCounts *counts);
+
+template <typename Writer>
+void findCycles(LocalParameters &par, size_t kmerSize, DBReader<unsigned int> *seqDbr, Writer &cycleResultWriter);
+
+// All iterations of assembleiterate on inputDbr, which stays open. Returns the contigs,
+// cyclic contigs that were removed from further extension are written to cycles and the
+// sequences dropped by --drop-contained to contained. All are closed. counts of the input
+// sequences can be NULL. prefDbName is used if the k-mer matches do not fit into memory.
+// Unless checkpoint is empty, the state after each iteration is written to databases
+// starting with checkpoint and a later call continues after the last finished iteration.
+// Every iteration and its steps are recorded in profile.
+InMemoryDB *assembleIterations(LocalParameters &par, DBReader<unsigned int> *inputDbr, const SequenceCounts *counts,
+                               const std::string &prefDbName, const std::string &checkpoint,
+                               InMemoryDB &cycles, InMemoryDB &contained, ResourceProfile &profile);
+
+// removes the checkpoints of assembleIterations
+void removeAssemblyCheckpoints(const std::string &checkpoint, int iterations);
+
+// Read preparation steps of the nucleotide workflows, the same as the mergereads,
+// normalizereads and collapseduplicates modules. Databases are given by name.
+void mergeReads(LocalParameters &par, const std::vector<std::string> &filenames, const std::string &outDb);
+
+void normalizeReads(LocalParameters &par, const std::string &readDb, const std::string &outDb);
+
+// countDb can be empty, the collapseduplicates module writes them to <outDB>_count
+void collapseDuplicates(LocalParameters &par, const std::string &inDb, const std::string &outDb, const std::string &countDb);
+
+// --kmer-end-window for scale times the longest sequence of seqDbr, which needs its data
+int kmerEndWindow(float scale, DBReader<unsigned int> *seqDbr);
+
+// Steps of the protein and guided nucleotide workflows, the same as the modules with
+// the lower case name. Databases are given by name.
+void extractStartLongOrfs(LocalParameters &par, const std::string &readDb, const std::string &orfDb);
+
+// kmermatcher, which picks the k-mer length and alphabet for each database anew
+void matchKmers(LocalParameters &par, const std::string &seqDb, const std::string &prefDb);
+
+int extensionRescoreDiagonal(LocalParameters &par, const std::string &queryDb, const std::string &targetDb,
+                             const std::string &prefDb, const std::string &alnDb);
+
+// proteinaln2nucl of the mmseqs library on par.db1 to par.db6
+int proteinaln2nucl(Parameters &par);
+
+void findAssemblyStart(LocalParameters &par, const std::string &seqDb, const std::string &alnDb, const std::string &outDb);
+
+// the yield is also written to <outDb>.yield
+ExtensionYield assembleResults(LocalParameters &par, const std::string &seqDb, const std::string &alnDb, const std::string &outDb);
+
+ExtensionYield guidedAssembleResults(LocalParameters &par, const std::string &nuclSeqDb, const std::string &aaSeqDb,
+                                     const std::string &nuclAlnDb, const std::string &nuclOutDb, const std::string &aaOutDb);
+
+void filterNoncoding(LocalParameters &par, const std::string &seqDbName, const std::string &outDb);
+
+// returns the number of selected sequences
+size_t selectAssembled(LocalParameters &par, const std::string &resultDb, const std::string &sourceDb, const std::string &outDb);
+
+// createhdb and convert2fasta in one pass: seqDbr as FASTA with 'ID len:<len> cycle:<0|1>'
+// headers, ID is the position in seqDbr. Without cycleDbr the cycle field is left out.
+void writeContigFasta(DBReader<unsigned int> *seqDbr, DBReader<unsigned int> *cycleDbr, const std::string &fastaFile);
+
+#endif
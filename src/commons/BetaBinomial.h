@@ -0,0 +1,100 @@
+#ifndef BETABINOMIAL_H
+#define BETABINOMIAL_H
+
+#include "AssemblyHit.h"
+
+#include <cmath>
+
+// Ranks extension candidates by comparing the mismatch rates of two hits.
+// For hit 1 with mismatch rate ~ Beta(alpha1, beta1) and hit 2 with mismatch
+// rate ~ Beta(alpha2, beta2), p is the probability that hit 1 has a lower
+// mismatch rate than hit 2. All Beta parameters are integers, so every
+// lgamma is looked up in a log factorial table and the series is evaluated
+// with a multiplicative recurrence instead of exp/log calls per term.
+class BetaBinomial {
+public:
+    static const unsigned int LOG_GAMMA_TABLE_SIZE = 8192;
+
+    // log(Gamma(n)) = log((n-1)!) for integer n > 0
+    static double logGamma(unsigned int n) {
+        static const LogGammaTable table;
+        if (n < LOG_GAMMA_TABLE_SIZE) {
+            return table.values[n];
+        }
+        return std::lgamma(static_cast<double>(n));
+    }
+
+    // returns p, summing stops as soon as p exceeds stopAbove
+    static double probability(unsigned int alpha1, unsigned int beta1, unsigned int alpha2, unsigned int beta2,
+                              double stopAbove) {
+        double log_c = (logGamma(beta1 + beta2) + logGamma(alpha1 + beta1))
+                       - (logGamma(alpha1 + beta1 + beta2) + logGamma(beta1));
+        double p = 0.0;
+        if (log_c < MIN_LOG_TERM) {
+            // the first term underflows, later terms might not
+            double log_r = 0.0;
+            for (size_t idx = 0; idx < alpha2 && p <= stopAbove; idx++) {
+                p += exp(log_r + log_c);
+                log_r += log(ratio(alpha1, beta1, beta2, idx));
+            }
+            return p;
+        }
+        double term = exp(log_c);
+        for (size_t idx = 0; idx < alpha2 && p <= stopAbove; idx++) {
+            p += term;
+            term *= ratio(alpha1, beta1, beta2, idx);
+        }
+        return p;
+    }
+
+    // comparison for the extension queues, true if r1 should be extended after r2. Hits
+    // that are equally good otherwise are ordered by the number of identical reads of their
+    // target (see SequenceCounts).
+    static bool compare(const AssemblyHit &r1, const AssemblyHit &r2, unsigned int count1 = 1, unsigned int count2 = 1) {
+        const unsigned int alnLength1 = r1.alnLength();
+        const unsigned int alnLength2 = r2.alnLength();
+        unsigned int mm_count1 = (1 - r1.seqId) * alnLength1 + 0.5;
+        unsigned int mm_count2 = (1 - r2.seqId) * alnLength2 + 0.5;
+
+        unsigned int alpha1 = mm_count1 + 1;
+        unsigned int alpha2 = mm_count2 + 1;
+        unsigned int beta1 = alnLength1 - mm_count1 + 1;
+        unsigned int beta2 = alnLength2 - mm_count2 + 1;
+
+        double p = probability(alpha1, beta1, alpha2, beta2, 0.55);
+        if (p < 0.45)
+            return true;
+        if (p > 0.55)
+            return false;
+        if (r1.dbLen - alnLength1 < r2.dbLen - alnLength2)
+            return true;
+        if (r1.dbLen - alnLength1 > r2.dbLen - alnLength2)
+            return false;
+        if (count1 > count2)
+            return false;
+
+        return true;
+    }
+
+private:
+    // below exp underflows to a denormal or zero
+    static constexpr double MIN_LOG_TERM = -700.0;
+
+    struct LogGammaTable {
+        double values[LOG_GAMMA_TABLE_SIZE];
+
+        LogGammaTable() {
+            values[0] = INFINITY;
+            for (unsigned int n = 1; n < LOG_GAMMA_TABLE_SIZE; n++) {
+                values[n] = std::lgamma(static_cast<double>(n));
+            }
+        }
+    };
+
+    static double ratio(unsigned int alpha1, unsigned int beta1, unsigned int beta2, size_t idx) {
+        return (static_cast<double>(alpha1 + idx) * static_cast<double>(beta2 + idx))
+               / (static_cast<double>(idx + 1) * static_cast<double>(idx + alpha1 + beta1 + beta2));
+    }
+};
+
+#endif
@@ -0,0 +1,111 @@
+#ifndef CONTIGBUFFER_H
+#define CONTIGBUFFER_H
+
+#include "Util.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+// Sequence buffer for greedy contig extension. The contig is kept centered
+// in the allocation with headroom on both sides, so prepending and appending
+// a fragment are both amortized O(fragment length). data() is always a
+// contiguous, null-terminated view that can be passed to the alignment code.
+class ContigBuffer {
+public:
+    ContigBuffer() : buffer(NULL), capacity(0), start(0), end(0) {}
+
+    ~ContigBuffer() {
+        free(buffer);
+    }
+
+    ContigBuffer(const ContigBuffer &) = delete;
+    ContigBuffer &operator=(const ContigBuffer &) = delete;
+
+    // replace the content, keeps the allocation for reuse between queries
+    void assign(const char *seq, size_t len) {
+        if (capacity < 2 * (len + 1)) {
+            free(buffer);
+            capacity = std::max(4 * (len + 1), static_cast<size_t>(256));
+            buffer = static_cast<char *>(malloc(capacity));
+            Util::checkAllocation(buffer, "Can not allocate contig buffer");
+        }
+        start = (capacity - len) / 2;
+        end = start + len;
+        memcpy(buffer + start, seq, len);
+        buffer[end] = '\0';
+    }
+
+    void append(const char *seq, size_t len) {
+        reserve(0, len);
+        memcpy(buffer + end, seq, len);
+        end += len;
+        buffer[end] = '\0';
+    }
+
+    void prepend(const char *seq, size_t len) {
+        reserve(len, 0);
+        start -= len;
+        memcpy(buffer + start, seq, len);
+    }
+
+    void push_back(char c) {
+        append(&c, 1);
+    }
+
+    const char *data() const {
+        return buffer + start;
+    }
+
+    size_t length() const {
+        return end - start;
+    }
+
+    size_t size() const {
+        return end - start;
+    }
+
+    char operator[](size_t pos) const {
+        return buffer[start + pos];
+    }
+
+private:
+    char *buffer;
+    size_t capacity;
+    // content is [start, end), buffer[end] is always '\0'
+    size_t start;
+    size_t end;
+
+    // make sure there are at least front bytes before and back bytes after the content
+    void reserve(size_t front, size_t back) {
+        if (buffer != NULL && front <= start && end + back + 1 <= capacity) {
+            return;
+        }
+        size_t len = end - start;
+        size_t needed = front + len + back + 1;
+        if (buffer != NULL && 2 * needed <= capacity) {
+            // enough space in total, only recenter
+            size_t newStart = front + (capacity - needed) / 2;
+            memmove(buffer + newStart, buffer + start, len);
+            start = newStart;
+            end = newStart + len;
+            buffer[end] = '\0';
+            return;
+        }
+        size_t newCapacity = std::max(2 * needed, static_cast<size_t>(256));
+        char *newBuffer = static_cast<char *>(malloc(newCapacity));
+        Util::checkAllocation(newBuffer, "Can not allocate contig buffer");
+        size_t newStart = front + (newCapacity - needed) / 2;
+        if (buffer != NULL) {
+            memcpy(newBuffer + newStart, buffer + start, len);
+            free(buffer);
+        }
+        buffer = newBuffer;
+        capacity = newCapacity;
+        start = newStart;
+        end = newStart + len;
+        buffer[end] = '\0';
+    }
+};
+
+#endif
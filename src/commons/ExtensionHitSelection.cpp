@@ -0,0 +1,127 @@
+#include "ExtensionHitSelection.h"
+#include "BetaBinomial.h"
+
+#include <algorithm>
+
+class CompareByBetaBinomial {
+public:
+    explicit CompareByBetaBinomial(const SequenceCounts *counts) : counts(counts) {}
+
+    bool operator() (const AssemblyHit & r1,const AssemblyHit & r2) {
+        if (counts == NULL) {
+            return BetaBinomial::compare(r1, r2);
+        }
+        return BetaBinomial::compare(r1, r2, counts->get(r1.dbKey), counts->get(r2.dbKey));
+    }
+
+private:
+    const SequenceCounts *counts;
+};
+
+ExtensionHitSelection::ExtensionHitSelection(size_t maxHits, unsigned int threads, bool isNucl, const SequenceCounts *counts)
+        : maxHits(maxHits), isNucl(isNucl), counts(counts), threadBuffers(threads) {}
+
+// the hit with the values the assembly queue compares and the side of the query it
+// could extend, nucleotide targets are turned to the strand of the query
+ExtensionHitSelection::Side ExtensionHitSelection::toAssemblyHit(const Matcher::result_t &result, EvalueComputation &evaluer,
+                                                                 AssemblyHit &hit) const {
+    hit.dbKey = result.dbKey;
+    hit.score = result.score;
+    hit.seqId = result.seqId;
+    hit.qStartPos = result.qStartPos;
+    hit.qEndPos = result.qEndPos;
+    hit.dbStartPos = result.dbStartPos;
+    hit.dbEndPos = result.dbEndPos;
+    hit.dbLen = result.dbLen;
+    if (isNucl == false) {
+        // score per column as assembleresults computes it
+        int rawScore = static_cast<int>(evaluer.computeRawScoreFromBitScore(hit.score) + 0.5);
+        float scorePerCol = static_cast<float>(rawScore) / static_cast<float>(hit.alnLength() + 0.5);
+        hit.score = static_cast<int>(scorePerCol * 100);
+        const bool rightStart = hit.dbStartPos == 0 && hit.dbEndPos != static_cast<int>(hit.dbLen) - 1;
+        const bool leftStart = hit.qStartPos == 0 && hit.qEndPos != static_cast<int>(result.qLen) - 1;
+        if (rightStart && hit.qStartPos != 0) {
+            return SIDE_RIGHT;
+        }
+        if (leftStart && hit.dbStartPos != 0) {
+            return SIDE_LEFT;
+        }
+        return SIDE_NONE;
+    }
+
+    if (hit.qStartPos > hit.qEndPos) {
+        std::swap(hit.qStartPos, hit.qEndPos);
+        int dbStartPos = hit.dbStartPos;
+        hit.dbStartPos = hit.dbLen - hit.dbEndPos - 1;
+        hit.dbEndPos = hit.dbLen - dbStartPos - 1;
+    }
+    const bool targetEnds = hit.dbEndPos == static_cast<int>(hit.dbLen) - 1;
+    const bool queryEnds = hit.qEndPos == static_cast<int>(result.qLen) - 1;
+    if (hit.dbStartPos == 0 && hit.qStartPos != 0 && queryEnds && targetEnds == false) {
+        return SIDE_RIGHT;
+    }
+    if (hit.qStartPos == 0 && hit.dbStartPos != 0 && targetEnds && queryEnds == false) {
+        return SIDE_LEFT;
+    }
+    return SIDE_NONE;
+}
+
+template <typename Compare>
+void ExtensionHitSelection::keepBest(Buffers &buffers, Compare hitCompare) {
+    struct CompareIndex {
+        const std::vector<AssemblyHit> &hits;
+        Compare compare;
+
+        bool operator()(unsigned int first, unsigned int second) {
+            return compare(hits[first], hits[second]);
+        }
+    } compare = { buffers.hits, hitCompare };
+    for (size_t side = 0; side < SIDES; side++) {
+        std::vector<unsigned int> &heap = buffers.sides[side];
+        std::make_heap(heap.begin(), heap.end(), compare);
+        for (size_t i = 0; i < maxHits && heap.empty() == false; i++) {
+            buffers.keep[heap.front()] = true;
+            std::pop_heap(heap.begin(), heap.end(), compare);
+            heap.pop_back();
+        }
+    }
+}
+
+void ExtensionHitSelection::select(std::vector<Matcher::result_t> &alnResults, unsigned int queryKey,
+                                   EvalueComputation &evaluer, unsigned int thread_idx) {
+    Buffers &buffers = threadBuffers[thread_idx];
+    buffers.hits.resize(alnResults.size());
+    for (size_t side = 0; side < SIDES; side++) {
+        buffers.sides[side].clear();
+    }
+    for (size_t i = 0; i < alnResults.size(); i++) {
+        Side side = toAssemblyHit(alnResults[i], evaluer, buffers.hits[i]);
+        if (alnResults[i].dbKey != queryKey) {
+            buffers.sides[side].push_back(i);
+        }
+    }
+    bool needsSelection = false;
+    for (size_t side = 0; side < SIDES; side++) {
+        needsSelection |= buffers.sides[side].size() > maxHits;
+    }
+    if (needsSelection == false) {
+        return;
+    }
+
+    buffers.keep.resize(alnResults.size());
+    for (size_t i = 0; i < alnResults.size(); i++) {
+        buffers.keep[i] = alnResults[i].dbKey == queryKey;
+    }
+    if (isNucl) {
+        keepBest(buffers, CompareByBetaBinomial(counts));
+    } else {
+        keepBest(buffers, CompareResultByScore(counts));
+    }
+    buffers.selected.clear();
+    for (size_t i = 0; i < alnResults.size(); i++) {
+        if (buffers.keep[i]) {
+            buffers.selected.emplace_back(alnResults[i]);
+        }
+    }
+    alnResults.swap(buffers.selected);
+}
@@ -0,0 +1,48 @@
+#ifndef EXTENSIONHITSELECTION_H
+#define EXTENSIONHITSELECTION_H
+
+#include "AssemblyHit.h"
+#include "DiagonalRescorer.h"
+#include "SequenceCounts.h"
+
+#include <vector>
+
+// Keeps at most maxHits alignments per side of the query (right overhang, left overhang,
+// other) in the order the assembly pops them from its queue: nucleotide hits by
+// BetaBinomial::compare with the read counts like nuclassembleresults, protein hits by score
+// per column and count like assembleresults. The hit of the query to itself is always kept.
+class ExtensionHitSelection : public AlignmentHitSelection {
+public:
+    ExtensionHitSelection(size_t maxHits, unsigned int threads, bool isNucl, const SequenceCounts *counts = NULL);
+
+    void select(std::vector<Matcher::result_t> &alnResults, unsigned int queryKey,
+                EvalueComputation &evaluer, unsigned int thread_idx);
+
+private:
+    enum Side {
+        SIDE_RIGHT = 0,
+        SIDE_LEFT = 1,
+        // contained, identical or not at an end of the query
+        SIDE_NONE = 2,
+        SIDES = 3
+    };
+
+    struct Buffers {
+        std::vector<AssemblyHit> hits;
+        std::vector<unsigned int> sides[SIDES];
+        std::vector<char> keep;
+        std::vector<Matcher::result_t> selected;
+    };
+
+    const size_t maxHits;
+    const bool isNucl;
+    const SequenceCounts *counts;
+    std::vector<Buffers> threadBuffers;
+
+    Side toAssemblyHit(const Matcher::result_t &result, EvalueComputation &evaluer, AssemblyHit &hit) const;
+
+    template <typename Compare>
+    void keepBest(Buffers &buffers, Compare compare);
+};
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef EXTENSIONYIELD_H
+#define EXTENSIONYIELD_H
+
+#include "Debug.h"
+#include "Util.h"
+
+#include <cstdio>
+#include <string>
+
+// What one assembly iteration achieved, from the wasExtended flags of the assembly
+// modules: queries that were extended (0x20), the residues added to them and the
+// sequences that were merged into another contig (0x80), as well as the sequences that
+// were dropped because a longer one contains them (--drop-contained). The assembly
+// modules write it next to their result as <resultDB>.yield, so the workflows can stop
+// iterating once an iteration extends too few sequences.
+struct ExtensionYield {
+    size_t queries;
+    size_t extended;
+    size_t addedResidues;
+    size_t merged;
+    size_t contained;
+
+    ExtensionYield() : queries(0), extended(0), addedResidues(0), merged(0), contained(0) {}
+
+    // fraction of the queries that were extended
+    bool isBelow(float minYield) const {
+        return static_cast<double>(extended) < static_cast<double>(minYield) * queries;
+    }
+
+    void print() const {
+        Debug(Debug::INFO) << "Extended " << extended << " of " << queries << " sequences by " << addedResidues
+                           << " residues, " << merged << " sequences were merged into contigs\n";
+        if (contained > 0) {
+            Debug(Debug::INFO) << "Dropped " << contained << " sequences that are contained in longer sequences\n";
+        }
+    }
+
+    void writeFile(const std::string &resultDb) const {
+        std::string yieldFile = resultDb + ".yield";
+        FILE *file = fopen(yieldFile.c_str(), "w");
+        if (file == NULL) {
+            perror(yieldFile.c_str());
+            EXIT(EXIT_FAILURE);
+        }
+        fprintf(file, "%zu\t%zu\t%zu\t%zu\t%zu\n", queries, extended, addedResidues, merged, contained);
+        if (fclose(file) != 0) {
+            Debug(Debug::ERROR) << "Cannot close file " << yieldFile << "\n";
+            EXIT(EXIT_FAILURE);
+        }
+    }
+
+    // the yield of an assembly step that ran before, false if it did not write one
+    bool readFile(const std::string &resultDb) {
+        std::string yieldFile = resultDb + ".yield";
+        FILE *file = fopen(yieldFile.c_str(), "r");
+        if (file == NULL) {
+            return false;
+        }
+        int fields = fscanf(file, "%zu\t%zu\t%zu\t%zu\t%zu", &queries, &extended, &addedResidues, &merged, &contained);
+        fclose(file);
+        return fields == 5;
+    }
+};
+
+#endif
@@ -0,0 +1,121 @@
+#include "InMemoryDB.h"
+#include "DBWriter.h"
+#include "Debug.h"
+#include "FastSort.h"
+#include "Util.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef OPENMP
+#include <omp.h>
+#endif
+
+// entries are held uncompressed, so the compression flag of a source dbtype is dropped
+InMemoryDB::InMemoryDB(unsigned int threads, int dbtype) :
+        threads(threads), dbtype(dbtype & ~(1 << 31)), threadData(threads), threadEntries(threads),
+        data(NULL), dataSize(0), index(NULL), size(0), reader(NULL) {}
+
+InMemoryDB::~InMemoryDB() {
+    if (reader != NULL) {
+        reader->close();
+        delete reader;
+    }
+    delete[] index;
+    free(data);
+}
+
+void InMemoryDB::writeData(const char *entryData, size_t entrySize, unsigned int key, unsigned int threadIdx) {
+    if (reader != NULL) {
+        Debug(Debug::ERROR) << "Cannot write to closed in-memory database\n";
+        EXIT(EXIT_FAILURE);
+    }
+    std::vector<char> &buffer = threadData[threadIdx];
+    Entry entry;
+    entry.key = key;
+    entry.thread = threadIdx;
+    entry.offset = buffer.size();
+    entry.length = entrySize + 1;
+    buffer.insert(buffer.end(), entryData, entryData + entrySize);
+    buffer.push_back('\0');
+    threadEntries[threadIdx].push_back(entry);
+}
+
+void InMemoryDB::close() {
+    std::vector<Entry> entries;
+    for (unsigned int thread = 0; thread < threads; thread++) {
+        entries.insert(entries.end(), threadEntries[thread].begin(), threadEntries[thread].end());
+        dataSize += threadData[thread].size();
+    }
+    SORT_PARALLEL(entries.begin(), entries.end(), Entry::compareByKey);
+
+    size = entries.size();
+    // keep a valid pointer for empty databases
+    data = static_cast<char *>(malloc(std::max(dataSize, static_cast<size_t>(1))));
+    Util::checkAllocation(data, "Cannot allocate in-memory database");
+    index = new(std::nothrow) DBReader<unsigned int>::Index[std::max(size, static_cast<size_t>(1))];
+    Util::checkAllocation(index, "Cannot allocate in-memory database index");
+
+    unsigned int lastKey = 0;
+    unsigned int maxSeqLen = 0;
+    size_t offset = 0;
+    for (size_t i = 0; i < size; i++) {
+        index[i].id = entries[i].key;
+        index[i].offset = offset;
+        index[i].length = static_cast<unsigned int>(entries[i].length);
+        offset += entries[i].length;
+        lastKey = std::max(lastKey, entries[i].key);
+        maxSeqLen = std::max(maxSeqLen, index[i].length);
+    }
+
+#pragma omp parallel for schedule(static) num_threads(threads)
+    for (size_t i = 0; i < size; i++) {
+        const Entry &entry = entries[i];
+        memcpy(data + index[i].offset, threadData[entry.thread].data() + entry.offset, entry.length);
+    }
+
+    for (unsigned int thread = 0; thread < threads; thread++) {
+        std::vector<char>().swap(threadData[thread]);
+        std::vector<Entry>().swap(threadEntries[thread]);
+    }
+
+    reader = new DBReader<unsigned int>(index, size, dataSize, lastKey, dbtype, maxSeqLen, threads);
+    reader->open(DBReader<unsigned int>::NOSORT);
+    reader->setData(data, dataSize);
+    reader->setMode(DBReader<unsigned int>::USE_INDEX | DBReader<unsigned int>::USE_DATA);
+}
+
+DBReader<unsigned int> *InMemoryDB::getReader() {
+    if (reader == NULL) {
+        Debug(Debug::ERROR) << "In-memory database was not closed\n";
+        EXIT(EXIT_FAILURE);
+    }
+    return reader;
+}
+
+size_t InMemoryDB::getMemorySize() const {
+    size_t memory = dataSize + size * sizeof(DBReader<unsigned int>::Index);
+    for (unsigned int thread = 0; thread < threads; thread++) {
+        memory += threadData[thread].capacity() + threadEntries[thread].capacity() * sizeof(Entry);
+    }
+    return memory;
+}
+
+void InMemoryDB::writeToDisk(const std::string &dataFile, const std::string &indexFile, size_t compressed) {
+    DBReader<unsigned int> *dbr = getReader();
+    DBWriter writer(dataFile.c_str(), indexFile.c_str(), threads, compressed, dbtype);
+    writer.open();
+#pragma omp parallel num_threads(threads)
+    {
+        unsigned int thread_idx = 0;
+#ifdef OPENMP
+        thread_idx = static_cast<unsigned int>(omp_get_thread_num());
+#endif
+#pragma omp for schedule(static)
+        for (size_t id = 0; id < dbr->getSize(); id++) {
+            writer.writeData(dbr->getData(id, thread_idx), dbr->getEntryLen(id) - 1, dbr->getDbKey(id), thread_idx);
+        }
+    }
+    writer.close(true);
+}
@@ -0,0 +1,66 @@
+#ifndef INMEMORYDB_H
+#define INMEMORYDB_H
+
+#include "DBReader.h"
+
+#include <string>
+#include <vector>
+
+// Database that is only kept in memory. Entries are written per thread with the
+// same interface as DBWriter. close() merges them into one buffer sorted by key,
+// which is then accessible through a regular DBReader. This lets the assembly
+// steps pass results to each other without writing intermediate databases.
+class InMemoryDB {
+public:
+    InMemoryDB(unsigned int threads, int dbtype);
+    ~InMemoryDB();
+
+    InMemoryDB(const InMemoryDB &) = delete;
+    InMemoryDB &operator=(const InMemoryDB &) = delete;
+
+    // appends a null byte to the entry, like DBWriter::writeData
+    void writeData(const char *data, size_t dataSize, unsigned int key, unsigned int threadIdx = 0);
+
+    void close();
+
+    // only valid after close(), owned by this object
+    DBReader<unsigned int> *getReader();
+
+    // number of bytes held by the database, including pending thread buffers
+    size_t getMemorySize() const;
+
+    void writeToDisk(const std::string &dataFile, const std::string &indexFile, size_t compressed);
+
+private:
+    struct Entry {
+        unsigned int key;
+        unsigned int thread;
+        size_t offset;
+        size_t length;
+
+        static bool compareByKey(const Entry &first, const Entry &second) {
+            if (first.key < second.key)
+                return true;
+            if (second.key < first.key)
+                return false;
+            if (first.thread < second.thread)
+                return true;
+            if (second.thread < first.thread)
+                return false;
+            return first.offset < second.offset;
+        }
+    };
+
+    unsigned int threads;
+    int dbtype;
+    std::vector<std::vector<char>> threadData;
+    std::vector<std::vector<Entry>> threadEntries;
+
+    char *data;
+    size_t dataSize;
+    DBReader<unsigned int>::Index *index;
+    size_t size;
+    DBReader<unsigned int> *reader;
+};
+
+#endif
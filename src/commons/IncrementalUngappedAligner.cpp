@@ -0,0 +1,210 @@
+#include "IncrementalUngappedAligner.h"
+#include "Parameters.h"
+#include "simd.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+
+// A, C, G and T differ in the lower four bits. A residue is one of them (upper case)
+// if the entry at its lower bits is the residue itself, the unused entries can
+// never match a residue with these lower bits.
+static const __m128i nucleotideLookup = _mm_setr_epi8(static_cast<char>(0xFF), 'A', 0, 'C', 'T', 0, 0, 'G', 0, 0, 0, 0, 0, 0, 0, 0);
+
+static inline __m128i isNucleotide(__m128i block) {
+    __m128i index = _mm_and_si128(block, _mm_set1_epi8(0x0F));
+    return _mm_cmpeq_epi8(_mm_shuffle_epi8(nucleotideLookup, index), block);
+}
+
+#ifdef AVX2
+static inline __m256i isNucleotide(__m256i block) {
+    __m256i index = _mm256_and_si256(block, _mm256_set1_epi8(0x0F));
+    return _mm256_cmpeq_epi8(_mm256_shuffle_epi8(_mm256_broadcastsi128_si256(nucleotideLookup), index), block);
+}
+#endif
+
+// number of positions with seq1[pos] == seq2[pos]
+static unsigned int countIdentities(const char *seq1, const char *seq2, unsigned int length) {
+    unsigned int identities = 0;
+    unsigned int pos = 0;
+#ifdef AVX2
+    for (; pos + 32 <= length; pos += 32) {
+        __m256i block1 = _mm256_loadu_si256((const __m256i *) (seq1 + pos));
+        __m256i block2 = _mm256_loadu_si256((const __m256i *) (seq2 + pos));
+        identities += __builtin_popcount(static_cast<unsigned int>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block1, block2))));
+    }
+#endif
+    for (; pos + 16 <= length; pos += 16) {
+        __m128i block1 = _mm_loadu_si128((const __m128i *) (seq1 + pos));
+        __m128i block2 = _mm_loadu_si128((const __m128i *) (seq2 + pos));
+        identities += __builtin_popcount(static_cast<unsigned int>(_mm_movemask_epi8(_mm_cmpeq_epi8(block1, block2))));
+    }
+    for (; pos < length; pos++) {
+        identities += (seq1[pos] == seq2[pos]) ? 1 : 0;
+    }
+    return identities;
+}
+
+IncrementalUngappedAligner::IncrementalUngappedAligner(const char **fastMatrix, int alnMode) :
+        fastMatrix(fastMatrix), alnMode(alnMode) {
+    const char nucleotides[] = {'A', 'C', 'G', 'T'};
+    matchScore = fastMatrix[static_cast<int>('A')][static_cast<int>('A')];
+    mismatchScore = fastMatrix[static_cast<int>('A')][static_cast<int>('C')];
+    uniformNucleotideScores = true;
+    for (size_t i = 0; i < 4; i++) {
+        for (size_t j = 0; j < 4; j++) {
+            int expected = (i == j) ? matchScore : mismatchScore;
+            if (fastMatrix[static_cast<int>(nucleotides[i])][static_cast<int>(nucleotides[j])] != expected) {
+                uniformNucleotideScores = false;
+            }
+        }
+    }
+}
+
+// adds the substitution scores and identities of the diagonal to score and identities,
+// blocks of upper case nucleotides are scored by counting the matches
+void IncrementalUngappedAligner::sumDiagonal(const char *seq1, const char *seq2, unsigned int length,
+                                       int64_t &score, unsigned int &identities) const {
+    unsigned int pos = 0;
+    if (uniformNucleotideScores) {
+        const int64_t scoreDiff = matchScore - mismatchScore;
+        while (pos + 16 <= length) {
+#ifdef AVX2
+            if (pos + 32 <= length) {
+                __m256i block1 = _mm256_loadu_si256((const __m256i *) (seq1 + pos));
+                __m256i block2 = _mm256_loadu_si256((const __m256i *) (seq2 + pos));
+                __m256i valid = _mm256_and_si256(isNucleotide(block1), isNucleotide(block2));
+                if (_mm256_movemask_epi8(valid) == -1) {
+                    unsigned int matches = __builtin_popcount(static_cast<unsigned int>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block1, block2))));
+                    score += 32 * static_cast<int64_t>(mismatchScore) + matches * scoreDiff;
+                    identities += matches;
+                    pos += 32;
+                    continue;
+                }
+            }
+#endif
+            __m128i block1 = _mm_loadu_si128((const __m128i *) (seq1 + pos));
+            __m128i block2 = _mm_loadu_si128((const __m128i *) (seq2 + pos));
+            __m128i valid = _mm_and_si128(isNucleotide(block1), isNucleotide(block2));
+            if (_mm_movemask_epi8(valid) == 0xFFFF) {
+                unsigned int matches = __builtin_popcount(static_cast<unsigned int>(_mm_movemask_epi8(_mm_cmpeq_epi8(block1, block2))));
+                score += 16 * static_cast<int64_t>(mismatchScore) + matches * scoreDiff;
+                identities += matches;
+            } else {
+                for (unsigned int i = pos; i < pos + 16; i++) {
+                    score += fastMatrix[static_cast<int>(seq1[i])][static_cast<int>(seq2[i])];
+                    identities += (seq1[i] == seq2[i]) ? 1 : 0;
+                }
+            }
+            pos += 16;
+        }
+    }
+    for (; pos < length; pos++) {
+        score += fastMatrix[static_cast<int>(seq1[pos])][static_cast<int>(seq2[pos])];
+        identities += (seq1[pos] == seq2[pos]) ? 1 : 0;
+    }
+}
+
+// same as DistanceCalculator::computeGlobalSubstitutionStartEndDistance on the diagonal.
+// The sums cover the whole overlap, the '*' at the ends and the identity of the last
+// position (the assemblers count identities in [startPos, endPos)) are removed afterwards.
+DistanceCalculator::LocalAlignment IncrementalUngappedAligner::alignEndToEnd(const char *querySeq, unsigned int querySeqLen,
+                                                                       unsigned int queryOffset, const Target &target,
+                                                                       unsigned int &identities) const {
+    unsigned int minDistToDiagonal = abs(target.diagonal);
+    DistanceCalculator::LocalAlignment res;
+    res.distToDiagonal = minDistToDiagonal;
+    res.diagonal = target.diagonal;
+    identities = 0;
+
+    unsigned int queryStart;
+    unsigned int length;
+    if (target.diagonal >= 0 && minDistToDiagonal < querySeqLen) {
+        queryStart = minDistToDiagonal;
+        length = std::min(target.seqLen, querySeqLen - minDistToDiagonal);
+    } else if (target.diagonal < 0 && minDistToDiagonal < target.seqLen) {
+        queryStart = 0;
+        length = std::min(target.seqLen - minDistToDiagonal, querySeqLen);
+    } else {
+        return res;
+    }
+    res.diagonalLen = length;
+    const char *seq1 = querySeq + queryStart;
+    const char *seq2 = target.seq + (static_cast<int>(queryStart) - target.diagonal);
+
+    int64_t score = 0;
+    unsigned int allIdentities = 0;
+    OverlapSum *sum = target.sum;
+    const int diagonal = target.diagonal - static_cast<int>(queryOffset);
+    const int absQueryStart = static_cast<int>(queryStart) - static_cast<int>(queryOffset);
+    if (sum != NULL && sum->valid && sum->diagonal == diagonal && sum->queryStart >= absQueryStart
+        && sum->queryStart + sum->length <= absQueryStart + length) {
+        // previous overlap is unchanged, only scan what was added in front and after it
+        unsigned int prefix = sum->queryStart - absQueryStart;
+        unsigned int suffix = prefix + sum->length;
+        score = sum->score;
+        allIdentities = sum->identities;
+        sumDiagonal(seq1, seq2, prefix, score, allIdentities);
+        sumDiagonal(seq1 + suffix, seq2 + suffix, length - suffix, score, allIdentities);
+    } else {
+        sumDiagonal(seq1, seq2, length, score, allIdentities);
+    }
+    if (sum != NULL) {
+        sum->valid = true;
+        sum->diagonal = diagonal;
+        sum->queryStart = absQueryStart;
+        sum->length = length;
+        sum->score = score;
+        sum->identities = allIdentities;
+    }
+
+    unsigned int first = (seq1[0] == '*' || seq2[0] == '*') ? 1 : 0;
+    unsigned int last = length - 1;
+    if (last > 0 && (seq1[length - 1] == '*' || seq2[length - 1] == '*')) {
+        last--;
+    }
+    if (first == 1) {
+        score -= fastMatrix[static_cast<int>(seq1[0])][static_cast<int>(seq2[0])];
+        allIdentities -= (seq1[0] == seq2[0]) ? 1 : 0;
+    }
+    if (last != length - 1) {
+        score -= fastMatrix[static_cast<int>(seq1[length - 1])][static_cast<int>(seq2[length - 1])];
+        allIdentities -= (seq1[length - 1] == seq2[length - 1]) ? 1 : 0;
+    }
+    if (first <= last) {
+        allIdentities -= (seq1[last] == seq2[last]) ? 1 : 0;
+    }
+    identities = allIdentities;
+
+    score = std::max(score, static_cast<int64_t>(0));
+    DistanceCalculator::LocalAlignment tmp(first, last, score);
+    res.score = tmp.score;
+    res.startPos = tmp.startPos;
+    res.endPos = tmp.endPos;
+    return res;
+}
+
+void IncrementalUngappedAligner::align(const char *querySeq, unsigned int querySeqLen, unsigned int queryOffset,
+                                 const std::vector<Target> &targets, std::vector<Result> &results) const {
+    results.resize(targets.size());
+    if (alnMode == Parameters::RESCORE_MODE_END_TO_END_ALIGNMENT) {
+        for (size_t i = 0; i < targets.size(); i++) {
+            results[i].alignment = alignEndToEnd(querySeq, querySeqLen, queryOffset, targets[i], results[i].identities);
+        }
+        return;
+    }
+
+    for (size_t i = 0; i < targets.size(); i++) {
+        const Target &target = targets[i];
+        DistanceCalculator::LocalAlignment alignment = DistanceCalculator::ungappedAlignmentByDiagonal(
+                querySeq, querySeqLen, target.seq, target.seqLen, target.diagonal, fastMatrix, alnMode);
+        results[i].alignment = alignment;
+        results[i].identities = 0;
+        if (alignment.endPos > alignment.startPos) {
+            unsigned int dist = abs(alignment.diagonal);
+            const char *seq1 = querySeq + alignment.startPos + ((alignment.diagonal >= 0) ? dist : 0);
+            const char *seq2 = target.seq + alignment.startPos + ((alignment.diagonal < 0) ? dist : 0);
+            results[i].identities = countIdentities(seq1, seq2, alignment.endPos - alignment.startPos);
+        }
+    }
+}
@@ -0,0 +1,74 @@
+#ifndef INCREMENTALUNGAPPEDALIGNER_H
+#define INCREMENTALUNGAPPEDALIGNER_H
+
+#include "DistanceCalculator.h"
+
+#include <cstdint>
+#include <vector>
+
+// Ungapped realignment of the pending hits after the assemblers extended the query.
+// Each (target, diagonal) pair is aligned on its own; end-to-end alignments reuse the
+// sums of the previous round and score runs of A, C, G and T 16 or 32 residues at once.
+// Comparing several hits at once (one 64 bit lane per hit) was slower: after the first
+// round only the residues added to the query are scanned, and gathering these short
+// runs from several targets costs more than comparing them per pair.
+// Results are the same as DistanceCalculator::ungappedAlignmentByDiagonal plus
+// the number of identical residues in [startPos, endPos) of each alignment.
+class IncrementalUngappedAligner {
+public:
+    // Sums over the whole overlap of the last end-to-end alignment of a target. The
+    // query of the assemblers only grows at its ends, so on the next refresh only the
+    // added query residues are scanned. Positions are relative to the query start
+    // before anything was prepended.
+    struct OverlapSum {
+        bool valid;
+        int diagonal;
+        int queryStart;
+        unsigned int length;
+        int64_t score;
+        unsigned int identities;
+
+        OverlapSum() : valid(false), diagonal(0), queryStart(0), length(0), score(0), identities(0) {}
+    };
+
+    struct Target {
+        const char *seq;
+        unsigned int seqLen;
+        int diagonal;
+        // optional, updated by align for end-to-end alignments
+        OverlapSum *sum;
+
+        Target(const char *seq, unsigned int seqLen, int diagonal, OverlapSum *sum = NULL)
+                : seq(seq), seqLen(seqLen), diagonal(diagonal), sum(sum) {}
+    };
+
+    struct Result {
+        DistanceCalculator::LocalAlignment alignment;
+        unsigned int identities;
+    };
+
+    // fastMatrix is the ASCII matrix of SubstitutionMatrix::createAsciiSubMat
+    IncrementalUngappedAligner(const char **fastMatrix, int alnMode);
+
+    // queryOffset is the number of residues prepended to the query since the first alignment
+    void align(const char *querySeq, unsigned int querySeqLen, unsigned int queryOffset,
+               const std::vector<Target> &targets, std::vector<Result> &results) const;
+
+private:
+    const char **fastMatrix;
+    int alnMode;
+    // A, C, G and T have one match and one mismatch score (true for nucleotide.out),
+    // this allows scoring them by comparing 16 or 32 residues at once
+    bool uniformNucleotideScores;
+    int matchScore;
+    int mismatchScore;
+
+    void sumDiagonal(const char *seq1, const char *seq2, unsigned int length,
+                     int64_t &score, unsigned int &identities) const;
+
+    DistanceCalculator::LocalAlignment alignEndToEnd(const char *querySeq, unsigned int querySeqLen,
+                                                     unsigned int queryOffset, const Target &target,
+                                                     unsigned int &identities) const;
+};
+
+#endif
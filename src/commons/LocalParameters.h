@@ -3,6 +3,7 @@
 
 #include <Parameters.h>
 #include <MultiParam.h>
+#include <ByteParser.h>
 #include <algorithm>
 #include <cfloat>
 
@@ -24,12 +25,19 @@ public:
     std::vector<MMseqsParameter *> guidedNuclAssembleworkflow;
 
     std::vector<MMseqsParameter *> assembleresults;
+    std::vector<MMseqsParameter *> assembleiterate;
+    std::vector<MMseqsParameter *> collapseduplicates;
     std::vector<MMseqsParameter *> cyclecheck;
     std::vector<MMseqsParameter *> createhdb;
+    std::vector<MMseqsParameter *> extensionrescorediagonal;
     std::vector<MMseqsParameter *> extractorfssubset;
+    std::vector<MMseqsParameter *> extractstartlongorfs;
     std::vector<MMseqsParameter *> filternoncoding;
     std::vector<MMseqsParameter *> guidedassembleresults;
+    std::vector<MMseqsParameter *> nuclassembleresults;
+    std::vector<MMseqsParameter *> normalizereads;
     std::vector<MMseqsParameter *> reduceredundancy;
+    std::vector<MMseqsParameter *> selectassembled;
 
 
     int filterProteins;
@@ -43,6 +51,19 @@ public:
     bool chopCycle;
     bool dbMode;
     bool keepTarget;
+    bool transitiveExtension;
+    bool dropContained;
+    bool collapseDuplicates;
+    bool selectComplete;
+    float minExtensionYield;
+    int maxAssemblyTime;
+    int checkpointInterval;
+    bool resourceProfile;
+    float kmerWindowScale;
+    int diginormCoverage;
+    int diginormKmerSize;
+    size_t diginormSketchSize;
+    int maxExtensionHits;
 
     MultiParam<int> multiNumIterations;
     MultiParam<int> multiKmerSize;
@@ -64,6 +85,19 @@ public:
     PARAMETER(PARAM_MULTI_MIN_ALN_LEN)
     PARAMETER(PARAM_DB_MODE)
     PARAMETER(PARAM_KEEP_TARGET)
+    PARAMETER(PARAM_TRANSITIVE_EXTENSION)
+    PARAMETER(PARAM_DROP_CONTAINED)
+    PARAMETER(PARAM_COLLAPSE_DUPLICATES)
+    PARAMETER(PARAM_SELECT_COMPLETE)
+    PARAMETER(PARAM_MIN_EXTENSION_YIELD)
+    PARAMETER(PARAM_MAX_ASSEMBLY_TIME)
+    PARAMETER(PARAM_CHECKPOINT_INTERVAL)
+    PARAMETER(PARAM_RESOURCE_PROFILE)
+    PARAMETER(PARAM_KMER_WINDOW_SCALE)
+    PARAMETER(PARAM_DIGINORM_COVERAGE)
+    PARAMETER(PARAM_DIGINORM_K)
+    PARAMETER(PARAM_DIGINORM_SKETCH_SIZE)
+    PARAMETER(PARAM_MAX_EXTENSION_HITS)
 
 
     // contig output
@@ -90,7 +124,20 @@ private:
             PARAM_MULTI_MIN_SEQ_ID(PARAM_MULTI_MIN_SEQ_ID_ID, "--min-seq-id", "Seq. id. threshold", "Overlap sequence identity threshold [0.0, 1.0]", typeid(MultiParam<float>), (void *) &multiSeqIdThr, "", MMseqsParameter::COMMAND_ALIGN),
             PARAM_MULTI_MIN_ALN_LEN(PARAM_MULTI_MIN_ALN_LEN_ID, "--min-aln-len", "Min alignment length", "Minimum alignment length (range 0-INT_MAX)", typeid(MultiParam<int>), (void *) &multiAlnLenThr, "", MMseqsParameter::COMMAND_ALIGN),
             PARAM_DB_MODE(PARAM_DB_MODE_ID, "--db-mode", "Input is database", "Input is database", typeid(bool), (void *) &dbMode, "", MMseqsParameter::COMMAND_EXPERT),
-            PARAM_KEEP_TARGET(PARAM_KEEP_TARGET_ID, "--keep-target", "Keep target sequences for the next iteration", "Keep target sequences", typeid(bool), (void*) &keepTarget, "", MMseqsParameter::COMMAND_MISC){
+            PARAM_KEEP_TARGET(PARAM_KEEP_TARGET_ID, "--keep-target", "Keep target sequences for the next iteration", "Keep target sequences", typeid(bool), (void*) &keepTarget, "", MMseqsParameter::COMMAND_MISC),
+            PARAM_TRANSITIVE_EXTENSION(PARAM_TRANSITIVE_EXTENSION_ID, "--transitive-extension", "Transitive extension", "Keep extending contig ends with the overlaps of the read at the end as long as they agree (nucleotide assembly)", typeid(bool), (void*) &transitiveExtension, "", MMseqsParameter::COMMAND_MISC | MMseqsParameter::COMMAND_EXPERT),
+            PARAM_DROP_CONTAINED(PARAM_DROP_CONTAINED_ID, "--drop-contained", "Drop contained sequences", "Do not pass sequences that are completely covered by a longer sequence with at least --min-seq-id on to the next iteration, record them in <resultDB>_contained instead (nucleotide assembly)", typeid(bool), (void*) &dropContained, "", MMseqsParameter::COMMAND_MISC | MMseqsParameter::COMMAND_EXPERT),
+            PARAM_COLLAPSE_DUPLICATES(PARAM_COLLAPSE_DUPLICATES_ID, "--collapse-duplicates", "Collapse duplicates", "Assemble only one of identical reads (both strands) and of identical ORFs, nuclassemble extends with the more frequent read first if two are equally good", typeid(bool), (void*) &collapseDuplicates, "", MMseqsParameter::COMMAND_MISC | MMseqsParameter::COMMAND_EXPERT),
+            PARAM_SELECT_COMPLETE(PARAM_SELECT_COMPLETE_ID, "--select-complete", "Select complete sequences", "Also select sequences that were not extended but start and end with a stop codon (*)", typeid(bool), (void*) &selectComplete, "", MMseqsParameter::COMMAND_MISC | MMseqsParameter::COMMAND_EXPERT),
+            PARAM_MIN_EXTENSION_YIELD(PARAM_MIN_EXTENSION_YIELD_ID, "--min-extension-yield", "Minimum extension yield", "Stop iterating once an iteration extends less than this fraction of the sequences (range 0.0-1.0, 0.0: run all iterations)", typeid(float), (void*) &minExtensionYield, "^0(\\.[0-9]+)?|1(\\.0+)?$", MMseqsParameter::COMMAND_MISC | MMseqsParameter::COMMAND_EXPERT),
+            PARAM_MAX_ASSEMBLY_TIME(PARAM_MAX_ASSEMBLY_TIME_ID, "--max-assembly-time", "Maximum assembly time", "Do not start another iteration after this many seconds of assembly iterations (0: no limit)", typeid(int), (void*) &maxAssemblyTime, "^[0-9]+$", MMseqsParameter::COMMAND_MISC | MMseqsParameter::COMMAND_EXPERT),
+            PARAM_CHECKPOINT_INTERVAL(PARAM_CHECKPOINT_INTERVAL_ID, "--checkpoint-interval", "Checkpoint interval", "Write the contigs after every N-th assembly iteration, a restarted nuclassemble continues after the last one (0: no checkpoints)", typeid(int), (void*) &checkpointInterval, "^[0-9]+$", MMseqsParameter::COMMAND_MISC | MMseqsParameter::COMMAND_EXPERT),
+            PARAM_RESOURCE_PROFILE(PARAM_RESOURCE_PROFILE_ID, "--resource-profile", "Resource profile", "Record wall time, CPU time, peak RSS, I/O and entries of every workflow step in <tmpDir>/resource_profile.json and print a summary at the end", typeid(bool), (void*) &resourceProfile, "", MMseqsParameter::COMMAND_MISC | MMseqsParameter::COMMAND_EXPERT),
+            PARAM_KMER_WINDOW_SCALE(PARAM_KMER_WINDOW_SCALE_ID, "--kmer-window-scale", "K-mer window scale", "Select k-mers only from both ends of a sequence, in windows of this factor times the longest input sequence (0.0: whole sequence)", typeid(float), (void*) &kmerWindowScale, "^[0-9]*(\\.[0-9]+)?$", MMseqsParameter::COMMAND_CLUSTLINEAR | MMseqsParameter::COMMAND_EXPERT),
+            PARAM_DIGINORM_COVERAGE(PARAM_DIGINORM_COVERAGE_ID, "--diginorm-coverage", "Digital normalization coverage", "Drop reads whose median k-mer abundance in the reads kept before reached this coverage (0: keep all reads)", typeid(int), (void*) &diginormCoverage, "^[0-9]+$", MMseqsParameter::COMMAND_MISC | MMseqsParameter::COMMAND_EXPERT),
+            PARAM_DIGINORM_K(PARAM_DIGINORM_K_ID, "--diginorm-k", "Digital normalization k-mer length", "k-mer length for the abundances of digital normalization (range 1-32)", typeid(int), (void*) &diginormKmerSize, "^[1-9]{1}[0-9]*$", MMseqsParameter::COMMAND_MISC | MMseqsParameter::COMMAND_EXPERT),
+            PARAM_DIGINORM_SKETCH_SIZE(PARAM_DIGINORM_SKETCH_SIZE_ID, "--diginorm-sketch-size", "Digital normalization sketch size", "Memory of the count-min sketch for the k-mer abundances of digital normalization. E.g. 800B, 5K, 10M, 1G", typeid(ByteParser), (void*) &diginormSketchSize, "^[1-9]{1}[0-9]*(B|K|M|G|T)?$", MMseqsParameter::COMMAND_MISC | MMseqsParameter::COMMAND_EXPERT),
+            PARAM_MAX_EXTENSION_HITS(PARAM_MAX_EXTENSION_HITS_ID, "--max-extension-hits", "Maximum extension hits", "Keep only this many alignments per query side (right overhang, left overhang, other) in the order the assembly extends with them (0: keep all)", typeid(int), (void*) &maxExtensionHits, "^[0-9]+$", MMseqsParameter::COMMAND_ALIGN | MMseqsParameter::COMMAND_EXPERT){
 
         // assembleresult
         assembleresults.push_back(&PARAM_MIN_SEQ_ID);
@@ -101,11 +148,22 @@ private:
         assembleresults.push_back(
                 &PARAM_RESCORE_MODE); //temporary added until assemble and nuclassemble use same rescoremode
 
+        // nuclassembleresult
+        nuclassembleresults = assembleresults;
+        nuclassembleresults.push_back(&PARAM_TRANSITIVE_EXTENSION);
+        nuclassembleresults.push_back(&PARAM_DROP_CONTAINED);
+
         extractorfssubset.push_back(&PARAM_TRANSLATION_TABLE);
         extractorfssubset.push_back(&PARAM_USE_ALL_TABLE_STARTS);
         extractorfssubset.push_back(&PARAM_THREADS);
         extractorfssubset.push_back(&PARAM_V);
 
+        // extractstartlongorfs (extractorfs and translatenucs of both ORF sets)
+        extractstartlongorfs = combineList(extractorfs, translatenucs);
+        extractstartlongorfs = removeParameter(extractstartlongorfs, PARAM_TRANSLATE);
+        extractstartlongorfs = removeParameter(extractstartlongorfs, PARAM_ID_OFFSET);
+        extractstartlongorfs = removeParameter(extractstartlongorfs, PARAM_CREATE_LOOKUP);
+
         filternoncoding.push_back(&PARAM_PROTEIN_FILTER_THRESHOLD);
         filternoncoding.push_back(&PARAM_THREADS);
         filternoncoding.push_back(&PARAM_V);
@@ -120,6 +178,24 @@ private:
         createhdb.push_back(&PARAM_COMPRESSED);
         createhdb.push_back(&PARAM_V);
 
+        //collapseduplicates
+        collapseduplicates.push_back(&PARAM_COMPRESSED);
+        collapseduplicates.push_back(&PARAM_THREADS);
+        collapseduplicates.push_back(&PARAM_V);
+
+        //normalizereads
+        normalizereads.push_back(&PARAM_DIGINORM_COVERAGE);
+        normalizereads.push_back(&PARAM_DIGINORM_K);
+        normalizereads.push_back(&PARAM_DIGINORM_SKETCH_SIZE);
+        normalizereads.push_back(&PARAM_COMPRESSED);
+        normalizereads.push_back(&PARAM_V);
+
+        //selectassembled
+        selectassembled.push_back(&PARAM_SELECT_COMPLETE);
+        selectassembled.push_back(&PARAM_SUBDB_MODE);
+        selectassembled.push_back(&PARAM_THREADS);
+        selectassembled.push_back(&PARAM_V);
+
         //reduceredundancy (subset of clustering parameters which have to be adjusted)
         reduceredundancy.push_back(&PARAM_ALPH_SIZE);
         reduceredundancy.push_back(&PARAM_CLUSTER_MODE);
@@ -138,30 +214,62 @@ private:
         reduceredundancy.push_back(&PARAM_THREADS);
         reduceredundancy.push_back(&PARAM_REMOVE_TMP_FILES);
 
+        // extensionrescorediagonal (rescorediagonal of the assembly workflows)
+        extensionrescorediagonal = rescorediagonal;
+        extensionrescorediagonal.push_back(&PARAM_MAX_EXTENSION_HITS);
+
+        // assembleiterate (all steps of one nuclassemble iteration)
+        assembleiterate = combineList(kmermatcher, extensionrescorediagonal);
+        assembleiterate = combineList(assembleiterate, nuclassembleresults);
+        assembleiterate = combineList(assembleiterate, cyclecheck);
+        assembleiterate = removeParameter(assembleiterate, PARAM_WRAPPED_SCORING);
+        assembleiterate = removeParameter(assembleiterate, PARAM_FILTER_HITS);
+        assembleiterate.push_back(&PARAM_CYCLE_CHECK);
+        assembleiterate.push_back(&PARAM_NUM_ITERATIONS);
+        assembleiterate.push_back(&PARAM_MIN_EXTENSION_YIELD);
+        assembleiterate.push_back(&PARAM_MAX_ASSEMBLY_TIME);
+        assembleiterate.push_back(&PARAM_KMER_WINDOW_SCALE);
 
         // assembler workflow
         assembleworkflow = combineList(createdb, kmermatcher);
-        assembleworkflow = combineList(assembleworkflow, rescorediagonal);
+        assembleworkflow = combineList(assembleworkflow, extensionrescorediagonal);
         assembleworkflow = combineList(assembleworkflow, extractorfs);
         assembleworkflow = combineList(assembleworkflow, assembleresults);
         assembleworkflow = combineList(assembleworkflow, filternoncoding);
 
         assembleworkflow.push_back(&PARAM_FILTER_PROTEINS);
         assembleworkflow.push_back(&PARAM_NUM_ITERATIONS);
+        assembleworkflow.push_back(&PARAM_MIN_EXTENSION_YIELD);
+        assembleworkflow.push_back(&PARAM_MAX_ASSEMBLY_TIME);
+        assembleworkflow.push_back(&PARAM_KMER_WINDOW_SCALE);
+        assembleworkflow.push_back(&PARAM_COLLAPSE_DUPLICATES);
+        assembleworkflow.push_back(&PARAM_DIGINORM_COVERAGE);
+        assembleworkflow.push_back(&PARAM_DIGINORM_K);
+        assembleworkflow.push_back(&PARAM_DIGINORM_SKETCH_SIZE);
+        assembleworkflow.push_back(&PARAM_RESOURCE_PROFILE);
         assembleworkflow.push_back(&PARAM_DELETE_TMP_INC);
         assembleworkflow.push_back(&PARAM_REMOVE_TMP_FILES);
         assembleworkflow.push_back(&PARAM_RUNNER);
 
         // nuclassembler workflow
         nuclassembleworkflow = combineList(createdb, kmermatcher);
-        nuclassembleworkflow = combineList(nuclassembleworkflow, rescorediagonal);
-        nuclassembleworkflow = combineList(nuclassembleworkflow, assembleresults);
+        nuclassembleworkflow = combineList(nuclassembleworkflow, extensionrescorediagonal);
+        nuclassembleworkflow = combineList(nuclassembleworkflow, nuclassembleresults);
         nuclassembleworkflow = combineList(nuclassembleworkflow, cyclecheck);
 
         nuclassembleworkflow.push_back(&PARAM_CYCLE_CHECK);
         nuclassembleworkflow.push_back(&PARAM_MIN_CONTIG_LEN);
         nuclassembleworkflow.push_back(&PARAM_CONTIG_OUTPUT_MODE);
         nuclassembleworkflow.push_back(&PARAM_NUM_ITERATIONS);
+        nuclassembleworkflow.push_back(&PARAM_MIN_EXTENSION_YIELD);
+        nuclassembleworkflow.push_back(&PARAM_MAX_ASSEMBLY_TIME);
+        nuclassembleworkflow.push_back(&PARAM_CHECKPOINT_INTERVAL);
+        nuclassembleworkflow.push_back(&PARAM_KMER_WINDOW_SCALE);
+        nuclassembleworkflow.push_back(&PARAM_COLLAPSE_DUPLICATES);
+        nuclassembleworkflow.push_back(&PARAM_DIGINORM_COVERAGE);
+        nuclassembleworkflow.push_back(&PARAM_DIGINORM_K);
+        nuclassembleworkflow.push_back(&PARAM_DIGINORM_SKETCH_SIZE);
+        nuclassembleworkflow.push_back(&PARAM_RESOURCE_PROFILE);
         nuclassembleworkflow.push_back(&PARAM_DB_MODE);
         nuclassembleworkflow.push_back(&PARAM_REMOVE_TMP_FILES);
         nuclassembleworkflow.push_back(&PARAM_DELETE_TMP_INC);
@@ -203,6 +311,19 @@ private:
         cycleCheck = true;
         dbMode = false;
         keepTarget = true;
+        transitiveExtension = false;
+        dropContained = false;
+        collapseDuplicates = false;
+        selectComplete = false;
+        minExtensionYield = 0.0f;
+        maxAssemblyTime = 0;
+        checkpointInterval = 0;
+        resourceProfile = false;
+        kmerWindowScale = 0.0f;
+        diginormCoverage = 0;
+        diginormKmerSize = 20;
+        diginormSketchSize = 1024UL * 1024UL * 1024UL;
+        maxExtensionHits = 0;
 
         multiNumIterations = MultiParam<int>(5, 5);
         multiKmerSize = MultiParam<int>(14, 22);
@@ -0,0 +1,327 @@
+#include "ResourceProfile.h"
+#include "Debug.h"
+#include "FileUtil.h"
+#include "Util.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <dirent.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+// getrusage reports the resident set size in kilobytes on Linux and in bytes on macOS
+#ifdef __APPLE__
+static const size_t RSS_UNIT = 1;
+#else
+static const size_t RSS_UNIT = 1024;
+#endif
+static const size_t BLOCK_SIZE = 512;
+
+static double toSeconds(const struct timeval &time) {
+    return time.tv_sec + 1e-6 * time.tv_usec;
+}
+
+// wall clock time, so steps recorded by different processes can be ordered
+static double currentTime() {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return now.tv_sec + 1e-9 * now.tv_nsec;
+}
+
+static std::string formatBytes(size_t bytes) {
+    const char *units[] = {"B", "K", "M", "G", "T"};
+    double value = static_cast<double>(bytes);
+    size_t unit = 0;
+    while (value >= 1024.0 && unit < 4) {
+        value /= 1024.0;
+        unit++;
+    }
+    std::ostringstream ss;
+    ss << std::fixed << std::setprecision(unit == 0 ? 0 : 1) << value << units[unit];
+    return ss.str();
+}
+
+static std::string escapeJson(const std::string &str) {
+    std::string escaped;
+    for (size_t i = 0; i < str.size(); i++) {
+        if (str[i] == '"' || str[i] == '\\') {
+            escaped.push_back('\\');
+        }
+        escaped.push_back(str[i]);
+    }
+    return escaped;
+}
+
+ResourceProfile::Usage ResourceProfile::currentUsage() {
+    Usage usage;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    usage.wallTime = now.tv_sec + 1e-9 * now.tv_nsec;
+
+    struct rusage self;
+    struct rusage children;
+    getrusage(RUSAGE_SELF, &self);
+    getrusage(RUSAGE_CHILDREN, &children);
+    usage.cpuTime = toSeconds(self.ru_utime) + toSeconds(self.ru_stime)
+                    + toSeconds(children.ru_utime) + toSeconds(children.ru_stime);
+    usage.blocksRead = self.ru_inblock + children.ru_inblock;
+    usage.blocksWritten = self.ru_oublock + children.ru_oublock;
+    usage.childPeakRss = children.ru_maxrss * RSS_UNIT;
+    return usage;
+}
+
+// VmHWM of /proc/self/status, which can be reset unlike the maximum of getrusage
+size_t ResourceProfile::readPeakRss() {
+#ifdef __linux__
+    FILE *status = fopen("/proc/self/status", "r");
+    if (status != NULL) {
+        char line[256];
+        size_t peak = 0;
+        bool found = false;
+        while (found == false && fgets(line, sizeof(line), status) != NULL) {
+            if (strncmp(line, "VmHWM:", 6) == 0) {
+                peak = strtoull(line + 6, NULL, 10) * 1024;
+                found = true;
+            }
+        }
+        fclose(status);
+        if (found) {
+            return peak;
+        }
+    }
+#endif
+    struct rusage self;
+    getrusage(RUSAGE_SELF, &self);
+    return self.ru_maxrss * RSS_UNIT;
+}
+
+// sets the high-water mark to the current resident set size, so it only covers what
+// follows. Without /proc/self/clear_refs (not Linux or older than 4.0) nothing changes.
+void ResourceProfile::resetPeakRss() {
+#ifdef __linux__
+    FILE *clearRefs = fopen("/proc/self/clear_refs", "w");
+    if (clearRefs == NULL) {
+        return;
+    }
+    fputs("5", clearRefs);
+    fclose(clearRefs);
+#endif
+}
+
+// the high-water mark since the last reset belongs to all steps that are open
+void ResourceProfile::updatePeakRss() {
+    if (openSteps.empty()) {
+        return;
+    }
+    size_t peak = readPeakRss();
+    for (size_t i = 0; i < openSteps.size(); i++) {
+        openSteps[i].record.peakRss = std::max(openSteps[i].record.peakRss, peak);
+    }
+}
+
+size_t ResourceProfile::directorySize(const std::string &dir) {
+    DIR *handle = opendir(dir.c_str());
+    if (handle == NULL) {
+        return 0;
+    }
+    size_t size = 0;
+    struct dirent *entry;
+    while ((entry = readdir(handle)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+        std::string path = dir + "/" + entry->d_name;
+        struct stat st;
+        // symlinks, e.g. tmp/latest, are not followed
+        if (lstat(path.c_str(), &st) != 0) {
+            continue;
+        }
+        if (S_ISDIR(st.st_mode)) {
+            size += directorySize(path);
+        } else if (S_ISREG(st.st_mode)) {
+            size += st.st_size;
+        }
+    }
+    closedir(handle);
+    return size;
+}
+
+size_t ResourceProfile::countEntries(const std::string &db) {
+    std::string index = db + ".index";
+    if (db.empty() || FileUtil::fileExists(index.c_str()) == false) {
+        return 0;
+    }
+    return FileUtil::countLines(index.c_str());
+}
+
+void ResourceProfile::startStep(const std::string &name) {
+    if (tmpDir.empty()) {
+        return;
+    }
+    updatePeakRss();
+    OpenStep step;
+    step.record.name = name;
+    step.record.depth = openSteps.size();
+    step.record.startTime = currentTime();
+    step.record.peakRss = 0;
+    step.record.entriesIn = 0;
+    step.record.entriesOut = 0;
+    step.start = currentUsage();
+    openSteps.push_back(step);
+    resetPeakRss();
+}
+
+void ResourceProfile::setEntries(size_t entriesIn, size_t entriesOut) {
+    if (openSteps.empty()) {
+        return;
+    }
+    openSteps.back().record.entriesIn = entriesIn;
+    openSteps.back().record.entriesOut = entriesOut;
+}
+
+void ResourceProfile::endStep() {
+    if (openSteps.empty()) {
+        return;
+    }
+    Usage end = currentUsage();
+    updatePeakRss();
+    Record record = openSteps.back().record;
+    const Usage &start = openSteps.back().start;
+    openSteps.pop_back();
+
+    record.wallTime = end.wallTime - start.wallTime;
+    record.cpuTime = end.cpuTime - start.cpuTime;
+    record.bytesRead = (end.blocksRead - start.blocksRead) * BLOCK_SIZE;
+    record.bytesWritten = (end.blocksWritten - start.blocksWritten) * BLOCK_SIZE;
+    // a child process of this step used more memory than all children before
+    if (end.childPeakRss > start.childPeakRss) {
+        record.peakRss = std::max(record.peakRss, end.childPeakRss);
+    }
+    append(record);
+}
+
+void ResourceProfile::append(const Record &record) {
+    std::string tsvFile = tmpDir + "/resource_profile.tsv";
+    FILE *tsv = fopen(tsvFile.c_str(), "a");
+    if (tsv == NULL) {
+        perror(tsvFile.c_str());
+        EXIT(EXIT_FAILURE);
+    }
+    fprintf(tsv, "%s\t%u\t%.6f\t%.3f\t%.3f\t%zu\t%zu\t%zu\t%zu\t%zu\n", record.name.c_str(), record.depth,
+            record.startTime, record.wallTime, record.cpuTime, record.peakRss, record.bytesRead, record.bytesWritten,
+            record.entriesIn, record.entriesOut);
+    if (fclose(tsv) != 0) {
+        Debug(Debug::ERROR) << "Cannot close file " << tsvFile << "\n";
+        EXIT(EXIT_FAILURE);
+    }
+}
+
+std::vector<ResourceProfile::Record> ResourceProfile::readRecords() const {
+    std::vector<Record> records;
+    std::string tsvFile = tmpDir + "/resource_profile.tsv";
+    if (tmpDir.empty() || FileUtil::fileExists(tsvFile.c_str()) == false) {
+        return records;
+    }
+    FILE *tsv = FileUtil::openFileOrDie(tsvFile.c_str(), "r", true);
+    char *line = NULL;
+    size_t len = 0;
+    ssize_t read;
+    while ((read = getline(&line, &len, tsv)) != -1) {
+        if (read > 0 && line[read - 1] == '\n') {
+            line[read - 1] = '\0';
+        }
+        std::vector<std::string> columns = Util::split(line, "\t");
+        if (columns.size() != 10) {
+            continue;
+        }
+        Record record;
+        record.name = columns[0];
+        record.depth = strtoul(columns[1].c_str(), NULL, 10);
+        record.startTime = strtod(columns[2].c_str(), NULL);
+        record.wallTime = strtod(columns[3].c_str(), NULL);
+        record.cpuTime = strtod(columns[4].c_str(), NULL);
+        record.peakRss = strtoull(columns[5].c_str(), NULL, 10);
+        record.bytesRead = strtoull(columns[6].c_str(), NULL, 10);
+        record.bytesWritten = strtoull(columns[7].c_str(), NULL, 10);
+        record.entriesIn = strtoull(columns[8].c_str(), NULL, 10);
+        record.entriesOut = strtoull(columns[9].c_str(), NULL, 10);
+        records.push_back(record);
+    }
+    free(line);
+    fclose(tsv);
+    // steps are appended when they end, nested steps end before the step they are part of
+    std::stable_sort(records.begin(), records.end(), Record::compareByStart);
+    return records;
+}
+
+void ResourceProfile::finish() const {
+    std::vector<Record> records = readRecords();
+    if (records.empty()) {
+        return;
+    }
+    size_t tmpDirSize = directorySize(tmpDir);
+    writeJson(records, tmpDirSize);
+    printSummary(records, tmpDirSize);
+}
+
+void ResourceProfile::writeJson(const std::vector<Record> &records, size_t tmpDirSize) const {
+    std::string jsonFile = tmpDir + "/resource_profile.json";
+    FILE *json = fopen(jsonFile.c_str(), "w");
+    if (json == NULL) {
+        perror(jsonFile.c_str());
+        EXIT(EXIT_FAILURE);
+    }
+    fprintf(json, "{\n  \"tmp_dir_bytes\": %zu,\n  \"steps\": [\n", tmpDirSize);
+    for (size_t i = 0; i < records.size(); i++) {
+        const Record &r = records[i];
+        fprintf(json, "    {\"step\": \"%s\", \"depth\": %u, \"start_time_s\": %.6f, \"wall_time_s\": %.3f, \"cpu_time_s\": %.3f, "
+                      "\"peak_rss_bytes\": %zu, \"bytes_read\": %zu, \"bytes_written\": %zu, "
+                      "\"entries_in\": %zu, \"entries_out\": %zu}%s\n",
+                escapeJson(r.name).c_str(), r.depth, r.startTime, r.wallTime, r.cpuTime, r.peakRss, r.bytesRead,
+                r.bytesWritten, r.entriesIn, r.entriesOut, (i + 1 < records.size()) ? "," : "");
+    }
+    fputs("  ]\n}\n", json);
+    if (fclose(json) != 0) {
+        Debug(Debug::ERROR) << "Cannot close file " << jsonFile << "\n";
+        EXIT(EXIT_FAILURE);
+    }
+}
+
+void ResourceProfile::printSummary(const std::vector<Record> &records, size_t tmpDirSize) const {
+    std::ostringstream ss;
+    ss << "Resource profile (" << tmpDir << "/resource_profile.json)\n";
+    ss << std::left << std::setw(36) << "step" << std::right
+       << std::setw(10) << "wall s" << std::setw(10) << "cpu s" << std::setw(9) << "peak RSS"
+       << std::setw(9) << "read" << std::setw(9) << "written"
+       << std::setw(12) << "entries in" << std::setw(12) << "entries out" << "\n";
+    for (size_t i = 0; i < records.size(); i++) {
+        const Record &r = records[i];
+        std::string name = std::string(2 * r.depth, ' ') + r.name;
+        ss << std::left << std::setw(36) << name << std::right << std::fixed << std::setprecision(1)
+           << std::setw(10) << r.wallTime << std::setw(10) << r.cpuTime
+           << std::setw(9) << formatBytes(r.peakRss) << std::setw(9) << formatBytes(r.bytesRead)
+           << std::setw(9) << formatBytes(r.bytesWritten)
+           << std::setw(12) << r.entriesIn << std::setw(12) << r.entriesOut << "\n";
+    }
+    ss << "Tmp dir size at the end: " << formatBytes(tmpDirSize) << "\n";
+    Debug(Debug::INFO) << ss.str();
+}
+
+void ResourceProfile::clear(const std::string &tmpDir) {
+    std::string tsvFile = tmpDir + "/resource_profile.tsv";
+    std::string jsonFile = tmpDir + "/resource_profile.json";
+    if (FileUtil::fileExists(tsvFile.c_str())) {
+        FileUtil::remove(tsvFile.c_str());
+    }
+    if (FileUtil::fileExists(jsonFile.c_str())) {
+        FileUtil::remove(jsonFile.c_str());
+    }
+}
@@ -0,0 +1,82 @@
+#ifndef RESOURCEPROFILE_H
+#define RESOURCEPROFILE_H
+
+#include <string>
+#include <vector>
+
+// Resource usage of the steps of a workflow run, recorded with --resource-profile. Every
+// finished step appends one line to <tmpDir>/resource_profile.tsv, modules run as separate
+// processes are measured by the step that waits for them. finish() writes
+// <tmpDir>/resource_profile.json once at the end of the run. A profile without tmp dir
+// records nothing.
+class ResourceProfile {
+public:
+    struct Record {
+        std::string name;
+        // nesting level, iterations are recorded inside the workflow step that runs them
+        unsigned int depth;
+        // seconds since the epoch
+        double startTime;
+        double wallTime;
+        double cpuTime;
+        // highest resident set size during the step. Where the high-water mark of the process
+        // cannot be reset (see resetPeakRss), it is the peak of the process up to the step end.
+        size_t peakRss;
+        // block I/O as reported by getrusage, reads served by the page cache are not counted
+        size_t bytesRead;
+        size_t bytesWritten;
+        size_t entriesIn;
+        size_t entriesOut;
+
+        static bool compareByStart(const Record &first, const Record &second) {
+            return first.startTime < second.startTime;
+        }
+    };
+
+    ResourceProfile() {}
+    explicit ResourceProfile(const std::string &tmpDir) : tmpDir(tmpDir) {}
+
+    // measures this process and its children that finished in between, steps can be nested
+    void startStep(const std::string &name);
+    void setEntries(size_t entriesIn, size_t entriesOut);
+    void endStep();
+
+    // writes the JSON file with the size of the tmp dir at the end of the run and prints a summary
+    void finish() const;
+
+    // starts a new profile, records of earlier runs in the same tmp dir are removed
+    static void clear(const std::string &tmpDir);
+
+    // entries of a database, 0 if it does not exist
+    static size_t countEntries(const std::string &db);
+
+private:
+    struct Usage {
+        double wallTime;
+        double cpuTime;
+        size_t blocksRead;
+        size_t blocksWritten;
+        size_t childPeakRss;
+    };
+
+    struct OpenStep {
+        Record record;
+        Usage start;
+    };
+
+    static Usage currentUsage();
+    static size_t readPeakRss();
+    static void resetPeakRss();
+    void updatePeakRss();
+    static size_t directorySize(const std::string &dir);
+
+    void append(const Record &record);
+    std::vector<Record> readRecords() const;
+    void writeJson(const std::vector<Record> &records, size_t tmpDirSize) const;
+    void printSummary(const std::vector<Record> &records, size_t tmpDirSize) const;
+
+    std::string tmpDir;
+    std::vector<OpenStep> openSteps;
+};
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef SEQUENCECOUNTS_H
+#define SEQUENCECOUNTS_H
+
+#include "DBReader.h"
+#include "FileUtil.h"
+#include "Util.h"
+
+#include <string>
+#include <vector>
+
+// Number of identical reads each entry of collapseDuplicates stands for, by key. Contigs
+// keep the key of the sequence they grew from and with it its count. Keys without an
+// entry count once.
+class SequenceCounts {
+public:
+    explicit SequenceCounts(const std::string &countDb) {
+        DBReader<unsigned int> reader(countDb.c_str(), (countDb + ".index").c_str(), 1, DBReader<unsigned int>::USE_INDEX|DBReader<unsigned int>::USE_DATA);
+        reader.open(DBReader<unsigned int>::NOSORT);
+        if (reader.getSize() > 0) {
+            counts.resize(static_cast<size_t>(reader.getLastKey()) + 1, 1);
+        }
+        for (size_t id = 0; id < reader.getSize(); id++) {
+            counts[reader.getDbKey(id)] = Util::fast_atoi<unsigned int>(reader.getData(id, 0));
+        }
+        reader.close();
+    }
+
+    // the counts collapseduplicates wrote for seqDb (<seqDb>_count), NULL if there are none
+    static SequenceCounts *openIfExists(const std::string &seqDb) {
+        const std::string countDb = seqDb + "_count";
+        if (FileUtil::fileExists((countDb + ".index").c_str()) == false) {
+            return NULL;
+        }
+        return new SequenceCounts(countDb);
+    }
+
+    unsigned int get(unsigned int key) const {
+        return key < counts.size() ? counts[key] : 1;
+    }
+
+private:
+    std::vector<unsigned int> counts;
+};
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef TARGETSTRANDS_H
+#define TARGETSTRANDS_H
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+// Strand of each target hit by the current query of an assembler, as (target key,
+// is reverse) pairs. The assemblers keep one such list per query instead of a flag
+// for every sequence of the database.
+inline bool compareStrandByKey(const std::pair<unsigned int, bool> &first, const std::pair<unsigned int, bool> &second) {
+    return first.first < second.first;
+}
+
+inline bool isReverseTarget(const std::vector<std::pair<unsigned int, bool>> &strands, unsigned int dbKey) {
+    // strands is stable sorted by key, if a target was hit more than once the last hit decides
+    std::vector<std::pair<unsigned int, bool>>::const_iterator it =
+            std::upper_bound(strands.begin(), strands.end(), std::make_pair(dbKey, true), compareStrandByKey);
+    if (it == strands.begin() || (it - 1)->first != dbKey) {
+        return false;
+    }
+    return (it - 1)->second;
+}
+
+#endif
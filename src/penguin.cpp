@@ -37,7 +37,7 @@ std::vector<struct Command> commands = {
                             {"nuclAlnResult", DbType::ACCESS_MODE_INPUT, DbType::NEED_DATA, &DbValidator::alignmentDb },
                             {"nuclAssembly", DbType::ACCESS_MODE_OUTPUT, DbType::NEED_DATA, &DbValidator::nuclDb },
                             {"aaAssembly", DbType::ACCESS_MODE_OUTPUT, DbType::NEED_DATA, &DbValidator::aaDb }}},
-    {"nuclassembleresults",      nuclassembleresult,       &localPar.assembleresults,      COMMAND_HIDDEN,
+    {"nuclassembleresults",      nuclassembleresult,       &localPar.nuclassembleresults,      COMMAND_HIDDEN,
         "Extending representative sequence to the left and right side using ungapped alignments.",
         NULL,
         "Annika Jochheim <annika.jochheim@mpinat.mpg.de>>",
@@ -45,6 +45,14 @@ std::vector<struct Command> commands = {
         CITATION_PLASS, {{"sequenceDB",  DbType::ACCESS_MODE_INPUT, DbType::NEED_DATA, &DbValidator::nuclDb },
                             {"alnResult", DbType::ACCESS_MODE_INPUT, DbType::NEED_DATA, &DbValidator::alignmentDb  },
                             {"reprSeqDB", DbType::ACCESS_MODE_OUTPUT, DbType::NEED_DATA, &DbValidator::sequenceDb }}},
+    {"assembleiterate",      assembleiterate,       &localPar.assembleiterate,      COMMAND_HIDDEN,
+        "Run all nucleotide assembly iterations in one process without intermediate databases",
+        NULL,
+        "Martin Steinegger <martin.steinegger@mpibpc.mpg.de>",
+        "<i:sequenceDB> <o:reprSeqDB> <o:sequenceDBcycle>",
+        CITATION_PLASS, {{"sequenceDB",  DbType::ACCESS_MODE_INPUT, DbType::NEED_DATA, &DbValidator::nuclDb },
+                            {"reprSeqDB", DbType::ACCESS_MODE_OUTPUT, DbType::NEED_DATA, &DbValidator::sequenceDb },
+                            {"cycleResult", DbType::ACCESS_MODE_OUTPUT, DbType::NEED_DATA, &DbValidator::nuclDb }}},
     {"mergereads",      mergereads,      &localPar.onlythreads,          COMMAND_HIDDEN,
         "Merge paired-end reads from FASTQ file (powered by FLASH)",
         NULL,
@@ -63,5 +71,36 @@ std::vector<struct Command> commands = {
         NULL,
         "Annika Jochheim <annika.jochheim@mpinat.mpg.de>",
         "<i:sequenceDB> [<i:sequenceDBcycle>] <o:headerDB>",
-        CITATION_PLASS, {{"sequenceDB", DbType::ACCESS_MODE_INPUT, DbType::NEED_DATA, NULL}}}
+        CITATION_PLASS, {{"sequenceDB", DbType::ACCESS_MODE_INPUT, DbType::NEED_DATA, NULL}}},
+    {"selectassembled",      selectassembled,      &localPar.selectassembled,          COMMAND_HIDDEN,
+        "Select sequences that were extended by the assembly",
+        NULL,
+        "Martin Steinegger <martin.steinegger@mpibpc.mpg.de>",
+        "<i:assemblyDB> <i:sourceDB> <o:assemblyDB>",
+        CITATION_PLASS, {{"assemblyDB", DbType::ACCESS_MODE_INPUT, DbType::NEED_DATA, &DbValidator::sequenceDb },
+                            {"sourceDB", DbType::ACCESS_MODE_INPUT, DbType::NEED_DATA, &DbValidator::sequenceDb },
+                            {"assemblyDB", DbType::ACCESS_MODE_OUTPUT, DbType::NEED_DATA, &DbValidator::sequenceDb }}},
+    {"collapseduplicates",   collapseduplicates,   &localPar.collapseduplicates,       COMMAND_HIDDEN,
+        "Collapse identical sequences into one entry and write their number to <o:sequenceDB>_count",
+        NULL,
+        "Martin Steinegger <martin.steinegger@mpibpc.mpg.de>",
+        "<i:sequenceDB> <o:sequenceDB>",
+        CITATION_PLASS, {{"sequenceDB", DbType::ACCESS_MODE_INPUT, DbType::NEED_DATA, &DbValidator::sequenceDb },
+                            {"sequenceDB", DbType::ACCESS_MODE_OUTPUT, DbType::NEED_DATA, &DbValidator::sequenceDb }}},
+    {"normalizereads",       normalizereads,       &localPar.normalizereads,           COMMAND_HIDDEN,
+        "Drop reads whose median k-mer abundance reached the target coverage (digital normalization)",
+        NULL,
+        "Martin Steinegger <martin.steinegger@mpibpc.mpg.de>",
+        "<i:sequenceDB> <o:sequenceDB>",
+        CITATION_PLASS, {{"sequenceDB", DbType::ACCESS_MODE_INPUT, DbType::NEED_DATA, &DbValidator::nuclDb },
+                            {"sequenceDB", DbType::ACCESS_MODE_OUTPUT, DbType::NEED_DATA, &DbValidator::nuclDb }}},
+    {"extensionrescorediagonal", extensionrescorediagonal, &localPar.extensionrescorediagonal, COMMAND_HIDDEN,
+        "Compute sequence identity for diagonal, keeping the hits the assembly extends with first",
+        NULL,
+        "Martin Steinegger <martin.steinegger@mpibpc.mpg.de>",
+        "<i:queryDB> <i:targetDB> <i:prefilterDB> <o:resultDB>",
+        CITATION_PLASS, {{"queryDB", DbType::ACCESS_MODE_INPUT, DbType::NEED_DATA, &DbValidator::sequenceDb },
+                         {"targetDB", DbType::ACCESS_MODE_INPUT, DbType::NEED_DATA, &DbValidator::sequenceDb },
+                         {"resultDB", DbType::ACCESS_MODE_INPUT, DbType::NEED_DATA, &DbValidator::resultDb },
+                         {"alignmentDB", DbType::ACCESS_MODE_OUTPUT, DbType::NEED_DATA, &DbValidator::alignmentDb }}}
 };
@@ -55,5 +55,43 @@ std::vector<struct Command> commands = {
                 NULL,
                 "Annika Jochheim <annika.jochheim@mpibpc.mpg.de>",
                 "<i:sequenceDB> [<i:sequenceDBcycle>] <o:headerDB>",
-                CITATION_PLASS, {{"sequenceDB", DbType::ACCESS_MODE_INPUT, DbType::NEED_DATA, NULL}}}
+                CITATION_PLASS, {{"sequenceDB", DbType::ACCESS_MODE_INPUT, DbType::NEED_DATA, NULL}}},
+        {"extractstartlongorfs", extractstartlongorfs, &localPar.extractstartlongorfs, COMMAND_HIDDEN,
+                "Extract and translate the long and the start ORFs of reads in one pass",
+                NULL,
+                "Martin Steinegger <martin.steinegger@mpibpc.mpg.de>",
+                "<i:sequenceDB> <o:sequenceDB>",
+                CITATION_PLASS, {{"sequenceDB", DbType::ACCESS_MODE_INPUT, DbType::NEED_DATA, &DbValidator::nuclDb },
+                                 {"sequenceDB", DbType::ACCESS_MODE_OUTPUT, DbType::NEED_DATA, &DbValidator::aaDb }}},
+        {"selectassembled",      selectassembled,      &localPar.selectassembled,          COMMAND_HIDDEN,
+                "Select sequences that were extended by the assembly",
+                NULL,
+                "Martin Steinegger <martin.steinegger@mpibpc.mpg.de>",
+                "<i:assemblyDB> <i:sourceDB> <o:assemblyDB>",
+                CITATION_PLASS, {{"assemblyDB", DbType::ACCESS_MODE_INPUT, DbType::NEED_DATA, &DbValidator::sequenceDb },
+                                 {"sourceDB", DbType::ACCESS_MODE_INPUT, DbType::NEED_DATA, &DbValidator::sequenceDb },
+                                 {"assemblyDB", DbType::ACCESS_MODE_OUTPUT, DbType::NEED_DATA, &DbValidator::sequenceDb }}},
+        {"collapseduplicates",   collapseduplicates,   &localPar.collapseduplicates,       COMMAND_HIDDEN,
+                "Collapse identical sequences into one entry and write their number to <o:sequenceDB>_count",
+                NULL,
+                "Martin Steinegger <martin.steinegger@mpibpc.mpg.de>",
+                "<i:sequenceDB> <o:sequenceDB>",
+                CITATION_PLASS, {{"sequenceDB", DbType::ACCESS_MODE_INPUT, DbType::NEED_DATA, &DbValidator::sequenceDb },
+                                 {"sequenceDB", DbType::ACCESS_MODE_OUTPUT, DbType::NEED_DATA, &DbValidator::sequenceDb }}},
+        {"normalizereads",       normalizereads,       &localPar.normalizereads,           COMMAND_HIDDEN,
+                "Drop reads whose median k-mer abundance reached the target coverage (digital normalization)",
+                NULL,
+                "Martin Steinegger <martin.steinegger@mpibpc.mpg.de>",
+                "<i:sequenceDB> <o:sequenceDB>",
+                CITATION_PLASS, {{"sequenceDB", DbType::ACCESS_MODE_INPUT, DbType::NEED_DATA, &DbValidator::nuclDb },
+                                 {"sequenceDB", DbType::ACCESS_MODE_OUTPUT, DbType::NEED_DATA, &DbValidator::nuclDb }}},
+        {"extensionrescorediagonal", extensionrescorediagonal, &localPar.extensionrescorediagonal, COMMAND_HIDDEN,
+                "Compute sequence identity for diagonal, keeping the hits the assembly extends with first",
+                NULL,
+                "Martin Steinegger <martin.steinegger@mpibpc.mpg.de>",
+                "<i:queryDB> <i:targetDB> <i:prefilterDB> <o:resultDB>",
+                CITATION_PLASS, {{"queryDB", DbType::ACCESS_MODE_INPUT, DbType::NEED_DATA, &DbValidator::sequenceDb },
+                                 {"targetDB", DbType::ACCESS_MODE_INPUT, DbType::NEED_DATA, &DbValidator::sequenceDb },
+                                 {"resultDB", DbType::ACCESS_MODE_INPUT, DbType::NEED_DATA, &DbValidator::resultDb },
+                                 {"alignmentDB", DbType::ACCESS_MODE_OUTPUT, DbType::NEED_DATA, &DbValidator::alignmentDb }}}
 };
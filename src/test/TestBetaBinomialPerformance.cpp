@@ -0,0 +1,102 @@
+// Times the extension queue comparison of the nucleotide assemblers: the lgamma and
+// log-space series they computed on every comparison before and BetaBinomial::compare
+// with its log factorial table and multiplicative recurrence.
+#include "BetaBinomial.h"
+#include "AssemblyHit.h"
+#include "Timer.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+const char* binary_name = "test_betabinomialperformance";
+
+// the comparison of CompareNuclResultByScore before BetaBinomial
+static bool compareLogSpace(const AssemblyHit &r1, const AssemblyHit &r2) {
+    const unsigned int alnLength1 = r1.alnLength();
+    const unsigned int alnLength2 = r2.alnLength();
+    unsigned int mm_count1 = (1 - r1.seqId) * alnLength1 + 0.5;
+    unsigned int mm_count2 = (1 - r2.seqId) * alnLength2 + 0.5;
+
+    unsigned int alpha1 = mm_count1 + 1;
+    unsigned int alpha2 = mm_count2 + 1;
+    unsigned int beta1 = alnLength1 - mm_count1 + 1;
+    unsigned int beta2 = alnLength2 - mm_count2 + 1;
+
+    double log_c = (std::lgamma(beta1+beta2)+std::lgamma(alpha1+beta1))-(std::lgamma(alpha1+beta1+beta2)+std::lgamma(beta1));
+    double log_r = 0.0;
+    double p = 0.0;
+    for (size_t idx = 0; idx < alpha2; idx++) {
+        p += exp(log_r + log_c);
+        log_r = log(alpha1+idx)+log(beta2+idx)-(log(idx+1) + log(idx+alpha1+beta1+beta2)) + log_r;
+    }
+
+    if (p < 0.45)
+        return true;
+    if (p  > 0.55)
+        return false;
+    if (r1.dbLen - alnLength1 < r2.dbLen - alnLength2)
+        return true;
+    if (r1.dbLen - alnLength1 > r2.dbLen - alnLength2)
+        return false;
+
+    return true;
+}
+
+// end-to-end hits with up to 10% mismatches
+static AssemblyHit randomHit(unsigned int minLen, unsigned int maxLen) {
+    AssemblyHit hit;
+    unsigned int alnLength = minLen + rand() % (maxLen - minLen + 1);
+    unsigned int mismatches = rand() % (alnLength / 10 + 1);
+    hit.dbKey = rand();
+    hit.score = 0;
+    hit.seqId = static_cast<float>(alnLength - mismatches) / static_cast<float>(alnLength);
+    hit.qStartPos = 0;
+    hit.qEndPos = alnLength - 1;
+    hit.dbStartPos = 0;
+    hit.dbEndPos = alnLength - 1;
+    hit.dbLen = alnLength + rand() % 100;
+    return hit;
+}
+
+int main (int, const char**) {
+    const unsigned int minLen = 20;
+    const unsigned int maxLens[] = {150, 1000, 20000};
+    const size_t comparisons[] = {2000000, 500000, 20000};
+
+    srand(1);
+    size_t errors = 0;
+    for (size_t range = 0; range < 3; range++) {
+        std::vector<AssemblyHit> hits(comparisons[range] + 1);
+        for (size_t i = 0; i < hits.size(); i++) {
+            hits[i] = randomHit(minLen, maxLens[range]);
+        }
+
+        std::vector<char> expected(comparisons[range]);
+        Timer timer;
+        for (size_t i = 0; i < comparisons[range]; i++) {
+            expected[i] = compareLogSpace(hits[i], hits[i + 1]);
+        }
+        double logSpaceTime = timer.getTimediff();
+
+        size_t differences = 0;
+        timer.reset();
+        for (size_t i = 0; i < comparisons[range]; i++) {
+            differences += (BetaBinomial::compare(hits[i], hits[i + 1]) != static_cast<bool>(expected[i])) ? 1 : 0;
+        }
+        double tableTime = timer.getTimediff();
+        errors += differences;
+
+        double logSpaceNs = logSpaceTime * 1e9 / comparisons[range];
+        double tableNs = tableTime * 1e9 / comparisons[range];
+        std::cout << "alignment length " << minLen << "-" << maxLens[range] << ": "
+                  << logSpaceNs << " ns -> " << tableNs << " ns (" << logSpaceNs / tableNs << "x)\n";
+    }
+
+    if (errors > 0) {
+        std::cout << errors << " comparisons differ from the log-space series\n";
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,145 @@
+// Times the end-to-end realignment of the pending hits of a growing contig:
+// the scalar DistanceCalculator path plus identity count that the assemblers used before,
+// IncrementalUngappedAligner on its own and with the overlap sums kept between rounds.
+#include "IncrementalUngappedAligner.h"
+#include "DistanceCalculator.h"
+#include "NucleotideMatrix.h"
+#include "Parameters.h"
+#include "SubstitutionMatrix.h"
+#include "Timer.h"
+#include "Util.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+const char* binary_name = "test_incrementalungappedalignerperformance";
+
+struct Read {
+    std::string seq;
+    int contigPos;
+};
+
+static bool sameResult(const DistanceCalculator::LocalAlignment &alignment, unsigned int identities,
+                       const IncrementalUngappedAligner::Result &result) {
+    return alignment.score == result.alignment.score && alignment.startPos == result.alignment.startPos
+           && alignment.endPos == result.alignment.endPos && alignment.diagonal == result.alignment.diagonal
+           && identities == result.identities;
+}
+
+int main (int, const char**) {
+    const size_t contigLen = 4000;
+    const size_t readLen = 150;
+    const size_t readCount = 400;
+    const int startLen = 300;
+    const int growBy = 25;
+    const size_t repeats = 200;
+
+    Parameters& par = Parameters::getInstance();
+    par.initMatrices();
+    NucleotideMatrix subMat(par.scoringMatrixFile.nucleotides, 1.0, 0.0);
+    SubstitutionMatrix::FastMatrix fastMatrix = SubstitutionMatrix::createAsciiSubMat(subMat);
+    const int alnMode = Parameters::RESCORE_MODE_END_TO_END_ALIGNMENT;
+    IncrementalUngappedAligner aligner(fastMatrix.matrix, alnMode);
+
+    // reads with about 1% substitutions and a few N
+    const char nucleotides[] = {'A', 'C', 'G', 'T'};
+    srand(1);
+    std::string contig(contigLen, 'A');
+    for (size_t i = 0; i < contigLen; i++) {
+        contig[i] = nucleotides[rand() % 4];
+    }
+    std::vector<Read> reads(readCount);
+    for (size_t i = 0; i < readCount; i++) {
+        reads[i].contigPos = rand() % (contigLen - readLen);
+        reads[i].seq = contig.substr(reads[i].contigPos, readLen);
+        for (size_t pos = 0; pos < readLen; pos++) {
+            int r = rand() % 1000;
+            if (r < 10) {
+                reads[i].seq[pos] = nucleotides[rand() % 4];
+            } else if (r < 11) {
+                reads[i].seq[pos] = 'N';
+            }
+        }
+    }
+
+    // the query grows by growBy residues on both ends per round, every read is realigned
+    std::vector<std::pair<int, int> > rounds;
+    for (int start = (contigLen - startLen) / 2, end = start + startLen;
+         start >= 0 && end <= static_cast<int>(contigLen); start -= growBy, end += growBy) {
+        rounds.emplace_back(start, end);
+    }
+    const int firstStart = rounds[0].first;
+
+    std::vector<std::vector<DistanceCalculator::LocalAlignment> > expected(rounds.size());
+    std::vector<std::vector<unsigned int> > expectedIdentities(rounds.size());
+    Timer timer;
+    for (size_t rep = 0; rep < repeats; rep++) {
+        for (size_t round = 0; round < rounds.size(); round++) {
+            const char *querySeq = contig.c_str() + rounds[round].first;
+            unsigned int queryLen = rounds[round].second - rounds[round].first;
+            expected[round].resize(readCount);
+            expectedIdentities[round].resize(readCount);
+            for (size_t i = 0; i < readCount; i++) {
+                int diagonal = reads[i].contigPos - rounds[round].first;
+                DistanceCalculator::LocalAlignment alignment = DistanceCalculator::ungappedAlignmentByDiagonal(
+                        querySeq, queryLen, reads[i].seq.c_str(), readLen, diagonal, fastMatrix.matrix, alnMode);
+                unsigned int identities = 0;
+                unsigned int dist = abs(alignment.diagonal);
+                const char *seq1 = querySeq + ((alignment.diagonal >= 0) ? dist : 0);
+                const char *seq2 = reads[i].seq.c_str() + ((alignment.diagonal < 0) ? dist : 0);
+                for (int pos = alignment.startPos; pos < alignment.endPos; pos++) {
+                    identities += (seq1[pos] == seq2[pos]) ? 1 : 0;
+                }
+                expected[round][i] = alignment;
+                expectedIdentities[round][i] = identities;
+            }
+        }
+    }
+    double scalarTime = timer.getTimediff();
+
+    std::vector<IncrementalUngappedAligner::Target> targets;
+    std::vector<IncrementalUngappedAligner::Result> results;
+    std::vector<IncrementalUngappedAligner::OverlapSum> sums(readCount);
+    size_t errors = 0;
+    double timings[2];
+    for (size_t withSums = 0; withSums < 2; withSums++) {
+        timer.reset();
+        for (size_t rep = 0; rep < repeats; rep++) {
+            std::fill(sums.begin(), sums.end(), IncrementalUngappedAligner::OverlapSum());
+            for (size_t round = 0; round < rounds.size(); round++) {
+                const char *querySeq = contig.c_str() + rounds[round].first;
+                unsigned int queryLen = rounds[round].second - rounds[round].first;
+                unsigned int queryOffset = firstStart - rounds[round].first;
+                targets.clear();
+                for (size_t i = 0; i < readCount; i++) {
+                    int diagonal = reads[i].contigPos - rounds[round].first;
+                    targets.emplace_back(reads[i].seq.c_str(), readLen, diagonal, withSums ? &sums[i] : NULL);
+                }
+                aligner.align(querySeq, queryLen, queryOffset, targets, results);
+                if (rep == 0) {
+                    for (size_t i = 0; i < readCount; i++) {
+                        errors += sameResult(expected[round][i], expectedIdentities[round][i], results[i]) ? 0 : 1;
+                    }
+                }
+            }
+        }
+        timings[withSums] = timer.getTimediff();
+    }
+
+    size_t alignments = repeats * rounds.size() * readCount;
+    std::cout << alignments << " end-to-end alignments in " << rounds.size() << " rounds\n";
+    std::cout << "scalar:              " << scalarTime << "s\n";
+    std::cout << "intra-pair SIMD:     " << timings[0] << "s (" << scalarTime / timings[0] << "x)\n";
+    std::cout << "SIMD + overlap sums: " << timings[1] << "s (" << scalarTime / timings[1] << "x)\n";
+
+    delete[] fastMatrix.matrix;
+    delete[] fastMatrix.matrixData;
+
+    if (errors > 0) {
+        std::cout << errors << " results differ from DistanceCalculator::ungappedAlignmentByDiagonal\n";
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,96 @@
+// Sorts random k-mer arrays with KmerRadixSort and with SORT_PARALLEL and checks that both
+// give the same order, for the rep. sequence/pos and rep. sequence/diagonal comparators
+// with and without the strand bit masked.
+#include "KmerRadixSort.h"
+#include "FastSort.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+const char* binary_name = "test_kmerradixsort";
+
+typedef KmerPosition<short> Kmer;
+
+static size_t randomBits(int bits) {
+    size_t value = (static_cast<size_t>(rand()) << 32) ^ (static_cast<size_t>(rand()) << 16) ^ rand();
+    return (bits >= 64) ? value : (value & ((1ULL << bits) - 1));
+}
+
+// few distinct k-mers, ids and positions, so that the comparator has to break many ties.
+// kmerBits limits the bytes the radix sort has to distribute, the strand bit is random.
+static void fillRandom(std::vector<Kmer> &kmers, int kmerBits, unsigned int distinctKmers, unsigned int maxId) {
+    std::vector<size_t> values(distinctKmers);
+    for (size_t i = 0; i < values.size(); i++) {
+        values[i] = randomBits(kmerBits);
+    }
+    for (size_t i = 0; i < kmers.size(); i++) {
+        size_t kmer = values[rand() % values.size()];
+        kmers[i].kmer = (rand() % 2) ? BIT_SET(kmer, 63) : BIT_CLEAR(kmer, 63);
+        kmers[i].id = rand() % maxId;
+        kmers[i].seqLen = static_cast<short>(rand() % 300);
+        kmers[i].pos = static_cast<short>(rand() % 300);
+    }
+}
+
+// total order over all fields, to check that both results are permutations of the input
+static bool compareBytes(const Kmer &first, const Kmer &second) {
+    return memcmp(&first, &second, sizeof(Kmer)) < 0;
+}
+
+template <bool MaskStrand, bool (*Compare)(const Kmer &, const Kmer &)>
+static bool sortsEqual(const std::vector<Kmer> &input) {
+    std::vector<Kmer> expected(input);
+    SORT_PARALLEL(expected.begin(), expected.end(), Compare);
+    std::vector<Kmer> result(input);
+    KmerRadixSort<Kmer, MaskStrand, Compare>::sort(result.data(), result.size());
+
+    // elements the comparator considers equal may end up in any order
+    for (size_t i = 0; i < result.size(); i++) {
+        if (Compare(result[i], expected[i]) || Compare(expected[i], result[i])) {
+            return false;
+        }
+    }
+    std::sort(expected.begin(), expected.end(), compareBytes);
+    std::sort(result.begin(), result.end(), compareBytes);
+    return memcmp(expected.data(), result.data(), sizeof(Kmer) * result.size()) == 0;
+}
+
+int main (int, const char**) {
+    const size_t arrays = 300;
+    const int kmerBits[] = {8, 20, 46, 62};
+
+    srand(1);
+    size_t errors = 0;
+    for (size_t array = 0; array < arrays; array++) {
+        // sizes around the comparison sort threshold and up to a few hundred thousand
+        size_t size = (array % 3 == 0) ? rand() % 200 : rand() % 200000;
+        std::vector<Kmer> kmers(size);
+        fillRandom(kmers, kmerBits[array % 4], 1 + rand() % 5000, 1 + rand() % 1000);
+
+        if (sortsEqual<false, Kmer::compareRepSequenceAndIdAndPos>(kmers) == false) {
+            std::cout << "array " << array << ": compareRepSequenceAndIdAndPos differs\n";
+            errors++;
+        }
+        if (sortsEqual<true, Kmer::compareRepSequenceAndIdAndPosReverse>(kmers) == false) {
+            std::cout << "array " << array << ": compareRepSequenceAndIdAndPosReverse differs\n";
+            errors++;
+        }
+        if (sortsEqual<false, Kmer::compareRepSequenceAndIdAndDiag>(kmers) == false) {
+            std::cout << "array " << array << ": compareRepSequenceAndIdAndDiag differs\n";
+            errors++;
+        }
+        if (sortsEqual<true, Kmer::compareRepSequenceAndIdAndDiagReverse>(kmers) == false) {
+            std::cout << "array " << array << ": compareRepSequenceAndIdAndDiagReverse differs\n";
+            errors++;
+        }
+    }
+
+    if (errors > 0) {
+        std::cout << errors << " of " << 4 * arrays << " sorts differ from SORT_PARALLEL\n";
+        return EXIT_FAILURE;
+    }
+    std::cout << "All " << 4 * arrays << " sorts match SORT_PARALLEL\n";
+    return EXIT_SUCCESS;
+}
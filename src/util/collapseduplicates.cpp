@@ -0,0 +1,203 @@
+#include "DBReader.h"
+#include "DBWriter.h"
+#include "Debug.h"
+#include "FastSort.h"
+#include "LocalParameters.h"
+#include "AssemblySteps.h"
+#include "NucleotideMatrix.h"
+#include "SequenceCounts.h"
+#include "Util.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifdef OPENMP
+#include <omp.h>
+#endif
+
+struct SequenceHash {
+    size_t hash;
+    unsigned int id;
+
+    static bool compareByHashAndId(const SequenceHash &first, const SequenceHash &second) {
+        if (first.hash != second.hash) {
+            return first.hash < second.hash;
+        }
+        return first.id < second.id;
+    }
+};
+
+// without the new line, the index length of compressed entries is not the sequence length
+static size_t sequenceLength(DBReader<unsigned int> &reader, size_t id, const char *data) {
+    return reader.isCompressed() ? strlen(data) - 1 : reader.getSeqLen(id);
+}
+
+// reverseComplement writes IUPAC codes as N, the reverse complement is only exact
+// for sequences of A, C, G, T and N
+static bool hasExactComplement(const char *seq, size_t length) {
+    for (size_t pos = 0; pos < length; pos++) {
+        switch (seq[pos]) {
+            case 'A': case 'C': case 'G': case 'T': case 'N':
+                break;
+            default:
+                return false;
+        }
+    }
+    return true;
+}
+
+// Keeps one entry for each group of identical sequences, nucleotide sequences of A, C, G,
+// T and N are also identical to their reverse complement. The entry that comes first in
+// the input is kept with its key. If countDb is not empty, it gets the number of sequences
+// each kept entry stands for (see SequenceCounts). Entries of an input that was collapsed
+// before stand for as many sequences as its counts say. The headers of the input are
+// linked to the output.
+void collapseDuplicates(LocalParameters &par, const std::string &inDb, const std::string &outDb, const std::string &countDb) {
+    DBReader<unsigned int> reader(inDb.c_str(), (inDb + ".index").c_str(), par.threads, DBReader<unsigned int>::USE_INDEX|DBReader<unsigned int>::USE_DATA);
+    reader.open(DBReader<unsigned int>::NOSORT);
+
+    const bool isNucl = Parameters::isEqualDbtype(reader.getDbtype(), Parameters::DBTYPE_NUCLEOTIDES);
+    NucleotideMatrix *nuclMatrix = NULL;
+    if (isNucl) {
+        nuclMatrix = new NucleotideMatrix(par.scoringMatrixFile.nucleotides, 1.0, 0.0);
+    }
+
+    // 1. hash every sequence, for nucleotides with an exact complement the smaller hash of both strands
+    std::vector<SequenceHash> hashes(reader.getSize());
+    Debug(Debug::INFO) << "Hash sequences\n";
+#pragma omp parallel
+    {
+        unsigned int thread_idx = 0;
+#ifdef OPENMP
+        thread_idx = static_cast<unsigned int>(omp_get_thread_num());
+#endif
+        std::vector<char> revComplement;
+#pragma omp for schedule(dynamic, 1000)
+        for (size_t id = 0; id < reader.getSize(); id++) {
+            const char *data = reader.getData(id, thread_idx);
+            size_t length = sequenceLength(reader, id, data);
+            size_t hash = Util::hash(data, length);
+            if (isNucl && hasExactComplement(data, length)) {
+                if (revComplement.size() < length) {
+                    revComplement.resize(length);
+                }
+                nuclMatrix->reverseComplement(data, length, revComplement.data(), 'N');
+                hash = std::min(hash, Util::hash(revComplement.data(), length));
+            }
+            hashes[id].hash = hash;
+            hashes[id].id = static_cast<unsigned int>(id);
+        }
+    }
+    SORT_PARALLEL(hashes.begin(), hashes.end(), SequenceHash::compareByHashAndId);
+
+    std::vector<size_t> runStarts;
+    for (size_t i = 0; i < hashes.size(); i++) {
+        if (i == 0 || hashes[i].hash != hashes[i - 1].hash) {
+            runStarts.push_back(i);
+        }
+    }
+    runStarts.push_back(hashes.size());
+
+    // 2. compare the sequences with equal hashes, count[id] is the number of sequences
+    // a kept entry stands for and 0 for collapsed entries
+    SequenceCounts *inputCounts = SequenceCounts::openIfExists(inDb);
+    std::vector<unsigned int> count(reader.getSize(), 0);
+    Debug(Debug::INFO) << "Collapse identical sequences\n";
+#pragma omp parallel
+    {
+        unsigned int thread_idx = 0;
+#ifdef OPENMP
+        thread_idx = static_cast<unsigned int>(omp_get_thread_num());
+#endif
+        std::vector<char> revComplement;
+        std::string sequence;
+        std::vector<unsigned int> kept;
+#pragma omp for schedule(dynamic, 1000)
+        for (size_t run = 0; run < runStarts.size() - 1; run++) {
+            kept.clear();
+            for (size_t i = runStarts[run]; i < runStarts[run + 1]; i++) {
+                unsigned int id = hashes[i].id;
+                // getData reuses the buffer of the thread for compressed databases
+                const char *data = reader.getData(id, thread_idx);
+                sequence.assign(data, sequenceLength(reader, id, data));
+                const size_t length = sequence.length();
+                const bool compareComplement = isNucl && hasExactComplement(sequence.c_str(), length);
+                if (compareComplement) {
+                    if (revComplement.size() < length) {
+                        revComplement.resize(length);
+                    }
+                    nuclMatrix->reverseComplement(sequence.c_str(), length, revComplement.data(), 'N');
+                }
+                bool isDuplicate = false;
+                for (size_t j = 0; j < kept.size() && isDuplicate == false; j++) {
+                    const char *keptData = reader.getData(kept[j], thread_idx);
+                    if (sequenceLength(reader, kept[j], keptData) != length) {
+                        continue;
+                    }
+                    isDuplicate = memcmp(sequence.c_str(), keptData, length) == 0
+                                  || (compareComplement && memcmp(revComplement.data(), keptData, length) == 0);
+                    if (isDuplicate) {
+                        count[kept[j]] += (inputCounts != NULL) ? inputCounts->get(reader.getDbKey(id)) : 1;
+                    }
+                }
+                if (isDuplicate == false) {
+                    kept.push_back(id);
+                    count[id] = (inputCounts != NULL) ? inputCounts->get(reader.getDbKey(id)) : 1;
+                }
+            }
+        }
+    }
+    delete nuclMatrix;
+    delete inputCounts;
+
+    // 3. write the kept entries and their counts
+    DBWriter sequenceWriter(outDb.c_str(), (outDb + ".index").c_str(), par.threads, par.compressed, reader.getDbtype());
+    sequenceWriter.open();
+    DBWriter *countWriter = NULL;
+    if (countDb.empty() == false) {
+        countWriter = new DBWriter(countDb.c_str(), (countDb + ".index").c_str(), par.threads, false, Parameters::DBTYPE_GENERIC_DB);
+        countWriter->open();
+    }
+    size_t keptCount = 0;
+#pragma omp parallel reduction(+:keptCount)
+    {
+        unsigned int thread_idx = 0;
+#ifdef OPENMP
+        thread_idx = static_cast<unsigned int>(omp_get_thread_num());
+#endif
+        std::string buffer;
+#pragma omp for schedule(static)
+        for (size_t id = 0; id < reader.getSize(); id++) {
+            if (count[id] == 0) {
+                continue;
+            }
+            unsigned int key = reader.getDbKey(id);
+            const char *data = reader.getData(id, thread_idx);
+            sequenceWriter.writeData(data, sequenceLength(reader, id, data) + 1, key, thread_idx);
+            if (countWriter != NULL) {
+                buffer = SSTR(count[id]) + "\n";
+                countWriter->writeData(buffer.c_str(), buffer.length(), key, thread_idx);
+            }
+            keptCount++;
+        }
+    }
+    DBReader<unsigned int>::softlinkDb(inDb, outDb, DBFiles::HEADERS);
+    if (countWriter != NULL) {
+        countWriter->close(true);
+        delete countWriter;
+    }
+    sequenceWriter.close(true);
+    Debug(Debug::INFO) << "Kept " << keptCount << " of " << reader.getSize() << " sequences\n";
+    reader.close();
+}
+
+int collapseduplicates(int argc, const char **argv, const Command& command) {
+    LocalParameters &par = LocalParameters::getLocalInstance();
+    par.parseParameters(argc, argv, command, true, 0, 0);
+
+    collapseDuplicates(par, par.db1, par.db2, par.db2 + "_count");
+
+    return EXIT_SUCCESS;
+}
@@ -6,6 +6,7 @@
 #include "DBReader.h"
 #include "DBWriter.h"
 #include "LocalParameters.h"
+#include "AssemblySteps.h"
 
 #include <algorithm>
 #ifdef OPENMP
@@ -75,3 +76,28 @@ int createhdb(int argc, const char **argv, const Command& command) {
 
     return EXIT_SUCCESS;
 }
+
+void writeContigFasta(DBReader<unsigned int> *seqDbr, DBReader<unsigned int> *cycleDbr, const std::string &fastaFile) {
+    FILE *fasta = FileUtil::openFileOrDie(fastaFile.c_str(), "w", false);
+    std::string header;
+    for (size_t id = 0; id < seqDbr->getSize(); id++) {
+        size_t seqLen = seqDbr->getSeqLen(id);
+        header.clear();
+        header.append(">");
+        header.append(SSTR(id));
+        header.append(HEADER_INTERN_SEP "len:");
+        header.append(SSTR(seqLen));
+        if (cycleDbr != NULL) {
+            header.append(HEADER_INTERN_SEP "cycle:");
+            header.append(SSTR(cycleDbr->getId(seqDbr->getDbKey(id)) != UINT_MAX));
+        }
+        header.append("\n");
+        fwrite(header.c_str(), sizeof(char), header.size(), fasta);
+        fwrite(seqDbr->getData(id, 0), sizeof(char), seqLen, fasta);
+        fwrite("\n", sizeof(char), 1, fasta);
+    }
+    if (fclose(fasta) != 0) {
+        Debug(Debug::ERROR) << "Cannot close file " << fastaFile << "\n";
+        EXIT(EXIT_FAILURE);
+    }
+}
@@ -0,0 +1,175 @@
+#include "DBReader.h"
+#include "DBWriter.h"
+#include "Debug.h"
+#include "LocalParameters.h"
+#include "AssemblySteps.h"
+#include "Orf.h"
+#include "TranslateNucl.h"
+#include "Util.h"
+
+#include <algorithm>
+
+#ifdef OPENMP
+#include <omp.h>
+#endif
+
+// Extracts and translates the ORFs of the assemble workflow in one pass over the reads.
+// The ORF parameters define the long ORFs. The start ORFs are ORFs with a complete start
+// and an incomplete end that are too short to be long ORFs (down to 20 codons). This is
+// the same as running extractorfs once for each set, translatenucs --add-orf-stop on both
+// and concatdbs on the results: the long ORFs come first, followed by the start ORFs,
+// each in the order of the reads.
+void extractStartLongOrfs(LocalParameters &par, const std::string &readDb, const std::string &orfDb) {
+    if ((par.orfStartMode == 1) && (par.contigStartMode < 2)) {
+        Debug(Debug::ERROR) << "Parameter combination is illegal, orf-start-mode 1 can only go with contig-start-mode 2\n";
+        EXIT(EXIT_FAILURE);
+    }
+
+    DBReader<unsigned int> reader(readDb.c_str(), (readDb + ".index").c_str(), par.threads, DBReader<unsigned int>::USE_INDEX|DBReader<unsigned int>::USE_DATA);
+    reader.open(DBReader<unsigned int>::NOSORT);
+
+    // the long ORFs of thread i are written to slot i, the start ORFs to slot threads + i,
+    // so merging the slots puts all long ORFs before the start ORFs
+    const unsigned int slots = 2 * par.threads;
+    const std::string orfHeaderDb = orfDb + "_h";
+    DBWriter sequenceWriter(orfDb.c_str(), (orfDb + ".index").c_str(), slots, par.compressed, Parameters::DBTYPE_AMINO_ACIDS);
+    sequenceWriter.open();
+    DBWriter headerWriter(orfHeaderDb.c_str(), (orfHeaderDb + ".index").c_str(), slots, false, Parameters::DBTYPE_GENERIC_DB);
+    headerWriter.open();
+
+    const size_t longMinLength = par.orfMinLength;
+    const size_t longMaxLength = par.orfMaxLength;
+    const size_t startMinLength = std::min(par.orfMinLength, 20);
+    const size_t startMaxLength = par.orfMinLength;
+
+    unsigned int forwardFrames = Orf::getFrames(par.forwardFrames);
+    unsigned int reverseFrames = Orf::getFrames(par.reverseFrames);
+    Debug::Progress progress(reader.getSize());
+    TranslateNucl translateNucl(static_cast<TranslateNucl::GenCode>(par.translationTable));
+    int wrongSeqCnt = 0;
+#pragma omp parallel reduction(+:wrongSeqCnt)
+    {
+        Orf orf(par.translationTable, par.useAllTableStarts);
+        unsigned int thread_idx = 0;
+#ifdef OPENMP
+        thread_idx = static_cast<unsigned int>(omp_get_thread_num());
+#endif
+        size_t querySize = 0;
+        size_t queryFrom = 0;
+        reader.decomposeDomainByAminoAcid(thread_idx, par.threads, &queryFrom, &querySize);
+        if (querySize == 0) {
+            queryFrom = 0;
+        }
+        char *aa = new char[(par.maxSeqLen + 1) + 3 + 1];
+        char buffer[1024];
+
+        std::vector<Orf::SequenceLocation> res;
+        res.reserve(1000);
+        for (size_t i = queryFrom; i < (queryFrom + querySize); ++i) {
+            progress.updateProgress();
+
+            unsigned int key = reader.getDbKey(i);
+            const char *data = reader.getData(i, thread_idx);
+            size_t sequenceLength = reader.getSeqLen(i);
+            if (!orf.setSequence(data, sequenceLength)) {
+                wrongSeqCnt++;
+                continue;
+            }
+
+            // one search covers both length ranges, the other filters are shared by both sets
+            orf.findAll(res, std::min(longMinLength, startMinLength), std::max(longMaxLength, startMaxLength),
+                        par.orfMaxGaps, forwardFrames, reverseFrames, par.orfStartMode);
+            for (std::vector<Orf::SequenceLocation>::const_iterator it = res.begin(); it != res.end(); ++it) {
+                const Orf::SequenceLocation &loc = *it;
+                // ORFs span whole codons and never include the stop codon
+                const size_t codons = (loc.to - loc.from + 1) / 3;
+                const bool isLong = codons >= longMinLength && codons <= longMaxLength
+                                    && (par.contigStartMode >= 2 || loc.hasIncompleteStart != par.contigStartMode)
+                                    && (par.contigEndMode >= 2 || loc.hasIncompleteEnd != par.contigEndMode);
+                const bool isStart = codons >= startMinLength && codons <= startMaxLength
+                                     && loc.hasIncompleteStart == false && loc.hasIncompleteEnd == true;
+
+                std::pair<const char *, size_t> sequence = orf.getSequence(loc);
+                size_t length = sequence.second - (sequence.second % 3);
+                if (length < 3 || (isLong == false && isStart == false)) {
+                    continue;
+                }
+                if (length > (3 * par.maxSeqLen)) {
+                    Debug(Debug::WARNING) << "ORF of entry " << key << " length (" << length << ") is too long. Trimming entry.\n";
+                    length = (3 * par.maxSeqLen);
+                }
+
+                // same as translatenucs --add-orf-stop
+                const bool addStopAtStart = par.addOrfStop && loc.hasIncompleteStart == false;
+                bool addStopAtEnd = par.addOrfStop && loc.hasIncompleteEnd == false;
+                char *writeAA = aa;
+                if (addStopAtStart) {
+                    aa[0] = '*';
+                    writeAA = aa + 1;
+                }
+                translateNucl.translate(writeAA, sequence.first, length);
+                if (addStopAtEnd && writeAA[(length / 3) - 1] != '*') {
+                    writeAA[length / 3] = '*';
+                    writeAA[length / 3 + 1] = '\n';
+                } else {
+                    addStopAtEnd = false;
+                    writeAA[length / 3] = '\n';
+                }
+                const size_t aaLength = (length / 3) + 1 + addStopAtStart + addStopAtEnd;
+
+                size_t fromPos = loc.from;
+                size_t toPos = loc.to;
+                if (loc.strand == Orf::STRAND_MINUS) {
+                    fromPos = (sequenceLength - 1) - loc.from;
+                    toPos = (sequenceLength - 1) - loc.to;
+                }
+                size_t headerLength = Orf::writeOrfHeader(buffer, key, fromPos, toPos, loc.hasIncompleteStart, loc.hasIncompleteEnd);
+
+                if (isLong) {
+                    sequenceWriter.writeData(aa, aaLength, key, thread_idx);
+                    headerWriter.writeData(buffer, headerLength, key, thread_idx);
+                }
+                if (isStart) {
+                    sequenceWriter.writeData(aa, aaLength, key, par.threads + thread_idx);
+                    headerWriter.writeData(buffer, headerLength, key, par.threads + thread_idx);
+                }
+            }
+            res.clear();
+        }
+        delete[] aa;
+    }
+    headerWriter.close(true);
+    sequenceWriter.close(true);
+    reader.close();
+    if (wrongSeqCnt == 1) {
+        Debug(Debug::WARNING) << "1 input sequence was shorter than 3 nucleotides\n";
+    } else if (wrongSeqCnt > 1) {
+        Debug(Debug::WARNING) << wrongSeqCnt << " input sequences were shorter than 3 nucleotides\n";
+    }
+
+    // number the ORFs in the order they were written
+#pragma omp parallel
+    {
+#pragma omp single
+        {
+#pragma omp task
+            {
+                DBWriter::createRenumberedDB(orfHeaderDb, orfHeaderDb + ".index", "", "", DBReader<unsigned int>::SORT_BY_OFFSET);
+            }
+
+#pragma omp task
+            {
+                DBWriter::createRenumberedDB(orfDb, orfDb + ".index", "", "", DBReader<unsigned int>::SORT_BY_OFFSET);
+            }
+        }
+    }
+}
+
+int extractstartlongorfs(int argc, const char **argv, const Command& command) {
+    LocalParameters &par = LocalParameters::getLocalInstance();
+    par.parseParameters(argc, argv, command, true, 0, 0);
+
+    extractStartLongOrfs(par, par.db1, par.db2);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,49 @@
+#include "AssemblySteps.h"
+#include "DBReader.h"
+#include "Debug.h"
+#include "LocalParameters.h"
+#include "kmermatcher.h"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <string>
+
+int kmerEndWindow(float kmerWindowScale, DBReader<unsigned int> *seqDbr) {
+    size_t maxSeqLen = 0;
+    for (size_t id = 0; id < seqDbr->getSize(); id++) {
+        // without the new line, the index length of compressed entries is not the sequence length
+        size_t seqLen = seqDbr->isCompressed() ? strlen(seqDbr->getData(id, 0)) - 1 : seqDbr->getSeqLen(id);
+        maxSeqLen = std::max(maxSeqLen, seqLen);
+    }
+    return static_cast<int>(std::ceil(kmerWindowScale * maxSeqLen));
+}
+
+void matchKmers(LocalParameters &par, const std::string &seqDb, const std::string &prefDb) {
+    DBReader<unsigned int> seqDbr(seqDb.c_str(), (seqDb + ".index").c_str(), par.threads,
+                                  DBReader<unsigned int>::USE_INDEX|DBReader<unsigned int>::USE_DATA);
+    seqDbr.open(DBReader<unsigned int>::NOSORT);
+
+    // only for this database, like in a separate kmermatcher process
+    const int kmerSize = par.kmerSize;
+    const MultiParam<int> alphabetSize = par.alphabetSize;
+    const int kmersPerSequence = par.kmersPerSequence;
+    const std::string spacedKmerPattern = par.spacedKmerPattern;
+    setKmerLengthAndAlphabet(par, seqDbr.getAminoAcidDBSize(), seqDbr.getDbtype());
+    Debug(Debug::INFO) << "Database size: " << seqDbr.getSize() << " type: " << seqDbr.getDbTypeName() << "\n";
+
+    par.db2 = prefDb;
+    par.db2Index = prefDb + ".index";
+    if (seqDbr.getMaxSeqLen() < SHRT_MAX) {
+        kmermatcherInner<short>(par, seqDbr);
+    } else {
+        kmermatcherInner<int>(par, seqDbr);
+    }
+    seqDbr.close();
+
+    par.kmerSize = kmerSize;
+    par.alphabetSize = alphabetSize;
+    par.kmersPerSequence = kmersPerSequence;
+    par.spacedKmerPattern = spacedKmerPattern;
+}
@@ -0,0 +1,167 @@
+#include "DBReader.h"
+#include "DBWriter.h"
+#include "Debug.h"
+#include "LocalParameters.h"
+#include "AssemblySteps.h"
+#include "Util.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Count-min sketch of k-mer abundances: every k-mer increments one counter in each row,
+// its abundance is the smallest of its counters. Collisions only overestimate the
+// abundance, so a read is at most dropped too early, never kept too long.
+class KmerSketch {
+public:
+    static const size_t ROWS = 4;
+
+    explicit KmerSketch(size_t memory) {
+        size_t width = 1;
+        while (width * 2 * ROWS * sizeof(unsigned short) <= memory) {
+            width *= 2;
+        }
+        mask = width - 1;
+        counters.resize(ROWS * width, 0);
+    }
+
+    unsigned int count(uint64_t kmer) const {
+        unsigned int min = USHRT_MAX;
+        for (size_t row = 0; row < ROWS; row++) {
+            min = std::min(min, static_cast<unsigned int>(counters[index(kmer, row)]));
+        }
+        return min;
+    }
+
+    void add(uint64_t kmer) {
+        for (size_t row = 0; row < ROWS; row++) {
+            unsigned short &counter = counters[index(kmer, row)];
+            if (counter < USHRT_MAX) {
+                counter++;
+            }
+        }
+    }
+
+    size_t memory() const {
+        return counters.size() * sizeof(unsigned short);
+    }
+
+private:
+    // finalizer of MurmurHash3, with a different seed for every row
+    size_t index(uint64_t kmer, size_t row) const {
+        uint64_t h = kmer ^ (0x9E3779B97F4A7C15ULL * (row + 1));
+        h ^= h >> 33;
+        h *= 0xFF51AFD7ED558CCDULL;
+        h ^= h >> 33;
+        h *= 0xC4CEB9FE1A85EC53ULL;
+        h ^= h >> 33;
+        return row * (mask + 1) + (h & mask);
+    }
+
+    size_t mask;
+    std::vector<unsigned short> counters;
+};
+
+// 2-bit code of a nucleotide, -1 for ambiguous ones
+static int nucleotideCode(char c) {
+    switch (c) {
+        case 'A': case 'a': return 0;
+        case 'C': case 'c': return 1;
+        case 'G': case 'g': return 2;
+        case 'T': case 't': return 3;
+        default: return -1;
+    }
+}
+
+// canonical k-mers (the smaller of both strands) of the unambiguous stretches of a read
+static void extractKmers(const char *seq, size_t length, int kmerSize, std::vector<uint64_t> &kmers) {
+    kmers.clear();
+    const uint64_t kmerMask = (kmerSize == 32) ? UINT64_MAX : ((1ULL << (2 * kmerSize)) - 1);
+    const unsigned int revShift = 2 * (kmerSize - 1);
+    uint64_t forward = 0;
+    uint64_t reverse = 0;
+    int valid = 0;
+    for (size_t i = 0; i < length; i++) {
+        int code = nucleotideCode(seq[i]);
+        if (code < 0) {
+            valid = 0;
+            continue;
+        }
+        forward = ((forward << 2) | code) & kmerMask;
+        reverse = (reverse >> 2) | (static_cast<uint64_t>(3 - code) << revShift);
+        if (++valid >= kmerSize) {
+            kmers.push_back(std::min(forward, reverse));
+        }
+    }
+}
+
+// Digital normalization: reads are streamed in input order and a read is dropped if the
+// median abundance of its k-mers in the reads kept so far reached --diginorm-coverage.
+// The k-mers of kept reads are added to the sketch. Reads without a k-mer are kept.
+void normalizeReads(LocalParameters &par, const std::string &readDb, const std::string &outDb) {
+    if (par.diginormKmerSize < 1 || par.diginormKmerSize > 32) {
+        Debug(Debug::ERROR) << "--diginorm-k has to be between 1 and 32\n";
+        EXIT(EXIT_FAILURE);
+    }
+    if (par.diginormCoverage < 1) {
+        Debug(Debug::ERROR) << "--diginorm-coverage has to be at least 1\n";
+        EXIT(EXIT_FAILURE);
+    }
+    const unsigned int targetCoverage = static_cast<unsigned int>(std::min(par.diginormCoverage, static_cast<int>(USHRT_MAX)));
+
+    DBReader<unsigned int> reader(readDb.c_str(), (readDb + ".index").c_str(), 1, DBReader<unsigned int>::USE_INDEX|DBReader<unsigned int>::USE_DATA);
+    reader.open(DBReader<unsigned int>::NOSORT);
+    if (Parameters::isEqualDbtype(reader.getDbtype(), Parameters::DBTYPE_NUCLEOTIDES) == false) {
+        Debug(Debug::ERROR) << "normalizereads needs a nucleotide database\n";
+        EXIT(EXIT_FAILURE);
+    }
+
+    DBWriter writer(outDb.c_str(), (outDb + ".index").c_str(), 1, par.compressed, reader.getDbtype());
+    writer.open();
+
+    KmerSketch sketch(par.diginormSketchSize);
+    Debug(Debug::INFO) << "Count k-mers in a sketch of " << sketch.memory() << " bytes\n";
+
+    std::vector<uint64_t> kmers;
+    std::vector<unsigned int> counts;
+    size_t kept = 0;
+    Debug::Progress progress(reader.getSize());
+    for (size_t id = 0; id < reader.getSize(); id++) {
+        progress.updateProgress();
+        const char *data = reader.getData(id, 0);
+        // without the new line, the index length of compressed entries is not the sequence length
+        const size_t length = reader.isCompressed() ? strlen(data) - 1 : reader.getSeqLen(id);
+        extractKmers(data, length, par.diginormKmerSize, kmers);
+        if (kmers.empty() == false) {
+            counts.resize(kmers.size());
+            for (size_t i = 0; i < kmers.size(); i++) {
+                counts[i] = sketch.count(kmers[i]);
+            }
+            std::vector<unsigned int>::iterator median = counts.begin() + counts.size() / 2;
+            std::nth_element(counts.begin(), median, counts.end());
+            if (*median >= targetCoverage) {
+                continue;
+            }
+            for (size_t i = 0; i < kmers.size(); i++) {
+                sketch.add(kmers[i]);
+            }
+        }
+        writer.writeData(data, length + 1, reader.getDbKey(id), 0);
+        kept++;
+    }
+    DBReader<unsigned int>::softlinkDb(readDb, outDb, DBFiles::HEADERS);
+    writer.close(true);
+    Debug(Debug::INFO) << "Kept " << kept << " of " << reader.getSize() << " reads\n";
+    reader.close();
+}
+
+int normalizereads(int argc, const char **argv, const Command& command) {
+    LocalParameters &par = LocalParameters::getLocalInstance();
+    par.parseParameters(argc, argv, command, true, 0, 0);
+
+    normalizeReads(par, par.db1, par.db2);
+
+    return EXIT_SUCCESS;
+}
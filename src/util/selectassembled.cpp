@@ -0,0 +1,104 @@
+#include "DBReader.h"
+#include "DBWriter.h"
+#include "Debug.h"
+#include "FileUtil.h"
+#include "LocalParameters.h"
+#include "AssemblySteps.h"
+#include "Util.h"
+
+#include <climits>
+#include <cstring>
+
+#ifdef OPENMP
+#include <omp.h>
+#endif
+
+// complete protein: '*' at both ends and only amino acids in between
+static bool isCompleteSequence(const char *data, size_t length) {
+    if (length < 2 || data[0] != '*' || data[length - 1] != '*') {
+        return false;
+    }
+    for (size_t i = 1; i < length - 1; i++) {
+        if (data[i] < 'A' || data[i] > 'Z') {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Keeps the assembled sequences: entries that are longer than the source sequence
+// with the same key and, with --select-complete, entries that are complete proteins.
+size_t selectAssembled(LocalParameters &par, const std::string &resultDb, const std::string &sourceDb, const std::string &outDb) {
+    DBReader<unsigned int> resultReader(resultDb.c_str(), (resultDb + ".index").c_str(), par.threads, DBReader<unsigned int>::USE_INDEX|DBReader<unsigned int>::USE_DATA);
+    resultReader.open(DBReader<unsigned int>::NOSORT);
+
+    DBReader<unsigned int> sourceReader(sourceDb.c_str(), (sourceDb + ".index").c_str(), 1, DBReader<unsigned int>::USE_INDEX);
+    sourceReader.open(DBReader<unsigned int>::NOSORT);
+
+    const bool softLink = par.subDbMode == Parameters::SUBDB_MODE_SOFT;
+    const bool isCompressed = resultReader.isCompressed();
+    DBWriter writer(outDb.c_str(), (outDb + ".index").c_str(), par.threads, isCompressed, resultReader.getDbtype());
+    writer.open();
+
+    size_t selected = 0;
+    Debug::Progress progress(resultReader.getSize());
+#pragma omp parallel reduction(+:selected)
+    {
+        unsigned int thread_idx = 0;
+#ifdef OPENMP
+        thread_idx = static_cast<unsigned int>(omp_get_thread_num());
+#endif
+
+#pragma omp for schedule(dynamic, 100)
+        for (size_t id = 0; id < resultReader.getSize(); id++) {
+            progress.updateProgress();
+
+            unsigned int key = resultReader.getDbKey(id);
+            size_t entryLen = resultReader.getEntryLen(id);
+            size_t sourceId = sourceReader.getId(key);
+            bool isAssembled = sourceId != UINT_MAX && entryLen > sourceReader.getEntryLen(sourceId);
+
+            char *data = NULL;
+            size_t length = 0;
+            if (isAssembled == false && par.selectComplete) {
+                data = resultReader.getData(id, thread_idx);
+                // without the new line
+                length = isCompressed ? strlen(data) - 1 : resultReader.getSeqLen(id);
+                isAssembled = isCompleteSequence(data, length);
+            }
+            if (isAssembled == false) {
+                continue;
+            }
+
+            if (softLink) {
+                writer.writeIndexEntry(key, resultReader.getOffset(id), entryLen, thread_idx);
+            } else {
+                if (data == NULL) {
+                    data = resultReader.getData(id, thread_idx);
+                    length = isCompressed ? strlen(data) - 1 : resultReader.getSeqLen(id);
+                }
+                writer.writeData(data, length + 1, key, thread_idx);
+            }
+            selected++;
+        }
+    }
+    writer.close(true);
+    if (softLink) {
+        DBReader<unsigned int>::softlinkDb(resultDb, outDb, DBFiles::DATA);
+    }
+    Debug(Debug::INFO) << "Selected " << selected << " of " << resultReader.getSize() << " sequences\n";
+
+    sourceReader.close();
+    resultReader.close();
+
+    return selected;
+}
+
+int selectassembled(int argc, const char **argv, const Command& command) {
+    LocalParameters &par = LocalParameters::getLocalInstance();
+    par.parseParameters(argc, argv, command, true, 0, 0);
+
+    selectAssembled(par, par.db1, par.db2, par.db3);
+
+    return EXIT_SUCCESS;
+}
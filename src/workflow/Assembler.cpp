@@ -1,11 +1,14 @@
+#include "AssemblySteps.h"
 #include "DBReader.h"
 #include "Util.h"
-#include "CommandCaller.h"
 #include "Debug.h"
 #include "FileUtil.h"
 #include "LocalParameters.h"
+#include "WorkflowRunner.h"
 
-#include "assemble.sh.h"
+#include <ctime>
+#include <string>
+#include <vector>
 
 void setAssembleDBWorkflowDefaults(LocalParameters *p) {
     p->spacedKmer = false;
@@ -26,6 +29,137 @@ void setAssembleDBWorkflowDefaults(LocalParameters *p) {
     p->rescoreMode = Parameters::RESCORE_MODE_END_TO_END_ALIGNMENT;
 }
 
+static void removeIncremental(LocalParameters &par, const std::string &db) {
+    if (par.deleteFilesInc && db.empty() == false) {
+        DBReader<unsigned int>::removeDb(db);
+    }
+}
+
+// the counts of collapseduplicates stay valid for later databases, the keys are kept
+static void linkCounts(const std::string &countDb, const std::string &db) {
+    if (countDb.empty() == false && FileUtil::fileExists((db + "_count.dbtype").c_str()) == false) {
+        DBReader<unsigned int>::softlinkDb(countDb, db + "_count");
+    }
+}
+
+// All iterations of the protein assembly on the ORFs of orfDb: k-mer matching, ungapped
+// alignment and assembly. The first iteration also moves the start of ORFs to their first
+// M (findassemblystart) and matches their k-mers again. Every step leaves a .done checkpoint
+// in tmpDir, a restarted run continues after the last finished step. countDb can be empty.
+// Returns the assembly of the last iteration.
+static std::string assembleProteins(LocalParameters &par, WorkflowRunner &workflow, const std::string &tmpDir,
+                                    const std::string &orfDb, const std::string &countDb) {
+    ResourceProfile &profile = workflow.getProfile();
+    // contigs only select k-mers near both ends, scaled to the longest ORF
+    if (par.kmerWindowScale > 0.0f) {
+        DBReader<unsigned int> orfDbr(orfDb.c_str(), (orfDb + ".index").c_str(), 1, DBReader<unsigned int>::USE_INDEX|DBReader<unsigned int>::USE_DATA);
+        orfDbr.open(DBReader<unsigned int>::NOSORT);
+        par.kmerEndWindow = kmerEndWindow(par.kmerWindowScale, &orfDbr);
+        orfDbr.close();
+        Debug(Debug::INFO) << "Select k-mers from the first and last " << par.kmerEndWindow << " residues\n";
+    }
+
+    const int hashShift = par.hashShift;
+    std::string input = orfDb;
+    std::string previousPref;
+    std::string previousAln;
+    std::string previousAssembly;
+    const time_t startTime = time(NULL);
+    int step = 0;
+    while (step < par.numIterations) {
+        Debug(Debug::INFO) << "STEP: " << step << "\n";
+        linkCounts(countDb, input);
+        // every other iteration uses a different k-mer hash, the first one also matches
+        // sequences that cannot be extended
+        par.hashShift = hashShift + (step + 1) / 2;
+        if (par.PARAM_INCLUDE_ONLY_EXTENDABLE.wasSet == false) {
+            par.includeOnlyExtendable = step > 0;
+        }
+
+        // 1. Finding exact $k$-mer matches.
+        const std::string pref = tmpDir + "/pref_" + SSTR(step);
+        if (workflow.runStep("kmermatcher_" + SSTR(step), pref + ".done", true, [&]() {
+            matchKmers(par, input, pref);
+            profile.setEntries(ResourceProfile::countEntries(input), ResourceProfile::countEntries(pref));
+        })) {
+            removeIncremental(par, previousPref);
+            previousPref = pref;
+        }
+
+        // 2. Ungapped alignment
+        std::string aln = tmpDir + "/aln_" + SSTR(step);
+        if (workflow.runStep("rescorediagonal_" + SSTR(step), aln + ".done", true, [&]() {
+            extensionRescoreDiagonal(par, input, input, pref, aln);
+            profile.setEntries(ResourceProfile::countEntries(pref), ResourceProfile::countEntries(aln));
+        })) {
+            removeIncremental(par, previousAln);
+            previousAln = aln;
+        }
+
+        if (step == 0) {
+            const std::string correctedDb = tmpDir + "/corrected_seqs";
+            if (workflow.runStep("findassemblystart", correctedDb + ".done", true, [&]() {
+                findAssemblyStart(par, input, aln, correctedDb);
+                profile.setEntries(ResourceProfile::countEntries(input), ResourceProfile::countEntries(correctedDb));
+            })) {
+                // deleted at the end of the first iteration
+                previousAssembly = correctedDb;
+            }
+            input = correctedDb;
+            linkCounts(countDb, input);
+
+            const std::string correctedPref = tmpDir + "/pref_corrected_" + SSTR(step);
+            if (workflow.runStep("kmermatcher_corrected_" + SSTR(step), correctedPref + ".done", true, [&]() {
+                matchKmers(par, input, correctedPref);
+                profile.setEntries(ResourceProfile::countEntries(input), ResourceProfile::countEntries(correctedPref));
+            })) {
+                removeIncremental(par, previousPref);
+                previousPref = correctedPref;
+            }
+
+            aln = tmpDir + "/aln_corrected_" + SSTR(step);
+            if (workflow.runStep("rescorediagonal_corrected_" + SSTR(step), aln + ".done", true, [&]() {
+                extensionRescoreDiagonal(par, input, input, correctedPref, aln);
+                profile.setEntries(ResourceProfile::countEntries(correctedPref), ResourceProfile::countEntries(aln));
+            })) {
+                removeIncremental(par, previousAln);
+                previousAln = aln;
+            }
+        }
+
+        // 3. Assemble
+        const std::string assembly = tmpDir + "/assembly_" + SSTR(step);
+        ExtensionYield yield;
+        if (workflow.runStep("assembleresults_" + SSTR(step), assembly + ".done", true, [&]() {
+            yield = assembleResults(par, input, aln, assembly);
+            profile.setEntries(ResourceProfile::countEntries(input), ResourceProfile::countEntries(assembly));
+        })) {
+            removeIncremental(par, previousAssembly);
+            previousAssembly = assembly;
+        } else {
+            yield.readFile(assembly);
+        }
+        input = assembly;
+        step++;
+
+        // stop early if further iterations would hardly extend anything or the time is up
+        if (step < par.numIterations) {
+            if (par.minExtensionYield > 0.0f && yield.isBelow(par.minExtensionYield)) {
+                Debug(Debug::INFO) << "Stop after " << step << " iterations, less than " << par.minExtensionYield
+                                   << " of the sequences were extended\n";
+                break;
+            }
+            if (par.maxAssemblyTime > 0 && time(NULL) - startTime >= par.maxAssemblyTime) {
+                Debug(Debug::INFO) << "Stop after " << step << " iterations, the time limit of "
+                                   << par.maxAssemblyTime << "s was reached\n";
+                break;
+            }
+        }
+    }
+    par.hashShift = hashShift;
+    return input;
+}
+
 int assemble(int argc, const char **argv, const Command &command) {
     LocalParameters &par = LocalParameters::getLocalInstance();
     setAssembleDBWorkflowDefaults(&par);
@@ -52,21 +186,16 @@ int assemble(int argc, const char **argv, const Command &command) {
 
     par.parseParameters(argc, argv, command, true, Parameters::PARSE_VARIADIC, 0);
 
-    CommandCaller cmd;
     if(par.filenames.size() < 3) {
         Debug(Debug::ERROR) << "Too few input files provided.\n";
         return EXIT_FAILURE;
     }
-    else if ((par.filenames.size() - 2) % 2 == 0) {
-        cmd.addVariable("PAIRED_END", "1"); // paired end reads
-    } else {
-        if (par.filenames.size() != 3) {
-            Debug(Debug::ERROR) << "Too many input files provided.\n";
-            Debug(Debug::ERROR) << "For paired-end input provide READSETA_1.fastq READSETA_2.fastq ... OUTPUT.fasta tmpDir\n";
-            Debug(Debug::ERROR) << "For single input use READSET.fast(q|a) OUTPUT.fasta tmpDir\n";
-            return EXIT_FAILURE;
-        }
-        cmd.addVariable("PAIRED_END", NULL); // single end reads
+    const bool pairedEnd = (par.filenames.size() - 2) % 2 == 0;
+    if (pairedEnd == false && par.filenames.size() != 3) {
+        Debug(Debug::ERROR) << "Too many input files provided.\n";
+        Debug(Debug::ERROR) << "For paired-end input provide READSETA_1.fastq READSETA_2.fastq ... OUTPUT.fasta tmpDir\n";
+        Debug(Debug::ERROR) << "For single input use READSET.fast(q|a) OUTPUT.fasta tmpDir\n";
+        return EXIT_FAILURE;
     }
 
     std::string tmpDir = par.filenames.back();
@@ -81,68 +210,140 @@ int assemble(int argc, const char **argv, const Command &command) {
         Debug(Debug::ERROR) << "Could not get real path of " << tmpDir << "!\n";
         EXIT(EXIT_FAILURE);
     }
-    cmd.addVariable("TMP_PATH", p);
+    tmpDir = p;
     par.filenames.pop_back();
     free(p);
 
-    cmd.addVariable("OUT_FILE", par.filenames.back().c_str());
+    const std::string outFile = par.filenames.back();
     par.filenames.pop_back();
-
-    cmd.addVariable("REMOVE_TMP", par.removeTmpFiles ? "TRUE" : NULL);
-    cmd.addVariable("REMOVE_INCREMENTAL_TMP", par.deleteFilesInc ? "TRUE" : NULL);
-
-    cmd.addVariable("RUNNER", par.runner.c_str());
-    cmd.addVariable("NUM_IT", SSTR(par.numIterations).c_str());
-    cmd.addVariable("PROTEIN_FILTER", par.filterProteins == 1 ? "1" : NULL);
-    // # 1. Finding exact $k$-mer matches.
-
-    for(int i = 0; i < par.numIterations; i++){
-        std::string key = "KMERMATCHER"+SSTR(i)+"_PAR";
-        par.hashShift = par.hashShift + i % 2;
-        if(par.PARAM_INCLUDE_ONLY_EXTENDABLE.wasSet == false){
-            if (i == 0) {
-                par.includeOnlyExtendable = false;
-            } else {
-                par.includeOnlyExtendable = true;
-            }
-        }
-        cmd.addVariable(key.c_str(), par.createParameterString(par.kmermatcher).c_str());
+    if (FileUtil::fileExists(outFile.c_str())) {
+        Debug(Debug::ERROR) << outFile << " exists already!\n";
+        return EXIT_FAILURE;
     }
 
-    cmd.addVariable("KMERMATCHER_PAR", par.createParameterString(par.kmermatcher).c_str());
-
     // # 2. Hamming distance pre-clustering
     par.filterHits = false;
 
-    // --orf-start-mode 0 --min-length 45 --max-gaps 0
+    // long ORFs: --orf-start-mode 0 --min-length 45 --max-gaps 0
+    // start ORFs (derived by extractstartlongorfs): --contig-start-mode 1 --contig-end-mode 0 --min-length 20 --max-length 45
     par.orfStartMode = 0;
     par.orfMaxGaps = 0;
-    cmd.addVariable("EXTRACTORFS_LONG_PAR", par.createParameterString(par.extractorfs).c_str());
+    par.addOrfStop = true;
 
+    // keep extended and complete proteins, copy them to the result
+    par.selectComplete = true;
+    par.subDbMode = Parameters::SUBDB_MODE_HARD;
 
-    // --contig-start-mode 1 --contig-end-mode 0 --orf-start-mode 0 --min-length 30 --max-length 45 --max-gaps 0
-    par.contigStartMode = 1;
-    par.contigEndMode = 0;
-    par.orfStartMode = 0;
-    par.orfMaxLength = par.orfMinLength;
-    par.orfMinLength = std::min(par.orfMinLength, 20);
-    par.orfMaxGaps = 0;
-    cmd.addVariable("EXTRACTORFS_START_PAR", par.createParameterString(par.extractorfs).c_str());
+    ResourceProfile::clear(tmpDir);
+    WorkflowRunner workflow(par.resourceProfile ? tmpDir : std::string());
+    const std::string readDb = tmpDir + "/nucl_reads";
+    std::vector<WorkflowRunner::StepId> inputSteps;
+    inputSteps.push_back(workflow.addStep("read import", readDb, false, std::vector<WorkflowRunner::StepId>(), [&]() {
+        if (pairedEnd) {
+            Debug(Debug::INFO) << "PAIRED END MODE\n";
+            mergeReads(par, par.filenames, readDb);
+        } else {
+            // createdb changes its parameters while parsing, it keeps running in its own process
+            std::vector<std::string> args(par.filenames);
+            args.push_back(readDb);
+            WorkflowRunner::runModule("createdb", args);
+        }
+        workflow.getProfile().setEntries(0, ResourceProfile::countEntries(readDb));
+    }));
 
+    // digital normalization, reads of regions that already reached --diginorm-coverage are dropped
+    std::string readInput = readDb;
+    const std::string normalizedDb = tmpDir + "/nucl_reads_norm";
+    if (par.diginormCoverage > 0) {
+        readInput = normalizedDb;
+        WorkflowRunner::StepId normalizeStep = workflow.addStep("normalize reads", normalizedDb + ".dbtype", false, inputSteps, [&]() {
+            normalizeReads(par, readDb, normalizedDb);
+            workflow.getProfile().setEntries(ResourceProfile::countEntries(readDb), ResourceProfile::countEntries(normalizedDb));
+        });
+        inputSteps = std::vector<WorkflowRunner::StepId>(1, normalizeStep);
+    }
 
-    par.addOrfStop = true;
-    //cmd.addVariable("CREATEDB_PAR", par.createParameterString(par.createdb).c_str());
-    cmd.addVariable("TRANSLATENUCS_PAR", par.createParameterString(par.translatenucs).c_str());
-    cmd.addVariable("UNGAPPED_ALN_PAR", par.createParameterString(par.rescorediagonal).c_str());
-    cmd.addVariable("ASSEMBLE_RESULT_PAR", par.createParameterString(par.assembleresults).c_str());
-    cmd.addVariable("FILTERNONCODING_PAR", par.createParameterString(par.filternoncoding).c_str());
-
-    cmd.addVariable("THREADS_PAR", par.createParameterString(par.onlythreads).c_str());
-    cmd.addVariable("VERBOSITY_PAR", par.createParameterString(par.onlyverbosity).c_str());
-
-    FileUtil::writeFile(tmpDir + "/assemble.sh", assemble_sh, assemble_sh_len);
-    std::string program(tmpDir + "/assemble.sh");
-    cmd.execProgram(program.c_str(), par.filenames);
+    // identical reads and ORFs are assembled once, their number breaks ties between extensions
+    const std::string uniqueDb = tmpDir + "/nucl_reads_unique";
+    if (par.collapseDuplicates) {
+        const std::string collapseInput = readInput;
+        readInput = uniqueDb;
+        WorkflowRunner::StepId collapseStep = workflow.addStep("collapse reads", uniqueDb + ".dbtype", false, inputSteps, [&, collapseInput]() {
+            collapseDuplicates(par, collapseInput, uniqueDb, uniqueDb + "_count");
+            workflow.getProfile().setEntries(ResourceProfile::countEntries(collapseInput), ResourceProfile::countEntries(uniqueDb));
+        });
+        inputSteps = std::vector<WorkflowRunner::StepId>(1, collapseStep);
+    }
+
+    const std::string orfDb = tmpDir + "/aa_6f_start_long";
+    inputSteps = std::vector<WorkflowRunner::StepId>(1, workflow.addStep("extract ORFs", orfDb + ".dbtype", false, inputSteps, [&]() {
+        extractStartLongOrfs(par, readInput, orfDb);
+        workflow.getProfile().setEntries(ResourceProfile::countEntries(readInput), ResourceProfile::countEntries(orfDb));
+    }));
+
+    std::string orfInput = orfDb;
+    std::string countDb;
+    const std::string uniqueOrfDb = tmpDir + "/aa_6f_start_long_unique";
+    if (par.collapseDuplicates) {
+        orfInput = uniqueOrfDb;
+        countDb = uniqueOrfDb + "_count";
+        inputSteps = std::vector<WorkflowRunner::StepId>(1, workflow.addStep("collapse ORFs", uniqueOrfDb + ".dbtype", false, inputSteps, [&]() {
+            collapseDuplicates(par, orfDb, uniqueOrfDb, countDb);
+            workflow.getProfile().setEntries(ResourceProfile::countEntries(orfDb), ResourceProfile::countEntries(uniqueOrfDb));
+        }));
+    }
+
+    // the iterations and the filter run on every start, their steps are skipped if they finished before
+    std::string resultDb;
+    WorkflowRunner::StepId assemblyStep = workflow.addStep("assembly", "", false, inputSteps, [&]() {
+        const std::string assemblyDb = assembleProteins(par, workflow, tmpDir, orfInput, countDb);
+        resultDb = assemblyDb;
+        if (par.filterProteins == 1) {
+            resultDb = assemblyDb + "_filtered";
+            workflow.runStep("filternoncoding", resultDb, false, [&]() {
+                filterNoncoding(par, assemblyDb, resultDb);
+                workflow.getProfile().setEntries(ResourceProfile::countEntries(assemblyDb), ResourceProfile::countEntries(resultDb));
+            });
+        }
+    });
+
+    // select only assembled sequences: extended proteins and complete proteins with * at start and end
+    const std::string selectedDb = tmpDir + "/assembly";
+    WorkflowRunner::StepId selectStep = workflow.addStep("select assembled", selectedDb + ".dbtype", false, std::vector<WorkflowRunner::StepId>(1, assemblyStep), [&]() {
+        size_t selected = selectAssembled(par, resultDb, orfDb, selectedDb);
+        workflow.getProfile().setEntries(ResourceProfile::countEntries(resultDb), selected);
+    });
+
+    workflow.addStep("contig output", "", false, std::vector<WorkflowRunner::StepId>(1, selectStep), [&]() {
+        DBReader<unsigned int> selectedDbr(selectedDb.c_str(), (selectedDb + ".index").c_str(), 1, DBReader<unsigned int>::USE_DATA|DBReader<unsigned int>::USE_INDEX);
+        selectedDbr.open(DBReader<unsigned int>::NOSORT);
+        const std::string fastaFile = tmpDir + "/assembly.fasta";
+        writeContigFasta(&selectedDbr, NULL, fastaFile);
+        workflow.getProfile().setEntries(selectedDbr.getSize(), selectedDbr.getSize());
+        selectedDbr.close();
+        FileUtil::move(fastaFile.c_str(), outFile.c_str());
+    });
+
+    workflow.run();
+
+    if (par.removeTmpFiles) {
+        Debug(Debug::INFO) << "Removing temporary files\n";
+        const std::string dbs[] = {readDb, normalizedDb, uniqueDb, orfDb, uniqueOrfDb};
+        for (size_t i = 0; i < 5; i++) {
+            WorkflowRunner::removeStepDb(dbs[i]);
+            DBReader<unsigned int>::removeDb(dbs[i] + "_h");
+        }
+        for (int step = 0; step < par.numIterations; step++) {
+            WorkflowRunner::removeStepDb(tmpDir + "/pref_" + SSTR(step));
+            WorkflowRunner::removeStepDb(tmpDir + "/aln_" + SSTR(step));
+            WorkflowRunner::removeStepDb(tmpDir + "/assembly_" + SSTR(step));
+            WorkflowRunner::removeStepDb(tmpDir + "/assembly_" + SSTR(step) + "_filtered");
+        }
+        WorkflowRunner::removeStepDb(tmpDir + "/corrected_seqs");
+        WorkflowRunner::removeStepDb(tmpDir + "/pref_corrected_0");
+        WorkflowRunner::removeStepDb(tmpDir + "/aln_corrected_0");
+        WorkflowRunner::removeStepDb(selectedDb);
+    }
 
     return EXIT_SUCCESS;
 }
@@ -1,11 +1,14 @@
+#include "AssemblySteps.h"
 #include "DBReader.h"
 #include "Util.h"
-#include "CommandCaller.h"
 #include "Debug.h"
 #include "FileUtil.h"
 #include "LocalParameters.h"
+#include "WorkflowRunner.h"
 
-#include "guidedNuclAssemble.sh.h"
+#include <ctime>
+#include <string>
+#include <vector>
 
 void setGuidedNuclAssemblerWorkflowDefaults(LocalParameters *p) {
 
@@ -40,6 +43,118 @@ void setGuidedNuclAssemblerWorkflowDefaults(LocalParameters *p) {
     p->zdrop = 200;
 }
 
+static void removeIncremental(LocalParameters &par, const std::string &db) {
+    if (par.deleteFilesInc && db.empty() == false) {
+        DBReader<unsigned int>::removeDb(db);
+    }
+}
+
+// All iterations of the protein guided assembly of the ORFs in nuclOrfDb and their translations
+// in aaOrfDb: k-mer matching and ungapped alignment of the proteins, the alignments are carried
+// over to the nucleotide sequences, which are then assembled. Every step leaves a .done
+// checkpoint in tmpDir, a restarted run continues after the last finished step. Returns the
+// nucleotide assembly of the last iteration.
+static std::string guidedAssembly(LocalParameters &par, WorkflowRunner &workflow, const std::string &tmpDir,
+                                  const std::string &nuclOrfDb, const std::string &aaOrfDb) {
+    ResourceProfile &profile = workflow.getProfile();
+    // contigs only select k-mers near both ends, scaled to the longest ORF
+    if (par.kmerWindowScale > 0.0f) {
+        DBReader<unsigned int> orfDbr(aaOrfDb.c_str(), (aaOrfDb + ".index").c_str(), 1, DBReader<unsigned int>::USE_INDEX|DBReader<unsigned int>::USE_DATA);
+        orfDbr.open(DBReader<unsigned int>::NOSORT);
+        par.kmerEndWindow = kmerEndWindow(par.kmerWindowScale, &orfDbr);
+        orfDbr.close();
+        Debug(Debug::INFO) << "Select k-mers from the first and last " << par.kmerEndWindow << " residues\n";
+    }
+
+    // the k-mer matching and alignment compare the proteins, the assembly the nucleotides
+    const float proteinSeqIdThr = par.seqIdThr;
+    std::string inputAa = aaOrfDb;
+    std::string inputNucl = nuclOrfDb;
+    std::string previousPref;
+    std::string previousAln;
+    std::string previousAlnNucl;
+    std::string previousAssemblyAa;
+    std::string previousAssemblyNucl;
+    const time_t startTime = time(NULL);
+    int step = 0;
+    while (step < par.numIterations) {
+        Debug(Debug::INFO) << "STEP: " << step << "\n";
+
+        // 1. Finding exact $k$-mer matches.
+        const std::string pref = tmpDir + "/pref_" + SSTR(step);
+        if (workflow.runStep("kmermatcher_" + SSTR(step), pref + ".done", true, [&]() {
+            matchKmers(par, inputAa, pref);
+            profile.setEntries(ResourceProfile::countEntries(inputAa), ResourceProfile::countEntries(pref));
+        })) {
+            removeIncremental(par, previousPref);
+            previousPref = pref;
+        }
+
+        // 2. Ungapped alignment
+        const std::string aln = tmpDir + "/aln_" + SSTR(step);
+        if (workflow.runStep("rescorediagonal_" + SSTR(step), aln + ".done", true, [&]() {
+            extensionRescoreDiagonal(par, inputAa, inputAa, pref, aln);
+            profile.setEntries(ResourceProfile::countEntries(pref), ResourceProfile::countEntries(aln));
+        })) {
+            removeIncremental(par, previousAln);
+            previousAln = aln;
+        }
+
+        // 3. Ungapped alignment protein 2 nucl
+        const std::string alnNucl = tmpDir + "/aln_nucl_" + SSTR(step);
+        if (workflow.runStep("proteinaln2nucl_" + SSTR(step), alnNucl + ".done", true, [&]() {
+            const std::string *dbs[] = {&inputNucl, &inputNucl, &inputAa, &inputAa, &aln, &alnNucl};
+            std::string *names[] = {&par.db1, &par.db2, &par.db3, &par.db4, &par.db5, &par.db6};
+            std::string *indices[] = {&par.db1Index, &par.db2Index, &par.db3Index, &par.db4Index, &par.db5Index, &par.db6Index};
+            for (size_t i = 0; i < 6; i++) {
+                *names[i] = *dbs[i];
+                *indices[i] = *dbs[i] + ".index";
+            }
+            proteinaln2nucl(par);
+            profile.setEntries(ResourceProfile::countEntries(aln), ResourceProfile::countEntries(alnNucl));
+        })) {
+            removeIncremental(par, previousAlnNucl);
+            previousAlnNucl = alnNucl;
+        }
+
+        // 4. Assemble
+        const std::string assemblyNucl = tmpDir + "/assembly_nucl_" + SSTR(step);
+        const std::string assemblyAa = tmpDir + "/assembly_aa_" + SSTR(step);
+        ExtensionYield yield;
+        if (workflow.runStep("guidedassembleresults_" + SSTR(step), tmpDir + "/assembly_aa_nucl_" + SSTR(step) + ".done", true, [&]() {
+            par.seqIdThr = par.multiSeqIdThr.nucleotides;
+            yield = guidedAssembleResults(par, inputNucl, inputAa, alnNucl, assemblyNucl, assemblyAa);
+            par.seqIdThr = proteinSeqIdThr;
+            profile.setEntries(ResourceProfile::countEntries(inputNucl), ResourceProfile::countEntries(assemblyNucl));
+        })) {
+            removeIncremental(par, previousAssemblyAa);
+            removeIncremental(par, previousAssemblyNucl);
+            previousAssemblyAa = assemblyAa;
+            previousAssemblyNucl = assemblyNucl;
+        } else {
+            yield.readFile(assemblyNucl);
+        }
+        inputAa = assemblyAa;
+        inputNucl = assemblyNucl;
+        step++;
+
+        // stop early if further iterations would hardly extend anything or the time is up
+        if (step < par.numIterations) {
+            if (par.minExtensionYield > 0.0f && yield.isBelow(par.minExtensionYield)) {
+                Debug(Debug::INFO) << "Stop after " << step << " iterations, less than " << par.minExtensionYield
+                                   << " of the sequences were extended\n";
+                break;
+            }
+            if (par.maxAssemblyTime > 0 && time(NULL) - startTime >= par.maxAssemblyTime) {
+                Debug(Debug::INFO) << "Stop after " << step << " iterations, the time limit of "
+                                   << par.maxAssemblyTime << "s was reached\n";
+                break;
+            }
+        }
+    }
+    return inputNucl;
+}
+
 int guidedNuclAssemble(int argc, const char **argv, const Command &command) {
     LocalParameters &par = LocalParameters::getLocalInstance();
     setGuidedNuclAssemblerWorkflowDefaults(&par);
@@ -81,24 +196,18 @@ int guidedNuclAssemble(int argc, const char **argv, const Command &command) {
     par.PARAM_USE_ALL_TABLE_STARTS.addCategory(MMseqsParameter::COMMAND_EXPERT);
 
     par.parseParameters(argc, argv, command, true, Parameters::PARSE_VARIADIC, 0);
-    CommandCaller cmd;
     if(par.filenames.size() < 3) {
         Debug(Debug::ERROR) << "Too few input files provided.\n";
         return EXIT_FAILURE;
     }
-    else if ((par.filenames.size() - 2) % 2 == 0) {
-        cmd.addVariable("PAIRED_END", "1"); // paired end reads
-    } else {
-        if (par.filenames.size() != 3) {
-            Debug(Debug::ERROR) << "Too many input files provided.\n";
-            Debug(Debug::ERROR) << "For paired-end input provide READSETA_1.fastq READSETA_2.fastq ... OUTPUT.fasta tmpDir\n";
-            Debug(Debug::ERROR) << "For single input use READSET.fast(q|a) OUTPUT.fasta tmpDir\n";
-            return EXIT_FAILURE;
-        }
-        cmd.addVariable("PAIRED_END", NULL); // single end reads
+    const bool pairedEnd = (par.filenames.size() - 2) % 2 == 0;
+    if (pairedEnd == false && par.filenames.size() != 3) {
+        Debug(Debug::ERROR) << "Too many input files provided.\n";
+        Debug(Debug::ERROR) << "For paired-end input provide READSETA_1.fastq READSETA_2.fastq ... OUTPUT.fasta tmpDir\n";
+        Debug(Debug::ERROR) << "For single input use READSET.fast(q|a) OUTPUT.fasta tmpDir\n";
+        return EXIT_FAILURE;
     }
 
-
     std::string tmpDir = par.filenames.back();
     std::string hash = SSTR(par.hashParameter(command.databases, par.filenames, *command.params));
     if (par.reuseLatest) {
@@ -111,29 +220,28 @@ int guidedNuclAssemble(int argc, const char **argv, const Command &command) {
         Debug(Debug::ERROR) << "Could not get real path of " << tmpDir << "!\n";
         EXIT(EXIT_FAILURE);
     }
-    cmd.addVariable("TMP_PATH", p);
+    tmpDir = p;
     par.filenames.pop_back();
     free(p);
 
-    cmd.addVariable("OUT_FILE", par.filenames.back().c_str());
+    const std::string outFile = par.filenames.back();
     par.filenames.pop_back();
-
-    cmd.addVariable("REMOVE_TMP", par.removeTmpFiles ? "TRUE" : NULL);
-    cmd.addVariable("REMOVE_INCREMENTAL_TMP", par.deleteFilesInc ? "TRUE" : NULL);
-    cmd.addVariable("RUNNER", par.runner.c_str());
+    if (FileUtil::fileExists(outFile.c_str())) {
+        Debug(Debug::ERROR) << outFile << " exists already!\n";
+        return EXIT_FAILURE;
+    }
 
     // set values for protein level assembly
     par.numIterations = par.multiNumIterations.aminoacids;
     par.kmerSize = par.multiKmerSize.aminoacids;
     par.seqIdThr = par.multiSeqIdThr.aminoacids;
     par.alnLenThr = par.multiAlnLenThr.aminoacids;
-    cmd.addVariable("NUM_IT", SSTR(par.numIterations).c_str());
 
     // # 0. Extract ORFs
     // --orf-start-mode 0 --min-length 45 --max-gaps 0
     par.orfStartMode = 0;
     par.orfMaxGaps = 0;
-    cmd.addVariable("EXTRACTORFS_LONG_PAR", par.createParameterString(par.extractorfs).c_str());
+    const std::string extractOrfsLongPar = par.createParameterString(par.extractorfs);
 
     // --contig-start-mode 1 --contig-end-mode 0 --orf-start-mode 0 --min-length 30 --max-length 45 --max-gaps 0
     par.contigStartMode = 1;
@@ -142,27 +250,29 @@ int guidedNuclAssemble(int argc, const char **argv, const Command &command) {
     par.orfMaxLength = par.orfMinLength;
     par.orfMinLength = std::min(par.orfMinLength, 20);
     par.orfMaxGaps = 0;
-    cmd.addVariable("EXTRACTORFS_START_PAR", par.createParameterString(par.extractorfs).c_str());
+    const std::string extractOrfsStartPar = par.createParameterString(par.extractorfs);
 
     // force parameters for assembly steps
     par.covThr = 0.0;
     par.seqIdMode = 0;
     par.includeOnlyExtendable = true;
 
-    // # 1. Finding exact $k$-mer matches.
-    cmd.addVariable("KMERMATCHER_PAR", par.createParameterString(par.kmermatcher).c_str());
-
     // # 2. Rescore diagonal
     par.filterHits = false;
-    bool addBacktrace = par.addBacktrace;
+    const bool addBacktrace = par.addBacktrace;
     par.addBacktrace = true;
-    cmd.addVariable("UNGAPPED_ALN_PAR", par.createParameterString(par.rescorediagonal).c_str());
-    cmd.addVariable("PROTEIN_ALN_2_NUCL_PAR", par.createParameterString(par.proteinaln2nucl).c_str());
-
 
-    // # 3. Assembly: Extend by left and right extension
-    par.seqIdThr = par.multiSeqIdThr.nucleotides;
-    cmd.addVariable("ASSEMBLE_RESULT_PAR", par.createParameterString(par.guidedassembleresults).c_str());
+    // the nucleotide assembly and the redundancy reduction run as separate modules with their
+    // own values, par keeps the ones of the protein level assembly
+    const int proteinNumIterations = par.numIterations;
+    const int proteinKmerSize = par.kmerSize;
+    const float proteinSeqIdThr = par.seqIdThr;
+    const int proteinAlnLenThr = par.alnLenThr;
+    const float proteinCovThr = par.covThr;
+    const int diginormCoverage = par.diginormCoverage;
+    const bool dbMode = par.dbMode;
+    const bool wrappedScoring = par.wrappedScoring;
+    const bool ignoreMultiKmer = par.ignoreMultiKmer;
 
     // set mandatory values for nucleotide level assembly step when calling nucleassemble step from guidedNuclAssembler
     par.numIterations = par.multiNumIterations.nucleotides;
@@ -171,21 +281,203 @@ int guidedNuclAssemble(int argc, const char **argv, const Command &command) {
     par.alnLenThr = par.multiAlnLenThr.nucleotides;
     par.addBacktrace = addBacktrace;
     par.dbMode = true;
-    cmd.addVariable("NUCL_ASM_PAR", par.createParameterString(par.nuclassembleworkflow).c_str());
+    // the reads were normalized before the guided assembly
+    par.diginormCoverage = 0;
+    const std::string nuclAssemblePar = par.createParameterString(par.nuclassembleworkflow);
 
     // set mandatory values for redundancy reduction
     par.seqIdThr = par.clustSeqIdThr;
     par.covThr = par.clustCovThr;
     par.wrappedScoring = true;
     par.ignoreMultiKmer = true;
-    cmd.addVariable("CLUSTER_PAR", par.createParameterString(par.reduceredundancy).c_str());
+    const std::string clusterPar = par.createParameterString(par.reduceredundancy);
+    const std::string threadsPar = par.createParameterString(par.onlythreads);
+
+    par.numIterations = proteinNumIterations;
+    par.kmerSize = proteinKmerSize;
+    par.seqIdThr = proteinSeqIdThr;
+    par.alnLenThr = proteinAlnLenThr;
+    par.covThr = proteinCovThr;
+    par.addBacktrace = true;
+    par.dbMode = dbMode;
+    par.diginormCoverage = diginormCoverage;
+    par.wrappedScoring = wrappedScoring;
+    par.ignoreMultiKmer = ignoreMultiKmer;
+
+    ResourceProfile::clear(tmpDir);
+    WorkflowRunner workflow(par.resourceProfile ? tmpDir : std::string());
+    const std::string readDb = tmpDir + "/nucl_reads";
+    std::vector<WorkflowRunner::StepId> inputSteps;
+    inputSteps.push_back(workflow.addStep("read import", readDb, false, std::vector<WorkflowRunner::StepId>(), [&]() {
+        if (pairedEnd) {
+            Debug(Debug::INFO) << "PAIRED END MODE\n";
+            mergeReads(par, par.filenames, readDb);
+        } else {
+            // createdb changes its parameters while parsing, it keeps running in its own process
+            std::vector<std::string> args(par.filenames);
+            args.push_back(readDb);
+            WorkflowRunner::runModule("createdb", args);
+        }
+        workflow.getProfile().setEntries(0, ResourceProfile::countEntries(readDb));
+    }));
+
+    // digital normalization, reads of regions that already reached --diginorm-coverage are dropped
+    std::string readInput = readDb;
+    const std::string normalizedDb = tmpDir + "/nucl_reads_norm";
+    if (par.diginormCoverage > 0) {
+        readInput = normalizedDb;
+        WorkflowRunner::StepId normalizeStep = workflow.addStep("normalize reads", normalizedDb + ".dbtype", false, inputSteps, [&]() {
+            normalizeReads(par, readDb, normalizedDb);
+            workflow.getProfile().setEntries(ResourceProfile::countEntries(readDb), ResourceProfile::countEntries(normalizedDb));
+        });
+        inputSteps = std::vector<WorkflowRunner::StepId>(1, normalizeStep);
+    }
+
+    // identical reads are assembled once, their number breaks ties between extensions
+    const std::string uniqueDb = tmpDir + "/nucl_reads_unique";
+    std::string countDb;
+    if (par.collapseDuplicates) {
+        const std::string collapseInput = readInput;
+        readInput = uniqueDb;
+        countDb = uniqueDb + "_count";
+        WorkflowRunner::StepId collapseStep = workflow.addStep("collapse duplicates", uniqueDb + ".dbtype", false, inputSteps, [&, collapseInput]() {
+            collapseDuplicates(par, collapseInput, uniqueDb, countDb);
+            workflow.getProfile().setEntries(ResourceProfile::countEntries(collapseInput), ResourceProfile::countEntries(uniqueDb));
+        });
+        inputSteps = std::vector<WorkflowRunner::StepId>(1, collapseStep);
+    }
+
+    const std::string guidedTmpDir = tmpDir + "/guidedassembly_tmp";
+    if (FileUtil::directoryExists(guidedTmpDir.c_str()) == false) {
+        FileUtil::makeDir(guidedTmpDir.c_str());
+    }
+
+    // extractorfs and translatenucs change their parameters while parsing, they keep running in their own process
+    const std::string startOrfDb = guidedTmpDir + "/nucl_6f_start";
+    const std::string longOrfDb = guidedTmpDir + "/nucl_6f_long";
+    const std::string nuclOrfDb = guidedTmpDir + "/nucl_6f_start_long";
+    const std::string aaOrfDb = guidedTmpDir + "/aa_6f_start_long";
+    std::vector<WorkflowRunner::StepId> orfSteps;
+    orfSteps.push_back(workflow.addStep("extractorfs_start", startOrfDb, false, inputSteps, [&]() {
+        WorkflowRunner::runModule("extractorfs", {readInput, startOrfDb}, extractOrfsStartPar);
+        workflow.getProfile().setEntries(ResourceProfile::countEntries(readInput), ResourceProfile::countEntries(startOrfDb));
+    }));
+    orfSteps.push_back(workflow.addStep("extractorfs_long", longOrfDb, false, inputSteps, [&]() {
+        WorkflowRunner::runModule("extractorfs", {readInput, longOrfDb}, extractOrfsLongPar);
+        workflow.getProfile().setEntries(ResourceProfile::countEntries(readInput), ResourceProfile::countEntries(longOrfDb));
+    }));
+    orfSteps.push_back(workflow.addStep("concatdbs", nuclOrfDb, false, orfSteps, [&]() {
+        WorkflowRunner::runModule("concatdbs", {longOrfDb, startOrfDb, nuclOrfDb});
+    }));
+    orfSteps.push_back(workflow.addStep("concatdbs_h", nuclOrfDb + "_h", false, orfSteps, [&]() {
+        WorkflowRunner::runModule("concatdbs", {longOrfDb + "_h", startOrfDb + "_h", nuclOrfDb + "_h"}, par.createParameterString(par.onlyverbosity));
+    }));
+    WorkflowRunner::StepId translateStep = workflow.addStep("translatenucs", aaOrfDb, false, orfSteps, [&]() {
+        WorkflowRunner::runModule("translatenucs", {nuclOrfDb, aaOrfDb, "--add-orf-stop"});
+        workflow.getProfile().setEntries(ResourceProfile::countEntries(nuclOrfDb), ResourceProfile::countEntries(aaOrfDb));
+    });
+
+    // the iterations run on every start, their steps are skipped if they finished before
+    std::string resultNuclDb;
+    WorkflowRunner::StepId assemblyStep = workflow.addStep("assembly", "", false, std::vector<WorkflowRunner::StepId>(1, translateStep), [&]() {
+        resultNuclDb = guidedAssembly(par, workflow, guidedTmpDir, nuclOrfDb, aaOrfDb);
+    });
 
-    cmd.addVariable("THREADS_PAR", par.createParameterString(par.onlythreads).c_str());
-    cmd.addVariable("VERBOSITY_PAR", par.createParameterString(par.onlyverbosity).c_str());
+    // select only assembled orfs
+    std::string selectedDb;
+    WorkflowRunner::StepId selectStep = workflow.addStep("select assembled", "", false, std::vector<WorkflowRunner::StepId>(1, assemblyStep), [&]() {
+        selectedDb = resultNuclDb + "_only_assembled";
+        workflow.runStep("selectassembled", selectedDb + ".dbtype", false, [&]() {
+            par.subDbMode = Parameters::SUBDB_MODE_SOFT;
+            size_t selected = selectAssembled(par, resultNuclDb, nuclOrfDb, selectedDb);
+            workflow.getProfile().setEntries(ResourceProfile::countEntries(resultNuclDb), selected);
+        });
+        if (FileUtil::fileExists((selectedDb + "_h.dbtype").c_str()) == false) {
+            DBReader<unsigned int>::softlinkDb(nuclOrfDb + "_h", selectedDb + "_h");
+        }
+    });
+
+    const std::string mergedDb = tmpDir + "/guided_assembly.merged";
+    WorkflowRunner::StepId mergeStep = workflow.addStep("merge", mergedDb + ".dbtype", false, std::vector<WorkflowRunner::StepId>(1, selectStep), [&]() {
+        if (countDb.empty() == false) {
+            // the reads come first and keep their keys, so their counts apply to the merged database.
+            // nuclassemble collapses it again and adds them up.
+            WorkflowRunner::runModule("concatdbs", {readInput, selectedDb, mergedDb});
+            DBReader<unsigned int>::softlinkDb(countDb, mergedDb + "_count");
+        } else {
+            WorkflowRunner::runModule("concatdbs", {selectedDb, readInput, mergedDb});
+        }
+    });
+
+    const std::string nuclAssemblyDb = tmpDir + "/nuclassembly";
+    WorkflowRunner::StepId nuclAssembleStep = workflow.addStep("nuclassemble", nuclAssemblyDb + ".dbtype", false, std::vector<WorkflowRunner::StepId>(1, mergeStep), [&]() {
+        WorkflowRunner::runModule("nuclassemble", {mergedDb, nuclAssemblyDb, tmpDir + "/nuclassembly_tmp"}, nuclAssemblePar);
+        workflow.getProfile().setEntries(ResourceProfile::countEntries(mergedDb), ResourceProfile::countEntries(nuclAssemblyDb));
+    });
 
-    FileUtil::writeFile(tmpDir + "/guidedNuclAssemble.sh", guidedNuclAssemble_sh, guidedNuclAssemble_sh_len);
-    std::string program(tmpDir + "/guidedNuclAssemble.sh");
-    cmd.execProgram(program.c_str(), par.filenames);
+    // redundancy reduction using linclust
+    const std::string clusterDb = tmpDir + "/clu";
+    const std::string repDb = nuclAssemblyDb + "_rep";
+    WorkflowRunner::StepId clusterStep = workflow.addStep("redundancy reduction", repDb + ".dbtype", false, std::vector<WorkflowRunner::StepId>(1, nuclAssembleStep), [&]() {
+        workflow.runStep("linclust", clusterDb + ".dbtype", false, [&]() {
+            WorkflowRunner::runModule("linclust", {nuclAssemblyDb, clusterDb, tmpDir + "/clu_tmp"}, clusterPar);
+            workflow.getProfile().setEntries(ResourceProfile::countEntries(nuclAssemblyDb), ResourceProfile::countEntries(clusterDb));
+        });
+        workflow.runStep("result2repseq", "", false, [&]() {
+            WorkflowRunner::runModule("result2repseq", {nuclAssemblyDb, clusterDb, repDb}, threadsPar);
+            workflow.getProfile().setEntries(ResourceProfile::countEntries(clusterDb), ResourceProfile::countEntries(repDb));
+        });
+    });
+
+    workflow.addStep("contig output", "", false, std::vector<WorkflowRunner::StepId>(1, clusterStep), [&]() {
+        DBReader<unsigned int> repDbr(repDb.c_str(), (repDb + ".index").c_str(), 1, DBReader<unsigned int>::USE_DATA|DBReader<unsigned int>::USE_INDEX);
+        repDbr.open(DBReader<unsigned int>::NOSORT);
+        // contigs that nuclassemble found to be cyclic
+        const std::string cycleIndex = nuclAssemblyDb + "_cycle.index";
+        DBReader<unsigned int> *cycleDbr = NULL;
+        if (FileUtil::fileExists(cycleIndex.c_str())) {
+            cycleDbr = new DBReader<unsigned int>(cycleIndex.c_str(), cycleIndex.c_str(), 1, DBReader<unsigned int>::USE_INDEX);
+            cycleDbr->open(DBReader<unsigned int>::NOSORT);
+        }
+        const std::string fastaFile = tmpDir + "/nuclassembly_rep.fasta";
+        writeContigFasta(&repDbr, cycleDbr, fastaFile);
+        workflow.getProfile().setEntries(repDbr.getSize(), repDbr.getSize());
+        if (cycleDbr != NULL) {
+            cycleDbr->close();
+            delete cycleDbr;
+        }
+        repDbr.close();
+        FileUtil::move(fastaFile.c_str(), outFile.c_str());
+    });
+
+    workflow.run();
+
+    if (par.removeTmpFiles) {
+        Debug(Debug::INFO) << "Removing temporary files\n";
+        const std::string dbs[] = {readDb, normalizedDb, uniqueDb, startOrfDb, longOrfDb, nuclOrfDb, aaOrfDb};
+        for (size_t i = 0; i < 7; i++) {
+            WorkflowRunner::removeStepDb(dbs[i]);
+            DBReader<unsigned int>::removeDb(dbs[i] + "_h");
+        }
+        for (int step = 0; step < par.numIterations; step++) {
+            WorkflowRunner::removeStepDb(guidedTmpDir + "/pref_" + SSTR(step));
+            WorkflowRunner::removeStepDb(guidedTmpDir + "/aln_" + SSTR(step));
+            WorkflowRunner::removeStepDb(guidedTmpDir + "/aln_nucl_" + SSTR(step));
+            WorkflowRunner::removeStepDb(guidedTmpDir + "/assembly_aa_" + SSTR(step));
+            WorkflowRunner::removeStepDb(guidedTmpDir + "/assembly_nucl_" + SSTR(step));
+            WorkflowRunner::removeStepDb(guidedTmpDir + "/assembly_nucl_" + SSTR(step) + "_only_assembled");
+            DBReader<unsigned int>::removeDb(guidedTmpDir + "/assembly_nucl_" + SSTR(step) + "_only_assembled_h");
+            WorkflowRunner::removeStepDb(guidedTmpDir + "/assembly_aa_nucl_" + SSTR(step));
+        }
+        WorkflowRunner::removeStepDb(mergedDb);
+        WorkflowRunner::removeStepDb(nuclAssemblyDb);
+        WorkflowRunner::removeStepDb(repDb);
+        WorkflowRunner::removeStepDb(clusterDb);
+        const std::string cycleIndex = nuclAssemblyDb + "_cycle.index";
+        if (FileUtil::fileExists(cycleIndex.c_str())) {
+            FileUtil::remove(cycleIndex.c_str());
+        }
+    }
 
     return EXIT_SUCCESS;
 }
@@ -1,11 +1,18 @@
+#include "AssemblySteps.h"
 #include "DBReader.h"
+#include "DBWriter.h"
 #include "Util.h"
-#include "CommandCaller.h"
 #include "Debug.h"
 #include "FileUtil.h"
+#include "InMemoryDB.h"
 #include "LocalParameters.h"
+#include "WorkflowRunner.h"
 
-#include "nuclassemble.sh.h"
+#include <algorithm>
+#include <climits>
+#include <cstdio>
+#include <string>
+#include <vector>
 
 void setNuclAssemblerWorkflowDefaults(LocalParameters *p) {
 
@@ -31,6 +38,112 @@ void setNuclAssemblerWorkflowDefaults(LocalParameters *p) {
 
 }
 
+// Selects the contigs to report and writes them sorted by key, as FASTA with
+// 'ID len:<len> cycle:<0|1>' headers or, in db mode, as sequence database.
+// sourceDbr is only needed if only extended contigs are reported. Returns the number
+// of reported contigs.
+static size_t writeNuclContigs(LocalParameters &par, DBReader<unsigned int> *contigDbr,
+                             DBReader<unsigned int> *cycleDbr, DBReader<unsigned int> *sourceDbr,
+                             const std::string &cycleIndex, const std::string &outFile, const std::string &tmpDir) {
+    struct Contig {
+        unsigned int key;
+        DBReader<unsigned int> *dbr;
+        size_t id;
+
+        static bool compareByKey(const Contig &first, const Contig &second) {
+            return first.key < second.key;
+        }
+    };
+
+    const bool onlyExtended = par.contigOutputMode == LocalParameters::OUTPUT_ONLY_EXTENDED_CONTIGS;
+    Debug(Debug::INFO) << (onlyExtended ? "Output only extended contigs\n" : "Output all contigs\n");
+    std::vector<Contig> contigs;
+    DBReader<unsigned int> *dbrs[] = {contigDbr, cycleDbr};
+    for (size_t i = 0; i < 2; i++) {
+        for (size_t id = 0; id < dbrs[i]->getSize(); id++) {
+            unsigned int key = dbrs[i]->getDbKey(id);
+            size_t entryLen = dbrs[i]->getEntryLen(id);
+            if (onlyExtended) {
+                size_t sourceId = sourceDbr->getId(key);
+                if (sourceId == UINT_MAX || entryLen <= sourceDbr->getEntryLen(sourceId)) {
+                    continue;
+                }
+            }
+            // the entry length includes the new line and the null byte
+            if (entryLen <= static_cast<size_t>(par.minContigLen) + 1) {
+                continue;
+            }
+            Contig contig = {key, dbrs[i], id};
+            contigs.push_back(contig);
+        }
+    }
+    std::stable_sort(contigs.begin(), contigs.end(), Contig::compareByKey);
+    const bool hasCycles = cycleDbr->getSize() > 0;
+
+    if (par.dbMode) {
+        std::string assemblyDb = tmpDir + "/assembly";
+        DBWriter writer(assemblyDb.c_str(), (assemblyDb + ".index").c_str(), 1, 0, Parameters::DBTYPE_NUCLEOTIDES);
+        writer.open();
+        for (size_t i = 0; i < contigs.size(); i++) {
+            const Contig &contig = contigs[i];
+            writer.writeData(contig.dbr->getData(contig.id, 0), contig.dbr->getEntryLen(contig.id) - 1, contig.key, 0);
+        }
+        writer.close(true);
+        DBReader<unsigned int>::moveDb(assemblyDb, outFile);
+
+        if (hasCycles) {
+            // lines of the cycle index that belong to reported contigs
+            DBReader<unsigned int> cycleIndexDbr(cycleIndex.c_str(), cycleIndex.c_str(), 1, DBReader<unsigned int>::USE_INDEX);
+            cycleIndexDbr.open(DBReader<unsigned int>::NOSORT);
+            std::string outIndex = outFile + "_cycle.index";
+            FILE *indexFile = FileUtil::openFileOrDie(outIndex.c_str(), "w", false);
+            char buffer[1024];
+            for (size_t id = 0; id < cycleIndexDbr.getSize(); id++) {
+                unsigned int key = cycleIndexDbr.getDbKey(id);
+                Contig search = {key, NULL, 0};
+                if (std::binary_search(contigs.begin(), contigs.end(), search, Contig::compareByKey) == false) {
+                    continue;
+                }
+                size_t len = DBWriter::indexToBuffer(buffer, key, cycleIndexDbr.getOffset(id), cycleIndexDbr.getEntryLen(id));
+                fwrite(buffer, sizeof(char), len, indexFile);
+            }
+            if (fclose(indexFile) != 0) {
+                Debug(Debug::ERROR) << "Cannot close file " << outIndex << "\n";
+                EXIT(EXIT_FAILURE);
+            }
+            cycleIndexDbr.close();
+        }
+        return contigs.size();
+    }
+
+    std::string fastaFile = tmpDir + "/assembly.fasta";
+    FILE *fasta = FileUtil::openFileOrDie(fastaFile.c_str(), "w", false);
+    std::string header;
+    for (size_t i = 0; i < contigs.size(); i++) {
+        const Contig &contig = contigs[i];
+        size_t seqLen = contig.dbr->getEntryLen(contig.id) - 2;
+        header.clear();
+        header.append(">");
+        header.append(SSTR(i));
+        header.append(" len:");
+        header.append(SSTR(seqLen));
+        if (hasCycles) {
+            header.append(" cycle:");
+            header.append(SSTR(cycleDbr->getId(contig.key) != UINT_MAX));
+        }
+        header.append("\n");
+        fwrite(header.c_str(), sizeof(char), header.size(), fasta);
+        fwrite(contig.dbr->getData(contig.id, 0), sizeof(char), seqLen, fasta);
+        fwrite("\n", sizeof(char), 1, fasta);
+    }
+    if (fclose(fasta) != 0) {
+        Debug(Debug::ERROR) << "Cannot close file " << fastaFile << "\n";
+        EXIT(EXIT_FAILURE);
+    }
+    FileUtil::move(fastaFile.c_str(), outFile.c_str());
+    return contigs.size();
+}
+
 int nuclassemble(int argc, const char **argv, const Command &command) {
     LocalParameters &par = LocalParameters::getLocalInstance();
     setNuclAssemblerWorkflowDefaults(&par);
@@ -53,21 +166,16 @@ int nuclassemble(int argc, const char **argv, const Command &command) {
 
     par.parseParameters(argc, argv, command, true, Parameters::PARSE_VARIADIC, 0);
 
-    CommandCaller cmd;
     if(par.filenames.size() < 3) {
         Debug(Debug::ERROR) << "Too few input files provided.\n";
         return EXIT_FAILURE;
     }
-    else if ((par.filenames.size() - 2) % 2 == 0) {
-        cmd.addVariable("PAIRED_END", "1"); // paired end reads
-    } else {
-        if (par.filenames.size() != 3) {
-            Debug(Debug::ERROR) << "Too many input files provided.\n";
-            Debug(Debug::ERROR) << "For paired-end input provide READSETA_1.fastq READSETA_2.fastq ... OUTPUT.fasta tmpDir\n";
-            Debug(Debug::ERROR) << "For single input use READSET.fast(q|a) OUTPUT.fasta tmpDir\n";
-            return EXIT_FAILURE;
-        }
-        cmd.addVariable("PAIRED_END", NULL); // single end reads
+    const bool pairedEnd = (par.filenames.size() - 2) % 2 == 0;
+    if (pairedEnd == false && par.filenames.size() != 3) {
+        Debug(Debug::ERROR) << "Too many input files provided.\n";
+        Debug(Debug::ERROR) << "For paired-end input provide READSETA_1.fastq READSETA_2.fastq ... OUTPUT.fasta tmpDir\n";
+        Debug(Debug::ERROR) << "For single input use READSET.fast(q|a) OUTPUT.fasta tmpDir\n";
+        return EXIT_FAILURE;
     }
 
     std::string tmpDir = par.filenames.back();
@@ -82,44 +190,149 @@ int nuclassemble(int argc, const char **argv, const Command &command) {
         Debug(Debug::ERROR) << "Could not get real path of " << tmpDir << "!\n";
         EXIT(EXIT_FAILURE);
     }
-    cmd.addVariable("TMP_PATH", p);
+    tmpDir = p;
     par.filenames.pop_back();
     free(p);
 
-    cmd.addVariable("OUT_FILE", par.filenames.back().c_str());
+    const std::string outFile = par.filenames.back();
     par.filenames.pop_back();
+    if (FileUtil::fileExists(outFile.c_str())) {
+        Debug(Debug::ERROR) << outFile << " exists already!\n";
+        return EXIT_FAILURE;
+    }
 
-    cmd.addVariable("REMOVE_TMP", par.removeTmpFiles ? "TRUE" : NULL);
-    cmd.addVariable("REMOVE_INCREMENTAL_TMP", par.deleteFilesInc ? "TRUE" : NULL);
+    ResourceProfile::clear(tmpDir);
+    WorkflowRunner workflow(par.resourceProfile ? tmpDir : std::string());
+    std::vector<WorkflowRunner::StepId> inputSteps;
+    std::string input;
+    if (par.dbMode) {
+        input = par.filenames[0];
+        if (FileUtil::fileExists((input + ".dbtype").c_str()) == false) {
+            Debug(Debug::ERROR) << input << ".dbtype not found!\n";
+            return EXIT_FAILURE;
+        }
+    } else {
+        input = tmpDir + "/nucl_reads";
+        inputSteps.push_back(workflow.addStep("read import", input, false, std::vector<WorkflowRunner::StepId>(), [&]() {
+            if (pairedEnd) {
+                Debug(Debug::INFO) << "PAIRED END MODE\n";
+                mergeReads(par, par.filenames, input);
+            } else {
+                // createdb changes its parameters while parsing, it keeps running in its own process
+                std::vector<std::string> args(par.filenames);
+                args.push_back(input);
+                WorkflowRunner::runModule("createdb", args);
+            }
+            workflow.getProfile().setEntries(0, ResourceProfile::countEntries(input));
+        }));
+    }
 
-    cmd.addVariable("RUNNER", par.runner.c_str());
-    cmd.addVariable("NUM_IT", SSTR(par.numIterations).c_str());
-    // # 1. Finding exact $k$-mer matches.
-    cmd.addVariable("KMERMATCHER_PAR", par.createParameterString(par.kmermatcher).c_str());
+    // digital normalization, reads of regions that already reached --diginorm-coverage are dropped
+    std::string assemblyInput = input;
+    const std::string normalizedDb = tmpDir + "/nucl_reads_norm";
+    if (par.diginormCoverage > 0) {
+        const std::string readDb = assemblyInput;
+        assemblyInput = normalizedDb;
+        WorkflowRunner::StepId normalizeStep = workflow.addStep("normalize reads", normalizedDb + ".dbtype", false, inputSteps, [&, readDb]() {
+            normalizeReads(par, readDb, normalizedDb);
+            workflow.getProfile().setEntries(ResourceProfile::countEntries(readDb), ResourceProfile::countEntries(normalizedDb));
+        });
+        inputSteps = std::vector<WorkflowRunner::StepId>(1, normalizeStep);
+    }
 
-    // # 2. Hamming distance pre-clustering
-    par.filterHits = false;
-    cmd.addVariable("UNGAPPED_ALN_PAR", par.createParameterString(par.rescorediagonal).c_str());
-    cmd.addVariable("ASSEMBLE_RESULT_PAR", par.createParameterString(par.assembleresults).c_str());
+    // identical reads are assembled once, their number breaks ties between extensions
+    const std::string uniqueDb = tmpDir + "/nucl_reads_unique";
+    if (par.collapseDuplicates) {
+        const std::string readDb = assemblyInput;
+        assemblyInput = uniqueDb;
+        WorkflowRunner::StepId collapseStep = workflow.addStep("collapse duplicates", uniqueDb + ".dbtype", false, inputSteps, [&, readDb]() {
+            collapseDuplicates(par, readDb, uniqueDb, uniqueDb + "_count");
+            workflow.getProfile().setEntries(ResourceProfile::countEntries(readDb), ResourceProfile::countEntries(uniqueDb));
+        });
+        inputSteps = std::vector<WorkflowRunner::StepId>(1, collapseStep);
+    }
 
-    cmd.addVariable("CALL_CYCLE_CHECK", par.cycleCheck ? "TRUE" : NULL);
-    cmd.addVariable("CYCLE_CHECK_PAR", par.createParameterString(par.cyclecheck).c_str());
+    // k-mer matching, ungapped alignment, assembly and cycle check of all iterations,
+    // the results stay in memory for the output step. With --checkpoint-interval every N-th
+    // iteration leaves a checkpoint, a restarted run continues after the last one.
+    const std::string contigDb = tmpDir + "/assembly_contigs";
+    const std::string iterationCheckpoint = contigDb + "_iteration";
+    const std::string cycleDb = tmpDir + "/assembly_contigs_cycle_all";
+    const std::string containedDb = contigDb + "_contained";
+    InMemoryDB *contigs = NULL;
+    InMemoryDB cycles(par.threads, Parameters::DBTYPE_NUCLEOTIDES);
+    InMemoryDB contained(par.threads, Parameters::DBTYPE_GENERIC_DB);
+    WorkflowRunner::StepId assemblyStep = workflow.addStep("assembly", contigDb + ".done", true, inputSteps, [&]() {
+        DBReader<unsigned int> inputDbr(assemblyInput.c_str(), (assemblyInput + ".index").c_str(), par.threads, DBReader<unsigned int>::USE_DATA|DBReader<unsigned int>::USE_INDEX);
+        inputDbr.open(DBReader<unsigned int>::NOSORT);
+        // counts of an input database that was collapsed before are used as well
+        SequenceCounts *counts = SequenceCounts::openIfExists(assemblyInput);
+        contigs = assembleIterations(par, &inputDbr, counts, contigDb + "_pref", iterationCheckpoint,
+                                     cycles, contained, workflow.getProfile());
+        delete counts;
+        workflow.getProfile().setEntries(inputDbr.getSize(), contigs->getReader()->getSize());
+        inputDbr.close();
+        contigs->writeToDisk(contigDb, contigDb + ".index", par.compressed);
+        cycles.writeToDisk(cycleDb, cycleDb + ".index", par.compressed);
+        if (par.dropContained) {
+            contained.writeToDisk(containedDb, containedDb + ".index", par.compressed);
+        }
+    });
 
-    cmd.addVariable("MIN_CONTIG_LEN", SSTR(par.minContigLen).c_str());
+    workflow.addStep("contig output", "", false, std::vector<WorkflowRunner::StepId>(1, assemblyStep), [&]() {
+        DBReader<unsigned int> *contigDbr;
+        DBReader<unsigned int> *cycleDbr;
+        if (contigs != NULL) {
+            contigDbr = contigs->getReader();
+            cycleDbr = cycles.getReader();
+        } else {
+            // the assembly was done by an earlier run
+            contigDbr = new DBReader<unsigned int>(contigDb.c_str(), (contigDb + ".index").c_str(), 1, DBReader<unsigned int>::USE_DATA|DBReader<unsigned int>::USE_INDEX);
+            contigDbr->open(DBReader<unsigned int>::NOSORT);
+            cycleDbr = new DBReader<unsigned int>(cycleDb.c_str(), (cycleDb + ".index").c_str(), 1, DBReader<unsigned int>::USE_DATA|DBReader<unsigned int>::USE_INDEX);
+            cycleDbr->open(DBReader<unsigned int>::NOSORT);
+        }
+        DBReader<unsigned int> *sourceDbr = NULL;
+        if (par.contigOutputMode == LocalParameters::OUTPUT_ONLY_EXTENDED_CONTIGS) {
+            sourceDbr = new DBReader<unsigned int>(assemblyInput.c_str(), (assemblyInput + ".index").c_str(), 1, DBReader<unsigned int>::USE_INDEX);
+            sourceDbr->open(DBReader<unsigned int>::NOSORT);
+        }
 
-    if (par.contigOutputMode == LocalParameters::OUTPUT_ONLY_EXTENDED_CONTIGS)
-        cmd.addVariable("OUTPUT_ONLY_EXTENDED_CONTIGS", "1");
-    else
-        cmd.addVariable("OUTPUT_ONLY_EXTENDED_CONTIGS", NULL);
+        size_t reported = writeNuclContigs(par, contigDbr, cycleDbr, sourceDbr, cycleDb + ".index", outFile, tmpDir);
+        workflow.getProfile().setEntries(contigDbr->getSize() + cycleDbr->getSize(), reported);
 
-    cmd.addVariable("THREADS_PAR", par.createParameterString(par.onlythreads).c_str());
-    cmd.addVariable("VERBOSITY_PAR", par.createParameterString(par.onlyverbosity).c_str());
+        if (sourceDbr != NULL) {
+            sourceDbr->close();
+            delete sourceDbr;
+        }
+        if (contigs == NULL) {
+            contigDbr->close();
+            delete contigDbr;
+            cycleDbr->close();
+            delete cycleDbr;
+        }
+    });
 
-    cmd.addVariable("DB_MODE", par.dbMode ? "TRUE" : NULL);
+    workflow.run();
+    delete contigs;
 
-    FileUtil::writeFile(tmpDir + "/nuclassemble.sh", nuclassemble_sh, nuclassemble_sh_len);
-    std::string program(tmpDir + "/nuclassemble.sh");
-    cmd.execProgram(program.c_str(), par.filenames);
+    if (par.removeTmpFiles) {
+        Debug(Debug::INFO) << "Removing temporary files\n";
+        DBReader<unsigned int>::removeDb(contigDb);
+        DBReader<unsigned int>::removeDb(cycleDb);
+        if (par.diginormCoverage > 0) {
+            DBReader<unsigned int>::removeDb(normalizedDb);
+        }
+        if (par.collapseDuplicates) {
+            DBReader<unsigned int>::removeDb(uniqueDb);
+            DBReader<unsigned int>::removeDb(uniqueDb + "_count");
+        }
+        if (par.dropContained) {
+            DBReader<unsigned int>::removeDb(containedDb);
+        }
+        removeAssemblyCheckpoints(iterationCheckpoint, par.numIterations);
+        FileUtil::remove((contigDb + ".done").c_str());
+    }
 
     return EXIT_SUCCESS;
 }
@@ -0,0 +1,133 @@
+#include "WorkflowRunner.h"
+#include "DBReader.h"
+#include "Debug.h"
+#include "FileUtil.h"
+#include "Timer.h"
+#include "Util.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <sys/wait.h>
+#include <unistd.h>
+
+WorkflowRunner::StepId WorkflowRunner::addStep(const std::string &name, const std::string &checkpoint,
+                                               bool touchCheckpoint, const std::vector<StepId> &dependencies,
+                                               const std::function<void()> &run) {
+    for (size_t i = 0; i < dependencies.size(); i++) {
+        if (dependencies[i] >= steps.size()) {
+            Debug(Debug::ERROR) << "Step " << name << " depends on a step that was not added before\n";
+            EXIT(EXIT_FAILURE);
+        }
+    }
+    Step step;
+    step.name = name;
+    step.checkpoint = checkpoint;
+    step.touchCheckpoint = touchCheckpoint;
+    step.dependencies = dependencies;
+    step.run = run;
+    steps.push_back(step);
+    return steps.size() - 1;
+}
+
+void WorkflowRunner::run() {
+    std::vector<bool> finished(steps.size(), false);
+    size_t finishedCount = 0;
+    while (finishedCount < steps.size()) {
+        // dependencies always refer to earlier steps, so there is always a runnable step
+        size_t next = 0;
+        for (; next < steps.size(); next++) {
+            if (finished[next]) {
+                continue;
+            }
+            bool ready = true;
+            for (size_t i = 0; i < steps[next].dependencies.size(); i++) {
+                ready &= finished[steps[next].dependencies[i]];
+            }
+            if (ready) {
+                break;
+            }
+        }
+
+        const Step &step = steps[next];
+        runStep(step.name, step.checkpoint, step.touchCheckpoint, step.run);
+        finished[next] = true;
+        finishedCount++;
+    }
+    profile.finish();
+}
+
+bool WorkflowRunner::runStep(const std::string &name, const std::string &checkpoint, bool touchCheckpoint,
+                             const std::function<void()> &run) {
+    if (checkpoint.empty() == false && FileUtil::fileExists(checkpoint.c_str())) {
+        Debug(Debug::INFO) << "Skip " << name << ", " << checkpoint << " exists\n";
+        return false;
+    }
+    Timer timer;
+    profile.startStep(name);
+    run();
+    if (touchCheckpoint) {
+        FILE *file = FileUtil::openFileOrDie(checkpoint.c_str(), "w", false);
+        if (fclose(file) != 0) {
+            Debug(Debug::ERROR) << "Cannot close file " << checkpoint << "\n";
+            EXIT(EXIT_FAILURE);
+        }
+    }
+    profile.endStep();
+    Debug(Debug::INFO) << "Time for " << name << ": " << timer.lap() << "\n";
+    return true;
+}
+
+void WorkflowRunner::runModule(const std::string &module, const std::vector<std::string> &moduleArgs,
+                               const std::string &parameters) {
+    const char *program = getenv("MMSEQS");
+    if (program == NULL) {
+        Debug(Debug::ERROR) << "MMSEQS is not set, cannot run module " << module << "\n";
+        EXIT(EXIT_FAILURE);
+    }
+
+    // the parameter string has no spaces inside of values, see Parameters::createParameterString
+    std::vector<std::string> args(moduleArgs);
+    std::vector<std::string> parameterArgs = Util::split(parameters, " ");
+    args.insert(args.end(), parameterArgs.begin(), parameterArgs.end());
+
+    const char **argv = new const char *[args.size() + 3];
+    argv[0] = program;
+    argv[1] = module.c_str();
+    for (size_t i = 0; i < args.size(); i++) {
+        argv[i + 2] = args[i].c_str();
+    }
+    argv[args.size() + 2] = NULL;
+
+    std::cout.flush();
+    std::cerr.flush();
+    pid_t pid = fork();
+    if (pid == -1) {
+        Debug(Debug::ERROR) << "Could not start module " << module << "\n";
+        EXIT(EXIT_FAILURE);
+    }
+    if (pid == 0) {
+        execvp(program, (char *const *) argv);
+        // only reached if execvp failed
+        _exit(EXIT_FAILURE);
+    }
+    delete[] argv;
+
+    int status;
+    if (waitpid(pid, &status, 0) == -1 || WIFEXITED(status) == false || WEXITSTATUS(status) != EXIT_SUCCESS) {
+        Debug(Debug::ERROR) << module << " died\n";
+        EXIT(EXIT_FAILURE);
+    }
+}
+
+void WorkflowRunner::removeStepDb(const std::string &db) {
+    DBReader<unsigned int>::removeDb(db);
+    DBReader<unsigned int>::removeDb(db + "_count");
+    const char *suffixes[] = {".done", ".yield"};
+    for (size_t i = 0; i < 2; i++) {
+        std::string file = db + suffixes[i];
+        if (FileUtil::fileExists(file.c_str())) {
+            FileUtil::remove(file.c_str());
+        }
+    }
+}
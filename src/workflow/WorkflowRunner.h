@@ -0,0 +1,62 @@
+#ifndef WORKFLOWRUNNER_H
+#define WORKFLOWRUNNER_H
+
+#include "ResourceProfile.h"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+// Runs the steps of a workflow inside the workflow process, so databases opened
+// or built by one step can be handed to the next one without writing and
+// re-reading them. Like the notExists checks of the workflow scripts, a step is
+// skipped if its checkpoint file exists. Steps run once all their dependencies
+// were run or skipped, in the order they were added. If a tmp dir is given, the
+// resource usage of every step that was run is recorded in a profile there.
+class WorkflowRunner {
+public:
+    typedef size_t StepId;
+
+    explicit WorkflowRunner(const std::string &tmpDir) : profile(tmpDir) {}
+
+    // checkpoint: skip the step if this file exists, always run it if empty
+    // touchCheckpoint: create the checkpoint file after the step succeeded (.done files)
+    StepId addStep(const std::string &name, const std::string &checkpoint, bool touchCheckpoint,
+                   const std::vector<StepId> &dependencies, const std::function<void()> &run);
+
+    void run();
+
+    // runs a step right away, for the steps of iterations that are only known while the
+    // workflow step running them is in progress. Returns false if it was skipped.
+    bool runStep(const std::string &name, const std::string &checkpoint, bool touchCheckpoint,
+                 const std::function<void()> &run);
+
+    // for steps that report their entries or record nested steps
+    ResourceProfile &getProfile() {
+        return profile;
+    }
+
+    // runs a module of this binary as a separate process, for modules that parse
+    // their own parameters, fails the workflow if the module fails. parameters are
+    // appended to args, as created by Parameters::createParameterString.
+    static void runModule(const std::string &module, const std::vector<std::string> &args,
+                          const std::string &parameters = "");
+
+    // removes the database of a step with the files kept next to it: its .done checkpoint,
+    // the .yield of assembly steps and the linked _count database
+    static void removeStepDb(const std::string &db);
+
+private:
+    struct Step {
+        std::string name;
+        std::string checkpoint;
+        bool touchCheckpoint;
+        std::vector<StepId> dependencies;
+        std::function<void()> run;
+    };
+
+    std::vector<Step> steps;
+    ResourceProfile profile;
+};
+
+#endif
@@ -0,0 +1,86 @@
+#!/bin/sh -e
+# Checks the output format of nuclassemble: the contigs it writes have to be the same as
+# those the former script steps (concatdbs, index selection, createsubdb, createhdb and
+# convert2fasta) write for the contig databases of the same run. The assembly itself is
+# only compared if a baseline penguin binary is given as fifth argument, then its FASTA
+# output has to be the same as that of PENGUIN.
+
+PENGUIN="$1"
+READS_1="$2"
+READS_2="$3"
+BASEDIR="$4"
+BASELINE="$5"
+
+fail() {
+    >&2 echo "Failed check: $1"
+    exit 1
+}
+
+# former nuclassemble.sh output of the contigs in tmp dir $1 for reads database $2
+# $3: output, $4: minimum contig length, $5: only extended contigs if set, $6: db mode if set
+former_output() {
+    TMP_PATH="$1"
+    SOURCE="$2"
+    OUT="$3"
+    MIN_CONTIG_LEN="$4"
+    rm -rf "${TMP_PATH}/former"
+    mkdir -p "${TMP_PATH}/former"
+    RESULT="${TMP_PATH}/assembly_contigs"
+    if [ -s "${TMP_PATH}/assembly_contigs_cycle_all" ]; then
+        CYCLE_ALL="${TMP_PATH}/assembly_contigs_cycle_all"
+        RESULT="${TMP_PATH}/former/assembly_merged"
+        "${PENGUIN}" concatdbs "${TMP_PATH}/assembly_contigs" "${CYCLE_ALL}" "${RESULT}" --preserve-keys -v 1
+    fi
+    if [ -n "$5" ]; then
+        awk 'NR == FNR { f[$1] = $0; next } $1 in f { print f[$1], $0 }' "${RESULT}.index" "${SOURCE}.index" > "${TMP_PATH}/former/tmp.index"
+        awk '$3 > $6 { print }' "${TMP_PATH}/former/tmp.index" > "${TMP_PATH}/former/only_assembled.index"
+    else
+        cat "${RESULT}.index" > "${TMP_PATH}/former/only_assembled.index"
+    fi
+    awk -v thr="${MIN_CONTIG_LEN}" '$3 > (thr+1) { print }' "${TMP_PATH}/former/only_assembled.index" > "${TMP_PATH}/former/filtered.index"
+    "${PENGUIN}" createsubdb "${TMP_PATH}/former/filtered.index" "${RESULT}" "${TMP_PATH}/former/assembly" --subdb-mode 0 -v 1
+    if [ -n "${CYCLE_ALL}" ]; then
+        awk 'NR == FNR { f[$1] = $0; next } $1 in f { print $0 }' "${CYCLE_ALL}.index" "${TMP_PATH}/former/assembly.index" > "${TMP_PATH}/former/assembly_cycle.index"
+    fi
+    if [ -n "$6" ]; then
+        "${PENGUIN}" mvdb "${TMP_PATH}/former/assembly" "${OUT}" -v 1
+        if [ -f "${TMP_PATH}/former/assembly_cycle.index" ]; then
+            mv "${TMP_PATH}/former/assembly_cycle.index" "${OUT}_cycle.index"
+        fi
+        return
+    fi
+    if [ -f "${TMP_PATH}/former/assembly_cycle.index" ]; then
+        "${PENGUIN}" createhdb "${TMP_PATH}/former/assembly" "${TMP_PATH}/former/assembly_cycle" "${TMP_PATH}/former/assembly" -v 1
+    else
+        "${PENGUIN}" createhdb "${TMP_PATH}/former/assembly" "${TMP_PATH}/former/assembly" -v 1
+    fi
+    "${PENGUIN}" convert2fasta "${TMP_PATH}/former/assembly" "${OUT}" -v 1
+}
+
+rm -rf "${BASEDIR}"
+mkdir -p "${BASEDIR}"
+
+"${PENGUIN}" nuclassemble "${READS_1}" "${READS_2}" "${BASEDIR}/all.fasta" "${BASEDIR}/tmp_all" --min-contig-len 200 --contig-output-mode 0 -v 1
+former_output "${BASEDIR}/tmp_all/latest" "${BASEDIR}/tmp_all/latest/nucl_reads" "${BASEDIR}/all_former.fasta" 200 "" ""
+cmp "${BASEDIR}/all.fasta" "${BASEDIR}/all_former.fasta" || fail "FASTA output of all contigs differs"
+
+"${PENGUIN}" nuclassemble "${READS_1}" "${READS_2}" "${BASEDIR}/extended.fasta" "${BASEDIR}/tmp_extended" --min-contig-len 100 --contig-output-mode 1 -v 1
+former_output "${BASEDIR}/tmp_extended/latest" "${BASEDIR}/tmp_extended/latest/nucl_reads" "${BASEDIR}/extended_former.fasta" 100 "1" ""
+cmp "${BASEDIR}/extended.fasta" "${BASEDIR}/extended_former.fasta" || fail "FASTA output of extended contigs differs"
+
+READS="${BASEDIR}/tmp_all/latest/nucl_reads"
+"${PENGUIN}" nuclassemble "${READS}" "${BASEDIR}/contigs" "${BASEDIR}/tmp_db" --db-mode 1 --min-contig-len 200 --contig-output-mode 1 -v 1
+former_output "${BASEDIR}/tmp_db/latest" "${READS}" "${BASEDIR}/contigs_former" 200 "1" "1"
+for suffix in "" ".index" ".dbtype" "_cycle.index"; do
+    if [ -f "${BASEDIR}/contigs${suffix}" ] || [ -f "${BASEDIR}/contigs_former${suffix}" ]; then
+        cmp "${BASEDIR}/contigs${suffix}" "${BASEDIR}/contigs_former${suffix}" || fail "database output contigs${suffix} differs"
+    fi
+done
+
+if [ -n "${BASELINE}" ]; then
+    "${BASELINE}" nuclassemble "${READS_1}" "${READS_2}" "${BASEDIR}/baseline.fasta" "${BASEDIR}/tmp_baseline" --min-contig-len 200 --contig-output-mode 0 -v 1
+    cmp "${BASEDIR}/all.fasta" "${BASEDIR}/baseline.fasta" || fail "FASTA output differs from the baseline"
+    echo "Contig output is the same as the baseline output"
+fi
+
+echo "Contig output format is the same as the former script output"